@@ -0,0 +1,161 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+/*
+ * Compares the color engine against LibRaw's own camera to sRGB conversion
+ * on the same demosaiced image.
+ *
+ * LibRaw's `convert_to_rgb` is internal, so its cost is measured as the
+ * difference between `dcraw_process` with `output_color = 1` (sRGB) and
+ * `output_color = 0` (raw color), plus the separate gamma pass done by
+ * `dcraw_make_mem_image`. Its inner loop is also reproduced here so the
+ * matrix step can be timed in isolation. The engine then converts the raw
+ * color `image` buffer with every kernel set available on this CPU.
+ *
+ * Build and run with `make -C bench color`, which links LibRaw and libjpeg
+ * through pkg-config and measures a generated 24 MP DNG, or pass a file
+ * with `RAW=some.nef`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "color_engine.h"
+#include "libraw/libraw.h"
+
+namespace
+{
+  using Clock = std::chrono::steady_clock;
+
+  double Millis(Clock::time_point since)
+  {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+  }
+
+  int Clip(int v)
+  {
+    return v < 0 ? 0 : v > 65535 ? 65535 : v;
+  }
+
+  double Process(LibRaw &processor, const char *path, int outputColor)
+  {
+    processor.recycle();
+    if (processor.open_file(path) != LIBRAW_SUCCESS || processor.unpack() != LIBRAW_SUCCESS)
+    {
+      std::fprintf(stderr, "cannot open %s\n", path);
+      std::exit(1);
+    }
+    processor.imgdata.params.output_color = outputColor;
+    processor.imgdata.params.use_camera_wb = 1;
+    Clock::time_point start = Clock::now();
+    processor.dcraw_process();
+    return Millis(start);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    std::fprintf(stderr, "usage: %s <raw file>\n", argv[0]);
+    return 1;
+  }
+  const int runs = 5;
+
+  LibRaw processor;
+  double srgb = 0, raw = 0;
+  for (int i = 0; i < runs; i++)
+  {
+    srgb += Process(processor, argv[1], 1) / runs;
+    raw += Process(processor, argv[1], 0) / runs;
+  }
+
+  libraw_data_t &imgdata = processor.imgdata;
+  std::size_t pixels = static_cast<std::size_t>(imgdata.sizes.iwidth) * imgdata.sizes.iheight;
+  const uint16_t *image = &imgdata.image[0][0];
+  std::printf("%s: %zu pixels\n", argv[1], pixels);
+  std::printf("dcraw_process sRGB - raw color: %8.2f ms\n", srgb - raw);
+
+  std::vector<uint16_t> reference(pixels * 3);
+  const uint16_t *lut = Bt709Lut16();
+  Clock::time_point start = Clock::now();
+  for (int run = 0; run < runs; run++)
+  {
+    // the loop of LibRaw's convert_to_rgb followed by a gamma pass
+    for (std::size_t i = 0; i < pixels; i++)
+    {
+      const uint16_t *img = image + 4 * i;
+      float out[3] = {};
+      for (int c = 0; c < imgdata.idata.colors; c++)
+      {
+        out[0] += imgdata.color.rgb_cam[0][c] * img[c];
+        out[1] += imgdata.color.rgb_cam[1][c] * img[c];
+        out[2] += imgdata.color.rgb_cam[2][c] * img[c];
+      }
+      for (int c = 0; c < 3; c++)
+      {
+        reference[i * 3 + c] = static_cast<uint16_t>(Clip(static_cast<int>(out[c])));
+      }
+    }
+    for (uint16_t &v : reference)
+    {
+      v = lut[v];
+    }
+  }
+  std::printf("convert_to_rgb loop + gamma:    %8.2f ms\n", Millis(start) / runs);
+
+  ColorTransform transform = {};
+  for (int c = 0; c < 4; c++)
+  {
+    transform.mul[c] = 1.0f / 65535.0f;
+    for (int i = 0; i < 3; i++)
+    {
+      transform.matrix[i][c] = c < imgdata.idata.colors ? imgdata.color.rgb_cam[i][c] : 0.0f;
+    }
+  }
+
+  std::vector<uint16_t> fused(pixels * 3);
+  for (const char *isa : {"scalar", "sse4.1", "avx2"})
+  {
+    if (!ColorEngineSelect(isa))
+    {
+      continue;
+    }
+    start = Clock::now();
+    for (int run = 0; run < runs; run++)
+    {
+      ColorConvert(transform, image, pixels, fused.data(), lut);
+    }
+    double elapsed = Millis(start) / runs;
+
+    int worst = 0;
+    for (std::size_t i = 0; i < fused.size(); i++)
+    {
+      worst = std::max(worst, std::abs(fused[i] - reference[i]));
+    }
+    std::printf("color engine %-7s          %8.2f ms (max difference %d)\n", isa, elapsed, worst);
+  }
+  return 0;
+}
@@ -0,0 +1,1180 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+/*
+ * Writes synthetic DNG files for benchmarks and throughput tests, so they
+ * can run offline against a known corpus instead of camera samples.
+ *
+ * The files follow the layout Adobe's converter uses: IFD0 holds a small
+ * uncompressed RGB thumbnail and the camera tags, the first SubIFD the raw
+ * CFA image, further SubIFDs JPEG previews. The raw image is either
+ * uncompressed, bit packed to the sample size, or lossless JPEG in tiles.
+ * Content is a procedural scene (gradients, color patches, a zone plate)
+ * plus noise seeded from the pixel position, so the same options always
+ * give the same bytes. Dark and vignetted flat scenes and hot pixels make
+ * calibration frames and outliers for the stacking tests.
+ *
+ * Build with `make -C bench`, which links libjpeg through pkg-config, or
+ * write the corpus with `npm run corpus`:
+ *
+ *   bench/bin/make_dng --megapixels 24 --bits 14 --compression ljpeg out.dng
+ *   bench/bin/make_dng --corpus bench/corpus
+ *
+ * Run without arguments for the list of options.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <jpeglib.h>
+}
+
+namespace
+{
+  enum class SceneKind
+  {
+    Chart,
+    Dark,
+    Flat,
+  };
+
+  struct Options
+  {
+    unsigned width = 4240;
+    unsigned height = 2832;
+    unsigned bits = 14;
+    bool ljpeg = true;
+    unsigned tileSize = 256;
+    // CFA colors of the top left 2x2 block, 0 = R, 1 = G, 2 = B
+    unsigned char cfa[4] = {0, 1, 1, 2};
+    unsigned thumbnailSize = 256;
+    std::vector<unsigned> previewSizes = {1024};
+    std::size_t xmpBytes = 0;
+    uint64_t seed = 1;
+    SceneKind scene = SceneKind::Chart;
+    // raw samples set to the white level, as (x, y)
+    std::vector<std::pair<unsigned, unsigned>> hotPixels;
+  };
+
+  // camera white balance, applied to the scene so AsShotNeutral is not 1
+  const double NEUTRAL[3] = {0.47, 1.0, 0.68};
+  // XYZ (D65) to linear sRGB, the camera space before white balance
+  const double XYZ_TO_RGB[3][3] = {
+      {3.2406, -1.5372, -0.4986},
+      {-0.9689, 1.8758, 0.0415},
+      {0.0557, -0.2040, 1.0570},
+  };
+
+  uint64_t Mix(uint64_t x)
+  {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+  }
+
+  /*
+   * Linear scene radiance in [0, 1] at normalized coordinates, per sRGB
+   * channel.
+   */
+  double Scene(SceneKind scene, int c, double u, double v)
+  {
+    if (scene == SceneKind::Dark)
+    {
+      return 0;
+    }
+    // an even field, darkened towards the corners like a lens does
+    if (scene == SceneKind::Flat)
+    {
+      double du = u - 0.5, dv = v - 0.5;
+      return 0.6 * (1 - 0.8 * (du * du + dv * dv));
+    }
+    // color patches in the middle third
+    if (u > 1.0 / 3 && u < 2.0 / 3 && v > 1.0 / 3 && v < 2.0 / 3)
+    {
+      int patch = static_cast<int>((u - 1.0 / 3) * 18) + 6 * static_cast<int>((v - 1.0 / 3) * 12);
+      uint64_t h = Mix(static_cast<uint64_t>(patch) * 3 + c);
+      return 0.05 + 0.85 * static_cast<double>(h & 0xffff) / 0xffff;
+    }
+    // a zone plate in the top right corner, hard on demosaicing
+    if (u > 0.75 && v < 0.25)
+    {
+      double du = (u - 0.875) * 8, dv = (v - 0.125) * 8;
+      return 0.45 + 0.4 * std::cos(60 * (du * du + dv * dv));
+    }
+    switch (c)
+    {
+    case 0:
+      return 0.08 + 0.7 * u;
+    case 1:
+      return 0.1 + 0.6 * v;
+    default:
+      return 0.15 + 0.6 * (1 - u) * v;
+    }
+  }
+
+  // camera value before scaling, i.e. scene times white balance
+  double Camera(SceneKind scene, int c, double u, double v)
+  {
+    return Scene(scene, c, u, v) * NEUTRAL[c];
+  }
+
+  uint16_t Sample(const Options &options, unsigned x, unsigned y)
+  {
+    int c = options.cfa[(y & 1) * 2 + (x & 1)];
+    double u = (x + 0.5) / options.width, v = (y + 0.5) / options.height;
+    unsigned white = (1u << options.bits) - 1;
+    unsigned black = options.bits > 8 ? 1u << (options.bits - 6) : 0;
+    for (const auto &hot : options.hotPixels)
+    {
+      if (hot.first == x && hot.second == y)
+      {
+        return static_cast<uint16_t>(white);
+      }
+    }
+    uint64_t h = Mix(options.seed ^ (static_cast<uint64_t>(y) << 32 | x));
+    // roughly gaussian, a few levels wide
+    double noise = (static_cast<double>(h & 0xffff) + static_cast<double>((h >> 16) & 0xffff)) / 65535.0 - 1.0;
+    double value = black + Camera(options.scene, c, u, v) * (white - black) + noise * (1u << (options.bits > 10 ? options.bits - 10 : 0)) * 2;
+    return static_cast<uint16_t>(std::min<double>(std::max(value, 0.0), white));
+  }
+
+  // 8 bit gamma encoded sRGB of the scene, for thumbnails and previews
+  std::vector<unsigned char> RenderRgb(SceneKind scene, unsigned width, unsigned height)
+  {
+    std::vector<unsigned char> rgb(static_cast<std::size_t>(width) * height * 3);
+    for (unsigned y = 0; y < height; y++)
+    {
+      for (unsigned x = 0; x < width; x++)
+      {
+        for (int c = 0; c < 3; c++)
+        {
+          double linear = Scene(scene, c, (x + 0.5) / width, (y + 0.5) / height);
+          double encoded = linear <= 0.0031308 ? 12.92 * linear : 1.055 * std::pow(linear, 1 / 2.4) - 0.055;
+          rgb[(static_cast<std::size_t>(y) * width + x) * 3 + c] = static_cast<unsigned char>(encoded * 255 + 0.5);
+        }
+      }
+    }
+    return rgb;
+  }
+
+  void FitSize(const Options &options, unsigned size, unsigned &width, unsigned &height)
+  {
+    if (options.width >= options.height)
+    {
+      width = size;
+      height = std::max(1u, static_cast<unsigned>(static_cast<uint64_t>(size) * options.height / options.width));
+    }
+    else
+    {
+      height = size;
+      width = std::max(1u, static_cast<unsigned>(static_cast<uint64_t>(size) * options.width / options.height));
+    }
+  }
+
+  std::vector<unsigned char> EncodeJpeg(const std::vector<unsigned char> &rgb, unsigned width, unsigned height)
+  {
+    jpeg_compress_struct cinfo;
+    jpeg_error_mgr jerr;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+
+    unsigned char *buffer = nullptr;
+    unsigned long size = 0;
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 90, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    while (cinfo.next_scanline < cinfo.image_height)
+    {
+      JSAMPROW row = const_cast<JSAMPROW>(&rgb[static_cast<std::size_t>(cinfo.next_scanline) * width * 3]);
+      jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<unsigned char> jpeg(buffer, buffer + size);
+    free(buffer);
+    return jpeg;
+  }
+
+  /*
+   * Lossless JPEG (ITU T.81 process 14, predictor 1) as DNG uses it: each
+   * tile row is coded as half as many pixels of two components, so every
+   * sample is predicted from the previous one of the same CFA color. One
+   * Huffman table per tile, optimized for it.
+   */
+  class LosslessJpeg
+  {
+  public:
+    static std::vector<unsigned char> Encode(const std::vector<uint16_t> &samples, unsigned width, unsigned height,
+                                             unsigned bits)
+    {
+      std::vector<int> diffs(samples.size());
+      unsigned freq[17] = {0};
+      int initial = 1 << (bits - 1);
+      for (unsigned y = 0; y < height; y++)
+      {
+        for (unsigned x = 0; x < width; x++)
+        {
+          std::size_t i = static_cast<std::size_t>(y) * width + x;
+          int pred = x >= 2 ? samples[i - 2] : y ? samples[i - width] : initial;
+          // differences are taken modulo 2^16
+          int diff = (samples[i] - pred) & 0xffff;
+          if (diff > 32768)
+          {
+            diff -= 65536;
+          }
+          diffs[i] = diff;
+          freq[Category(diff)]++;
+        }
+      }
+
+      unsigned char lengths[17];
+      CodeLengths(freq, lengths);
+      unsigned char counts[16] = {0};
+      std::vector<unsigned char> symbols;
+      for (unsigned length = 1; length <= 16; length++)
+      {
+        for (unsigned symbol = 0; symbol < 17; symbol++)
+        {
+          if (lengths[symbol] == length)
+          {
+            counts[length - 1]++;
+            symbols.push_back(static_cast<unsigned char>(symbol));
+          }
+        }
+      }
+      uint16_t codes[17] = {0};
+      uint16_t code = 0;
+      std::size_t k = 0;
+      for (unsigned length = 1; length <= 16; length++, code <<= 1)
+      {
+        for (unsigned n = 0; n < counts[length - 1]; n++)
+        {
+          codes[symbols[k++]] = code++;
+        }
+      }
+
+      LosslessJpeg out;
+      out.Marker(0xd8);
+      out.Marker(0xc3);
+      out.Word(14);
+      out.Byte(bits);
+      out.Word(height);
+      out.Word(width / 2);
+      out.Byte(2);
+      for (unsigned component = 1; component <= 2; component++)
+      {
+        out.Byte(component);
+        out.Byte(0x11);
+        out.Byte(0);
+      }
+      out.Marker(0xc4);
+      out.Word(static_cast<unsigned>(2 + 1 + 16 + symbols.size()));
+      out.Byte(0);
+      for (unsigned char count : counts)
+      {
+        out.Byte(count);
+      }
+      for (unsigned char symbol : symbols)
+      {
+        out.Byte(symbol);
+      }
+      out.Marker(0xda);
+      out.Word(10);
+      out.Byte(2);
+      for (unsigned component = 1; component <= 2; component++)
+      {
+        out.Byte(component);
+        out.Byte(0);
+      }
+      // predictor 1, no point transform
+      out.Byte(1);
+      out.Byte(0);
+      out.Byte(0);
+      for (int diff : diffs)
+      {
+        unsigned category = Category(diff);
+        out.Bits(codes[category], lengths[category]);
+        if (category && category < 16)
+        {
+          out.Bits(static_cast<unsigned>(diff < 0 ? diff - 1 : diff) & ((1u << category) - 1), category);
+        }
+      }
+      out.Flush();
+      out.Marker(0xd9);
+      return std::move(out.data_);
+    }
+
+  private:
+    static unsigned Category(int diff)
+    {
+      unsigned magnitude = static_cast<unsigned>(diff < 0 ? -diff : diff);
+      unsigned category = 0;
+      while (magnitude)
+      {
+        category++;
+        magnitude >>= 1;
+      }
+      return category;
+    }
+
+    // code lengths limited to 16 bits, T.81 Annex K.2
+    static void CodeLengths(const unsigned *counts, unsigned char *lengths)
+    {
+      uint64_t freq[18];
+      int others[18];
+      int size[18] = {0};
+      for (int i = 0; i < 17; i++)
+      {
+        freq[i] = counts[i];
+        others[i] = -1;
+      }
+      // reserved so no code is all ones
+      freq[17] = 1;
+      others[17] = -1;
+
+      for (;;)
+      {
+        int v1 = -1, v2 = -1;
+        for (int i = 0; i < 18; i++)
+        {
+          if (freq[i] && (v1 < 0 || freq[i] <= freq[v1]))
+          {
+            v1 = i;
+          }
+        }
+        for (int i = 0; i < 18; i++)
+        {
+          if (freq[i] && i != v1 && (v2 < 0 || freq[i] <= freq[v2]))
+          {
+            v2 = i;
+          }
+        }
+        if (v2 < 0)
+        {
+          break;
+        }
+        freq[v1] += freq[v2];
+        freq[v2] = 0;
+        size[v1]++;
+        while (others[v1] >= 0)
+        {
+          v1 = others[v1];
+          size[v1]++;
+        }
+        others[v1] = v2;
+        size[v2]++;
+        while (others[v2] >= 0)
+        {
+          v2 = others[v2];
+          size[v2]++;
+        }
+      }
+
+      int bits[33] = {0};
+      for (int i = 0; i < 18; i++)
+      {
+        if (size[i])
+        {
+          bits[size[i]]++;
+        }
+      }
+      for (int i = 32; i > 16; i--)
+      {
+        while (bits[i] > 0)
+        {
+          int j = i - 2;
+          while (bits[j] == 0)
+          {
+            j--;
+          }
+          bits[i] -= 2;
+          bits[i - 1]++;
+          bits[j + 1] += 2;
+          bits[j]--;
+        }
+      }
+      int longest = 16;
+      while (bits[longest] == 0)
+      {
+        longest--;
+      }
+      bits[longest]--;
+
+      // hand the adjusted lengths out by descending frequency, the reserved
+      // symbol taking the last (longest) slot
+      int order[18];
+      for (int i = 0; i < 18; i++)
+      {
+        order[i] = i;
+      }
+      std::stable_sort(order, order + 17, [&](int a, int b)
+                       { return counts[a] > counts[b]; });
+      int symbol = 0;
+      std::fill(lengths, lengths + 17, 0);
+      for (int length = 1; length <= 16; length++)
+      {
+        for (int n = 0; n < bits[length]; n++)
+        {
+          while (symbol < 17 && counts[order[symbol]] == 0)
+          {
+            symbol++;
+          }
+          if (symbol < 17)
+          {
+            lengths[order[symbol++]] = static_cast<unsigned char>(length);
+          }
+        }
+      }
+    }
+
+    void Byte(unsigned value) { this->data_.push_back(static_cast<unsigned char>(value)); }
+
+    void Word(unsigned value)
+    {
+      this->Byte(value >> 8);
+      this->Byte(value & 0xff);
+    }
+
+    void Marker(unsigned code)
+    {
+      this->Byte(0xff);
+      this->Byte(code);
+    }
+
+    void Bits(unsigned value, unsigned count)
+    {
+      for (unsigned i = count; i-- > 0;)
+      {
+        this->acc_ = (this->acc_ << 1) | ((value >> i) & 1);
+        if (++this->nacc_ == 8)
+        {
+          this->Byte(this->acc_);
+          // byte stuffing
+          if (this->acc_ == 0xff)
+          {
+            this->Byte(0);
+          }
+          this->acc_ = 0;
+          this->nacc_ = 0;
+        }
+      }
+    }
+
+    void Flush()
+    {
+      while (this->nacc_)
+      {
+        this->Bits(1, 1);
+      }
+    }
+
+    std::vector<unsigned char> data_;
+    unsigned acc_ = 0;
+    unsigned nacc_ = 0;
+  };
+
+  enum TiffType
+  {
+    BYTE = 1,
+    ASCII = 2,
+    SHORT = 3,
+    LONG = 4,
+    RATIONAL = 5,
+    SRATIONAL = 10,
+  };
+
+  const unsigned TYPE_SIZES[] = {0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8};
+
+  struct Entry
+  {
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    std::vector<unsigned char> value;
+  };
+
+  /*
+   * A little endian IFD whose out-of-line values are stored right after it.
+   * The size does not depend on the values, so offsets can be filled in
+   * after the file has been laid out.
+   */
+  class Ifd
+  {
+  public:
+    void Ascii(uint16_t tag, const std::string &text)
+    {
+      std::vector<unsigned char> value(text.begin(), text.end());
+      value.push_back(0);
+      this->Add(tag, ASCII, static_cast<uint32_t>(value.size()), value);
+    }
+
+    void Bytes(uint16_t tag, uint16_t type, const std::vector<unsigned char> &value)
+    {
+      this->Add(tag, type, static_cast<uint32_t>(value.size()), value);
+    }
+
+    void Shorts(uint16_t tag, const std::vector<uint32_t> &values)
+    {
+      std::vector<unsigned char> value;
+      for (uint32_t v : values)
+      {
+        Put(value, v, 2);
+      }
+      this->Add(tag, SHORT, static_cast<uint32_t>(values.size()), value);
+    }
+
+    void Longs(uint16_t tag, const std::vector<uint32_t> &values)
+    {
+      std::vector<unsigned char> value;
+      for (uint32_t v : values)
+      {
+        Put(value, v, 4);
+      }
+      this->Add(tag, LONG, static_cast<uint32_t>(values.size()), value);
+    }
+
+    void Rationals(uint16_t tag, uint16_t type, const std::vector<double> &values)
+    {
+      std::vector<unsigned char> value;
+      for (double v : values)
+      {
+        Put(value, static_cast<uint32_t>(static_cast<int32_t>(std::lround(v * 10000))), 4);
+        Put(value, 10000, 4);
+      }
+      this->Add(tag, type, static_cast<uint32_t>(values.size()), value);
+    }
+
+    std::size_t Size() const
+    {
+      std::size_t size = 2 + 12 * this->entries_.size() + 4;
+      for (const Entry &entry : this->entries_)
+      {
+        if (entry.value.size() > 4)
+        {
+          size += (entry.value.size() + 1) & ~std::size_t(1);
+        }
+      }
+      return size;
+    }
+
+    std::vector<unsigned char> Serialize(uint32_t position) const
+    {
+      std::vector<Entry> entries = this->entries_;
+      std::stable_sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+                       { return a.tag < b.tag; });
+      std::vector<unsigned char> out;
+      std::vector<unsigned char> extra;
+      uint32_t extraPosition = static_cast<uint32_t>(position + 2 + 12 * entries.size() + 4);
+      Put(out, static_cast<uint32_t>(entries.size()), 2);
+      for (const Entry &entry : entries)
+      {
+        Put(out, entry.tag, 2);
+        Put(out, entry.type, 2);
+        Put(out, entry.count, 4);
+        if (entry.value.size() <= 4)
+        {
+          std::vector<unsigned char> inline_(entry.value);
+          inline_.resize(4);
+          out.insert(out.end(), inline_.begin(), inline_.end());
+        }
+        else
+        {
+          Put(out, static_cast<uint32_t>(extraPosition + extra.size()), 4);
+          extra.insert(extra.end(), entry.value.begin(), entry.value.end());
+          if (extra.size() & 1)
+          {
+            extra.push_back(0);
+          }
+        }
+      }
+      // no next IFD, chains are expressed with SubIFDs
+      Put(out, 0, 4);
+      out.insert(out.end(), extra.begin(), extra.end());
+      return out;
+    }
+
+    static void Put(std::vector<unsigned char> &out, uint32_t value, unsigned size)
+    {
+      for (unsigned i = 0; i < size; i++)
+      {
+        out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+      }
+    }
+
+  private:
+    void Add(uint16_t tag, uint16_t type, uint32_t count, const std::vector<unsigned char> &value)
+    {
+      for (Entry &entry : this->entries_)
+      {
+        if (entry.tag == tag)
+        {
+          entry = {tag, type, count, value};
+          return;
+        }
+      }
+      this->entries_.push_back({tag, type, count, value});
+    }
+
+    std::vector<Entry> entries_;
+  };
+
+  std::string MakeXmp(std::size_t size)
+  {
+    std::string xmp =
+        "<?xpacket begin=\"\xef\xbb\xbf\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n"
+        "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+        " <rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n"
+        "  <rdf:Description rdf:about=\"\"\n"
+        "    xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\"\n"
+        "    xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
+        "    xmlns:crs=\"http://ns.adobe.com/camera-raw-settings/1.0/\"\n"
+        "   xmp:Rating=\"3\"\n"
+        "   xmp:Label=\"Green\"\n"
+        "   xmp:CreatorTool=\"libraw.js make_dng\"\n"
+        "   crs:HasCrop=\"True\"\n"
+        "   crs:CropTop=\"0.1\"\n"
+        "   crs:CropLeft=\"0.1\"\n"
+        "   crs:CropBottom=\"0.9\"\n"
+        "   crs:CropRight=\"0.9\">\n"
+        "   <dc:subject>\n"
+        "    <rdf:Bag>\n"
+        "     <rdf:li>synthetic</rdf:li>\n"
+        "     <rdf:li>benchmark</rdf:li>\n"
+        "    </rdf:Bag>\n"
+        "   </dc:subject>\n"
+        "  </rdf:Description>\n"
+        " </rdf:RDF>\n"
+        "</x:xmpmeta>\n";
+    const std::string trailer = "<?xpacket end=\"w\"?>";
+    // padding, as editors leave for in-place updates
+    while (xmp.size() + trailer.size() < size)
+    {
+      std::size_t line = std::min<std::size_t>(100, size - xmp.size() - trailer.size());
+      xmp.append(line - 1, ' ');
+      xmp += '\n';
+    }
+    return xmp + trailer;
+  }
+
+  /*
+   * Packs samples MSB first, each row starting on a byte boundary, or as
+   * little endian shorts for 16 bit data.
+   */
+  void PackRow(const std::vector<uint16_t> &row, unsigned bits, std::vector<unsigned char> &out)
+  {
+    out.clear();
+    if (bits == 16)
+    {
+      for (uint16_t sample : row)
+      {
+        out.push_back(static_cast<unsigned char>(sample));
+        out.push_back(static_cast<unsigned char>(sample >> 8));
+      }
+      return;
+    }
+    uint32_t acc = 0;
+    unsigned nacc = 0;
+    for (uint16_t sample : row)
+    {
+      acc = (acc << bits) | sample;
+      nacc += bits;
+      while (nacc >= 8)
+      {
+        nacc -= 8;
+        out.push_back(static_cast<unsigned char>(acc >> nacc));
+      }
+    }
+    if (nacc)
+    {
+      out.push_back(static_cast<unsigned char>(acc << (8 - nacc)));
+    }
+  }
+
+  bool Write(FILE *file, const std::vector<unsigned char> &data)
+  {
+    return data.empty() || std::fwrite(data.data(), 1, data.size(), file) == data.size();
+  }
+
+  bool WriteDng(const Options &options, const std::string &path)
+  {
+    unsigned bits = options.bits;
+    unsigned black = bits > 8 ? 1u << (bits - 6) : 0;
+    unsigned white = (1u << bits) - 1;
+
+    // thumbnail and previews
+    unsigned thumbWidth, thumbHeight;
+    FitSize(options, options.thumbnailSize, thumbWidth, thumbHeight);
+    std::vector<unsigned char> thumbnail = RenderRgb(options.scene, thumbWidth, thumbHeight);
+    std::vector<std::vector<unsigned char>> previews;
+    std::vector<std::pair<unsigned, unsigned>> previewDims;
+    for (unsigned size : options.previewSizes)
+    {
+      unsigned w, h;
+      FitSize(options, size, w, h);
+      previews.push_back(EncodeJpeg(RenderRgb(options.scene, w, h), w, h));
+      previewDims.emplace_back(w, h);
+    }
+
+    // raw data, compressed tiles are built up front, strips are streamed
+    std::vector<std::vector<unsigned char>> tiles;
+    unsigned tilesAcross = 0, tilesDown = 0;
+    std::size_t rowBytes = (static_cast<std::size_t>(options.width) * bits + 7) / 8;
+    if (options.ljpeg)
+    {
+      unsigned tile = options.tileSize;
+      tilesAcross = (options.width + tile - 1) / tile;
+      tilesDown = (options.height + tile - 1) / tile;
+      std::vector<uint16_t> samples(static_cast<std::size_t>(tile) * tile);
+      for (unsigned ty = 0; ty < tilesDown; ty++)
+      {
+        for (unsigned tx = 0; tx < tilesAcross; tx++)
+        {
+          for (unsigned y = 0; y < tile; y++)
+          {
+            for (unsigned x = 0; x < tile; x++)
+            {
+              // edge tiles continue the scene past the frame, readers crop it
+              samples[static_cast<std::size_t>(y) * tile + x] = Sample(options, tx * tile + x, ty * tile + y);
+            }
+          }
+          tiles.push_back(LosslessJpeg::Encode(samples, tile, tile, bits));
+        }
+      }
+    }
+
+    Ifd ifd0, raw, exif;
+    std::vector<Ifd> previewIfds(previews.size());
+
+    ifd0.Longs(254, {1});
+    ifd0.Longs(256, {thumbWidth});
+    ifd0.Longs(257, {thumbHeight});
+    ifd0.Shorts(258, {8, 8, 8});
+    ifd0.Shorts(259, {1});
+    ifd0.Shorts(262, {2});
+    ifd0.Ascii(271, "Synthetic");
+    ifd0.Ascii(272, "DNG Corpus");
+    ifd0.Longs(273, {0});
+    ifd0.Shorts(274, {1});
+    ifd0.Shorts(277, {3});
+    ifd0.Longs(278, {thumbHeight});
+    ifd0.Longs(279, {static_cast<uint32_t>(thumbnail.size())});
+    ifd0.Shorts(284, {1});
+    ifd0.Ascii(305, "libraw.js make_dng");
+    ifd0.Ascii(306, "2024:01:01 12:00:00");
+    ifd0.Longs(330, std::vector<uint32_t>(1 + previews.size(), 0));
+    if (options.xmpBytes)
+    {
+      std::string xmp = MakeXmp(options.xmpBytes);
+      ifd0.Bytes(700, BYTE, std::vector<unsigned char>(xmp.begin(), xmp.end()));
+    }
+    ifd0.Longs(34665, {0});
+    ifd0.Bytes(50706, BYTE, {1, 4, 0, 0});
+    ifd0.Bytes(50707, BYTE, {1, 1, 0, 0});
+    ifd0.Ascii(50708, "Synthetic DNG Corpus");
+    std::vector<double> matrix;
+    for (int r = 0; r < 3; r++)
+    {
+      for (int c = 0; c < 3; c++)
+      {
+        matrix.push_back(XYZ_TO_RGB[r][c] * NEUTRAL[r]);
+      }
+    }
+    ifd0.Rationals(50721, SRATIONAL, matrix);
+    ifd0.Rationals(50728, RATIONAL, {NEUTRAL[0], NEUTRAL[1], NEUTRAL[2]});
+    // D65
+    ifd0.Shorts(50778, {21});
+
+    exif.Rationals(33434, RATIONAL, {1.0 / 125});
+    exif.Rationals(33437, RATIONAL, {4.0});
+    exif.Shorts(34855, {100});
+    exif.Ascii(36867, "2024:01:01 12:00:00");
+    exif.Rationals(37386, RATIONAL, {50.0});
+    exif.Ascii(42033, "SYN" + std::to_string(options.seed));
+
+    raw.Longs(254, {0});
+    raw.Longs(256, {options.width});
+    raw.Longs(257, {options.height});
+    raw.Shorts(258, {bits});
+    raw.Shorts(259, {options.ljpeg ? 7u : 1u});
+    raw.Shorts(262, {32803});
+    raw.Shorts(277, {1});
+    raw.Shorts(284, {1});
+    if (options.ljpeg)
+    {
+      raw.Longs(322, {options.tileSize});
+      raw.Longs(323, {options.tileSize});
+      std::vector<uint32_t> counts;
+      for (const auto &tile : tiles)
+      {
+        counts.push_back(static_cast<uint32_t>(tile.size()));
+      }
+      raw.Longs(324, std::vector<uint32_t>(tiles.size(), 0));
+      raw.Longs(325, counts);
+    }
+    else
+    {
+      raw.Longs(273, {0});
+      raw.Longs(278, {options.height});
+      raw.Longs(279, {static_cast<uint32_t>(rowBytes * options.height)});
+    }
+    raw.Shorts(33421, {2, 2});
+    raw.Bytes(33422, BYTE, {options.cfa[0], options.cfa[1], options.cfa[2], options.cfa[3]});
+    raw.Bytes(50710, BYTE, {0, 1, 2});
+    raw.Shorts(50711, {1});
+    raw.Longs(50714, {black});
+    raw.Longs(50717, {white});
+
+    for (std::size_t i = 0; i < previews.size(); i++)
+    {
+      Ifd &ifd = previewIfds[i];
+      ifd.Longs(254, {1});
+      ifd.Longs(256, {previewDims[i].first});
+      ifd.Longs(257, {previewDims[i].second});
+      ifd.Shorts(258, {8, 8, 8});
+      ifd.Shorts(259, {7});
+      ifd.Shorts(262, {6});
+      ifd.Longs(273, {0});
+      ifd.Shorts(277, {3});
+      ifd.Longs(278, {previewDims[i].second});
+      ifd.Longs(279, {static_cast<uint32_t>(previews[i].size())});
+      ifd.Shorts(284, {1});
+    }
+
+    // layout: header, IFDs, thumbnail, previews, raw data
+    uint64_t position = 8;
+    auto place = [&position](std::size_t size)
+    {
+      uint64_t at = position;
+      position += (size + 1) & ~std::size_t(1);
+      return static_cast<uint32_t>(at);
+    };
+    uint32_t ifd0At = place(ifd0.Size());
+    uint32_t exifAt = place(exif.Size());
+    uint32_t rawAt = place(raw.Size());
+    std::vector<uint32_t> previewIfdAt;
+    for (const Ifd &ifd : previewIfds)
+    {
+      previewIfdAt.push_back(place(ifd.Size()));
+    }
+    uint32_t thumbnailAt = place(thumbnail.size());
+    std::vector<uint32_t> previewAt;
+    for (const auto &preview : previews)
+    {
+      previewAt.push_back(place(preview.size()));
+    }
+    std::vector<uint32_t> tileAt;
+    for (const auto &tile : tiles)
+    {
+      tileAt.push_back(place(tile.size()));
+    }
+    uint32_t stripAt = options.ljpeg ? 0 : place(rowBytes * options.height);
+    if (position > 0xffffffffull)
+    {
+      std::fprintf(stderr, "make_dng: %s would exceed 4 GiB\n", path.c_str());
+      return false;
+    }
+
+    std::vector<uint32_t> subIfds = {rawAt};
+    subIfds.insert(subIfds.end(), previewIfdAt.begin(), previewIfdAt.end());
+    ifd0.Longs(330, subIfds);
+    ifd0.Longs(273, {thumbnailAt});
+    ifd0.Longs(34665, {exifAt});
+    if (options.ljpeg)
+    {
+      raw.Longs(324, tileAt);
+    }
+    else
+    {
+      raw.Longs(273, {stripAt});
+    }
+    for (std::size_t i = 0; i < previewIfds.size(); i++)
+    {
+      previewIfds[i].Longs(273, {previewAt[i]});
+    }
+
+    FILE *file = std::fopen(path.c_str(), "wb");
+    if (!file)
+    {
+      std::perror(path.c_str());
+      return false;
+    }
+    std::vector<unsigned char> header = {'I', 'I', 42, 0};
+    Ifd::Put(header, ifd0At, 4);
+    auto pad = [](std::vector<unsigned char> data)
+    {
+      if (data.size() & 1)
+      {
+        data.push_back(0);
+      }
+      return data;
+    };
+    bool ok = Write(file, header) && Write(file, pad(ifd0.Serialize(ifd0At))) &&
+              Write(file, pad(exif.Serialize(exifAt))) && Write(file, pad(raw.Serialize(rawAt)));
+    for (std::size_t i = 0; ok && i < previewIfds.size(); i++)
+    {
+      ok = Write(file, pad(previewIfds[i].Serialize(previewIfdAt[i])));
+    }
+    ok = ok && Write(file, pad(thumbnail));
+    for (std::size_t i = 0; ok && i < previews.size(); i++)
+    {
+      ok = Write(file, pad(previews[i]));
+    }
+    for (std::size_t i = 0; ok && i < tiles.size(); i++)
+    {
+      ok = Write(file, pad(tiles[i]));
+    }
+    if (ok && !options.ljpeg)
+    {
+      std::vector<uint16_t> row(options.width);
+      std::vector<unsigned char> packed;
+      for (unsigned y = 0; ok && y < options.height; y++)
+      {
+        for (unsigned x = 0; x < options.width; x++)
+        {
+          row[x] = Sample(options, x, y);
+        }
+        PackRow(row, bits, packed);
+        ok = Write(file, packed);
+      }
+    }
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok)
+    {
+      std::fprintf(stderr, "make_dng: failed to write %s\n", path.c_str());
+    }
+    return ok;
+  }
+
+  bool ParseCfa(const std::string &name, unsigned char *cfa)
+  {
+    if (name.size() != 4)
+    {
+      return false;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+      const char *colors = "RGB";
+      const char *found = std::strchr(colors, name[i]);
+      if (!found || !name[i])
+      {
+        return false;
+      }
+      cfa[i] = static_cast<unsigned char>(found - colors);
+    }
+    return true;
+  }
+
+  // 3:2 frame of about `megapixels`, with even dimensions
+  void SizeFor(double megapixels, Options &options)
+  {
+    double height = std::sqrt(megapixels * 1e6 / 1.5);
+    options.height = static_cast<unsigned>(height / 2) * 2;
+    options.width = static_cast<unsigned>(height * 1.5 / 2) * 2;
+  }
+
+  struct CorpusEntry
+  {
+    double megapixels;
+    unsigned bits;
+    bool ljpeg;
+    const char *cfa;
+    std::size_t xmpBytes;
+  };
+
+  // 12 to 150 MP across the bit depths and compressions cameras produce
+  const CorpusEntry CORPUS[] = {
+      {12, 12, false, "RGGB", 0},
+      {12, 14, true, "RGGB", 4096},
+      {24, 14, true, "BGGR", 4096},
+      {24, 12, false, "GRBG", 0},
+      {45, 14, true, "RGGB", 4096},
+      {61, 16, false, "RGGB", 0},
+      {100, 16, true, "GBRG", 4096},
+      {150, 14, true, "RGGB", 4096},
+      {150, 16, false, "RGGB", 0},
+  };
+
+  void Usage()
+  {
+    std::fprintf(stderr,
+                 "usage: make_dng [options] out.dng\n"
+                 "       make_dng --corpus dir\n"
+                 "\n"
+                 "  --width N, --height N   raw size (default 4240x2832)\n"
+                 "  --megapixels N          3:2 raw size of about N MP\n"
+                 "  --bits N                bits per sample, 8 to 16 (default 14)\n"
+                 "  --compression C         ljpeg or none (default ljpeg)\n"
+                 "  --tile N                lossless JPEG tile size (default 256)\n"
+                 "  --cfa XXXX              RGGB, BGGR, GRBG or GBRG (default RGGB)\n"
+                 "  --thumbnail N           IFD0 thumbnail size (default 256)\n"
+                 "  --previews N,N,...      JPEG preview sizes, empty for none (default 1024)\n"
+                 "  --xmp N                 embed an XMP packet padded to N bytes\n"
+                 "  --seed N                noise seed (default 1)\n"
+                 "  --scene S               chart, dark or flat (default chart)\n"
+                 "  --hot X,Y               set a raw sample to the white level, repeatable\n");
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options options;
+  std::string output;
+  std::string corpus;
+
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    std::string value = hasValue ? argv[i + 1] : "";
+    bool valid = true;
+    if (arg.compare(0, 2, "--") != 0)
+    {
+      output = arg;
+      continue;
+    }
+    if (!hasValue)
+    {
+      Usage();
+      return 2;
+    }
+    i++;
+    if (arg == "--width")
+      options.width = std::strtoul(value.c_str(), nullptr, 10) & ~1u;
+    else if (arg == "--height")
+      options.height = std::strtoul(value.c_str(), nullptr, 10) & ~1u;
+    else if (arg == "--megapixels")
+      SizeFor(std::strtod(value.c_str(), nullptr), options);
+    else if (arg == "--bits")
+    {
+      options.bits = std::strtoul(value.c_str(), nullptr, 10);
+      valid = options.bits >= 8 && options.bits <= 16;
+    }
+    else if (arg == "--compression")
+    {
+      options.ljpeg = value == "ljpeg";
+      valid = options.ljpeg || value == "none";
+    }
+    else if (arg == "--tile")
+    {
+      options.tileSize = std::strtoul(value.c_str(), nullptr, 10);
+      valid = options.tileSize >= 16 && options.tileSize % 16 == 0;
+    }
+    else if (arg == "--cfa")
+      valid = ParseCfa(value, options.cfa);
+    else if (arg == "--thumbnail")
+      options.thumbnailSize = std::strtoul(value.c_str(), nullptr, 10);
+    else if (arg == "--previews")
+    {
+      options.previewSizes.clear();
+      for (const char *p = value.c_str(); *p;)
+      {
+        char *end;
+        unsigned long size = std::strtoul(p, &end, 10);
+        if (end == p || !size)
+        {
+          valid = false;
+          break;
+        }
+        options.previewSizes.push_back(size);
+        p = *end == ',' ? end + 1 : end;
+      }
+    }
+    else if (arg == "--xmp")
+      options.xmpBytes = std::strtoul(value.c_str(), nullptr, 10);
+    else if (arg == "--seed")
+      options.seed = std::strtoull(value.c_str(), nullptr, 10);
+    else if (arg == "--scene")
+    {
+      options.scene = value == "dark" ? SceneKind::Dark : value == "flat" ? SceneKind::Flat : SceneKind::Chart;
+      valid = options.scene != SceneKind::Chart || value == "chart";
+    }
+    else if (arg == "--hot")
+    {
+      char *end;
+      unsigned long x = std::strtoul(value.c_str(), &end, 10);
+      valid = *end == ',';
+      if (valid)
+      {
+        const char *p = end + 1;
+        unsigned long y = std::strtoul(p, &end, 10);
+        valid = end != p && !*end;
+        options.hotPixels.emplace_back(x, y);
+      }
+    }
+    else if (arg == "--corpus")
+      corpus = value;
+    else
+      valid = false;
+    if (!valid)
+    {
+      std::fprintf(stderr, "make_dng: invalid %s %s\n", arg.c_str(), value.c_str());
+      return 2;
+    }
+  }
+
+  if (!corpus.empty())
+  {
+    std::error_code error;
+    std::filesystem::create_directories(corpus, error);
+    for (const CorpusEntry &entry : CORPUS)
+    {
+      Options item = options;
+      SizeFor(entry.megapixels, item);
+      item.bits = entry.bits;
+      item.ljpeg = entry.ljpeg;
+      item.xmpBytes = entry.xmpBytes;
+      ParseCfa(entry.cfa, item.cfa);
+      char name[128];
+      std::snprintf(name, sizeof(name), "/synthetic-%gmp-%ubit-%s-%s.dng", entry.megapixels, entry.bits,
+                    entry.ljpeg ? "ljpeg" : "raw", entry.cfa);
+      std::printf("%s\n", (corpus + name).c_str());
+      if (!WriteDng(item, corpus + name))
+      {
+        return 1;
+      }
+    }
+    return 0;
+  }
+
+  if (output.empty() || !options.width || !options.height)
+  {
+    Usage();
+    return 2;
+  }
+  return WriteDng(options, output) ? 0 : 1;
+}
@@ -3,9 +3,40 @@
     {
       "target_name": "node_libraw_binding",
       "sources": [
+        "./src/addon.cpp",
+        "./src/async_job.cpp",
+        "./src/camera_index.cpp",
+        "./src/color_engine.cpp",
+        "./src/developer.cpp",
+        "./src/encoder.cpp",
+        "./src/exif_tags.cpp",
+        "./src/extract.cpp",
+        "./src/fd_datastream.cpp",
+        "./src/hash.cpp",
+        "./src/hot_file_cache.cpp",
         "./src/index.cpp",
         "./src/libraw_wrapper.cpp",
-        "./src/wraptypes.cpp"
+        "./src/mapped_file.cpp",
+        "./src/parallel.cpp",
+        "./src/perceptual_hash.cpp",
+        "./src/phash.cpp",
+        "./src/prefetch.cpp",
+        "./src/preview.cpp",
+        "./src/processor_pool.cpp",
+        "./src/raw_archive.cpp",
+        "./src/raw_codec.cpp",
+        "./src/render_cache.cpp",
+        "./src/render_preview.cpp",
+        "./src/render_region.cpp",
+        "./src/shared_ring.cpp",
+        "./src/shots.cpp",
+        "./src/stack.cpp",
+        "./src/stacker.cpp",
+        "./src/trace.cpp",
+        "./src/worker_pool.cpp",
+        "./src/worker_ring.cpp",
+        "./src/wraptypes.cpp",
+        "./src/xmp.cpp"
       ],
       "include_dirs": [
         "<!@(node -p \"require('node-addon-api').include\")"
@@ -0,0 +1,152 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "addon.h"
+#include "async_job.h"
+#include "trace.h"
+#include "worker_pool.h"
+
+AddonData *AddonData::Create(Napi::Env env)
+{
+  AddonData *data = new AddonData(env);
+  env.SetInstanceData<AddonData>(data);
+  return data;
+}
+
+AddonData *AddonData::Get(Napi::Env env)
+{
+  return env.GetInstanceData<AddonData>();
+}
+
+AddonData::AddonData(Napi::Env env) : env_(env)
+{
+  Tracer::NameThread("js");
+  this->tsfn_ = Napi::ThreadSafeFunction::New(
+      env,
+      Napi::Function::New(env, [](const Napi::CallbackInfo &) {}),
+      "LibRawWrapper",
+      0,
+      1);
+  // only keep the event loop alive while jobs are outstanding
+  this->tsfn_.Unref(env);
+  napi_add_env_cleanup_hook(env, &AddonData::Cleanup, this);
+}
+
+AddonData::~AddonData()
+{
+  if (!this->closing_)
+  {
+    napi_remove_env_cleanup_hook(this->env_, &AddonData::Cleanup, this);
+    this->Drain();
+  }
+}
+
+void AddonData::Cleanup(void *arg)
+{
+  static_cast<AddonData *>(arg)->Drain();
+}
+
+void AddonData::Queue(AsyncJob *job, Priority priority)
+{
+  if (this->inflight_++ == 0)
+  {
+    this->tsfn_.Ref(this->env_);
+  }
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->outstanding_++;
+  }
+  uint64_t queued = Tracer::Enabled() ? Tracer::Now() : 0;
+  WorkerPool::Instance().Submit([this, job, queued]
+                                {
+    if (queued && Tracer::Enabled())
+    {
+      Tracer::Instance().Record(TraceEvent{TraceEvent::Kind::Queue, "queue", job->Name(), queued,
+                                           Tracer::Now() - queued, reinterpret_cast<uintptr_t>(job), {}, {}});
+    }
+    bool closing;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      closing = this->closing_;
+    }
+    // jobs that have not started by the time the env goes away are dropped
+    if (!closing)
+    {
+      TraceSpan span(job->Name());
+      job->Execute();
+    }
+    this->Finish(job); },
+                                priority);
+}
+
+void AddonData::Finish(AsyncJob *job)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->completed_.push_back(job);
+  this->outstanding_--;
+  if (!this->closing_)
+  {
+    this->tsfn_.NonBlockingCall([this](Napi::Env env, Napi::Function)
+                                { this->Deliver(env); });
+  }
+  this->cv_.notify_all();
+}
+
+void AddonData::Deliver(Napi::Env env)
+{
+  std::vector<AsyncJob *> jobs;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    jobs.swap(this->completed_);
+  }
+  for (AsyncJob *job : jobs)
+  {
+    Napi::HandleScope scope(env);
+    {
+      TraceSpan span("wrap", job->Name());
+      job->Complete(env);
+    }
+    delete job;
+    if (--this->inflight_ == 0)
+    {
+      this->tsfn_.Unref(env);
+    }
+  }
+}
+
+void AddonData::Drain()
+{
+  std::vector<AsyncJob *> jobs;
+  {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    this->closing_ = true;
+    this->cv_.wait(lock, [this]
+                   { return this->outstanding_ == 0; });
+    jobs.swap(this->completed_);
+  }
+  for (AsyncJob *job : jobs)
+  {
+    job->Abandon();
+    delete job;
+  }
+  this->tsfn_.Release();
+}
@@ -0,0 +1,78 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_ADDON_H
+#define LIBRAWJS_ADDON_H
+
+#include <napi.h>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "worker_pool.h"
+
+class AsyncJob;
+
+/*
+ * Per-environment state of the addon.
+ *
+ * One instance is attached to every Node environment (main thread or
+ * `worker_thread`) that loads the addon. It owns the constructor reference
+ * and the channel through which jobs finished on the shared `WorkerPool`
+ * are handed back to this environment's JS thread.
+ *
+ * When the environment shuts down, an env cleanup hook stops accepting
+ * results, waits for jobs that are already running on the pool to finish,
+ * and discards undelivered results, so a terminated worker never leaves
+ * native threads touching its state.
+ */
+class AddonData
+{
+public:
+  static AddonData *Create(Napi::Env env);
+  static AddonData *Get(Napi::Env env);
+  ~AddonData();
+
+  void Queue(AsyncJob *job, Priority priority);
+
+  Napi::FunctionReference wrapperConstructor;
+  // frozen array of supported cameras, built on first request
+  Napi::Reference<Napi::Array> cameraList;
+
+private:
+  explicit AddonData(Napi::Env env);
+  static void Cleanup(void *arg);
+  void Drain();
+  void Finish(AsyncJob *job);
+  void Deliver(Napi::Env env);
+
+  Napi::Env env_;
+  Napi::ThreadSafeFunction tsfn_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::vector<AsyncJob *> completed_;
+  std::size_t outstanding_ = 0;
+  std::size_t inflight_ = 0;
+  bool closing_ = false;
+};
+
+#endif
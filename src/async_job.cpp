@@ -0,0 +1,91 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "async_job.h"
+#include "addon.h"
+
+AsyncJob::AsyncJob(Napi::Env env, const char *name)
+    : env_(env), name_(name), deferred_(Napi::Promise::Deferred::New(env))
+{
+}
+
+Napi::Promise AsyncJob::Queue(Priority priority)
+{
+  Napi::Promise promise = this->deferred_.Promise();
+  AddonData::Get(this->env_)->Queue(this, priority);
+  return promise;
+}
+
+void AsyncJob::SetError(const std::string &message)
+{
+  this->error_ = message;
+}
+
+void AsyncJob::Retain(Napi::Object object)
+{
+  this->retained_.push_back(Napi::Persistent(object));
+}
+
+void AsyncJob::Complete(Napi::Env env)
+{
+  if (!this->error_.empty())
+  {
+    this->deferred_.Reject(Napi::Error::New(env, this->error_).Value());
+    return;
+  }
+  try
+  {
+    this->deferred_.Resolve(this->OnOK(env));
+  }
+  catch (const Napi::Error &e)
+  {
+    this->deferred_.Reject(e.Value());
+  }
+}
+
+/*
+ * Called when the owning environment is torn down before the job could be
+ * settled; references cannot be released safely at that point.
+ */
+void AsyncJob::Abandon()
+{
+  for (Napi::ObjectReference &ref : this->retained_)
+  {
+    ref.SuppressDestruct();
+  }
+}
+
+Napi::Buffer<char> MoveToBuffer(Napi::Env env, std::vector<char> &&bytes)
+{
+  if (bytes.empty())
+  {
+    return Napi::Buffer<char>::New(env, 0);
+  }
+  std::vector<char> *owned = new std::vector<char>(std::move(bytes));
+  return Napi::Buffer<char>::New(
+      env,
+      owned->data(),
+      owned->size(),
+      [](Napi::Env, char *, std::vector<char> *hint)
+      { delete hint; },
+      owned);
+}
@@ -0,0 +1,75 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_ASYNC_JOB_H
+#define LIBRAWJS_ASYNC_JOB_H
+
+#include <napi.h>
+#include <string>
+#include <vector>
+#include "worker_pool.h"
+
+/*
+ * A unit of native work that runs on the shared `WorkerPool` and settles a
+ * Promise on the JS thread of the environment that queued it.
+ *
+ * `Execute` runs on a pool thread and must not touch any JS values. `OnOK`
+ * runs on the JS thread once `Execute` has returned without calling
+ * `SetError`. Objects passed to `Retain` are kept alive until the job has
+ * been settled.
+ */
+class AsyncJob
+{
+public:
+  // `name` identifies the job in traces, a static string
+  AsyncJob(Napi::Env env, const char *name);
+  virtual ~AsyncJob() = default;
+
+  Napi::Promise Queue(Priority priority = Priority::Normal);
+  const char *Name() const { return this->name_; }
+
+protected:
+  virtual void Execute() = 0;
+  virtual Napi::Value OnOK(Napi::Env env) = 0;
+
+  void SetError(const std::string &message);
+  void Retain(Napi::Object object);
+
+private:
+  friend class AddonData;
+
+  void Complete(Napi::Env env);
+  void Abandon();
+
+  Napi::Env env_;
+  const char *name_;
+  Napi::Promise::Deferred deferred_;
+  std::vector<Napi::ObjectReference> retained_;
+  std::string error_;
+};
+
+/*
+ * Hands ownership of `bytes` to a JS Buffer without copying them.
+ */
+Napi::Buffer<char> MoveToBuffer(Napi::Env env, std::vector<char> &&bytes);
+
+#endif
@@ -0,0 +1,170 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "camera_index.h"
+#include "libraw/libraw.h"
+#include <cctype>
+#include <vector>
+
+const CameraIndex &CameraIndex::Instance()
+{
+  static CameraIndex *index = new CameraIndex(LibRaw::cameraList());
+  return *index;
+}
+
+// splits the alternative names of an entry on '/' and ','
+static void AddNames(const std::string &text, std::vector<std::string> &names)
+{
+  std::size_t start = 0;
+  while (start <= text.size())
+  {
+    std::size_t end = text.find_first_of("/,", start);
+    if (end == std::string::npos)
+    {
+      end = text.size();
+    }
+    std::string name = CameraIndex::Normalize(text.substr(start, end - start));
+    if (!name.empty())
+    {
+      names.push_back(name);
+    }
+    start = end + 1;
+  }
+}
+
+CameraIndex::CameraIndex(const char **cameras)
+{
+  for (std::size_t i = 0; cameras[i] != nullptr; i++)
+  {
+    std::string entry = Normalize(cameras[i]);
+    this->makes_.insert(entry.substr(0, entry.find(' ')));
+
+    // the full entry stays indexed, then its parts
+    std::vector<std::string> entries{entry};
+    std::vector<std::string> aliases;
+    std::size_t open = entry.find(" (");
+    if (open != std::string::npos && entry.back() == ')')
+    {
+      AddNames(entry.substr(open + 2, entry.size() - open - 3), aliases);
+      entry.erase(open);
+      entries.push_back(entry);
+    }
+    std::size_t slash = entry.find(" / ");
+    if (slash != std::string::npos)
+    {
+      AddNames(entry.substr(slash + 3), aliases);
+      entries.push_back(entry.substr(0, slash));
+    }
+
+    for (const std::string &name : entries)
+    {
+      for (std::size_t space = name.find(' '); space != std::string::npos; space = name.find(' ', space + 1))
+      {
+        std::string make = name.substr(0, space);
+        this->keys_.insert(Key(make, name.substr(space + 1)));
+        for (const std::string &alias : aliases)
+        {
+          this->keys_.insert(Key(make, alias));
+        }
+      }
+    }
+  }
+}
+
+std::string CameraIndex::Normalize(const std::string &text)
+{
+  std::string out;
+  out.reserve(text.size());
+  bool pendingSpace = false;
+  for (unsigned char c : text)
+  {
+    if (std::isspace(c))
+    {
+      pendingSpace = !out.empty();
+      continue;
+    }
+    if (pendingSpace)
+    {
+      out.push_back(' ');
+      pendingSpace = false;
+    }
+    out.push_back(static_cast<char>(std::tolower(c)));
+  }
+  return out;
+}
+
+std::string CameraIndex::Key(const std::string &make, const std::string &model)
+{
+  std::string key;
+  key.reserve(make.size() + model.size() + 1);
+  key.append(make).push_back('\0');
+  key.append(model);
+  return key;
+}
+
+bool CameraIndex::Contains(const std::string &make, const std::string &model) const
+{
+  std::string normalizedMake = Normalize(make);
+  std::string normalizedModel = Normalize(model);
+  if (normalizedMake.empty() || normalizedModel.empty())
+  {
+    return false;
+  }
+  if (this->ContainsModel(normalizedMake, normalizedModel))
+  {
+    return true;
+  }
+  // EXIF makers name the listed make among other words, as in "NIKON
+  // CORPORATION", "KONICA MINOLTA" or "Phase One" for "PhaseOne"
+  std::string joined;
+  std::size_t start = 0;
+  while (start < normalizedMake.size())
+  {
+    std::size_t end = normalizedMake.find(' ', start);
+    if (end == std::string::npos)
+    {
+      end = normalizedMake.size();
+    }
+    std::string word = normalizedMake.substr(start, end - start);
+    joined += word;
+    if (word != normalizedMake && this->makes_.count(word) && this->ContainsModel(word, normalizedModel))
+    {
+      return true;
+    }
+    start = end + 1;
+  }
+  return joined != normalizedMake && this->makes_.count(joined) && this->ContainsModel(joined, normalizedModel);
+}
+
+bool CameraIndex::ContainsModel(const std::string &make, std::string model) const
+{
+  // EXIF models frequently repeat the make, e.g. "Canon" / "Canon EOS R5"
+  if (model.size() > make.size() && model.compare(0, make.size(), make) == 0 && model[make.size()] == ' ')
+  {
+    if (this->keys_.count(Key(make, model)))
+    {
+      return true;
+    }
+    model.erase(0, make.size() + 1);
+  }
+  return this->keys_.count(Key(make, model)) != 0;
+}
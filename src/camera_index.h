@@ -0,0 +1,67 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_CAMERA_INDEX_H
+#define LIBRAWJS_CAMERA_INDEX_H
+
+#include <string>
+#include <unordered_set>
+
+/*
+ * Hash index over LibRaw's list of supported cameras.
+ *
+ * LibRaw lists cameras as "Make Model" strings, where the make may itself
+ * contain spaces. Every entry is indexed under each possible make/model
+ * split, keyed on normalized text, so a lookup with the values of
+ * `idata.normalized_make` and `idata.normalized_model` is a single hash
+ * probe. Other names an entry gives, in parentheses ("Sony ILCA-77M2
+ * (A77-II)") or after slashes ("Canon PowerShot SD300 / IXUS 40"), are
+ * indexed as models of the same make.
+ *
+ * Raw EXIF strings work too: like LibRaw, a maker string such as "NIKON
+ * CORPORATION" is reduced to the listed make it contains, and a model that
+ * repeats the make is tried without it.
+ *
+ * The list is static data of the library, so the index is built once per
+ * process on first use and shared between environments.
+ */
+class CameraIndex
+{
+public:
+  static const CameraIndex &Instance();
+
+  bool Contains(const std::string &make, const std::string &model) const;
+
+  /* lowercases ASCII letters, trims and collapses runs of whitespace */
+  static std::string Normalize(const std::string &text);
+
+private:
+  explicit CameraIndex(const char **cameras);
+  static std::string Key(const std::string &make, const std::string &model);
+  bool ContainsModel(const std::string &make, std::string model) const;
+
+  std::unordered_set<std::string> keys_;
+  // normalized first words of the entries, the makes an EXIF maker may name
+  std::unordered_set<std::string> makes_;
+};
+
+#endif
@@ -0,0 +1,335 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "color_engine.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define LIBRAWJS_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+  const std::size_t kLutSize = 0x10000;
+  // pixels converted to float per step of the table lookup passes
+  const std::size_t kBlock = 512;
+
+  using Kernel16 = void (*)(const ColorTransform &, const uint16_t *, std::size_t, float *, float);
+  using KernelF = void (*)(const ColorTransform &, const float *, std::size_t, float *, float);
+
+  /*
+   * Scalar kernels, also used for the tails the vector kernels leave over.
+   * `scale` multiplies the clipped output, 65535 when it feeds a table.
+   */
+  template <typename In>
+  void ConvertScalar(const ColorTransform &t, const In *in, std::size_t count, float *out, float scale)
+  {
+    for (std::size_t i = 0; i < count; i++, in += 4, out += 3)
+    {
+      float cam[4];
+      for (int k = 0; k < 4; k++)
+      {
+        cam[k] = std::min(std::max(static_cast<float>(in[k]) * t.mul[k], 0.0f), 1.0f);
+      }
+      for (int c = 0; c < 3; c++)
+      {
+        float v = t.matrix[c][0] * cam[0] + t.matrix[c][1] * cam[1] + t.matrix[c][2] * cam[2] + t.matrix[c][3] * cam[3];
+        out[c] = std::min(std::max(v, 0.0f), 1.0f) * scale;
+      }
+    }
+  }
+
+  void Scalar16(const ColorTransform &t, const uint16_t *in, std::size_t count, float *out, float scale)
+  {
+    ConvertScalar(t, in, count, out, scale);
+  }
+
+  void ScalarF(const ColorTransform &t, const float *in, std::size_t count, float *out, float scale)
+  {
+    ConvertScalar(t, in, count, out, scale);
+  }
+
+#ifdef LIBRAWJS_X86_KERNELS
+  /*
+   * One pixel per 128 bit vector. Output pixels are stored as four floats,
+   * the fourth lands on the next pixel's first sample and is overwritten by
+   * it, so the last pixel is left to the scalar kernel.
+   */
+#define LIBRAWJS_SSE_PIXEL(load)                                                  \
+  __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(load, mul), zero), one);            \
+  __m128 rgb = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));    \
+  rgb = _mm_add_ps(rgb, _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)))); \
+  rgb = _mm_add_ps(rgb, _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)))); \
+  rgb = _mm_add_ps(rgb, _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)))); \
+  _mm_storeu_ps(out + 3 * i, _mm_mul_ps(_mm_min_ps(_mm_max_ps(rgb, zero), one), scale4));
+
+#define LIBRAWJS_SSE_SETUP                                                                      \
+  const __m128 zero = _mm_setzero_ps();                                                         \
+  const __m128 one = _mm_set1_ps(1.0f);                                                         \
+  const __m128 scale4 = _mm_set1_ps(scale);                                                     \
+  const __m128 mul = _mm_loadu_ps(t.mul);                                                       \
+  const __m128 c0 = _mm_setr_ps(t.matrix[0][0], t.matrix[1][0], t.matrix[2][0], 0.0f);          \
+  const __m128 c1 = _mm_setr_ps(t.matrix[0][1], t.matrix[1][1], t.matrix[2][1], 0.0f);          \
+  const __m128 c2 = _mm_setr_ps(t.matrix[0][2], t.matrix[1][2], t.matrix[2][2], 0.0f);          \
+  const __m128 c3 = _mm_setr_ps(t.matrix[0][3], t.matrix[1][3], t.matrix[2][3], 0.0f);
+
+  __attribute__((target("sse4.1"))) void Sse16(const ColorTransform &t, const uint16_t *in, std::size_t count, float *out, float scale)
+  {
+    LIBRAWJS_SSE_SETUP
+    std::size_t i = 0;
+    for (; i + 1 < count; i++)
+    {
+      __m128i px = _mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(in + 4 * i)));
+      LIBRAWJS_SSE_PIXEL(_mm_cvtepi32_ps(px))
+    }
+    ConvertScalar(t, in + 4 * i, count - i, out + 3 * i, scale);
+  }
+
+  __attribute__((target("sse4.1"))) void SseF(const ColorTransform &t, const float *in, std::size_t count, float *out, float scale)
+  {
+    LIBRAWJS_SSE_SETUP
+    std::size_t i = 0;
+    for (; i + 1 < count; i++)
+    {
+      LIBRAWJS_SSE_PIXEL(_mm_loadu_ps(in + 4 * i))
+    }
+    ConvertScalar(t, in + 4 * i, count - i, out + 3 * i, scale);
+  }
+
+  /*
+   * Two pixels per 256 bit vector, one per lane. The same overlapping
+   * stores as above, so the last pair is left to the scalar kernel.
+   */
+#define LIBRAWJS_AVX_PAIR(load)                                                                       \
+  __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(load, mul), zero), one);                       \
+  __m256 rgb = _mm256_mul_ps(c0, _mm256_permute_ps(v, _MM_SHUFFLE(0, 0, 0, 0)));                      \
+  rgb = _mm256_fmadd_ps(c1, _mm256_permute_ps(v, _MM_SHUFFLE(1, 1, 1, 1)), rgb);                      \
+  rgb = _mm256_fmadd_ps(c2, _mm256_permute_ps(v, _MM_SHUFFLE(2, 2, 2, 2)), rgb);                      \
+  rgb = _mm256_fmadd_ps(c3, _mm256_permute_ps(v, _MM_SHUFFLE(3, 3, 3, 3)), rgb);                      \
+  rgb = _mm256_mul_ps(_mm256_min_ps(_mm256_max_ps(rgb, zero), one), scale8);                          \
+  _mm_storeu_ps(out + 3 * i, _mm256_castps256_ps128(rgb));                                            \
+  _mm_storeu_ps(out + 3 * i + 3, _mm256_extractf128_ps(rgb, 1));
+
+#define LIBRAWJS_AVX_SETUP                                                                             \
+  const __m256 zero = _mm256_setzero_ps();                                                             \
+  const __m256 one = _mm256_set1_ps(1.0f);                                                             \
+  const __m256 scale8 = _mm256_set1_ps(scale);                                                         \
+  const __m256 mul = _mm256_broadcast_ps(reinterpret_cast<const __m128 *>(t.mul));                     \
+  const __m256 c0 = _mm256_setr_ps(t.matrix[0][0], t.matrix[1][0], t.matrix[2][0], 0.0f,               \
+                                   t.matrix[0][0], t.matrix[1][0], t.matrix[2][0], 0.0f);              \
+  const __m256 c1 = _mm256_setr_ps(t.matrix[0][1], t.matrix[1][1], t.matrix[2][1], 0.0f,               \
+                                   t.matrix[0][1], t.matrix[1][1], t.matrix[2][1], 0.0f);              \
+  const __m256 c2 = _mm256_setr_ps(t.matrix[0][2], t.matrix[1][2], t.matrix[2][2], 0.0f,               \
+                                   t.matrix[0][2], t.matrix[1][2], t.matrix[2][2], 0.0f);              \
+  const __m256 c3 = _mm256_setr_ps(t.matrix[0][3], t.matrix[1][3], t.matrix[2][3], 0.0f,               \
+                                   t.matrix[0][3], t.matrix[1][3], t.matrix[2][3], 0.0f);
+
+  __attribute__((target("avx2,fma"))) void Avx16(const ColorTransform &t, const uint16_t *in, std::size_t count, float *out, float scale)
+  {
+    LIBRAWJS_AVX_SETUP
+    std::size_t i = 0;
+    for (; i + 2 < count; i += 2)
+    {
+      __m256i px = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(in + 4 * i)));
+      LIBRAWJS_AVX_PAIR(_mm256_cvtepi32_ps(px))
+    }
+    ConvertScalar(t, in + 4 * i, count - i, out + 3 * i, scale);
+  }
+
+  __attribute__((target("avx2,fma"))) void AvxF(const ColorTransform &t, const float *in, std::size_t count, float *out, float scale)
+  {
+    LIBRAWJS_AVX_SETUP
+    std::size_t i = 0;
+    for (; i + 2 < count; i += 2)
+    {
+      LIBRAWJS_AVX_PAIR(_mm256_loadu_ps(in + 4 * i))
+    }
+    ConvertScalar(t, in + 4 * i, count - i, out + 3 * i, scale);
+  }
+#endif
+
+  struct Kernels
+  {
+    const char *name;
+    Kernel16 u16;
+    KernelF f32;
+    bool available;
+  };
+
+  Kernels *KernelTable()
+  {
+    static Kernels table[] = {
+#ifdef LIBRAWJS_X86_KERNELS
+        {"avx2", Avx16, AvxF, __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")},
+        {"sse4.1", Sse16, SseF, __builtin_cpu_supports("sse4.1") != 0},
+#endif
+        {"scalar", Scalar16, ScalarF, true},
+        {nullptr, nullptr, nullptr, false},
+    };
+    return table;
+  }
+
+  /* the best available set, or the one named by LIBRAWJS_COLOR_ENGINE */
+  const Kernels *Detect()
+  {
+    const char *forced = std::getenv("LIBRAWJS_COLOR_ENGINE");
+    const Kernels *best = nullptr;
+    for (Kernels *k = KernelTable(); k->name; k++)
+    {
+      if (!k->available)
+      {
+        continue;
+      }
+      if (forced && std::strcmp(k->name, forced) == 0)
+      {
+        return k;
+      }
+      if (!best)
+      {
+        best = k;
+      }
+    }
+    return best;
+  }
+
+  // switched by `ColorEngineSelect` while pool threads may be converting
+  std::atomic<const Kernels *> &Active()
+  {
+    static std::atomic<const Kernels *> active{Detect()};
+    return active;
+  }
+
+  const Kernels *Current()
+  {
+    return Active().load(std::memory_order_acquire);
+  }
+
+  template <typename In, typename Out>
+  void ConvertLut(const ColorTransform &t, const In *in, std::size_t count, Out *out, const Out *lut,
+                  void (*kernel)(const ColorTransform &, const In *, std::size_t, float *, float))
+  {
+    float block[kBlock * 3];
+    for (std::size_t done = 0; done < count; done += kBlock)
+    {
+      std::size_t n = std::min(kBlock, count - done);
+      kernel(t, in + 4 * done, n, block, static_cast<float>(kLutSize - 1));
+      Out *dst = out + 3 * done;
+      for (std::size_t i = 0; i < n * 3; i++)
+      {
+        dst[i] = lut[static_cast<std::size_t>(block[i] + 0.5f)];
+      }
+    }
+  }
+
+  float Bt709(float v)
+  {
+    return v < 0.018f ? v * 4.5f : 1.099f * std::pow(v, 0.45f) - 0.099f;
+  }
+
+  struct Bt709Tables
+  {
+    std::vector<uint16_t> bits16;
+    std::vector<uint8_t> bits8;
+    std::vector<float> curve;
+
+    Bt709Tables() : bits16(kLutSize), bits8(kLutSize), curve(kLutSize)
+    {
+      for (std::size_t i = 0; i < kLutSize; i++)
+      {
+        float v = Bt709(static_cast<float>(i) / (kLutSize - 1));
+        this->curve[i] = v;
+        this->bits16[i] = static_cast<uint16_t>(std::lround(v * 65535.0f));
+        this->bits8[i] = static_cast<uint8_t>(std::lround(v * 255.0f));
+      }
+    }
+  };
+
+  const Bt709Tables &Tables()
+  {
+    static const Bt709Tables tables;
+    return tables;
+  }
+}
+
+void ColorConvert(const ColorTransform &transform, const uint16_t *in, std::size_t count, float *out)
+{
+  Current()->u16(transform, in, count, out, 1.0f);
+}
+
+void ColorConvert(const ColorTransform &transform, const float *in, std::size_t count, float *out)
+{
+  Current()->f32(transform, in, count, out, 1.0f);
+}
+
+void ColorConvert(const ColorTransform &transform, const uint16_t *in, std::size_t count, uint16_t *out, const uint16_t *lut)
+{
+  ConvertLut(transform, in, count, out, lut, Current()->u16);
+}
+
+void ColorConvert(const ColorTransform &transform, const float *in, std::size_t count, uint16_t *out, const uint16_t *lut)
+{
+  ConvertLut(transform, in, count, out, lut, Current()->f32);
+}
+
+void ColorConvert(const ColorTransform &transform, const float *in, std::size_t count, uint8_t *out, const uint8_t *lut)
+{
+  ConvertLut(transform, in, count, out, lut, Current()->f32);
+}
+
+const uint16_t *Bt709Lut16()
+{
+  return Tables().bits16.data();
+}
+
+const uint8_t *Bt709Lut8()
+{
+  return Tables().bits8.data();
+}
+
+const float *Bt709LutFloat()
+{
+  return Tables().curve.data();
+}
+
+const char *ColorEngineIsa()
+{
+  return Current()->name;
+}
+
+bool ColorEngineSelect(const char *isa)
+{
+  for (Kernels *k = KernelTable(); k->name; k++)
+  {
+    if (k->available && std::strcmp(k->name, isa) == 0)
+    {
+      Active().store(k, std::memory_order_release);
+      return true;
+    }
+  }
+  return false;
+}
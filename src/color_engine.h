@@ -0,0 +1,75 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_COLOR_ENGINE_H
+#define LIBRAWJS_COLOR_ENGINE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Shared color conversion used by every rendering path of the addon.
+ *
+ * A conversion takes interleaved four channel camera values (the layout of
+ * LibRaw's `image` buffer) and in a single pass scales every channel by its
+ * multiplier (white balance and input range), clips to [0, 1], applies the
+ * 3x4 camera to RGB matrix (`rgb_cam`), clips again and either stores the
+ * linear result or maps it through a 65536 entry gamma table.
+ *
+ * The per pixel math runs in SSE4.1 or AVX2/FMA kernels, picked once at
+ * runtime from the CPU's features, with a scalar fallback for other CPUs.
+ * Table lookups are fused in blocks that stay in L1 cache. Setting
+ * LIBRAWJS_COLOR_ENGINE to a kernel set name forces that set if available.
+ */
+
+struct ColorTransform
+{
+  // input multipliers, e.g. white balance / (maximum - black)
+  float mul[4];
+  // camera to RGB, unused columns must be 0
+  float matrix[3][4];
+};
+
+/* linear RGB in [0, 1] */
+void ColorConvert(const ColorTransform &transform, const uint16_t *in, std::size_t count, float *out);
+void ColorConvert(const ColorTransform &transform, const float *in, std::size_t count, float *out);
+
+/* gamma encoded RGB through `lut`, indexed by linear value * 65535 */
+void ColorConvert(const ColorTransform &transform, const uint16_t *in, std::size_t count, uint16_t *out, const uint16_t *lut);
+void ColorConvert(const ColorTransform &transform, const float *in, std::size_t count, uint16_t *out, const uint16_t *lut);
+void ColorConvert(const ColorTransform &transform, const float *in, std::size_t count, uint8_t *out, const uint8_t *lut);
+
+/*
+ * BT.709 curve (LibRaw's default output gamma) as lookup tables, built once
+ * per process.
+ */
+const uint16_t *Bt709Lut16();
+const uint8_t *Bt709Lut8();
+const float *Bt709LutFloat();
+
+/* name of the kernel set in use: "avx2", "sse4.1" or "scalar" */
+const char *ColorEngineIsa();
+
+/* overrides the detected kernel set, returns false if it is not available */
+bool ColorEngineSelect(const char *isa);
+
+#endif
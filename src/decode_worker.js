@@ -0,0 +1,77 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+'use strict';
+
+// Entry point of the child processes started by `DecodeWorkers`, see
+// decode_workers.ts. Plain JavaScript so it runs both from `src` and from
+// `dist` without compiling: it only needs the native addon.
+
+const path = require('path');
+const nodeGypBuild = require('node-gyp-build');
+
+const { LibRawWrapper } = nodeGypBuild(path.join(__dirname, '..'));
+
+// result fields carried through the shared-memory ring
+const SHARED_FIELDS = ['thumbnail', 'xmp'];
+
+const [ringFd, waitMs] = process.argv.slice(2).map(Number);
+const ring = LibRawWrapper.ringAttach(ringFd);
+const libraw = new LibRawWrapper();
+
+process.on('message', async ({ id, filename, options }) => {
+  let result;
+  try {
+    libraw.set_priority(options.priority ?? 'normal');
+    result = await libraw.extract(filename, options);
+  } catch (e) {
+    process.send({ id, error: e instanceof Error ? e.message : String(e) });
+    return;
+  }
+
+  const fields = SHARED_FIELDS.filter((field) => result[field]);
+  const buffers = fields.map((field) => result[field]);
+  const written =
+    buffers.length > 0
+      ? LibRawWrapper.ringWrite(ring, buffers, waitMs)
+      : undefined;
+  if (!written) {
+    // empty or no room in time: the buffers are copied over the channel
+    process.send({ id, result });
+    return;
+  }
+  for (const field of fields) {
+    delete result[field];
+  }
+  process.send({
+    id,
+    result,
+    shared: {
+      record: written.record,
+      fields,
+      spans: buffers.map((buffer, i) => [written.offsets[i], buffer.byteLength]),
+    },
+  });
+});
+
+// the parent starts timing calls from here
+process.send({ ready: true });
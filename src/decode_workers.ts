@@ -0,0 +1,373 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+import { ChildProcess, fork } from 'child_process';
+import * as os from 'os';
+import * as path from 'path';
+import nodeGypBuild from 'node-gyp-build';
+import type { ExtractOptions, ExtractResult } from './libraw';
+
+const librawAddon = nodeGypBuild(path.join(__dirname, '..'));
+
+// next to this file both in `src` and in `dist`
+const WORKER_PATH = path.join(__dirname, 'decode_worker.js');
+
+// result fields the workers return through shared memory
+const SHARED_FIELDS = ['thumbnail', 'xmp'];
+
+export interface DecodeWorkerOptions {
+  /** Number of worker processes. Defaults to the number of CPUs. */
+  workers?: number;
+  /**
+   * Shared memory per worker for returned thumbnails and XMP packets.
+   * Defaults to 64 MiB.
+   */
+  ringBytes?: number;
+  /**
+   * How long a worker waits for the parent to free ring space before it
+   * copies a result over its IPC channel instead, in milliseconds.
+   * Defaults to 100.
+   */
+  ringWaitMs?: number;
+  /**
+   * Kills a worker whose call runs longer, in milliseconds, counted from
+   * when the worker is ready to decode, so starting a worker does not count
+   * against its first call. 0 disables the limit. Defaults to 60000.
+   */
+  timeout?: number;
+}
+
+export interface DecodeWorkerStats {
+  workers: number;
+  busy: number;
+  queued: number;
+  /** workers that died while decoding */
+  crashes: number;
+  /** workers killed for exceeding the timeout */
+  timeouts: number;
+  /** results whose buffers were returned through shared memory */
+  shared: number;
+  /** results whose buffers were copied over the IPC channel */
+  copied: number;
+}
+
+interface Call {
+  filename: string;
+  options: ExtractOptions;
+  resolve: (result: ExtractResult) => void;
+  reject: (error: Error) => void;
+}
+
+interface Worker {
+  child: ChildProcess;
+  ring: unknown;
+  exited: Promise<void>;
+  call?: Call & { id: number };
+  timer?: NodeJS.Timeout;
+  timedOut: boolean;
+  // set once the child has loaded the addon
+  ready: boolean;
+}
+
+interface Reply {
+  // sent once by a child that finished starting, without an id
+  ready?: boolean;
+  id: number;
+  error?: string;
+  result?: Record<string, unknown>;
+  shared?: { record: number; fields: string[]; spans: [number, number][] };
+}
+
+function positiveInteger(value: number, name: string): number {
+  if (!Number.isInteger(value) || value < 1) {
+    throw new TypeError(`${name} must be a positive integer`);
+  }
+  return value;
+}
+
+/**
+ * Runs {@link LibRaw.extract} in supervised child processes, so a crash or
+ * hang inside LibRaw on a malformed file costs one worker instead of the
+ * whole process.
+ *
+ * Each worker gets a shared-memory ring. Thumbnails and XMP packets are
+ * written there by the worker and returned as Buffers over the mapping,
+ * without being copied or serialized; only the small remainder of each
+ * result travels over the IPC channel. Ring space is reclaimed when those
+ * Buffers are garbage collected, so copy the ones you keep for long.
+ *
+ * A worker that exits or times out rejects its call and is replaced by the
+ * next call. Workers do not keep the process alive while idle; call
+ * {@link DecodeWorkers.close} to stop them.
+ */
+export class DecodeWorkers {
+  private size: number;
+  private ringBytes: number;
+  private ringWaitMs: number;
+  private timeout: number;
+  private workers: Worker[] = [];
+  private idle: Worker[] = [];
+  private queue: Call[] = [];
+  private nextId = 0;
+  private closed = false;
+  private counts = { crashes: 0, timeouts: 0, shared: 0, copied: 0 };
+
+  constructor(options: DecodeWorkerOptions = {}) {
+    this.size = positiveInteger(
+      options.workers ?? os.cpus().length,
+      'workers'
+    );
+    this.ringBytes = positiveInteger(
+      options.ringBytes ?? 64 * 1024 * 1024,
+      'ringBytes'
+    );
+    this.ringWaitMs = options.ringWaitMs ?? 100;
+    this.timeout = options.timeout ?? 60000;
+    if (!Number.isInteger(this.ringWaitMs) || this.ringWaitMs < 0) {
+      throw new TypeError('ringWaitMs must be a non-negative integer');
+    }
+    if (!Number.isInteger(this.timeout) || this.timeout < 0) {
+      throw new TypeError('timeout must be a non-negative integer');
+    }
+  }
+
+  /**
+   * Extracts a file in a worker, see {@link LibRaw.extract}. Rejects if
+   * the file cannot be read or parsed, or if the worker dies or times out.
+   * @param filename the file path to open
+   * @param options the parts to extract
+   */
+  extract(
+    filename: string,
+    options: ExtractOptions = {}
+  ): Promise<ExtractResult> {
+    if (this.closed) {
+      return Promise.reject(new Error('decode workers are closed'));
+    }
+    return new Promise((resolve, reject) => {
+      this.queue.push({ filename, options, resolve, reject });
+      this.dispatch();
+    });
+  }
+
+  stats(): DecodeWorkerStats {
+    return {
+      workers: this.workers.length,
+      busy: this.workers.length - this.idle.length,
+      queued: this.queue.length,
+      ...this.counts,
+    };
+  }
+
+  /**
+   * Rejects queued calls, lets running ones finish and stops the workers.
+   */
+  async close(): Promise<void> {
+    this.closed = true;
+    for (const call of this.queue.splice(0)) {
+      call.reject(new Error('decode workers are closed'));
+    }
+    const exited = this.workers.map((worker) => worker.exited);
+    for (const worker of this.idle) {
+      worker.child.disconnect();
+    }
+    await Promise.all(exited);
+  }
+
+  private dispatch(): void {
+    while (this.queue.length > 0) {
+      let worker = this.idle.pop();
+      if (!worker) {
+        if (this.workers.length >= this.size) {
+          return;
+        }
+        worker = this.spawn();
+      }
+      this.send(worker, this.queue.shift() as Call);
+    }
+  }
+
+  private spawn(): Worker {
+    const { fd, ring } = librawAddon.LibRawWrapper.ringCreate(this.ringBytes);
+    // the ring becomes descriptor 4 of the child, after the IPC channel
+    const child = fork(WORKER_PATH, ['4', String(this.ringWaitMs)], {
+      stdio: ['ignore', 'inherit', 'inherit', 'ipc', fd],
+      serialization: 'advanced',
+    });
+    const worker: Worker = {
+      child,
+      ring,
+      exited: new Promise((resolve) => child.once('exit', () => resolve())),
+      timedOut: false,
+      ready: false,
+    };
+    child.on('message', (reply: Reply) => this.receive(worker, reply));
+    child.on('exit', (code, signal) => this.exit(worker, code, signal));
+    // failed sends surface as an exit
+    child.on('error', () => child.kill('SIGKILL'));
+    this.workers.push(worker);
+    return worker;
+  }
+
+  private send(worker: Worker, call: Call): void {
+    worker.call = { ...call, id: this.nextId++ };
+    this.setBusy(worker, true);
+    // a starting child queues the call, its timer starts once it is ready
+    if (worker.ready) {
+      this.startTimer(worker);
+    }
+    worker.child.send({
+      id: worker.call.id,
+      filename: call.filename,
+      options: call.options,
+    });
+  }
+
+  private startTimer(worker: Worker): void {
+    if (this.timeout > 0) {
+      worker.timer = setTimeout(() => {
+        worker.timedOut = true;
+        worker.child.kill('SIGKILL');
+      }, this.timeout);
+    }
+  }
+
+  private receive(worker: Worker, reply: Reply): void {
+    if (reply?.ready === true && !worker.ready) {
+      worker.ready = true;
+      if (worker.call) {
+        this.startTimer(worker);
+      }
+      return;
+    }
+    const call = worker.call;
+    if (!call || !reply || reply.id !== call.id) {
+      // the worker cannot be trusted anymore, its exit rejects the call
+      worker.child.kill('SIGKILL');
+      return;
+    }
+    if (worker.timer) {
+      clearTimeout(worker.timer);
+    }
+    worker.call = undefined;
+    try {
+      call.resolve(this.decode(worker, reply));
+    } catch (e) {
+      call.reject(e instanceof Error ? e : new Error(String(e)));
+      if (reply.error === undefined) {
+        worker.child.kill('SIGKILL');
+        return;
+      }
+    }
+
+    if (this.closed) {
+      worker.child.disconnect();
+      return;
+    }
+    this.setBusy(worker, false);
+    this.idle.push(worker);
+    this.dispatch();
+  }
+
+  private decode(worker: Worker, reply: Reply): ExtractResult {
+    if (reply.error !== undefined) {
+      throw new Error(reply.error);
+    }
+    const result = reply.result;
+    if (typeof result !== 'object' || result === null) {
+      throw new Error('decode worker sent an invalid result');
+    }
+    // buffers sent over the channel arrive as plain Uint8Arrays
+    for (const field of SHARED_FIELDS) {
+      const value = result[field];
+      if (value instanceof Uint8Array && !Buffer.isBuffer(value)) {
+        result[field] = Buffer.from(
+          value.buffer,
+          value.byteOffset,
+          value.byteLength
+        );
+      }
+    }
+    const shared = reply.shared;
+    if (!shared) {
+      this.counts.copied++;
+      return result as ExtractResult;
+    }
+    if (
+      !Array.isArray(shared.fields) ||
+      !Array.isArray(shared.spans) ||
+      shared.fields.length !== shared.spans.length ||
+      !shared.fields.every((field) => SHARED_FIELDS.includes(field))
+    ) {
+      throw new Error('decode worker sent an invalid result');
+    }
+    const buffers: Buffer[] = librawAddon.LibRawWrapper.ringView(
+      worker.ring,
+      shared.record,
+      shared.spans
+    );
+    shared.fields.forEach((field, i) => {
+      result[field] = buffers[i];
+    });
+    this.counts.shared++;
+    return result as ExtractResult;
+  }
+
+  private exit(
+    worker: Worker,
+    code: number | null,
+    signal: NodeJS.Signals | null
+  ): void {
+    this.workers = this.workers.filter((other) => other !== worker);
+    this.idle = this.idle.filter((other) => other !== worker);
+    if (worker.timer) {
+      clearTimeout(worker.timer);
+    }
+    const call = worker.call;
+    if (call) {
+      worker.call = undefined;
+      if (worker.timedOut) {
+        this.counts.timeouts++;
+      } else {
+        this.counts.crashes++;
+      }
+      const reason = worker.timedOut
+        ? 'timed out'
+        : `exited (${signal ?? code})`;
+      call.reject(
+        new Error(`decode worker ${reason} extracting ${call.filename}`)
+      );
+    }
+    this.dispatch();
+  }
+
+  // idle workers must not keep the event loop alive
+  private setBusy(worker: Worker, busy: boolean): void {
+    if (busy) {
+      worker.child.ref();
+      worker.child.channel?.ref();
+    } else {
+      worker.child.unref();
+      worker.child.channel?.unref();
+    }
+  }
+}
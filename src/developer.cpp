@@ -0,0 +1,371 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "developer.h"
+#include "color_engine.h"
+#include "parallel.h"
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+  const int kBorder = 2;
+  // smallest box that holds every color of a Bayer or X-Trans pattern
+  const int kMinBin = 3;
+  /*
+   * Mean of the pixels of `color` within `radius` of (row, col), or a
+   * negative value if there are none.
+   */
+  float Average(const float *lin, const int8_t *colors, int stride, int row, int col, int color, int radius)
+  {
+    float sum = 0;
+    int count = 0;
+    for (int r = row - radius; r <= row + radius; r++)
+    {
+      for (int c = col - radius; c <= col + radius; c++)
+      {
+        if (colors[r * stride + c] == color)
+        {
+          sum += lin[r * stride + c];
+          count++;
+        }
+      }
+    }
+    return count ? sum / count : -1.0f;
+  }
+}
+
+int RawDeveloper::Init(bool inset)
+{
+  libraw_data_t &imgdata = this->processor_->imgdata;
+  const libraw_colordata_t &color = imgdata.rawdata.color;
+  const libraw_image_sizes_t &sizes = imgdata.sizes;
+
+  if (!imgdata.rawdata.raw_alloc)
+  {
+    return LIBRAW_OUT_OF_ORDER_CALL;
+  }
+  if (!imgdata.rawdata.raw_image || !imgdata.idata.filters || imgdata.idata.colors < 3)
+  {
+    return LIBRAW_FILE_UNSUPPORTED;
+  }
+
+  this->raw_ = imgdata.rawdata.raw_image;
+  this->pitch_ = sizes.raw_pitch / sizeof(uint16_t);
+  this->topMargin_ = sizes.top_margin;
+  this->leftMargin_ = sizes.left_margin;
+  this->visibleWidth_ = sizes.width;
+  this->visibleHeight_ = sizes.height;
+  this->width_ = sizes.width;
+  this->height_ = sizes.height;
+  this->originX_ = 0;
+  this->originY_ = 0;
+  this->colors_ = imgdata.idata.colors;
+
+  // inset crops are relative to the full raw frame
+  const libraw_raw_inset_crop_t &crop = sizes.raw_inset_crops[0];
+  if (inset && crop.cwidth && crop.cheight && crop.cleft != 0xffff && crop.ctop != 0xffff)
+  {
+    int left = std::max(crop.cleft - sizes.left_margin, 0);
+    int top = std::max(crop.ctop - sizes.top_margin, 0);
+    this->originX_ = std::min(left, this->visibleWidth_);
+    this->originY_ = std::min(top, this->visibleHeight_);
+    this->width_ = std::min<int>(crop.cwidth, this->visibleWidth_ - this->originX_);
+    this->height_ = std::min<int>(crop.cheight, this->visibleHeight_ - this->originY_);
+  }
+
+  const float *wb = color.cam_mul[0] > 0 && color.cam_mul[1] > 0 ? color.cam_mul : color.pre_mul;
+  float balance[4] = {wb[0], wb[1], wb[2], wb[3] > 0 ? wb[3] : wb[1]};
+  float least = *std::min_element(balance, balance + 4);
+  if (!(least > 0))
+  {
+    std::fill(balance, balance + 4, 1.0f);
+    least = 1.0f;
+  }
+  for (int c = 0; c < 4; c++)
+  {
+    this->black_[c] = static_cast<float>(color.black + color.cblack[c]);
+    float range = std::max(static_cast<float>(color.maximum) - this->black_[c], 1.0f);
+    this->mul_[c] = balance[c] / least / range;
+    this->transform_.mul[c] = 1.0f;
+    for (int i = 0; i < 3; i++)
+    {
+      // samples are already scaled, only the matrix is left to apply
+      this->transform_.matrix[i][c] = c < this->colors_ ? color.rgb_cam[i][c] : 0.0f;
+    }
+  }
+  this->patternRows_ = color.cblack[4];
+  this->patternCols_ = color.cblack[5];
+  this->pattern_ = this->patternRows_ && this->patternCols_ ? color.cblack + 6 : nullptr;
+  return LIBRAW_SUCCESS;
+}
+
+bool RawDeveloper::Contains(const Region &region) const
+{
+  return region.x >= 0 && region.y >= 0 && region.width > 0 && region.height > 0 &&
+         region.x <= this->width_ - region.width && region.y <= this->height_ - region.height;
+}
+
+float RawDeveloper::BlackAt(int color, int row, int col) const
+{
+  float black = this->black_[color];
+  if (this->pattern_)
+  {
+    black += this->pattern_[(row % this->patternRows_) * this->patternCols_ + col % this->patternCols_];
+  }
+  return black;
+}
+
+void RawDeveloper::DevelopRows(const Region &region, int first, int last, float *out) const
+{
+  int top = this->originY_ + region.y + first - kBorder;
+  int left = this->originX_ + region.x - kBorder;
+  int rows = last - first + 2 * kBorder;
+  int cols = region.width + 2 * kBorder;
+
+  std::vector<float> lin(static_cast<std::size_t>(rows) * cols);
+  std::vector<int8_t> colors(lin.size());
+  this->LoadSamples(top, left, rows, cols, lin.data(), colors.data());
+
+  for (int r = kBorder; r < rows - kBorder; r++)
+  {
+    for (int c = kBorder; c < cols - kBorder; c++)
+    {
+      int center = r * cols + c;
+      float *cam = out;
+      out += 4;
+      std::fill(cam, cam + 4, 0.0f);
+      for (int k = 0; k < this->colors_; k++)
+      {
+        float v = colors[center] == k ? lin[center] : Average(lin.data(), colors.data(), cols, r, c, k, 1);
+        if (v < 0)
+        {
+          v = Average(lin.data(), colors.data(), cols, r, c, k, 2);
+        }
+        cam[k] = v;
+      }
+    }
+  }
+}
+
+void RawDeveloper::LoadSamples(int top, int left, int rows, int cols, float *lin, int8_t *colors) const
+{
+  for (int r = 0; r < rows; r++)
+  {
+    int row = top + r;
+    float *linRow = lin + static_cast<std::size_t>(r) * cols;
+    int8_t *colorRow = colors + static_cast<std::size_t>(r) * cols;
+    std::fill(linRow, linRow + cols, 0.0f);
+    std::fill(colorRow, colorRow + cols, -1);
+    if (row < 0 || row >= this->visibleHeight_)
+    {
+      continue;
+    }
+    const uint16_t *src = this->raw_ + (row + this->topMargin_) * this->pitch_ + this->leftMargin_;
+    for (int c = 0; c < cols; c++)
+    {
+      int col = left + c;
+      if (col < 0 || col >= this->visibleWidth_)
+      {
+        continue;
+      }
+      int fc = this->processor_->COLOR(row, col) & 3;
+      float v = src[col] - this->BlackAt(fc, row, col);
+      linRow[c] = v > 0 ? v * this->mul_[fc] : 0.0f;
+      // three color sensors mark the second green as color 3
+      colorRow[c] = static_cast<int8_t>(this->colors_ == 3 && fc == 3 ? 1 : fc);
+    }
+  }
+}
+
+void RawDeveloper::RenderLinear(const Region &region, int width, int height, float *rgb) const
+{
+  if (region.width >= kMinBin * width && region.height >= kMinBin * height)
+  {
+    // large reductions: average every CFA color over the source box, which
+    // demosaics and resamples in one step
+    ParallelFor(height, 4, [&](std::size_t first, std::size_t last)
+                {
+      std::vector<float> lin;
+      std::vector<int8_t> colors;
+      std::vector<float> cams(static_cast<std::size_t>(width) * 4);
+      for (std::size_t y = first; y < last; y++)
+      {
+        int top = region.y + static_cast<int>(y * region.height / height);
+        int rows = region.y + static_cast<int>((y + 1) * region.height / height) - top;
+        lin.resize(static_cast<std::size_t>(rows) * region.width);
+        colors.resize(lin.size());
+        this->LoadSamples(this->originY_ + top, this->originX_ + region.x, rows, region.width, lin.data(), colors.data());
+        for (int x = 0; x < width; x++)
+        {
+          int left = static_cast<int>(static_cast<std::size_t>(x) * region.width / width);
+          int right = static_cast<int>(static_cast<std::size_t>(x + 1) * region.width / width);
+          float sum[4] = {};
+          int count[4] = {};
+          for (int r = 0; r < rows; r++)
+          {
+            for (int c = left; c < right; c++)
+            {
+              int8_t k = colors[r * region.width + c];
+              if (k < 0)
+              {
+                continue;
+              }
+              sum[k] += lin[r * region.width + c];
+              count[k]++;
+            }
+          }
+          for (int k = 0; k < 4; k++)
+          {
+            cams[x * 4 + k] = count[k] ? sum[k] / count[k] : 0.0f;
+          }
+        }
+        ColorConvert(this->transform_, cams.data(), width, rgb + y * width * 3);
+      } });
+    return;
+  }
+
+  // small reductions and enlargements: develop at full resolution and
+  // sample bilinearly at pixel centers
+  std::vector<float> full(static_cast<std::size_t>(region.width) * region.height * 3);
+  ParallelFor(region.height, 16, [&](std::size_t first, std::size_t last)
+              {
+    std::vector<float> cams((last - first) * region.width * 4);
+    this->DevelopRows(region, static_cast<int>(first), static_cast<int>(last), cams.data());
+    ColorConvert(this->transform_, cams.data(), (last - first) * region.width, full.data() + first * region.width * 3); });
+  ParallelFor(height, 16, [&](std::size_t first, std::size_t last)
+              {
+    for (std::size_t y = first; y < last; y++)
+    {
+      float sy = std::min(std::max((y + 0.5f) * region.height / height - 0.5f, 0.0f), region.height - 1.0f);
+      int y0 = static_cast<int>(sy);
+      int y1 = std::min(y0 + 1, region.height - 1);
+      float fy = sy - y0;
+      for (int x = 0; x < width; x++)
+      {
+        float sx = std::min(std::max((x + 0.5f) * region.width / width - 0.5f, 0.0f), region.width - 1.0f);
+        int x0 = static_cast<int>(sx);
+        int x1 = std::min(x0 + 1, region.width - 1);
+        float fx = sx - x0;
+        const float *p00 = &full[(static_cast<std::size_t>(y0) * region.width + x0) * 3];
+        const float *p01 = &full[(static_cast<std::size_t>(y0) * region.width + x1) * 3];
+        const float *p10 = &full[(static_cast<std::size_t>(y1) * region.width + x0) * 3];
+        const float *p11 = &full[(static_cast<std::size_t>(y1) * region.width + x1) * 3];
+        float *dst = rgb + (y * width + x) * 3;
+        for (int i = 0; i < 3; i++)
+        {
+          float a = p00[i] + (p01[i] - p00[i]) * fx;
+          float b = p10[i] + (p11[i] - p10[i]) * fx;
+          dst[i] = a + (b - a) * fy;
+        }
+      }
+    } });
+}
+
+void RawDeveloper::RenderPreview(int maxSize, int &width, int &height, std::vector<char> &rgb) const
+{
+  double scale = std::min(1.0, static_cast<double>(maxSize) / std::max(this->width_, this->height_));
+  width = std::max(1, static_cast<int>(this->width_ * scale));
+  height = std::max(1, static_cast<int>(this->height_ * scale));
+
+  std::size_t samples = static_cast<std::size_t>(width) * height * 3;
+  std::vector<float> linear(samples);
+  this->RenderLinear(Region{0, 0, this->width_, this->height_}, width, height, linear.data());
+  rgb.resize(samples);
+  const uint8_t *lut = Bt709Lut8();
+  for (std::size_t i = 0; i < samples; i++)
+  {
+    rgb[i] = static_cast<char>(lut[static_cast<std::size_t>(linear[i] * 65535.0f + 0.5f)]);
+  }
+}
+
+void RawDeveloper::RenderTensor(const Region &region, const TensorOptions &options, float *out) const
+{
+  std::size_t pixels = static_cast<std::size_t>(options.width) * options.height;
+  std::vector<float> rgb(pixels * 3);
+  this->RenderLinear(region, options.width, options.height, rgb.data());
+
+  float factor[3];
+  float bias[3];
+  for (int c = 0; c < 3; c++)
+  {
+    factor[c] = 1.0f / options.std[c];
+    bias[c] = -options.mean[c] * factor[c];
+  }
+  const float *curve = options.linear ? nullptr : Bt709LutFloat();
+  ParallelFor(pixels, 4096, [&](std::size_t first, std::size_t last)
+              {
+    float *src = rgb.data() + first * 3;
+    std::size_t count = last - first;
+    // locals, so the compiler need not reload them after every store
+    const float f0 = factor[0], f1 = factor[1], f2 = factor[2];
+    const float b0 = bias[0], b1 = bias[1], b2 = bias[2];
+    // the table lookups get their own pass, so the normalization below is
+    // plain multiply-adds without branches that the compiler vectorizes
+    if (curve)
+    {
+      for (std::size_t i = 0; i < count * 3; i++)
+      {
+        src[i] = curve[static_cast<std::size_t>(src[i] * 65535.0f + 0.5f)];
+      }
+    }
+    if (options.planar)
+    {
+      float *r = out + first;
+      float *g = r + pixels;
+      float *b = g + pixels;
+      for (std::size_t i = 0; i < count; i++)
+      {
+        r[i] = src[i * 3] * f0 + b0;
+        g[i] = src[i * 3 + 1] * f1 + b1;
+        b[i] = src[i * 3 + 2] * f2 + b2;
+      }
+    }
+    else
+    {
+      float *dst = out + first * 3;
+      for (std::size_t i = 0; i < count; i++)
+      {
+        dst[i * 3] = src[i * 3] * f0 + b0;
+        dst[i * 3 + 1] = src[i * 3 + 1] * f1 + b1;
+        dst[i * 3 + 2] = src[i * 3 + 2] * f2 + b2;
+      }
+    } });
+}
+
+void RawDeveloper::Render(const Region &region, unsigned bits, char *out) const
+{
+  std::size_t rowPixels = static_cast<std::size_t>(region.width);
+  ParallelFor(region.height, 16, [&](std::size_t first, std::size_t last)
+              {
+    std::vector<float> cams((last - first) * rowPixels * 4);
+    this->DevelopRows(region, static_cast<int>(first), static_cast<int>(last), cams.data());
+    std::size_t offset = first * rowPixels * 3;
+    if (bits == 16)
+    {
+      ColorConvert(this->transform_, cams.data(), cams.size() / 4, reinterpret_cast<uint16_t *>(out) + offset, Bt709Lut16());
+    }
+    else
+    {
+      ColorConvert(this->transform_, cams.data(), cams.size() / 4, reinterpret_cast<uint8_t *>(out) + offset, Bt709Lut8());
+    } });
+}
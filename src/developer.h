@@ -0,0 +1,123 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_DEVELOPER_H
+#define LIBRAWJS_DEVELOPER_H
+
+#include <cstdint>
+#include <vector>
+#include "color_engine.h"
+#include "libraw/libraw.h"
+
+/*
+ * A rectangle in the coordinates of a `RawDeveloper`'s addressable area.
+ */
+struct Region
+{
+  int x;
+  int y;
+  int width;
+  int height;
+};
+
+/*
+ * Shape and normalization of a float tensor. Samples are
+ * `(value - mean[c]) / std[c]`, where value is in [0, 1] and either linear
+ * or gamma encoded.
+ */
+struct TensorOptions
+{
+  int width;
+  int height;
+  bool planar;
+  bool linear;
+  float mean[3];
+  float std[3];
+};
+
+/*
+ * Develops arbitrary rectangles straight from an unpacked `raw_image`.
+ *
+ * LibRaw's own pipeline (`dcraw_process`) always works on the whole frame
+ * and allocates a four channel copy of it first. This one reads only the
+ * requested rows and columns plus a two pixel border, subtracts the black
+ * level, applies the as-shot white balance, demosaics bilinearly and
+ * converts to sRGB with the camera matrix (`rgb_cam`). Output is gamma
+ * encoded with the BT.709 curve LibRaw uses by default, without automatic
+ * brightening, and is not rotated by `sizes.flip`.
+ *
+ * Coordinates address the visible area (`sizes.width` x `sizes.height`),
+ * or the camera's default crop (`sizes.raw_inset_crops[0]`) when asked to
+ * and when the file has one. Bayer and X-Trans sensors are supported.
+ *
+ * `Init` reads the processor's state; the processor must not be modified
+ * while the developer is in use.
+ */
+class RawDeveloper
+{
+public:
+  explicit RawDeveloper(LibRaw *processor) : processor_(processor) {}
+
+  // returns a LibRaw error code
+  int Init(bool inset);
+
+  int Width() const { return this->width_; }
+  int Height() const { return this->height_; }
+  bool Contains(const Region &region) const;
+
+  // writes interleaved RGB with 8 or 16 (native endian) bits per sample
+  void Render(const Region &region, unsigned bits, char *out) const;
+  // linear interleaved RGB of `region` resampled to `width` x `height`
+  void RenderLinear(const Region &region, int width, int height, float *rgb) const;
+  // writes a CHW (planar) or HWC tensor of `region`
+  void RenderTensor(const Region &region, const TensorOptions &options, float *out) const;
+  // 8 bit RGB of the whole area, scaled so the longer side is at most `maxSize`
+  void RenderPreview(int maxSize, int &width, int &height, std::vector<char> &rgb) const;
+
+private:
+  // demosaiced camera values, four per pixel, of rows [first, last) of `region`
+  void DevelopRows(const Region &region, int first, int last, float *out) const;
+  float BlackAt(int color, int row, int col) const;
+  // black subtracted, white balanced samples and their CFA colors, -1 outside the image
+  void LoadSamples(int top, int left, int rows, int cols, float *lin, int8_t *colors) const;
+
+  LibRaw *processor_;
+  const uint16_t *raw_ = nullptr;
+  std::size_t pitch_ = 0;
+  int topMargin_ = 0;
+  int leftMargin_ = 0;
+  int visibleWidth_ = 0;
+  int visibleHeight_ = 0;
+  int originX_ = 0;
+  int originY_ = 0;
+  int width_ = 0;
+  int height_ = 0;
+  int colors_ = 3;
+  float black_[4] = {};
+  float mul_[4] = {};
+  ColorTransform transform_ = {};
+  unsigned patternRows_ = 0;
+  unsigned patternCols_ = 0;
+  const unsigned *pattern_ = nullptr;
+};
+
+#endif
@@ -0,0 +1,566 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "encoder.h"
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+extern "C"
+{
+#include <jpeglib.h>
+}
+
+namespace
+{
+  // rows handed to libjpeg at once, large enough to keep the parallel
+  // renderer busy and small enough to stay a fraction of the image
+  const int JpegBandRows = 256;
+  // profile bytes per APP2 marker, 65533 less the 14 byte marker header
+  const std::size_t IccChunk = 65519;
+
+  struct JpegError
+  {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+    char message[JMSG_LENGTH_MAX];
+  };
+
+  void OnJpegError(j_common_ptr info)
+  {
+    JpegError *error = reinterpret_cast<JpegError *>(info->err);
+    error->manager.format_message(info, error->message);
+    std::longjmp(error->jump, 1);
+  }
+
+  void IgnoreJpegMessage(j_common_ptr, int) {}
+
+  // compressed output grows in place, so the result can be handed to JS
+  // without another copy
+  struct VectorDestination
+  {
+    jpeg_destination_mgr manager;
+    std::vector<char> *bytes;
+  };
+
+  void InitDestination(j_compress_ptr info)
+  {
+    VectorDestination *dest = reinterpret_cast<VectorDestination *>(info->dest);
+    dest->manager.next_output_byte = reinterpret_cast<JOCTET *>(dest->bytes->data());
+    dest->manager.free_in_buffer = dest->bytes->size();
+  }
+
+  boolean GrowDestination(j_compress_ptr info)
+  {
+    VectorDestination *dest = reinterpret_cast<VectorDestination *>(info->dest);
+    std::size_t used = dest->bytes->size();
+    dest->bytes->resize(used * 2);
+    dest->manager.next_output_byte = reinterpret_cast<JOCTET *>(dest->bytes->data() + used);
+    dest->manager.free_in_buffer = dest->bytes->size() - used;
+    return TRUE;
+  }
+
+  void TermDestination(j_compress_ptr info)
+  {
+    VectorDestination *dest = reinterpret_cast<VectorDestination *>(info->dest);
+    dest->bytes->resize(dest->bytes->size() - dest->manager.free_in_buffer);
+  }
+
+  class JpegEncoder : public ImageEncoder
+  {
+  public:
+    JpegEncoder(int width, int height) : width_(width), height_(height) {}
+
+    ~JpegEncoder() override
+    {
+      if (this->created_)
+      {
+        jpeg_destroy_compress(&this->info_);
+      }
+    }
+
+    bool Start(const EncodeSettings &settings)
+    {
+      this->info_.err = jpeg_std_error(&this->jpegError_.manager);
+      this->jpegError_.manager.error_exit = OnJpegError;
+      this->jpegError_.manager.emit_message = IgnoreJpegMessage;
+
+      // declared before setjmp so a longjmp does not skip its destructor
+      std::vector<JOCTET> marker;
+      if (setjmp(this->jpegError_.jump))
+      {
+        return this->Fail();
+      }
+      jpeg_create_compress(&this->info_);
+      this->created_ = true;
+
+      // roughly what a high quality JPEG takes, grown as needed
+      this->bytes_.resize(std::max<std::size_t>(static_cast<std::size_t>(this->width_) * this->height_ / 2, 1 << 16));
+      this->dest_.bytes = &this->bytes_;
+      this->dest_.manager.init_destination = InitDestination;
+      this->dest_.manager.empty_output_buffer = GrowDestination;
+      this->dest_.manager.term_destination = TermDestination;
+      this->info_.dest = &this->dest_.manager;
+
+      this->info_.image_width = this->width_;
+      this->info_.image_height = this->height_;
+      this->info_.input_components = 3;
+      this->info_.in_color_space = JCS_RGB;
+      jpeg_set_defaults(&this->info_);
+      jpeg_set_quality(&this->info_, settings.quality, TRUE);
+      jpeg_start_compress(&this->info_, TRUE);
+
+      std::size_t chunks = (settings.icc.size() + IccChunk - 1) / IccChunk;
+      for (std::size_t i = 0; i < chunks; i++)
+      {
+        std::size_t begin = i * IccChunk;
+        std::size_t size = std::min(IccChunk, settings.icc.size() - begin);
+        static const char tag[] = "ICC_PROFILE";
+        marker.assign(tag, tag + sizeof(tag));
+        marker.push_back(static_cast<JOCTET>(i + 1));
+        marker.push_back(static_cast<JOCTET>(chunks));
+        marker.insert(marker.end(), settings.icc.begin() + begin, settings.icc.begin() + begin + size);
+        jpeg_write_marker(&this->info_, JPEG_APP0 + 2, marker.data(), static_cast<unsigned>(marker.size()));
+      }
+      return true;
+    }
+
+    int BandRows() const override { return JpegBandRows; }
+
+    char *Band(int rows) override
+    {
+      this->band_.resize(static_cast<std::size_t>(rows) * this->width_ * 3);
+      return this->band_.data();
+    }
+
+    bool Write(int rows) override
+    {
+      this->rows_.resize(rows);
+      for (int i = 0; i < rows; i++)
+      {
+        this->rows_[i] = reinterpret_cast<JSAMPROW>(this->band_.data() + static_cast<std::size_t>(i) * this->width_ * 3);
+      }
+      if (setjmp(this->jpegError_.jump))
+      {
+        return this->Fail();
+      }
+      JDIMENSION written = 0;
+      while (written < static_cast<JDIMENSION>(rows))
+      {
+        written += jpeg_write_scanlines(&this->info_, this->rows_.data() + written, rows - written);
+      }
+      return true;
+    }
+
+    bool Finish(std::vector<char> &out) override
+    {
+      if (setjmp(this->jpegError_.jump))
+      {
+        return this->Fail();
+      }
+      jpeg_finish_compress(&this->info_);
+      out = std::move(this->bytes_);
+      return true;
+    }
+
+  private:
+    bool Fail()
+    {
+      this->error_ = std::string("libjpeg failed: ") + this->jpegError_.message;
+      return false;
+    }
+
+    int width_;
+    int height_;
+    bool created_ = false;
+    jpeg_compress_struct info_;
+    JpegError jpegError_;
+    VectorDestination dest_;
+    std::vector<char> bytes_;
+    std::vector<char> band_;
+    std::vector<JSAMPROW> rows_;
+  };
+
+  /*
+   * Samples are written by the renderer in host order, so the whole file
+   * uses host order and the header says which one that is.
+   */
+  class TiffEncoder : public ImageEncoder
+  {
+  public:
+    TiffEncoder(const EncodeSettings &settings, int width, int height)
+        : stride_(static_cast<std::size_t>(width) * 3 * (settings.bits / 8)), height_(height)
+    {
+      TiffWriter writer;
+      Describe(writer, settings, width, height);
+      this->dataAt_ = writer.Layout(this->file_, this->stride_ * height);
+    }
+
+    static bool Fits(const EncodeSettings &settings, int width, int height)
+    {
+      TiffWriter writer;
+      Describe(writer, settings, width, height);
+      return writer.Fits(static_cast<std::size_t>(width) * height * 3 * (settings.bits / 8));
+    }
+
+    int BandRows() const override { return this->height_; }
+
+    char *Band(int) override
+    {
+      return this->file_.data() + this->dataAt_ + this->rows_ * this->stride_;
+    }
+
+    bool Write(int rows) override
+    {
+      this->rows_ += rows;
+      return true;
+    }
+
+    bool Finish(std::vector<char> &out) override
+    {
+      if (this->rows_ != static_cast<std::size_t>(this->height_))
+      {
+        this->error_ = "the image is incomplete";
+        return false;
+      }
+      out = std::move(this->file_);
+      return true;
+    }
+
+  private:
+    static void Describe(TiffWriter &writer, const EncodeSettings &settings, int width, int height)
+    {
+      uint16_t bits = static_cast<uint16_t>(settings.bits);
+      writer.Long(256, {static_cast<uint32_t>(width)});
+      writer.Long(257, {static_cast<uint32_t>(height)});
+      writer.Long(278, {static_cast<uint32_t>(height)});
+      writer.Short(258, {bits, bits, bits});
+      // uncompressed, RGB, interleaved
+      writer.Short(259, {1});
+      writer.Short(262, {2});
+      writer.Short(277, {3});
+      writer.Short(284, {1});
+      // 300 dpi
+      writer.Rational(282, {300, 1});
+      writer.Rational(283, {300, 1});
+      writer.Short(296, {2});
+      if (!settings.icc.empty())
+      {
+        writer.Add(34675, TiffUndefined, static_cast<uint32_t>(settings.icc.size()), settings.icc.data(), settings.icc.size());
+      }
+    }
+
+    std::size_t stride_;
+    int height_;
+    std::size_t dataAt_;
+    std::size_t rows_ = 0;
+    std::vector<char> file_;
+  };
+
+  // ICC data is always big endian
+  void PutBe32(std::vector<char> &out, uint32_t value)
+  {
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  void PutBe16(std::vector<char> &out, uint16_t value)
+  {
+    out.push_back(static_cast<char>(value >> 8));
+    out.push_back(static_cast<char>(value));
+  }
+
+  void PutSignature(std::vector<char> &out, const char *signature)
+  {
+    out.insert(out.end(), signature, signature + 4);
+  }
+
+  void PutXyz(std::vector<char> &out, double x, double y, double z)
+  {
+    for (double v : {x, y, z})
+    {
+      PutBe32(out, static_cast<uint32_t>(static_cast<int32_t>(std::lround(v * 65536))));
+    }
+  }
+
+  void Align4(std::vector<char> &out)
+  {
+    out.resize((out.size() + 3) & ~static_cast<std::size_t>(3));
+  }
+
+  std::vector<char> BuildRenderedIccProfile()
+  {
+    struct Tag
+    {
+      const char *signature;
+      std::vector<char> data;
+    };
+    std::vector<Tag> tags;
+
+    // ICC v2 profiles describe themselves with textDescriptionType, whose
+    // Unicode and ScriptCode parts may be empty
+    const char description[] = "BT.709 RGB (libraw.js)";
+    std::vector<char> desc;
+    PutSignature(desc, "desc");
+    PutBe32(desc, 0);
+    PutBe32(desc, sizeof(description));
+    desc.insert(desc.end(), description, description + sizeof(description));
+    desc.resize(desc.size() + 4 + 4 + 2 + 1 + 67);
+    tags.push_back({"desc", desc});
+
+    const char copyright[] = "No copyright, use freely";
+    std::vector<char> cprt;
+    PutSignature(cprt, "text");
+    PutBe32(cprt, 0);
+    cprt.insert(cprt.end(), copyright, copyright + sizeof(copyright));
+    tags.push_back({"cprt", cprt});
+
+    // sRGB primaries and white, Bradford adapted to the D50 of the PCS
+    const double colorants[4][3] = {
+        {0.9642, 1.0, 0.8249},
+        {0.4360747, 0.2225045, 0.0139322},
+        {0.3850649, 0.7168786, 0.0971045},
+        {0.1430804, 0.0606169, 0.7141733},
+    };
+    const char *xyzTags[4] = {"wtpt", "rXYZ", "gXYZ", "bXYZ"};
+    for (int i = 0; i < 4; i++)
+    {
+      std::vector<char> xyz;
+      PutSignature(xyz, "XYZ ");
+      PutBe32(xyz, 0);
+      PutXyz(xyz, colorants[i][0], colorants[i][1], colorants[i][2]);
+      tags.push_back({xyzTags[i], xyz});
+    }
+
+    // the inverse of the curve the renderer applies, encoded to linear
+    const uint32_t points = 1024;
+    std::vector<char> curve;
+    PutSignature(curve, "curv");
+    PutBe32(curve, 0);
+    PutBe32(curve, points);
+    for (uint32_t i = 0; i < points; i++)
+    {
+      double v = static_cast<double>(i) / (points - 1);
+      double linear = v < 0.081 ? v / 4.5 : std::pow((v + 0.099) / 1.099, 1 / 0.45);
+      PutBe16(curve, static_cast<uint16_t>(std::lround(std::min(linear, 1.0) * 65535)));
+    }
+    for (const char *signature : {"rTRC", "gTRC", "bTRC"})
+    {
+      tags.push_back({signature, curve});
+    }
+
+    std::vector<char> profile;
+    profile.resize(128);
+    PutBe32(profile, static_cast<uint32_t>(tags.size()));
+    std::size_t table = profile.size();
+    profile.resize(table + tags.size() * 12);
+    std::size_t offset = 0;
+    for (std::size_t i = 0; i < tags.size(); i++)
+    {
+      // the three curves are identical and share their data
+      if (i == 0 || tags[i].data != tags[i - 1].data)
+      {
+        Align4(profile);
+        offset = profile.size();
+        profile.insert(profile.end(), tags[i].data.begin(), tags[i].data.end());
+      }
+      std::vector<char> entry;
+      PutSignature(entry, tags[i].signature);
+      PutBe32(entry, static_cast<uint32_t>(offset));
+      PutBe32(entry, static_cast<uint32_t>(tags[i].data.size()));
+      std::copy(entry.begin(), entry.end(), profile.begin() + table + i * 12);
+    }
+    Align4(profile);
+
+    std::vector<char> header;
+    PutBe32(header, static_cast<uint32_t>(profile.size()));
+    PutBe32(header, 0);
+    PutBe32(header, 0x02100000);
+    PutSignature(header, "mntr");
+    PutSignature(header, "RGB ");
+    PutSignature(header, "XYZ ");
+    // 2021-01-01 00:00:00
+    for (uint16_t field : {2021, 1, 1, 0, 0, 0})
+    {
+      PutBe16(header, field);
+    }
+    PutSignature(header, "acsp");
+    header.resize(64);
+    // perceptual intent, D50 illuminant
+    PutBe32(header, 0);
+    PutXyz(header, 0.9642, 1.0, 0.8249);
+    std::copy(header.begin(), header.end(), profile.begin());
+    return profile;
+  }
+}
+
+void TiffWriter::Add(uint16_t tag, TiffType type, uint32_t count, const void *values, std::size_t size)
+{
+  const char *bytes = static_cast<const char *>(values);
+  this->entries_.push_back({tag, type, count, std::vector<char>(bytes, bytes + size)});
+}
+
+void TiffWriter::Short(uint16_t tag, const std::vector<uint16_t> &values)
+{
+  this->Add(tag, TiffShort, static_cast<uint32_t>(values.size()), values.data(), values.size() * sizeof(uint16_t));
+}
+
+void TiffWriter::Long(uint16_t tag, const std::vector<uint32_t> &values)
+{
+  this->Add(tag, TiffLong, static_cast<uint32_t>(values.size()), values.data(), values.size() * sizeof(uint32_t));
+}
+
+void TiffWriter::Rational(uint16_t tag, const std::vector<uint32_t> &values)
+{
+  this->Add(tag, TiffRational, static_cast<uint32_t>(values.size() / 2), values.data(), values.size() * sizeof(uint32_t));
+}
+
+void TiffWriter::SRational(uint16_t tag, const std::vector<int32_t> &values)
+{
+  this->Add(tag, TiffSRational, static_cast<uint32_t>(values.size() / 2), values.data(), values.size() * sizeof(int32_t));
+}
+
+void TiffWriter::Ascii(uint16_t tag, const std::string &text)
+{
+  this->Add(tag, TiffAscii, static_cast<uint32_t>(text.size() + 1), text.c_str(), text.size() + 1);
+}
+
+bool TiffWriter::Fits(std::size_t imageBytes) const
+{
+  // header, directory with the strip tags, and values
+  uint64_t size = 8 + 2 + (this->entries_.size() + 2) * 12 + 4 + 16;
+  for (const Entry &entry : this->entries_)
+  {
+    size += entry.values.size() + 1;
+  }
+  return size + imageBytes <= std::numeric_limits<uint32_t>::max();
+}
+
+std::size_t TiffWriter::Layout(std::vector<char> &file, std::size_t imageBytes)
+{
+  TiffWriter strip = *this;
+  uint32_t stripBytes = static_cast<uint32_t>(imageBytes);
+  // the offset is filled in below
+  strip.Long(273, {0});
+  strip.Long(279, {stripBytes});
+  std::vector<Entry> &entries = strip.entries_;
+  std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b)
+            { return a.tag < b.tag; });
+
+  // values that do not fit in their entry follow the directory, word aligned
+  const std::size_t ifd = 8;
+  std::size_t end = ifd + 2 + entries.size() * 12 + 4;
+  std::vector<std::size_t> at(entries.size());
+  for (std::size_t i = 0; i < entries.size(); i++)
+  {
+    if (entries[i].values.size() > 4)
+    {
+      at[i] = end;
+      end = (end + entries[i].values.size() + 1) & ~static_cast<std::size_t>(1);
+    }
+  }
+  std::size_t dataAt = (end + 15) & ~static_cast<std::size_t>(15);
+  file.assign(dataAt + imageBytes, 0);
+
+  auto put16 = [&](std::size_t offset, uint16_t value)
+  { std::memcpy(file.data() + offset, &value, sizeof(value)); };
+  auto put32 = [&](std::size_t offset, uint32_t value)
+  { std::memcpy(file.data() + offset, &value, sizeof(value)); };
+
+  const uint16_t probe = 1;
+  file[0] = file[1] = *reinterpret_cast<const char *>(&probe) == 1 ? 'I' : 'M';
+  put16(2, 42);
+  put32(4, ifd);
+  put16(ifd, static_cast<uint16_t>(entries.size()));
+  for (std::size_t i = 0; i < entries.size(); i++)
+  {
+    const Entry &entry = entries[i];
+    std::size_t offset = ifd + 2 + i * 12;
+    put16(offset, entry.tag);
+    put16(offset + 2, entry.type);
+    put32(offset + 4, entry.count);
+    if (entry.tag == 273)
+    {
+      put32(offset + 8, static_cast<uint32_t>(dataAt));
+    }
+    else if (entry.values.size() <= 4)
+    {
+      // left justified in the entry
+      std::copy(entry.values.begin(), entry.values.end(), file.begin() + offset + 8);
+    }
+    else
+    {
+      put32(offset + 8, static_cast<uint32_t>(at[i]));
+      std::copy(entry.values.begin(), entry.values.end(), file.begin() + at[i]);
+    }
+  }
+  put32(ifd + 2 + entries.size() * 12, 0);
+  return dataAt;
+}
+
+std::unique_ptr<ImageEncoder> CreateEncoder(const EncodeSettings &settings, int width, int height, std::string &error)
+{
+  if (settings.format == ImageFormat::Jpeg)
+  {
+    if (settings.bits != 8)
+    {
+      error = "JPEG only supports 8 bit samples";
+      return nullptr;
+    }
+    if (width > JPEG_MAX_DIMENSION || height > JPEG_MAX_DIMENSION)
+    {
+      error = "the image is too large for JPEG";
+      return nullptr;
+    }
+    if ((settings.icc.size() + IccChunk - 1) / IccChunk > 255)
+    {
+      error = "the ICC profile is too large for JPEG";
+      return nullptr;
+    }
+    std::unique_ptr<JpegEncoder> encoder(new JpegEncoder(width, height));
+    if (!encoder->Start(settings))
+    {
+      error = encoder->Error();
+      return nullptr;
+    }
+    return encoder;
+  }
+
+  if (!TiffEncoder::Fits(settings, width, height))
+  {
+    error = "the image is too large for TIFF";
+    return nullptr;
+  }
+  return std::unique_ptr<ImageEncoder>(new TiffEncoder(settings, width, height));
+}
+
+const std::vector<char> &RenderedIccProfile()
+{
+  static const std::vector<char> profile = BuildRenderedIccProfile();
+  return profile;
+}
@@ -0,0 +1,135 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_ENCODER_H
+#define LIBRAWJS_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Writes developed images straight into a compressed or container format,
+ * a band of rows at a time, so a full size uncompressed copy of the image
+ * never has to exist next to the encoded one.
+ *
+ * JPEG output is 8 bit baseline through libjpeg. TIFF output is baseline
+ * uncompressed RGB with 8 or 16 bits per sample in the host's byte order,
+ * written in place: its bands point into the file being produced. An ICC
+ * profile, when given, is embedded as APP2 markers or the ICC tag.
+ */
+enum class ImageFormat
+{
+  Jpeg,
+  Tiff,
+};
+
+struct EncodeSettings
+{
+  ImageFormat format;
+  // 8 or 16, JPEG only supports 8
+  unsigned bits;
+  // JPEG quality, 1 to 100
+  int quality;
+  std::vector<char> icc;
+};
+
+class ImageEncoder
+{
+public:
+  virtual ~ImageEncoder() = default;
+
+  // most rows a band may hold
+  virtual int BandRows() const = 0;
+  // where the next `rows` rows of interleaved RGB are to be written
+  virtual char *Band(int rows) = 0;
+  // encodes the band returned by the last call to `Band`
+  virtual bool Write(int rows) = 0;
+  // completes the file once every row has been written
+  virtual bool Finish(std::vector<char> &out) = 0;
+
+  const std::string &Error() const { return this->error_; }
+
+protected:
+  std::string error_;
+};
+
+/*
+ * Returns nullptr and sets `error` if the image cannot be represented in
+ * the requested format.
+ */
+std::unique_ptr<ImageEncoder> CreateEncoder(const EncodeSettings &settings, int width, int height, std::string &error);
+
+enum TiffType : uint16_t
+{
+  TiffByte = 1,
+  TiffAscii = 2,
+  TiffShort = 3,
+  TiffLong = 4,
+  TiffRational = 5,
+  TiffUndefined = 7,
+  TiffSRational = 10,
+};
+
+/*
+ * Lays out a TIFF file with a single directory and a single strip, in the
+ * host's byte order so image data can be written into it as is. Tags may
+ * be added in any order; StripOffsets and StripByteCounts are added by
+ * `Layout`.
+ */
+class TiffWriter
+{
+public:
+  void Add(uint16_t tag, TiffType type, uint32_t count, const void *values, std::size_t size);
+  void Short(uint16_t tag, const std::vector<uint16_t> &values);
+  void Long(uint16_t tag, const std::vector<uint32_t> &values);
+  // numerator and denominator pairs
+  void Rational(uint16_t tag, const std::vector<uint32_t> &values);
+  void SRational(uint16_t tag, const std::vector<int32_t> &values);
+  void Ascii(uint16_t tag, const std::string &text);
+
+  // whether `imageBytes` of data fit the 32 bit offsets of a TIFF file
+  bool Fits(std::size_t imageBytes) const;
+  // sizes `file` for `imageBytes` of strip data and returns its offset
+  std::size_t Layout(std::vector<char> &file, std::size_t imageBytes);
+
+private:
+  struct Entry
+  {
+    uint16_t tag;
+    TiffType type;
+    uint32_t count;
+    std::vector<char> values;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+/*
+ * ICC profile of the addon's rendered colors: sRGB primaries with the
+ * BT.709 curve, built once per process.
+ */
+const std::vector<char> &RenderedIccProfile();
+
+#endif
@@ -0,0 +1,270 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "exif_tags.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// bytes per value of each TIFF field type, 0 for types we do not read
+const unsigned TYPE_SIZES[] = {0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8, 4};
+
+/*
+ * LibRaw passes EXIF IFD tags as they are and tags of other directories
+ * with the directory in the upper bits: the TIFF IFD index plus one from
+ * bit 20 (or 0x30000 for the Panasonic raw IFD), 0x10000 and 0x20000 for
+ * makernotes, 0x40000 for interoperability and 0x50000 for GPS.
+ */
+ExifGroup GroupOf(int tag)
+{
+  if (tag >> 20)
+  {
+    return ExifGroup::Tiff;
+  }
+  switch (tag >> 16)
+  {
+  case 0:
+    return ExifGroup::Exif;
+  case 1:
+  case 2:
+    return ExifGroup::Makernote;
+  case 3:
+    return ExifGroup::Tiff;
+  case 4:
+    return ExifGroup::Interop;
+  case 5:
+    return ExifGroup::Gps;
+  default:
+    return ExifGroup::Any;
+  }
+}
+
+bool Matches(ExifGroup requested, ExifGroup group)
+{
+  if (requested == ExifGroup::Any)
+  {
+    return group == ExifGroup::Tiff || group == ExifGroup::Exif;
+  }
+  return requested == group;
+}
+
+uint64_t ReadUnsigned(const unsigned char *p, unsigned size, bool little)
+{
+  uint64_t value = 0;
+  for (unsigned i = 0; i < size; i++)
+  {
+    value |= static_cast<uint64_t>(p[little ? i : size - 1 - i]) << (8 * i);
+  }
+  return value;
+}
+
+double ReadNumber(const unsigned char *p, int type, bool little)
+{
+  switch (type)
+  {
+  case 1:
+    return p[0];
+  case 6:
+    return static_cast<int8_t>(p[0]);
+  case 3:
+    return static_cast<uint16_t>(ReadUnsigned(p, 2, little));
+  case 8:
+    return static_cast<int16_t>(ReadUnsigned(p, 2, little));
+  case 4:
+  case 13:
+    return static_cast<uint32_t>(ReadUnsigned(p, 4, little));
+  case 9:
+    return static_cast<int32_t>(ReadUnsigned(p, 4, little));
+  case 5:
+  case 10:
+  {
+    uint32_t num = static_cast<uint32_t>(ReadUnsigned(p, 4, little));
+    uint32_t den = static_cast<uint32_t>(ReadUnsigned(p + 4, 4, little));
+    if (type == 10)
+    {
+      return den ? static_cast<double>(static_cast<int32_t>(num)) / static_cast<int32_t>(den) : 0;
+    }
+    return den ? static_cast<double>(num) / den : 0;
+  }
+  case 11:
+  {
+    uint32_t bits = static_cast<uint32_t>(ReadUnsigned(p, 4, little));
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+  case 12:
+  {
+    uint64_t bits = ReadUnsigned(p, 8, little);
+    double d;
+    std::memcpy(&d, &bits, sizeof(d));
+    return d;
+  }
+  default:
+    return 0;
+  }
+}
+} // namespace
+
+bool ExifTagCollector::ParseRequest(const std::string &spec, ExifTagRequest &request)
+{
+  static const struct
+  {
+    const char *name;
+    ExifGroup group;
+  } groups[] = {
+      {"tiff", ExifGroup::Tiff},
+      {"exif", ExifGroup::Exif},
+      {"makernote", ExifGroup::Makernote},
+      {"gps", ExifGroup::Gps},
+      {"interop", ExifGroup::Interop},
+  };
+
+  std::size_t colon = spec.find(':');
+  if (colon == std::string::npos)
+  {
+    return false;
+  }
+  std::string name = spec.substr(0, colon);
+  const char *number = spec.c_str() + colon + 1;
+  char *end;
+  unsigned long tag = std::strtoul(number, &end, 0);
+  if (end == number || *end != '\0' || tag > 0xffff)
+  {
+    return false;
+  }
+  for (const auto &group : groups)
+  {
+    if (name == group.name)
+    {
+      request.key = spec;
+      request.group = group.group;
+      request.tag = static_cast<uint16_t>(tag);
+      return true;
+    }
+  }
+  return false;
+}
+
+void ExifTagCollector::Callback(void *context, int tag, int type, int len, unsigned int ord, void *ifp, INT64 /* base */)
+{
+  static_cast<ExifTagCollector *>(context)->Collect(tag, type, len, ord, static_cast<LibRaw_abstract_datastream *>(ifp));
+}
+
+void ExifTagCollector::SetRequests(std::vector<ExifTagRequest> requests)
+{
+  this->requests_ = std::move(requests);
+  this->Reset();
+}
+
+void ExifTagCollector::Reset()
+{
+  this->values_.assign(this->requests_.size(), ExifTagValue());
+  this->remaining_ = this->requests_.size();
+}
+
+void ExifTagCollector::Append(const std::vector<ExifTagRequest> &requests)
+{
+  this->requests_.insert(this->requests_.end(), requests.begin(), requests.end());
+  this->Reset();
+}
+
+ExifTagCollector ExifTagCollector::Detach(std::size_t count)
+{
+  ExifTagCollector detached;
+  detached.requests_.assign(this->requests_.begin() + count, this->requests_.end());
+  detached.values_.assign(this->values_.begin() + count, this->values_.end());
+  this->requests_.resize(count);
+  this->values_.resize(count);
+  this->remaining_ = 0;
+  for (const ExifTagValue &value : this->values_)
+  {
+    this->remaining_ += value.found ? 0 : 1;
+  }
+  return detached;
+}
+
+void ExifTagCollector::Collect(int tag, int type, int len, unsigned int ord, LibRaw_abstract_datastream *stream)
+{
+  if (this->remaining_ == 0 || type <= 0 || type >= static_cast<int>(sizeof(TYPE_SIZES) / sizeof(TYPE_SIZES[0])) ||
+      !TYPE_SIZES[type] || len <= 0)
+  {
+    return;
+  }
+  ExifGroup group = GroupOf(tag);
+  uint16_t id = static_cast<uint16_t>(tag & 0xffff);
+
+  std::vector<unsigned char> data;
+  for (std::size_t i = 0; i < this->requests_.size(); i++)
+  {
+    const ExifTagRequest &request = this->requests_[i];
+    ExifTagValue &value = this->values_[i];
+    if (value.found || request.tag != id || !Matches(request.group, group))
+    {
+      continue;
+    }
+
+    if (data.empty())
+    {
+      std::size_t size = static_cast<std::size_t>(len) * TYPE_SIZES[type];
+      if (size > MaxValueSize)
+      {
+        return;
+      }
+      // the stream is positioned at the value, LibRaw continues from here
+      INT64 position = stream->tell();
+      data.resize(size);
+      std::size_t read = stream->read(data.data(), 1, size);
+      stream->seek(position, SEEK_SET);
+      if (read != size)
+      {
+        return;
+      }
+    }
+
+    value.found = true;
+    value.type = type;
+    if (type == 2)
+    {
+      value.text.assign(data.begin(), data.end());
+      value.text.resize(strnlen(value.text.c_str(), value.text.size()));
+    }
+    else if (type == 7)
+    {
+      value.bytes = data;
+    }
+    else
+    {
+      bool little = ord == 0x4949;
+      unsigned size = TYPE_SIZES[type];
+      value.numbers.resize(len);
+      for (int j = 0; j < len; j++)
+      {
+        value.numbers[j] = ReadNumber(data.data() + static_cast<std::size_t>(j) * size, type, little);
+      }
+    }
+    this->remaining_--;
+  }
+}
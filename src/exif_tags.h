@@ -0,0 +1,116 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_EXIF_TAGS_H
+#define LIBRAWJS_EXIF_TAGS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "libraw/libraw.h"
+
+/*
+ * Collects TIFF/EXIF tags that `libraw_data_t` does not model, through
+ * LibRaw's EXIF parser callback, so they are read by the same parse as the
+ * rest of the metadata.
+ *
+ * A request names a tag in one of LibRaw's tag groups; `Any` matches the
+ * TIFF IFDs and the EXIF IFD, which is where most tags of interest live.
+ * The first occurrence of a tag wins.
+ */
+
+enum class ExifGroup
+{
+  Any,
+  Tiff,
+  Exif,
+  Makernote,
+  Gps,
+  Interop,
+};
+
+struct ExifTagRequest
+{
+  // the name the value is reported under
+  std::string key;
+  ExifGroup group;
+  uint16_t tag;
+};
+
+struct ExifTagValue
+{
+  bool found = false;
+  // the TIFF field type, e.g. 2 for ASCII
+  int type = 0;
+  // ASCII
+  std::string text;
+  // UNDEFINED
+  std::vector<unsigned char> bytes;
+  // integer, rational and floating point types, in file order
+  std::vector<double> numbers;
+};
+
+class ExifTagCollector
+{
+public:
+  // values larger than this are skipped rather than copied
+  static const std::size_t MaxValueSize = 64 * 1024;
+
+  /*
+   * Parses `group:tag`, e.g. `makernote:0x0016` or `gps:2`, where group is
+   * one of tiff, exif, makernote, gps and interop. Returns false if it is
+   * malformed.
+   */
+  static bool ParseRequest(const std::string &spec, ExifTagRequest &request);
+
+  /*
+   * The `exif_parser_callback` to register with `set_exifparser_handler`,
+   * with the collector as context.
+   */
+  static void Callback(void *context, int tag, int type, int len, unsigned int ord, void *ifp, INT64 base);
+
+  void SetRequests(std::vector<ExifTagRequest> requests);
+  // forgets the values of the previous file, keeps the requests
+  void Reset();
+
+  /*
+   * `Append` adds requests after the current ones for the next file, and
+   * `Detach` moves every request past the first `count`, with its value,
+   * into a collector of its own. Together they collect a call's tags
+   * alongside the ones registered on an instance in a single parse.
+   */
+  void Append(const std::vector<ExifTagRequest> &requests);
+  ExifTagCollector Detach(std::size_t count);
+
+  const std::vector<ExifTagRequest> &Requests() const { return this->requests_; }
+  const std::vector<ExifTagValue> &Values() const { return this->values_; }
+
+private:
+  void Collect(int tag, int type, int len, unsigned int ord, LibRaw_abstract_datastream *stream);
+
+  std::vector<ExifTagRequest> requests_;
+  std::vector<ExifTagValue> values_;
+  std::size_t remaining_ = 0;
+};
+
+#endif
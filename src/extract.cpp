@@ -0,0 +1,289 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include <cstring>
+#include <vector>
+#include "async_job.h"
+#include "hash.h"
+#include "phash.h"
+#include "prefetch.h"
+#include "libraw_wrapper.h"
+#include "trace.h"
+#include "wraptypes.h"
+
+/*
+ * Opens a file and gathers everything an ingest step usually needs from it
+ * in a single trip to the worker pool.
+ *
+ * When a content hash is requested the file is memory mapped, hashed, and
+ * LibRaw parses it from the same mapping via its buffer datastream, so the
+ * bytes are only read from disk once. LibRaw seeks around the file while
+ * parsing, which is why the hash is not fed from its reads directly.
+ */
+class ExtractJob : public AsyncJob
+{
+public:
+  ExtractJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper, std::string filename, Napi::Object options,
+             std::vector<XmpField> xmpFields, std::vector<ExifTagRequest> exifTags)
+      : AsyncJob(info.Env(), "extract"), wrapper_(wrapper), filename_(std::move(filename)), xmpFields_(std::move(xmpFields)),
+        exifTags_(std::move(exifTags))
+  {
+    this->Retain(info.This().As<Napi::Object>());
+    this->metadata_ = Flag(options, "metadata", true);
+    this->thumbnail_ = Flag(options, "thumbnail", false);
+    this->xmp_ = Flag(options, "xmp", false);
+    this->hash_ = Flag(options, "hash", false);
+    this->perceptualHash_ = Flag(options, "perceptualHash", false);
+    this->readXmpFields_ = !options.Get("xmpFields").IsUndefined();
+    this->readExifTags_ = !options.Get("exifTags").IsUndefined();
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    TraceSpan::SetFile(this->filename_);
+
+    this->wrapper_->CloseInput();
+    // the tags registered with setExifTags stay the instance's, the call's
+    // own are collected in the same parse and taken out again
+    ExifTagCollector &exif = this->wrapper_->exif_;
+    std::size_t registered = exif.Requests().size();
+    if (this->readExifTags_)
+    {
+      exif.Append(this->exifTags_);
+    }
+
+    bool opened;
+    {
+      TraceSpan span("open");
+      opened = this->Open();
+    }
+    if (this->readExifTags_)
+    {
+      this->exif_ = exif.Detach(registered);
+    }
+    if (!opened)
+    {
+      return;
+    }
+    LibRaw *processor = this->wrapper_->processor_;
+    TraceSpan::SetModel(processor->imgdata.idata.make, processor->imgdata.idata.model);
+
+    if ((this->thumbnail_ || this->perceptualHash_) && this->wrapper_->LoadThumbnail() == LIBRAW_SUCCESS)
+    {
+      libraw_thumbnail_t &thumb = processor->imgdata.thumbnail;
+      if (this->thumbnail_ && thumb.thumb)
+      {
+        this->thumb_.assign(thumb.thumb, thumb.thumb + thumb.tlength);
+      }
+      // hashed while the thumbnail is at hand, without a second read
+      this->hasPerceptual_ = this->perceptualHash_ && HashThumbnail(thumb, this->perceptual_);
+    }
+    if (this->xmp_ && processor->imgdata.idata.xmpdata)
+    {
+      libraw_iparams_t &idata = processor->imgdata.idata;
+      this->xmpData_.assign(idata.xmpdata, idata.xmpdata + idata.xmplen);
+    }
+    if (this->readXmpFields_)
+    {
+      libraw_iparams_t &idata = processor->imgdata.idata;
+      ReadXmp(idata.xmpdata, idata.xmplen, this->xmpFields_, this->xmpValues_);
+    }
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    Napi::Object result = Napi::Object::New(env);
+
+    if (this->metadata_)
+    {
+      std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+      result.Set("metadata", WrapLibRawData(&env, &this->wrapper_->processor_->imgdata));
+    }
+    if (!this->thumb_.empty())
+    {
+      result.Set("thumbnail", MoveToBuffer(env, std::move(this->thumb_)));
+    }
+    if (!this->xmpData_.empty())
+    {
+      result.Set("xmp", MoveToBuffer(env, std::move(this->xmpData_)));
+    }
+    if (this->readExifTags_)
+    {
+      result.Set("exifTags", WrapExifTags(env, this->exif_));
+    }
+    if (this->readXmpFields_)
+    {
+      result.Set("xmpFields", WrapXmpFields(env, this->xmpFields_, this->xmpValues_));
+    }
+    if (this->hash_)
+    {
+      result.Set("hash", Xxh64::ToHex(this->digest_));
+    }
+    if (this->hasPerceptual_)
+    {
+      result.Set("dhash", Napi::BigInt::New(env, this->perceptual_.dhash));
+      result.Set("phash", Napi::BigInt::New(env, this->perceptual_.phash));
+    }
+
+    return result;
+  }
+
+private:
+  // opens the file on the wrapper, from the hot-file cache, a read-ahead buffer or disk
+  bool Open()
+  {
+    // a hit in the hot-file cache replaces the wrapper's processor
+    bool cached = this->wrapper_->OpenCached(this->filename_);
+    LibRaw *processor = this->wrapper_->processor_;
+
+    // a file hinted by a batch may have been read ahead already
+    PrefetchBuffer &prefetched = this->wrapper_->prefetched_;
+    bool ahead = false;
+    if (cached)
+    {
+      Prefetcher::Instance().Cancel(this->filename_);
+    }
+    else
+    {
+      ahead = Prefetcher::Instance().Take(this->filename_, prefetched);
+    }
+
+    int ret = LIBRAW_SUCCESS;
+    if (ahead)
+    {
+      if (this->hash_)
+      {
+        this->digest_ = Xxh64::Hash(prefetched.data.get(), prefetched.size);
+      }
+      TraceSpan span("parse");
+      ret = processor->open_buffer(prefetched.data.get(), prefetched.size);
+    }
+    else if (this->hash_)
+    {
+      MappedFile &mapped = this->wrapper_->mapped_;
+      // a cached processor may be reading from a mapping already
+      int err = mapped.Data() ? 0 : mapped.Open(this->filename_);
+      if (err)
+      {
+        this->SetError(std::string("extract could not read file: ") + std::strerror(err));
+        return false;
+      }
+      this->digest_ = Xxh64::Hash(mapped.Data(), mapped.Size());
+      if (!cached)
+      {
+        TraceSpan span("parse");
+        ret = processor->open_buffer(mapped.Data(), mapped.Size());
+      }
+      else if (!this->wrapper_->inputData_)
+      {
+        // mapped only to be hashed
+        mapped.Close();
+      }
+    }
+    else if (!cached)
+    {
+      TraceSpan span("parse");
+      ret = processor->open_file(this->filename_.c_str());
+    }
+    if (ret != LIBRAW_SUCCESS)
+    {
+      this->SetError(std::string("extract could not open file: ") + libraw_strerror(ret));
+      return false;
+    }
+    if (ahead)
+    {
+      // the buffer is not a mapping the hot-file cache could keep
+      this->wrapper_->inputData_ = prefetched.data.get();
+      this->wrapper_->inputSize_ = prefetched.size;
+    }
+    else if (!cached)
+    {
+      if (this->hash_)
+      {
+        this->wrapper_->inputData_ = this->wrapper_->mapped_.Data();
+        this->wrapper_->inputSize_ = this->wrapper_->mapped_.Size();
+      }
+      else
+      {
+        this->wrapper_->inputPath_ = this->filename_;
+      }
+      this->wrapper_->cacheable_ = !this->wrapper_->fileId_.path.empty();
+    }
+    return true;
+  }
+
+  static bool Flag(Napi::Object options, const char *name, bool fallback)
+  {
+    Napi::Value value = options.Get(name);
+    return value.IsUndefined() ? fallback : value.ToBoolean().Value();
+  }
+
+  LibRawWrapper *wrapper_;
+  std::string filename_;
+  bool metadata_;
+  bool thumbnail_;
+  bool xmp_;
+  bool hash_;
+  bool perceptualHash_;
+  bool hasPerceptual_ = false;
+  PerceptualHash perceptual_ = {};
+  uint64_t digest_ = 0;
+  std::vector<char> thumb_;
+  std::vector<char> xmpData_;
+  bool readXmpFields_;
+  bool readExifTags_;
+  std::vector<ExifTagRequest> exifTags_;
+  ExifTagCollector exif_;
+  std::vector<XmpField> xmpFields_;
+  std::vector<XmpValue> xmpValues_;
+};
+
+Napi::Value LibRawWrapper::Extract(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsString())
+  {
+    Napi::TypeError::New(env, "extract received an invalid argument, filename must be a string.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object options = info[1].IsObject() ? info[1].As<Napi::Object>() : Napi::Object::New(env);
+  std::vector<XmpField> xmpFields;
+  Napi::Value xmpSpec = options.Get("xmpFields");
+  if (!xmpSpec.IsUndefined() && !ReadXmpSpec(env, xmpSpec, "extract", xmpFields))
+  {
+    return env.Undefined();
+  }
+  std::vector<ExifTagRequest> exifTags;
+  Napi::Value exifSpec = options.Get("exifTags");
+  if (!exifSpec.IsUndefined() && !ReadExifTagSpec(env, exifSpec, "extract", exifTags))
+  {
+    return env.Undefined();
+  }
+  // the job closes any datastream over a previous `open_buffer` input first
+  this->buffer_.Reset();
+  return (new ExtractJob(info, this, info[0].As<Napi::String>().Utf8Value(), options, std::move(xmpFields),
+                         std::move(exifTags)))
+      ->Queue(this->priority_);
+}
@@ -0,0 +1,220 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "fd_datastream.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  const std::size_t kWindowSize = 64 * 1024;
+}
+
+FdDatastream::FdDatastream(int fd)
+    : fd_(dup(fd)), error_(0), size_(0), position_(0), window_(kWindowSize), windowStart_(0), windowLength_(0)
+{
+  struct stat st;
+  if (this->fd_ < 0)
+  {
+    this->error_ = errno;
+  }
+  else if (fstat(this->fd_, &st) != 0)
+  {
+    this->error_ = errno;
+  }
+  else
+  {
+    this->size_ = st.st_size;
+  }
+}
+
+FdDatastream::~FdDatastream()
+{
+  if (this->fd_ >= 0)
+  {
+    close(this->fd_);
+  }
+}
+
+int FdDatastream::valid()
+{
+  return this->fd_ >= 0 && this->error_ == 0;
+}
+
+bool FdDatastream::Fill(INT64 position)
+{
+  ssize_t n;
+  do
+  {
+    n = pread(this->fd_, this->window_.data(), this->window_.size(), position);
+  } while (n < 0 && errno == EINTR);
+  this->windowStart_ = position;
+  this->windowLength_ = n > 0 ? n : 0;
+  return n > 0;
+}
+
+int FdDatastream::read(void *ptr, size_t size, size_t nmemb)
+{
+  if (size == 0 || nmemb == 0)
+  {
+    return 0;
+  }
+  unsigned char *out = static_cast<unsigned char *>(ptr);
+  std::size_t wanted = size * nmemb;
+  std::size_t done = 0;
+
+  while (done < wanted && this->position_ < this->size_)
+  {
+    INT64 inWindow = this->position_ - this->windowStart_;
+    if (inWindow >= 0 && inWindow < (INT64)this->windowLength_)
+    {
+      std::size_t n = std::min(wanted - done, this->windowLength_ - (std::size_t)inWindow);
+      std::memcpy(out + done, this->window_.data() + inWindow, n);
+      done += n;
+      this->position_ += n;
+    }
+    else if (wanted - done >= this->window_.size())
+    {
+      // large reads (strips, tiles) bypass the window
+      ssize_t n = pread(this->fd_, out + done, wanted - done, this->position_);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        break;
+      }
+      done += n;
+      this->position_ += n;
+    }
+    else if (!this->Fill(this->position_))
+    {
+      break;
+    }
+  }
+  return int(done / size);
+}
+
+int FdDatastream::seek(INT64 offset, int whence)
+{
+  INT64 target;
+  switch (whence)
+  {
+  case SEEK_SET:
+    target = offset;
+    break;
+  case SEEK_CUR:
+    target = this->position_ + offset;
+    break;
+  case SEEK_END:
+    target = this->size_ + offset;
+    break;
+  default:
+    return -1;
+  }
+  this->position_ = std::max<INT64>(0, std::min(target, this->size_));
+  return 0;
+}
+
+INT64 FdDatastream::tell()
+{
+  return this->position_;
+}
+
+INT64 FdDatastream::size()
+{
+  return this->size_;
+}
+
+int FdDatastream::get_char()
+{
+  unsigned char c;
+  return this->read(&c, 1, 1) == 1 ? c : -1;
+}
+
+char *FdDatastream::gets(char *str, int sz)
+{
+  if (sz < 1 || this->position_ >= this->size_)
+  {
+    return NULL;
+  }
+  int i = 0;
+  while (i < sz - 1)
+  {
+    int c = this->get_char();
+    if (c < 0)
+    {
+      break;
+    }
+    str[i++] = (char)c;
+    if (c == '\n')
+    {
+      break;
+    }
+  }
+  str[i] = 0;
+  return str;
+}
+
+/*
+ * Mirrors LibRaw_buffer_datastream: scan from the current position, then
+ * skip past the token that was consumed.
+ */
+int FdDatastream::scanf_one(const char *fmt, void *val)
+{
+  char token[32];
+  INT64 start = this->position_;
+  int n = this->read(token, 1, sizeof(token) - 1);
+  token[n] = 0;
+  this->position_ = start;
+
+  int result = sscanf(token, fmt, val);
+  if (result > 0)
+  {
+    int skipped = 0;
+    while (this->position_ < this->size_)
+    {
+      this->position_++;
+      skipped++;
+      if (skipped >= n)
+      {
+        break;
+      }
+      char c = token[skipped];
+      if (c == 0 || c == ' ' || c == '\t' || c == '\n' || skipped > 24)
+      {
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+int FdDatastream::eof()
+{
+  return this->position_ >= this->size_;
+}
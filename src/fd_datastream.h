@@ -0,0 +1,73 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_FD_DATASTREAM_H
+#define LIBRAWJS_FD_DATASTREAM_H
+
+#include <cstddef>
+#include <vector>
+#include "libraw/libraw.h"
+
+/*
+ * LibRaw datastream over an already open file descriptor.
+ *
+ * Reads use pread(2) against a private position, so the descriptor's own
+ * offset is never touched and the path is never resolved again. The
+ * descriptor is duplicated on construction; closing the caller's copy does
+ * not affect the stream. Small reads are served from a read-ahead window
+ * because LibRaw's parsers issue many byte-sized reads.
+ */
+class FdDatastream : public LibRaw_abstract_datastream
+{
+public:
+  explicit FdDatastream(int fd);
+  virtual ~FdDatastream();
+
+  // 0 when the stream is usable, otherwise the errno from setting it up
+  int error() const { return this->error_; }
+  // the duplicated descriptor, valid for the lifetime of the stream
+  int fd() const { return this->fd_; }
+
+  virtual int valid();
+  virtual int read(void *ptr, size_t size, size_t nmemb);
+  virtual int seek(INT64 offset, int whence);
+  virtual INT64 tell();
+  virtual INT64 size();
+  virtual int get_char();
+  virtual char *gets(char *str, int sz);
+  virtual int scanf_one(const char *fmt, void *val);
+  virtual int eof();
+  virtual void *make_jas_stream() { return NULL; }
+
+private:
+  bool Fill(INT64 position);
+
+  int fd_;
+  int error_;
+  INT64 size_;
+  INT64 position_;
+  std::vector<unsigned char> window_;
+  INT64 windowStart_;
+  std::size_t windowLength_;
+};
+
+#endif
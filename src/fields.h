@@ -0,0 +1,222 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_FIELDS_H
+#define LIBRAWJS_FIELDS_H
+
+#include <cstddef>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/*
+ * Compile-time field descriptors.
+ *
+ * Each wrapped struct gets a `FieldTable<S>` specialization listing the
+ * members we expose, in the form of `Field` descriptors. A descriptor knows
+ * the JS-facing name, the member pointer (and therefore the offset), the
+ * scalar type of the member and its array dimensions. Consumers walk a table
+ * with `ForEachField` and get a fully typed descriptor per member, so the
+ * per-field code is specialized by the compiler instead of being looked up
+ * at runtime.
+ *
+ * The eager metadata wrapping walks the tables at compile time. Field
+ * projections resolve a dotted path through them once, with `ResolveField`,
+ * and then read the member from its offset by kind and dimensions.
+ */
+
+enum class FieldKind
+{
+  Struct,
+  Char,
+  Integer,
+  Unsigned,
+  Float,
+  Double,
+};
+
+/*
+ * Controls how `char` arrays are presented. LibRaw stores both strings and
+ * small lookup tables in `char[]` members; `Text` treats them as C strings,
+ * `Array` as arrays of numbers. Other array types are always arrays.
+ */
+enum class FieldRepr
+{
+  Text,
+  Array,
+};
+
+template <typename T>
+constexpr FieldKind KindOf()
+{
+  if (std::is_same<T, char>::value)
+    return FieldKind::Char;
+  if (std::is_same<T, float>::value)
+    return FieldKind::Float;
+  if (std::is_floating_point<T>::value)
+    return FieldKind::Double;
+  if (std::is_integral<T>::value && std::is_unsigned<T>::value)
+    return FieldKind::Unsigned;
+  if (std::is_integral<T>::value)
+    return FieldKind::Integer;
+  return FieldKind::Struct;
+}
+
+template <typename S, typename M, FieldRepr R = FieldRepr::Text>
+struct Field
+{
+  using struct_type = S;
+  using member_type = M;
+  using scalar_type = typename std::remove_all_extents<M>::type;
+
+  static constexpr FieldKind kind = KindOf<scalar_type>();
+  static constexpr FieldRepr repr = R;
+  static constexpr std::size_t rank = std::rank<M>::value;
+
+  const char *name;
+  M S::*member;
+
+  static constexpr std::size_t extent(unsigned dim)
+  {
+    return dim == 0   ? std::extent<M, 0>::value
+           : dim == 1 ? std::extent<M, 1>::value
+           : dim == 2 ? std::extent<M, 2>::value
+                      : 0;
+  }
+
+  constexpr const M &get(const S &s) const { return s.*member; }
+
+  std::size_t offset() const
+  {
+    static const S probe{};
+    return reinterpret_cast<const char *>(&(probe.*member)) -
+           reinterpret_cast<const char *>(&probe);
+  }
+};
+
+template <typename S, typename M>
+constexpr Field<S, M> MakeField(const char *name, M S::*member)
+{
+  return Field<S, M>{name, member};
+}
+
+template <FieldRepr R, typename S, typename M>
+constexpr Field<S, M, R> MakeField(const char *name, M S::*member)
+{
+  return Field<S, M, R>{name, member};
+}
+
+/*
+ * `FIELD(S, m)` exposes `S::m` under its own name, `FIELD_ARRAY` does the
+ * same but never treats the member as a string, and `FIELD_AS` publishes a
+ * member under a different name.
+ */
+#define FIELD(S, m) MakeField(#m, &S::m)
+#define FIELD_ARRAY(S, m) MakeField<FieldRepr::Array>(#m, &S::m)
+#define FIELD_AS(S, name, m) MakeField(name, &S::m)
+
+template <typename S>
+struct FieldTable;
+
+template <typename S, typename = void>
+struct HasFieldTable : std::false_type
+{
+};
+
+template <typename S>
+struct HasFieldTable<S, decltype((void)FieldTable<S>::fields)> : std::true_type
+{
+};
+
+template <typename S, typename Fn>
+inline void ForEachField(Fn &&fn)
+{
+  std::apply([&](const auto &...f)
+             { (fn(f), ...); },
+             FieldTable<S>::fields);
+}
+
+template <typename S>
+constexpr std::size_t FieldCount()
+{
+  return std::tuple_size<typename std::decay<decltype(FieldTable<S>::fields)>::type>::value;
+}
+
+/*
+ * A member found by its path, e.g. `color.cam_mul`, located by its offset
+ * from the start of the root struct.
+ */
+struct FieldRef
+{
+  std::size_t offset = 0;
+  FieldKind kind = FieldKind::Struct;
+  FieldRepr repr = FieldRepr::Text;
+  // bytes of one scalar element
+  std::size_t size = 0;
+  std::size_t rank = 0;
+  std::size_t extents[3] = {0, 0, 0};
+};
+
+/*
+ * Resolves a dotted path of member names through the tables, starting at
+ * `S`. Only scalars and arrays of up to three dimensions of scalars can be
+ * resolved; a path ending at a struct, or going through an array, is
+ * rejected.
+ */
+template <typename S>
+bool ResolveField(const std::string &path, FieldRef &ref, std::size_t base = 0)
+{
+  std::size_t dot = path.find('.');
+  std::string head = path.substr(0, dot);
+  bool found = false;
+  bool resolved = false;
+  ForEachField<S>([&](const auto &field)
+                  {
+    using F = typename std::decay<decltype(field)>::type;
+    if (found || head != field.name)
+    {
+      return;
+    }
+    found = true;
+    std::size_t offset = base + field.offset();
+    if constexpr (F::kind == FieldKind::Struct && F::rank == 0)
+    {
+      resolved = dot != std::string::npos && ResolveField<typename F::member_type>(path.substr(dot + 1), ref, offset);
+    }
+    else if (dot == std::string::npos && F::kind != FieldKind::Struct && F::rank <= 3)
+    {
+      ref.offset = offset;
+      ref.kind = F::kind;
+      ref.repr = F::repr;
+      ref.size = sizeof(typename F::scalar_type);
+      ref.rank = F::rank;
+      for (std::size_t dim = 0; dim < F::rank; dim++)
+      {
+        ref.extents[dim] = F::extent(dim);
+      }
+      resolved = true;
+    } });
+  return resolved;
+}
+
+#endif
@@ -0,0 +1,185 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "hash.h"
+#include <cstring>
+
+namespace
+{
+  const uint64_t P1 = 11400714785074694791ULL;
+  const uint64_t P2 = 14029467366897019727ULL;
+  const uint64_t P3 = 1609587929392839161ULL;
+  const uint64_t P4 = 9650029242287828579ULL;
+  const uint64_t P5 = 2870177450012600261ULL;
+
+  inline uint64_t Rotl(uint64_t x, int r)
+  {
+    return (x << r) | (x >> (64 - r));
+  }
+
+  // memcpy keeps unaligned loads well-defined; digests assume little endian
+  inline uint64_t Read64(const unsigned char *p)
+  {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  inline uint32_t Read32(const unsigned char *p)
+  {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+  inline uint64_t Round(uint64_t acc, uint64_t input)
+  {
+    acc += input * P2;
+    acc = Rotl(acc, 31);
+    return acc * P1;
+  }
+
+  inline uint64_t MergeRound(uint64_t acc, uint64_t val)
+  {
+    acc ^= Round(0, val);
+    return acc * P1 + P4;
+  }
+}
+
+Xxh64::Xxh64(uint64_t seed) : seed_(seed)
+{
+  this->v_[0] = seed + P1 + P2;
+  this->v_[1] = seed + P2;
+  this->v_[2] = seed;
+  this->v_[3] = seed - P1;
+}
+
+void Xxh64::Update(const void *data, std::size_t length)
+{
+  const unsigned char *p = static_cast<const unsigned char *>(data);
+  const unsigned char *end = p + length;
+  this->total_ += length;
+
+  if (this->buffered_ + length < 32)
+  {
+    std::memcpy(this->buffer_ + this->buffered_, p, length);
+    this->buffered_ += length;
+    return;
+  }
+
+  if (this->buffered_)
+  {
+    std::size_t fill = 32 - this->buffered_;
+    std::memcpy(this->buffer_ + this->buffered_, p, fill);
+    for (int i = 0; i < 4; i++)
+    {
+      this->v_[i] = Round(this->v_[i], Read64(this->buffer_ + i * 8));
+    }
+    p += fill;
+    this->buffered_ = 0;
+  }
+
+  uint64_t v1 = this->v_[0], v2 = this->v_[1], v3 = this->v_[2], v4 = this->v_[3];
+  while (p + 32 <= end)
+  {
+    v1 = Round(v1, Read64(p));
+    v2 = Round(v2, Read64(p + 8));
+    v3 = Round(v3, Read64(p + 16));
+    v4 = Round(v4, Read64(p + 24));
+    p += 32;
+  }
+  this->v_[0] = v1;
+  this->v_[1] = v2;
+  this->v_[2] = v3;
+  this->v_[3] = v4;
+
+  if (p < end)
+  {
+    this->buffered_ = end - p;
+    std::memcpy(this->buffer_, p, this->buffered_);
+  }
+}
+
+uint64_t Xxh64::Digest() const
+{
+  uint64_t h;
+  if (this->total_ >= 32)
+  {
+    h = Rotl(this->v_[0], 1) + Rotl(this->v_[1], 7) + Rotl(this->v_[2], 12) + Rotl(this->v_[3], 18);
+    for (int i = 0; i < 4; i++)
+    {
+      h = MergeRound(h, this->v_[i]);
+    }
+  }
+  else
+  {
+    h = this->seed_ + P5;
+  }
+  h += this->total_;
+
+  const unsigned char *p = this->buffer_;
+  const unsigned char *end = p + this->buffered_;
+  while (p + 8 <= end)
+  {
+    h ^= Round(0, Read64(p));
+    h = Rotl(h, 27) * P1 + P4;
+    p += 8;
+  }
+  if (p + 4 <= end)
+  {
+    h ^= static_cast<uint64_t>(Read32(p)) * P1;
+    h = Rotl(h, 23) * P2 + P3;
+    p += 4;
+  }
+  while (p < end)
+  {
+    h ^= (*p) * P5;
+    h = Rotl(h, 11) * P1;
+    p++;
+  }
+
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  h ^= h >> 32;
+  return h;
+}
+
+uint64_t Xxh64::Hash(const void *data, std::size_t length, uint64_t seed)
+{
+  Xxh64 state(seed);
+  state.Update(data, length);
+  return state.Digest();
+}
+
+std::string Xxh64::ToHex(uint64_t digest)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string hex(16, '0');
+  for (int i = 15; i >= 0; i--)
+  {
+    hex[i] = digits[digest & 0xf];
+    digest >>= 4;
+  }
+  return hex;
+}
@@ -0,0 +1,53 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_HASH_H
+#define LIBRAWJS_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+ * Streaming XXH64 (https://github.com/Cyan4973/xxHash), used to fingerprint
+ * file contents. Produces the same digests as the reference implementation.
+ */
+class Xxh64
+{
+public:
+  explicit Xxh64(uint64_t seed = 0);
+
+  void Update(const void *data, std::size_t length);
+  uint64_t Digest() const;
+
+  static uint64_t Hash(const void *data, std::size_t length, uint64_t seed = 0);
+  static std::string ToHex(uint64_t digest);
+
+private:
+  uint64_t v_[4];
+  unsigned char buffer_[32];
+  std::size_t buffered_ = 0;
+  uint64_t total_ = 0;
+  uint64_t seed_;
+};
+
+#endif
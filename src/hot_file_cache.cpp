@@ -0,0 +1,210 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "hot_file_cache.h"
+#include "processor_pool.h"
+#include <cerrno>
+#include <iterator>
+#include <sys/stat.h>
+
+bool FileIdentity::operator==(const FileIdentity &other) const
+{
+  return this->path == other.path && this->device == other.device && this->inode == other.inode &&
+         this->size == other.size && this->mtimeNs == other.mtimeNs;
+}
+
+int StatFile(const std::string &path, FileIdentity &identity)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0)
+  {
+    return errno;
+  }
+  identity.path = path;
+  identity.device = st.st_dev;
+  identity.inode = st.st_ino;
+  identity.size = st.st_size;
+#ifdef __APPLE__
+  identity.mtimeNs = static_cast<int64_t>(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  identity.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+  return 0;
+}
+
+/*
+ * Whether an entry opened with `collected` can answer `requested`. The
+ * values are only gathered while a file is opened, so the requests must be
+ * the same.
+ */
+static bool CoversExifTags(const ExifTagCollector &collected, const std::vector<ExifTagRequest> &requested)
+{
+  if (requested.empty())
+  {
+    return true;
+  }
+  const std::vector<ExifTagRequest> &requests = collected.Requests();
+  if (requests.size() != requested.size())
+  {
+    return false;
+  }
+  for (std::size_t i = 0; i < requests.size(); i++)
+  {
+    if (requests[i].key != requested[i].key || requests[i].group != requested[i].group ||
+        requests[i].tag != requested[i].tag)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+HotFileCache &HotFileCache::Instance()
+{
+  static HotFileCache *cache = new HotFileCache();
+  return *cache;
+}
+
+void HotFileCache::Configure(std::size_t maxBytes, std::size_t maxEntries)
+{
+  Entries evicted;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->maxBytes_ = maxBytes;
+    this->maxEntries_ = maxEntries;
+    this->Trim(evicted);
+  }
+  Discard(evicted);
+}
+
+bool HotFileCache::Enabled()
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->maxBytes_ > 0;
+}
+
+bool HotFileCache::Put(HotFile &file)
+{
+  file.weight = Weight(file.processor);
+  Entries evicted;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (file.weight > this->maxBytes_)
+    {
+      return false;
+    }
+    auto found = this->index_.find(file.identity.path);
+    if (found != this->index_.end())
+    {
+      this->bytes_ -= found->second->weight;
+      evicted.splice(evicted.end(), this->entries_, found->second);
+      this->index_.erase(found);
+    }
+    this->entries_.push_front(std::move(file));
+    this->index_[this->entries_.front().identity.path] = this->entries_.begin();
+    this->bytes_ += this->entries_.front().weight;
+    this->Trim(evicted);
+  }
+  Discard(evicted);
+  return true;
+}
+
+bool HotFileCache::Take(const FileIdentity &identity, const std::vector<ExifTagRequest> &exifTags, HotFile &file)
+{
+  Entries stale;
+  bool hit = false;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    auto found = this->index_.find(identity.path);
+    if (found != this->index_.end())
+    {
+      Entries::iterator entry = found->second;
+      if (!(entry->identity == identity))
+      {
+        // the file changed since it was cached
+        this->bytes_ -= entry->weight;
+        stale.splice(stale.end(), this->entries_, entry);
+        this->index_.erase(found);
+      }
+      else if (CoversExifTags(entry->exif, exifTags))
+      {
+        this->bytes_ -= entry->weight;
+        file = std::move(*entry);
+        this->entries_.erase(entry);
+        this->index_.erase(found);
+        hit = true;
+      }
+    }
+    hit ? this->hits_++ : this->misses_++;
+  }
+  Discard(stale);
+  return hit;
+}
+
+HotFileCacheStats HotFileCache::Stats()
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return HotFileCacheStats{this->entries_.size(), this->bytes_, this->maxBytes_, this->maxEntries_, this->hits_,
+                           this->misses_};
+}
+
+std::size_t HotFileCache::Weight(const LibRaw *processor)
+{
+  const libraw_data_t &imgdata = processor->imgdata;
+  std::size_t weight = sizeof(LibRaw);
+  if (imgdata.rawdata.raw_alloc)
+  {
+    weight += static_cast<std::size_t>(imgdata.sizes.raw_pitch) * imgdata.sizes.raw_height;
+  }
+  if (imgdata.image)
+  {
+    weight += static_cast<std::size_t>(imgdata.sizes.iwidth) * imgdata.sizes.iheight * sizeof(*imgdata.image);
+  }
+  if (imgdata.thumbnail.thumb)
+  {
+    weight += imgdata.thumbnail.tlength;
+  }
+  // a mapped file is backed by the page cache and is not counted
+  return weight;
+}
+
+void HotFileCache::Trim(Entries &evicted)
+{
+  while (!this->entries_.empty() &&
+         (this->bytes_ > this->maxBytes_ || (this->maxEntries_ && this->entries_.size() > this->maxEntries_)))
+  {
+    Entries::iterator oldest = std::prev(this->entries_.end());
+    this->bytes_ -= oldest->weight;
+    this->index_.erase(oldest->identity.path);
+    evicted.splice(evicted.end(), this->entries_, oldest);
+  }
+}
+
+void HotFileCache::Discard(Entries &entries)
+{
+  for (HotFile &file : entries)
+  {
+    // recycled before `mapped` is unmapped, LibRaw may still point into it
+    ProcessorPool::Instance().Release(file.processor);
+  }
+  entries.clear();
+}
@@ -0,0 +1,145 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_HOT_FILE_CACHE_H
+#define LIBRAWJS_HOT_FILE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "libraw/libraw.h"
+#include "exif_tags.h"
+#include "mapped_file.h"
+
+/*
+ * Identifies a file on disk. Two opens of the same path see the same
+ * contents as long as the device, inode, size and modification time match.
+ */
+struct FileIdentity
+{
+  std::string path;
+  uint64_t device = 0;
+  uint64_t inode = 0;
+  int64_t size = 0;
+  int64_t mtimeNs = 0;
+
+  bool operator==(const FileIdentity &other) const;
+};
+
+// returns 0 on success, otherwise an errno value
+int StatFile(const std::string &path, FileIdentity &identity);
+
+/*
+ * A processor that has a file open, and possibly unpacked, together with
+ * what it needs to keep reading it.
+ */
+struct HotFile
+{
+  FileIdentity identity;
+  LibRaw *processor = nullptr;
+  // backs the processor's buffer datastream when the file was opened mapped
+  MappedFile mapped;
+  // the tags LibRaw's EXIF callback collected while opening
+  ExifTagCollector exif;
+  std::size_t weight = 0;
+};
+
+struct HotFileCacheStats
+{
+  std::size_t entries;
+  std::size_t bytes;
+  std::size_t maxBytes;
+  std::size_t maxEntries;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/*
+ * Process-wide LRU of opened processors, keyed by path.
+ *
+ * Viewers tend to ask for the metadata, the thumbnail and then a crop of
+ * the same file in quick succession, each time from a new `LibRaw`
+ * instance. When an instance closes a file it opened by path, it hands its
+ * processor to the cache instead of recycling it, and the next instance
+ * that opens the unchanged file takes the processor over with the file
+ * already parsed and, if it was, unpacked.
+ *
+ * An entry belongs to at most one instance at a time: `Take` removes it.
+ * Entries are weighted by the memory their processor holds (the raw and
+ * image buffers and the thumbnail) and the least recently stored ones are
+ * evicted once `maxBytes` or `maxEntries` is exceeded. Every entry keeps
+ * its file open, which is what `maxEntries` bounds. The cache is disabled
+ * until it is given a capacity.
+ */
+class HotFileCache
+{
+public:
+  static HotFileCache &Instance();
+
+  // a maxBytes of 0 disables the cache and drops every entry
+  void Configure(std::size_t maxBytes, std::size_t maxEntries);
+  bool Enabled();
+
+  /*
+   * Stores `file`, replacing an older entry for the same path. Returns
+   * false, leaving `file` untouched, if the cache is disabled or the entry
+   * alone exceeds the capacity.
+   */
+  bool Put(HotFile &file);
+
+  /*
+   * Moves the entry for `identity` into `file` if the file is unchanged
+   * and the entry collected the requested EXIF tags (or none are
+   * requested). A stale entry is dropped.
+   */
+  bool Take(const FileIdentity &identity, const std::vector<ExifTagRequest> &exifTags, HotFile &file);
+
+  HotFileCacheStats Stats();
+
+  // memory held by a processor, as accounted against maxBytes
+  static std::size_t Weight(const LibRaw *processor);
+
+private:
+  HotFileCache() = default;
+
+  using Entries = std::list<HotFile>;
+
+  // unlinks the least recently stored entries until the limits hold
+  void Trim(Entries &evicted);
+  static void Discard(Entries &entries);
+
+  std::mutex mutex_;
+  // most recently stored first
+  Entries entries_;
+  std::unordered_map<std::string, Entries::iterator> index_;
+  std::size_t bytes_ = 0;
+  std::size_t maxBytes_ = 0;
+  std::size_t maxEntries_ = 64;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+};
+
+#endif
@@ -20,10 +20,16 @@
  * Direct further questions to justinkambic.github@gmail.com.
  */
 
+#include "addon.h"
 #include "libraw_wrapper.h"
 
+/*
+ * Called once per environment (main thread or worker thread). All state
+ * that belongs to an environment hangs off its `AddonData`.
+ */
 Napi::Object Init(Napi::Env env, Napi::Object exports)
 {
+  AddonData::Create(env);
   return LibRawWrapper::Init(env, exports);
 }
 
@@ -0,0 +1,270 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+import { Transform, TransformCallback } from 'stream';
+
+/**
+ * Outcome of processing a single input. Exactly one of `result` and
+ * `error` is set; a failing input never stops the rest of the batch.
+ */
+export interface IngestItem<I, T> {
+  input: I;
+  result?: T;
+  error?: Error;
+}
+
+export interface IngestOptions {
+  /**
+   * Maximum number of inputs processed at once. Defaults to the size of
+   * the native worker pool.
+   */
+  concurrency?: number;
+  /** Emit results in input order rather than completion order. */
+  ordered?: boolean;
+}
+
+/**
+ * Lets a batch announce inputs before their work starts, e.g. so their
+ * files can be read ahead. Up to `depth` inputs are pulled past the
+ * window; each is hinted once, and cancelled if the batch stops before
+ * starting it or its work fails.
+ */
+export interface Lookahead<I> {
+  depth: number;
+  hint: (input: I) => void;
+  cancel: (input: I) => void;
+}
+
+type Worker<I, T> = (input: I) => Promise<T>;
+
+function toError(e: unknown): Error {
+  return e instanceof Error ? e : new Error(String(e));
+}
+
+function settle<I, T>(
+  input: I,
+  work: Promise<T>,
+  lookahead?: Lookahead<I>
+): Promise<IngestItem<I, T>> {
+  return work.then(
+    (result) => ({ input, result }),
+    (e: unknown) => {
+      // the work may have failed before it used its hint
+      lookahead?.cancel(input);
+      return { input, error: toError(e) };
+    }
+  );
+}
+
+/**
+ * Runs `worker` over `inputs` with at most `concurrency` calls in flight.
+ *
+ * Inputs are only pulled while there is room in the window, and results are
+ * only produced as fast as the consumer asks for them, so a slow consumer
+ * throttles the whole pipeline. In ordered mode, finished results waiting
+ * for an earlier input count against the window, which bounds memory.
+ * With a `lookahead`, inputs are pulled and hinted up to `depth` ahead of
+ * the window, and started from that queue in order.
+ */
+export async function* boundedMap<I, T>(
+  inputs: Iterable<I> | AsyncIterable<I>,
+  worker: Worker<I, T>,
+  { concurrency = 1, ordered = false }: IngestOptions,
+  lookahead?: Lookahead<I>
+): AsyncGenerator<IngestItem<I, T>> {
+  const iterator =
+    Symbol.asyncIterator in inputs
+      ? (inputs as AsyncIterable<I>)[Symbol.asyncIterator]()
+      : (inputs as Iterable<I>)[Symbol.iterator]();
+  const running = new Map<
+    number,
+    Promise<{ index: number; item: IngestItem<I, T> }>
+  >();
+  const finished = new Map<number, IngestItem<I, T>>();
+  const ahead: I[] = [];
+  const depth = lookahead?.depth ?? 0;
+  let nextIndex = 0;
+  let nextToEmit = 0;
+  let exhausted = false;
+
+  const pull = async (): Promise<void> => {
+    const next = await iterator.next();
+    if (next.done) {
+      exhausted = true;
+      return;
+    }
+    ahead.push(next.value);
+    lookahead?.hint(next.value);
+  };
+
+  try {
+    for (;;) {
+      while (running.size + finished.size < concurrency) {
+        if (ahead.length === 0) {
+          if (exhausted) {
+            break;
+          }
+          await pull();
+          continue;
+        }
+        const input = ahead.shift() as I;
+        const index = nextIndex++;
+        running.set(
+          index,
+          settle(input, worker(input), lookahead).then((item) => ({
+            index,
+            item,
+          }))
+        );
+      }
+      while (!exhausted && ahead.length < depth) {
+        await pull();
+      }
+
+      while (finished.has(nextToEmit)) {
+        const item = finished.get(nextToEmit) as IngestItem<I, T>;
+        finished.delete(nextToEmit++);
+        yield item;
+      }
+
+      if (running.size === 0) {
+        if (exhausted) {
+          return;
+        }
+        continue;
+      }
+
+      const { index, item } = await Promise.race(running.values());
+      running.delete(index);
+      if (ordered) {
+        finished.set(index, item);
+      } else {
+        yield item;
+      }
+    }
+  } finally {
+    for (const input of ahead) {
+      lookahead?.cancel(input);
+    }
+    if (!exhausted && iterator.return) {
+      await iterator.return();
+    }
+  }
+}
+
+/**
+ * Object mode `Transform` counterpart of {@link boundedMap}. Writes are
+ * acknowledged while fewer than `concurrency` inputs are in flight, or
+ * while fewer than the lookahead's `depth` are queued behind them; the
+ * readable side applies the usual stream backpressure on top of that.
+ */
+export class BoundedTransform<I, T> extends Transform {
+  private queue: I[] = [];
+  private running = 0;
+  private nextIndex = 0;
+  private nextToEmit = 0;
+  private finished = new Map<number, IngestItem<I, T>>();
+  private pendingWrite?: TransformCallback;
+  private pendingFlush?: TransformCallback;
+
+  constructor(
+    private worker: Worker<I, T>,
+    private options: Required<IngestOptions>,
+    private lookahead?: Lookahead<I>
+  ) {
+    super({ objectMode: true });
+  }
+
+  _transform(input: I, _encoding: string, callback: TransformCallback): void {
+    this.queue.push(input);
+    this.lookahead?.hint(input);
+    this.startQueued();
+    if (this.canAccept()) {
+      callback();
+    } else {
+      this.pendingWrite = callback;
+    }
+  }
+
+  _flush(callback: TransformCallback): void {
+    if (this.running === 0 && this.queue.length === 0) {
+      callback();
+    } else {
+      this.pendingFlush = callback;
+    }
+  }
+
+  _destroy(error: Error | null, callback: (error: Error | null) => void): void {
+    for (const input of this.queue) {
+      this.lookahead?.cancel(input);
+    }
+    this.queue = [];
+    callback(error);
+  }
+
+  private hasRoom(): boolean {
+    return this.running + this.finished.size < this.options.concurrency;
+  }
+
+  private canAccept(): boolean {
+    return (
+      this.queue.length < (this.lookahead?.depth ?? 0) ||
+      (this.queue.length === 0 && this.hasRoom())
+    );
+  }
+
+  private startQueued(): void {
+    while (this.queue.length > 0 && this.hasRoom()) {
+      const input = this.queue.shift() as I;
+      const index = this.nextIndex++;
+      this.running++;
+      settle(input, this.worker(input), this.lookahead).then((item) =>
+        this.complete(index, item)
+      );
+    }
+  }
+
+  private complete(index: number, item: IngestItem<I, T>): void {
+    this.running--;
+    if (this.options.ordered) {
+      this.finished.set(index, item);
+      while (this.finished.has(this.nextToEmit)) {
+        this.push(this.finished.get(this.nextToEmit));
+        this.finished.delete(this.nextToEmit++);
+      }
+    } else {
+      this.push(item);
+    }
+    this.startQueued();
+
+    if (this.pendingWrite && this.canAccept()) {
+      const callback = this.pendingWrite;
+      this.pendingWrite = undefined;
+      callback();
+    }
+    if (this.pendingFlush && this.running === 0 && this.queue.length === 0) {
+      const callback = this.pendingFlush;
+      this.pendingFlush = undefined;
+      callback();
+    }
+  }
+}
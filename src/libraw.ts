@@ -20,28 +20,456 @@
  * Direct further questions to justinkambic.github@gmail.com.
  */
 
+import * as os from 'os';
 import * as path from 'path';
 import nodeGypBuild from 'node-gyp-build';
+import { Readable, Transform } from 'stream';
+import {
+  boundedMap,
+  BoundedTransform,
+  IngestItem,
+  IngestOptions,
+  Lookahead,
+} from './ingest';
+import { DecodeWorkers } from './decode_workers';
+
+export type { IngestItem, IngestOptions } from './ingest';
+export { DecodeWorkers } from './decode_workers';
+export type {
+  DecodeWorkerOptions,
+  DecodeWorkerStats,
+} from './decode_workers';
 
 // `prebuildify` import magic, handles loading pre-built bins or will
 // try to `node-gyp build` if none are found. If you cannot get this to work
 // for your platform, you can do a dynamic install of LibRaw and the package should work.
 const librawAddon = nodeGypBuild(path.join(__dirname, '..'));
 
+// inputs an ingest with `prefetchBytes` pulls ahead of its window
+const PREFETCH_DEPTH = 64;
+
+/**
+ * Scheduling class of a native call. Queued `interactive` work starts
+ * before `normal` work, which starts before `background` work.
+ */
+export type Priority = 'interactive' | 'normal' | 'background';
+
+export interface CallOptions {
+  /** scheduling class of the call, `normal` by default */
+  priority?: Priority;
+}
+
+export interface SchedulerOptions {
+  /**
+   * Most worker threads a class may occupy at once, 0 for no limit.
+   * Capping `background` keeps threads free for interactive calls.
+   */
+  limits?: Partial<Record<Priority, number>>;
+  /**
+   * CPUs the worker threads are pinned to, an empty array to undo the
+   * pinning. Only supported on Linux.
+   */
+  affinity?: number[];
+  /**
+   * Most threads a single call may use for its parallel stages, counting
+   * its own. 0, the default, lets a call use every idle worker thread and
+   * 1 keeps each call on one thread.
+   */
+  threadsPerCall?: number;
+}
+
+export interface PriorityStats {
+  /** calls waiting for a worker thread */
+  queued: number;
+  /** calls running on a worker thread */
+  running: number;
+  limit: number;
+  /** calls started since the last reset */
+  started: number;
+  /** idle threads lent to running calls since the last reset */
+  helpers: number;
+  /** time calls spent queued, since the last reset */
+  meanWaitMs: number;
+  maxWaitMs: number;
+}
+
+export interface CacheOptions {
+  /** memory the cached processors may hold, 0 disables the cache */
+  maxBytes: number;
+  /** most files kept open by the cache, 64 by default, 0 for no limit */
+  maxEntries?: number;
+}
+
+export interface CacheStats {
+  entries: number;
+  bytes: number;
+  maxBytes: number;
+  maxEntries: number;
+  hits: number;
+  misses: number;
+}
+
+export interface PrefetchStats {
+  /** hinted files not read yet */
+  queued: number;
+  /** files read and waiting for their extract */
+  ready: number;
+  /** bytes read or being read for files not extracted yet */
+  bytes: number;
+  /** bytes of read-ahead buffers still held by instances */
+  held: number;
+  /** bytes of idle buffers kept for reuse */
+  pooled: number;
+  /** bound on `bytes + held + pooled`, see `prefetchBytes` */
+  maxBytes: number;
+  hits: number;
+  misses: number;
+}
+
+export interface TraceOptions {
+  /** events each thread keeps, older ones are dropped, default 65536 */
+  eventsPerThread?: number;
+}
+
+export interface RenderCacheOptions {
+  /** directory holding the cache, created if needed, `''` to disable */
+  directory: string;
+  /** size the directory may grow to, 0 disables the cache */
+  maxBytes: number;
+}
+
+export interface RenderCacheStats {
+  entries: number;
+  bytes: number;
+  maxBytes: number;
+  hits: number;
+  misses: number;
+}
+
+export type XmpFieldType = 'string' | 'number' | 'boolean' | 'array';
+
+/**
+ * XMP properties to read, by qualified name such as `xmp:Rating`. As an
+ * array, simple values are strings and `rdf:Bag`/`rdf:Seq` values are
+ * string arrays; as an object, each value is converted to the given type.
+ */
+export type XmpFieldSpec = string[] | { [name: string]: XmpFieldType };
+
+interface XmpTypeMap {
+  string: string;
+  number: number;
+  boolean: boolean;
+  array: string[];
+}
+
+/**
+ * The values read for an {@link XmpFieldSpec}. Properties that are
+ * missing, structured, or do not convert to the requested type are omitted.
+ */
+export type XmpFields<S extends XmpFieldSpec = XmpFieldSpec> = S extends {
+  [name: string]: XmpFieldType;
+}
+  ? {
+      [K in keyof S]?: S[K] extends XmpFieldType ? XmpTypeMap[S[K]] : never;
+    }
+  : { [name: string]: string | string[] | undefined };
+
+export type ExifTagGroup = 'tiff' | 'exif' | 'makernote' | 'gps' | 'interop';
+
+/**
+ * A TIFF/EXIF tag to collect. A number matches the tag in the TIFF IFDs and
+ * the EXIF IFD, `group:tag` (e.g. `makernote:0x0016`) a tag of that group.
+ */
+export type ExifTag = number | `${ExifTagGroup}:${number}`;
+
+/**
+ * Collected tags keyed by their request. ASCII values are strings,
+ * UNDEFINED values Buffers, and numeric values numbers, or arrays of
+ * numbers for tags with several values.
+ */
+export interface ExifTags {
+  [tag: string]: string | number | number[] | Buffer;
+}
+
+/**
+ * Selects what {@link LibRaw.extract} gathers. Only `metadata` is
+ * produced by default.
+ */
+export interface ExtractOptions extends CallOptions {
+  metadata?: boolean;
+  thumbnail?: boolean;
+  xmp?: boolean;
+  hash?: boolean;
+  /** compute `dhash`/`phash` from the embedded thumbnail */
+  perceptualHash?: boolean;
+  /** read these XMP properties into `xmpFields` */
+  xmpFields?: XmpFieldSpec;
+  /** collect these tags into `exifTags`, see {@link LibRaw.setExifTags} */
+  exifTags?: ExifTag[];
+}
+
+export interface ExtractResult {
+  metadata?: { [key: string]: unknown };
+  thumbnail?: Buffer;
+  xmp?: Buffer;
+  xmpFields?: XmpFields;
+  exifTags?: ExifTags;
+  /** hex encoded XXH64 digest of the file contents */
+  hash?: string;
+  /** 64 bit difference hash of the thumbnail */
+  dhash?: bigint;
+  /** 64 bit DCT hash of the thumbnail */
+  phash?: bigint;
+}
+
+export interface PerceptualHashes {
+  dhash: bigint;
+  phash: bigint;
+}
+
+/** A rectangle in image pixels. */
+export interface Region {
+  x: number;
+  y: number;
+  w: number;
+  h: number;
+}
+
+export interface RenderOptions extends CallOptions {
+  /** bits per sample of the output, 8 (default) or 16 */
+  bits?: 8 | 16;
+  /**
+   * Address the camera's default crop (`sizes.raw_inset_crops[0]`) instead
+   * of the whole visible area, when the file defines one.
+   */
+  inset?: boolean;
+}
+
+/** Interleaved RGB pixels, 16 bit samples are in native byte order. */
+export interface ProcessedImage {
+  width: number;
+  height: number;
+  colors: number;
+  bits: number;
+  data: Buffer;
+}
+
+export interface BandOptions extends RenderOptions {
+  /** rows per band, defaults to 256 */
+  bandHeight?: number;
+}
+
+/** A horizontal strip of a processed image, rows `y` to `y + height`. */
+export interface ImageBand extends ProcessedImage {
+  y: number;
+  /** height of the complete image */
+  imageHeight: number;
+}
+
+export interface TensorOptions extends CallOptions {
+  /** width of the tensor in pixels */
+  width: number;
+  /** height of the tensor in pixels */
+  height: number;
+  /** planar `chw` (default) or interleaved `hwc` */
+  layout?: 'chw' | 'hwc';
+  /** keep values linear instead of applying the BT.709 curve */
+  linear?: boolean;
+  /** part of the image to resample, the whole image by default */
+  region?: Region;
+  /** see {@link RenderOptions.inset} */
+  inset?: boolean;
+  /** per channel value subtracted from every sample, 0 by default */
+  mean?: [number, number, number];
+  /** per channel divisor applied after `mean`, 1 by default */
+  std?: [number, number, number];
+}
+
+export interface EncodeOptions {
+  /** `jpeg` (8 bit) or `tiff` (uncompressed, 8 or 16 bit) */
+  format: 'jpeg' | 'tiff';
+  /** JPEG quality from 1 to 100, 90 by default */
+  quality?: number;
+  /**
+   * ICC profile embedded in the file. By default, or when `true`, a
+   * profile of the rendered colors (sRGB primaries, BT.709 curve);
+   * `false` embeds none. A Buffer is embedded as is.
+   */
+  icc?: boolean | Buffer;
+}
+
+export interface EncodedRenderOptions extends RenderOptions {
+  encode: EncodeOptions;
+  /** part of the image to encode, the whole image by default */
+  region?: Region;
+}
+
+export interface PreviewOptions extends CallOptions {
+  /**
+   * `embedded` (default) resizes the embedded thumbnail, `raw` develops
+   * the raw data like {@link LibRaw.renderRegion}.
+   */
+  source?: 'embedded' | 'raw';
+  /** longest side in pixels, 1024 by default; smaller images keep their size */
+  size?: number;
+}
+
+export interface ShotOptions extends CallOptions {
+  /**
+   * `raw` (default) returns the visible CFA plane of every shot, one
+   * 16 bit sample per pixel; `preview` returns a downscaled 8 bit RGB
+   * rendering.
+   */
+  output?: 'raw' | 'preview';
+  /** longest side of previews, 1024 by default */
+  previewSize?: number;
+}
+
+/** One frame of a multi-shot file. */
+export interface Frame extends ProcessedImage {
+  /** index of the shot, as used by `rawparams.shot_select` */
+  shot: number;
+}
+
+export interface StackOptions extends CallOptions {
+  /**
+   * How the frames' values of a pixel are combined: `mean` (default),
+   * `sigmaClip`, the mean of the values left after rejecting outliers, or
+   * `median`.
+   */
+  method?: 'mean' | 'sigmaClip' | 'median';
+  /**
+   * Deviations from the mean beyond which `sigmaClip` rejects a value,
+   * 2.5 by default. With n frames a single outlier is at most
+   * `(n - 1) / sqrt(n)` deviations away, so small stacks need a low value.
+   */
+  sigma?: number;
+  /** rejection passes of `sigmaClip`, 3 by default */
+  iterations?: number;
+  /** master dark frame, subtracted while keeping the black level */
+  dark?: string;
+  /** master flat frame, normalized per CFA color and divided out */
+  flat?: string;
+  /** `raw` (default) returns the plane, `dng` a DNG file */
+  output?: 'raw' | 'dng';
+  /**
+   * Rows of every frame combined at once by `median` and `sigmaClip`,
+   * 64 by default. Memory use is about `tileRows * width * frames * 2`
+   * bytes per thread.
+   */
+  tileRows?: number;
+  /** where `median` and `sigmaClip` keep frames, `os.tmpdir()` by default */
+  tempDir?: string;
+}
+
+/** The visible CFA plane of a stack, one 16 bit sample per pixel. */
+export interface StackResult extends ProcessedImage {
+  frames: number;
+}
+
+export interface RawExportOptions extends CallOptions {
+  /**
+   * `lossless` (default) predicts every sample from its same-color
+   * neighbors and Rice codes the residuals, `none` only packs samples to
+   * the bit depth of the sensor.
+   */
+  compression?: 'lossless' | 'none';
+  /** rows of the frame per independently coded tile, 64 by default */
+  tileRows?: number;
+}
+
+/** A raw frame decoded by {@link LibRaw.decodeRaw}, margins included. */
+export interface RawFrame {
+  width: number;
+  height: number;
+  topMargin: number;
+  leftMargin: number;
+  visibleWidth: number;
+  visibleHeight: number;
+  /** significant bits of every sample */
+  bits: number;
+  /** `width * height` samples, row by row */
+  data: Uint16Array;
+}
+
+export interface LibRawIngestOptions extends IngestOptions {
+  /** What to gather from every file, see {@link LibRaw.extract}. */
+  extract?: ExtractOptions;
+  /**
+   * Bytes of upcoming files a background thread may read ahead of their
+   * extraction, so decoding does not wait on slow disks. Defaults to 0,
+   * which disables read-ahead. This bounds all read-ahead memory, including
+   * buffers of files being extracted; a single file larger than the budget
+   * is still read when nothing else is held.
+   */
+  prefetchBytes?: number;
+  /**
+   * Extracts in these worker processes instead of this one, isolating the
+   * batch from crashes and hangs in LibRaw. Cannot be combined with
+   * `prefetchBytes`.
+   */
+  workers?: DecodeWorkers;
+}
+
+export type IngestResult = IngestItem<string, ExtractResult>;
+
+function toView(
+  buffer: ArrayBufferView | ArrayBuffer | SharedArrayBuffer,
+  byteOffset?: number,
+  byteLength?: number
+): ArrayBufferView {
+  if (
+    buffer instanceof ArrayBuffer ||
+    (typeof SharedArrayBuffer !== 'undefined' &&
+      buffer instanceof SharedArrayBuffer)
+  ) {
+    return new Uint8Array(buffer, byteOffset, byteLength);
+  }
+  return buffer;
+}
+
 interface LibRawWrapper {
   error_count: () => number;
   getMetadata: () => { [key: string]: unknown };
+  getMetadataFields: (paths: string[]) => { [path: string]: unknown };
   getThumbnail: () => Buffer;
   getXmp: () => Buffer;
+  getXmpFields: (fields: XmpFieldSpec) => XmpFields;
+  setExifTags: (tags: ExifTag[]) => void;
+  getExifTags: () => ExifTags;
   cameraCount: () => number;
   cameraList: () => string[];
-  open_file: (filename: string, bigfile_size?: number) => number;
-  open_buffer: (buffer: Buffer) => number;
+  export_raw: (options: RawExportOptions) => Promise<Buffer>;
+  extract: (filename: string, options: ExtractOptions) => Promise<ExtractResult>;
+  open_file: (filename: string, bigfile_size?: number) => Promise<number>;
+  open_buffer: (buffer: ArrayBufferView) => Promise<number>;
+  open_fd: (fd: number) => Promise<number>;
+  perceptual_hash: () => Promise<PerceptualHashes>;
+  preview: (
+    filename: string,
+    options: PreviewOptions
+  ) => Promise<ProcessedImage>;
   recycle: () => void;
+  render_region: (
+    region: Region,
+    options: RenderOptions
+  ) => Promise<ProcessedImage>;
+  shot_count: () => number;
+  unpack_shots: (
+    options: ShotOptions & { shots?: number[] }
+  ) => Promise<Frame[]>;
+  render_tensor: (out: Float32Array, options: TensorOptions) => Promise<void>;
+  render_encoded: (options: EncodedRenderOptions) => Promise<Buffer>;
+  render_rows: (
+    y: number,
+    rows: number,
+    options: RenderOptions
+  ) => Promise<ImageBand>;
   recycle_datastream: () => void;
+  set_priority: (priority: Priority) => void;
   strerror: (errorCode: number) => string;
-  unpack: () => number;
-  unpack_thumb: () => number;
+  unpack: () => Promise<number>;
+  unpack_thumb: () => Promise<number>;
   version: () => string;
   versionNumber: () => number;
 }
@@ -51,11 +479,254 @@ interface LibRawWrapper {
  */
 export class LibRaw {
   private libraw: LibRawWrapper;
+  private pending: Promise<unknown> = Promise.resolve();
 
   constructor() {
     this.libraw = new librawAddon.LibRawWrapper();
   }
 
+  /**
+   * Runs {@link LibRaw.extract} over a list of paths with bounded
+   * concurrency and yields one {@link IngestResult} per path. New paths are
+   * only consumed while fewer than `concurrency` files are in flight and
+   * the caller keeps iterating, so arbitrarily large (or lazily produced)
+   * directory listings are processed in constant memory.
+   *
+   * A file that fails to open is reported through the `error` field of its
+   * result and does not stop the iteration.
+   * @param paths the files to process
+   * @param options concurrency, ordering and what to extract
+   */
+  static async *ingest(
+    paths: Iterable<string> | AsyncIterable<string>,
+    options: LibRawIngestOptions = {}
+  ): AsyncGenerator<IngestResult> {
+    const instances = new InstanceSet(options.workers);
+    try {
+      yield* boundedMap(
+        paths,
+        (filename: string) => instances.extract(filename, options.extract),
+        LibRaw.ingestOptions(options),
+        LibRaw.prefetchLookahead(options)
+      );
+    } finally {
+      await instances.recycle();
+    }
+  }
+
+  /**
+   * Stream counterpart of {@link LibRaw.ingest}: an object mode `Transform`
+   * that takes file paths and emits {@link IngestResult} objects.
+   * @param options concurrency, ordering and what to extract
+   */
+  static ingestStream(options: LibRawIngestOptions = {}): Transform {
+    const instances = new InstanceSet(options.workers);
+    const stream = new BoundedTransform(
+      (filename: string) => instances.extract(filename, options.extract),
+      LibRaw.ingestOptions(options),
+      LibRaw.prefetchLookahead(options)
+    );
+    stream.on('close', () => instances.recycle());
+    return stream;
+  }
+
+  /**
+   * Checks whether LibRaw supports a camera, without building the camera
+   * list. Matching ignores case and extra whitespace, and accepts both the
+   * normalized names from `idata.normalized_make`/`normalized_model` and
+   * raw EXIF strings whose model repeats the make.
+   * @param make the camera maker, e.g. `Nikon`
+   * @param model the camera model, e.g. `Z 6`
+   */
+  static isSupported(make: string, model: string): boolean {
+    return librawAddon.LibRawWrapper.isSupported(make, model);
+  }
+
+  /**
+   * Returns the indices of all hashes within `maxDistance` bits of `query`.
+   * The scan runs synchronously over the typed array and is fast enough for
+   * tens of millions of hashes.
+   * @param hashes dhash or phash values, e.g. from {@link LibRaw.extract}
+   * @param query the hash to compare against
+   * @param maxDistance the largest Hamming distance to report
+   */
+  static hammingSearch(
+    hashes: BigUint64Array,
+    query: bigint,
+    maxDistance: number
+  ): Uint32Array {
+    return librawAddon.LibRawWrapper.hammingSearch(hashes, query, maxDistance);
+  }
+
+  /**
+   * Stacks raw frames of the same scene taken with the same camera, pixel
+   * by pixel on the visible CFA plane, and calibrates the result with
+   * master dark and flat frames. Frames are decoded in parallel and their
+   * memory released as soon as they are added; `median` and `sigmaClip`
+   * keep a copy of every frame in an unlinked temporary file and combine
+   * it a tile at a time. The result keeps the frames' black and white
+   * levels, and a DNG result can be opened and developed like any raw.
+   * @param paths the light frames, with equal sizes and CFA patterns
+   * @param options method, calibration frames and output format
+   */
+  static stack(
+    paths: string[],
+    options: StackOptions & { output: 'dng' }
+  ): Promise<Buffer>;
+  static stack(paths: string[], options?: StackOptions): Promise<StackResult>;
+  static async stack(
+    paths: string[],
+    options: StackOptions = {}
+  ): Promise<StackResult | Buffer> {
+    return librawAddon.LibRawWrapper.stack(paths, {
+      tempDir: os.tmpdir(),
+      ...options,
+    });
+  }
+
+  /**
+   * Decodes an archive made by {@link LibRaw.exportRaw} on the worker
+   * pool, its tiles in parallel. Rejects archives that are truncated or
+   * corrupt.
+   * @param archive the archive, read in place
+   * @param options scheduling priority
+   */
+  static async decodeRaw(
+    archive: ArrayBufferView | ArrayBuffer,
+    options: CallOptions = {}
+  ): Promise<RawFrame> {
+    const frame: Omit<RawFrame, 'data'> & { data: Buffer } =
+      await librawAddon.LibRawWrapper.decodeRaw(toView(archive), options);
+    const { data } = frame;
+    return {
+      ...frame,
+      data: new Uint16Array(data.buffer, data.byteOffset, data.length / 2),
+    };
+  }
+
+  /**
+   * Adjusts the native thread pool shared by all instances. Limits apply
+   * to calls that have not started yet.
+   * @param options per class thread limits, CPU affinity and per call
+   * thread budget
+   */
+  static configureScheduler(options: SchedulerOptions): void {
+    librawAddon.LibRawWrapper.configureScheduler(options);
+  }
+
+  /**
+   * Returns the queue depth, running count and queueing delay of every
+   * scheduling class.
+   * @param reset start a new measurement period after reading
+   */
+  static schedulerStats(reset = false): Record<Priority, PriorityStats> {
+    return librawAddon.LibRawWrapper.schedulerStats(reset);
+  }
+
+  /**
+   * Sizes the hot-file cache shared by all instances. When an instance
+   * that opened a file by path opens another input, is recycled or is
+   * garbage collected, its processor is kept in the cache with the file
+   * parsed and possibly unpacked. Opening the unchanged file again, e.g. to
+   * render a crop after extracting the thumbnail, then skips reading and
+   * decoding it. The least recently used files are dropped first.
+   *
+   * The cache is disabled by default. Call {@link LibRaw.recycle} when done
+   * with an instance so its file becomes available to the next one.
+   * @param options the capacity of the cache
+   */
+  static configureCache(options: CacheOptions): void {
+    librawAddon.LibRawWrapper.configureCache(options);
+  }
+
+  /**
+   * Returns the size and hit counts of the hot-file cache.
+   */
+  static cacheStats(): CacheStats {
+    return librawAddon.LibRawWrapper.cacheStats();
+  }
+
+  /**
+   * Enables the on-disk cache of {@link LibRaw.preview} results, shared by
+   * all instances and by processes using the same directory. Entries are
+   * keyed by the content of the file and the options, written atomically,
+   * and the least recently used ones are removed once the directory
+   * exceeds `maxBytes`. Throws if the directory cannot be used.
+   * @param options the directory and its size limit
+   */
+  static configureRenderCache(options: RenderCacheOptions): void {
+    librawAddon.LibRawWrapper.configureRenderCache(options);
+  }
+
+  /**
+   * Returns the size and hit counts of the render cache.
+   */
+  static renderCacheStats(): RenderCacheStats {
+    return librawAddon.LibRawWrapper.renderCacheStats();
+  }
+
+  /**
+   * Starts recording a span for every native phase: queue waits, the call
+   * on its pool thread, and within it opening, parsing, unpacking and
+   * thumbnail extraction, then wrapping the result on the JS thread. Spans
+   * of a call carry the file name and camera model. Each thread keeps its
+   * most recent events in a fixed-size ring.
+   * @param options how many events to keep
+   */
+  static startTrace(options: TraceOptions = {}): void {
+    librawAddon.LibRawWrapper.startTrace(options.eventsPerThread ?? 65536);
+  }
+
+  /**
+   * Stops recording and returns the spans as Chrome Trace Event JSON, to be
+   * loaded into `chrome://tracing` or Perfetto.
+   */
+  static stopTrace(): string {
+    return librawAddon.LibRawWrapper.stopTrace();
+  }
+
+  /**
+   * Returns the state and hit counts of the read-ahead used by
+   * {@link LibRaw.ingest} when `prefetchBytes` is set.
+   */
+  static prefetchStats(): PrefetchStats {
+    return librawAddon.LibRawWrapper.prefetchStats();
+  }
+
+  private static ingestOptions(
+    options: IngestOptions
+  ): Required<IngestOptions> {
+    const concurrency =
+      options.concurrency ?? librawAddon.LibRawWrapper.poolSize();
+    if (!Number.isInteger(concurrency) || concurrency < 1) {
+      throw new TypeError('concurrency must be a positive integer');
+    }
+    return { concurrency, ordered: options.ordered ?? false };
+  }
+
+  private static prefetchLookahead(
+    options: LibRawIngestOptions
+  ): Lookahead<string> | undefined {
+    const maxBytes = options.prefetchBytes ?? 0;
+    if (typeof maxBytes !== 'number' || !(maxBytes >= 0)) {
+      throw new TypeError('prefetchBytes must be a non-negative number');
+    }
+    if (maxBytes === 0) {
+      return undefined;
+    }
+    if (options.workers) {
+      throw new TypeError('prefetchBytes cannot be combined with workers');
+    }
+    return {
+      // the byte budget decides how far reads actually run ahead
+      depth: PREFETCH_DEPTH,
+      hint: (filename: string) =>
+        librawAddon.LibRawWrapper.prefetch([filename], maxBytes),
+      cancel: (filename: string) =>
+        librawAddon.LibRawWrapper.cancelPrefetch([filename]),
+    };
+  }
+
   /**
    * This call returns count of non-fatal data errors (out of range, etc) occured in unpack() stage.
    */
@@ -68,7 +739,9 @@ export class LibRaw {
    * @param buffer the RAW file data
    */
   readBuffer(buffer: Buffer): Promise<void> {
-    return this.accessLibRaw<void>(() => this.libraw.open_buffer(buffer));
+    return this.accessLibRaw<void>(async () => {
+      await this.libraw.open_buffer(buffer);
+    });
   }
 
   /**
@@ -78,6 +751,21 @@ export class LibRaw {
     return this.accessLibRaw(() => this.libraw.getMetadata());
   }
 
+  /**
+   * Returns selected members of the RAW metadata, keyed by their path,
+   * without converting the rest.
+   *
+   * ```ts
+   * const { 'idata.model': model, 'other.iso_speed': iso } =
+   *   await lr.getMetadataFields(['idata.model', 'other.iso_speed']);
+   * ```
+   * @param paths dotted paths of numbers, strings or arrays, as found in
+   * {@link LibRaw.getMetadata}
+   */
+  getMetadataFields(paths: string[]): Promise<{ [path: string]: unknown }> {
+    return this.accessLibRaw(() => this.libraw.getMetadataFields(paths));
+  }
+
   /**
    * Helper function that returns the XMP data of the RAW file.
    */
@@ -85,6 +773,42 @@ export class LibRaw {
     return this.accessLibRaw(() => this.libraw.getXmp());
   }
 
+  /**
+   * Reads selected XMP properties natively, without parsing the packet as
+   * XML in JS.
+   *
+   * ```ts
+   * const { 'xmp:Rating': rating, 'dc:subject': keywords } =
+   *   await lr.getXmpFields({ 'xmp:Rating': 'number', 'dc:subject': 'array' });
+   * ```
+   * @param fields the properties to read and, optionally, their types
+   */
+  getXmpFields<S extends XmpFieldSpec>(fields: S): Promise<XmpFields<S>> {
+    return this.accessLibRaw(
+      () => this.libraw.getXmpFields(fields) as XmpFields<S>
+    );
+  }
+
+  /**
+   * Registers TIFF/EXIF tags that are not part of the metadata, such as
+   * `0xa431` (BodySerialNumber) or makernote lens IDs. They are collected
+   * by LibRaw's EXIF parser while the following files are opened, without
+   * reading the file a second time, and returned by
+   * {@link LibRaw.getExifTags}.
+   * @param tags the tags to collect, an empty array to stop collecting
+   */
+  setExifTags(tags: ExifTag[]): Promise<void> {
+    return this.accessLibRaw(() => this.libraw.setExifTags(tags));
+  }
+
+  /**
+   * Returns the tags registered with {@link LibRaw.setExifTags} that were
+   * found in the open file.
+   */
+  getExifTags(): Promise<ExifTags> {
+    return this.accessLibRaw(() => this.libraw.getExifTags());
+  }
+
   /**
    * Unpacks and returns the bytes for the image's thumbnail.
    */
@@ -100,10 +824,39 @@ export class LibRaw {
    * The function returns an integer number in accordance with the return code convention:
    * positive if any system call has returned an error, negative (from the LibRaw error list)
    * if there has been an error situation within LibRaw.
-   * @param buffer the image data
+   *
+   * The data is read in place, without copying, and is kept alive until the
+   * instance is recycled or opens another input. Views over a
+   * `SharedArrayBuffer` are supported; the bytes must not be modified (or
+   * an `ArrayBuffer` transferred) while LibRaw is using them.
+   * @param buffer the image data, or a buffer the view is taken from
+   * @param byteOffset offset of the image data when `buffer` is an `ArrayBuffer`
+   * @param byteLength length of the image data when `buffer` is an `ArrayBuffer`
+   * @param options scheduling class of the call
    */
-  openBuffer(buffer: Buffer): Promise<number> {
-    return this.accessLibRaw(() => this.libraw.open_buffer(buffer));
+  openBuffer(
+    buffer: ArrayBufferView | ArrayBuffer | SharedArrayBuffer,
+    byteOffset?: number,
+    byteLength?: number,
+    options: CallOptions = {}
+  ): Promise<number> {
+    return this.schedule(options.priority, () =>
+      this.libraw.open_buffer(toView(buffer, byteOffset, byteLength))
+    );
+  }
+
+  /**
+   * Opens an already open file descriptor, e.g. `FileHandle.fd`. The
+   * descriptor is read with pread(2), so its file position is left
+   * untouched, and it may be closed once this call resolves.
+   *
+   * Returns 0 on success, or an error code following the same convention
+   * as {@link LibRaw.openBuffer}.
+   * @param fd the file descriptor
+   * @param options scheduling class of the call
+   */
+  openFd(fd: number, options: CallOptions = {}): Promise<number> {
+    return this.schedule(options.priority, () => this.libraw.open_fd(fd));
   }
 
   /**
@@ -113,9 +866,14 @@ export class LibRaw {
    *
    * @param filename the file path to open
    * @param bigfileSize optional parameter bigfile_size controls background I/O interface used for file operations
+   * @param options scheduling class of the call
    */
-  openFile(filename: string, bigFileSize?: number): Promise<number> {
-    return this.accessLibRaw(() => {
+  openFile(
+    filename: string,
+    bigFileSize?: number,
+    options: CallOptions = {}
+  ): Promise<number> {
+    return this.schedule(options.priority, () => {
       if (bigFileSize === undefined) {
         return this.libraw.open_file(filename);
       }
@@ -123,12 +881,225 @@ export class LibRaw {
     });
   }
 
+  /**
+   * Opens a file and returns the requested metadata, thumbnail, XMP packet
+   * and content hash in a single native call. The file stays open on this
+   * instance, so it can be unpacked or queried further afterwards.
+   *
+   * Rejects if the file cannot be read or parsed. A missing thumbnail or
+   * XMP packet is reported by omitting the corresponding field.
+   * @param filename the file path to open
+   * @param options the parts to extract
+   */
+  extract(
+    filename: string,
+    options: ExtractOptions = {}
+  ): Promise<ExtractResult> {
+    return this.schedule(options.priority, () =>
+      this.libraw.extract(filename, options)
+    );
+  }
+
+  /**
+   * Computes the perceptual hashes of the open file's embedded thumbnail.
+   * Near-duplicate images, such as different exposures or crops of the
+   * same scene, differ in only a few bits.
+   *
+   * Rejects if the file has no thumbnail in a format that can be decoded.
+   * @param options scheduling class of the call
+   */
+  perceptualHash(options: CallOptions = {}): Promise<PerceptualHashes> {
+    return this.schedule(options.priority, () =>
+      this.libraw.perceptual_hash()
+    );
+  }
+
+  /**
+   * Renders an 8 bit RGB preview of a file, unrotated, whose longer side
+   * is at most `size` pixels.
+   *
+   * With the render cache enabled (see {@link LibRaw.configureRenderCache})
+   * a preview rendered before, by any process, is read from the cache and
+   * the file is not opened; `data` is then a view of the mapped cache
+   * entry. Otherwise the file is opened on this instance, as by
+   * {@link LibRaw.extract}, and stays open afterwards.
+   * @param filename the file path to preview
+   * @param options source and size of the preview
+   */
+  preview(
+    filename: string,
+    options: PreviewOptions = {}
+  ): Promise<ProcessedImage> {
+    return this.schedule(options.priority, () =>
+      this.libraw.preview(filename, options)
+    );
+  }
+
+  /**
+   * Number of shots in the open file, `idata.raw_count`, at least 1.
+   */
+  shotCount(): Promise<number> {
+    return this.accessLibRaw(() => this.libraw.shot_count());
+  }
+
+  /**
+   * Unpacks every shot of a multi-shot file (pixel shift, dual exposure,
+   * ...) in parallel. The open input is read once and shared; each shot is
+   * decoded by its own processor on the native thread pool, so this
+   * instance's own state is left as it is.
+   * @param options the kind of frame to return
+   */
+  unpackAll(options: ShotOptions = {}): Promise<Frame[]> {
+    return this.schedule(options.priority, () =>
+      this.libraw.unpack_shots(options)
+    );
+  }
+
+  /**
+   * Calls `fn` with every shot of the open file in order, unpacking one
+   * shot at a time to keep memory bounded. The next shot is not unpacked
+   * until the promise returned by `fn` settles.
+   * @param fn receives each frame
+   * @param options the kind of frame to return
+   */
+  async forEachShot(
+    fn: (frame: Frame) => void | Promise<void>,
+    options: ShotOptions = {}
+  ): Promise<void> {
+    const count = await this.shotCount();
+    for (let shot = 0; shot < count; shot++) {
+      const [frame] = await this.schedule(options.priority, () =>
+        this.libraw.unpack_shots({ ...options, shots: [shot] })
+      );
+      await fn(frame);
+    }
+  }
+
+  /**
+   * Develops a single rectangle of the image, e.g. a 1:1 crop around the
+   * focus point, without processing the whole frame. Unpacks the raw data
+   * first if {@link LibRaw.unpack} has not been called.
+   *
+   * Coordinates are in the unrotated visible area (`sizes.width` by
+   * `sizes.height`). The crop is demosaiced bilinearly, white balanced
+   * as shot and converted to sRGB with the BT.709 gamma curve and no
+   * automatic brightening. Bayer and X-Trans sensors are supported.
+   * @param region the rectangle to render
+   * @param options output depth and coordinate origin
+   */
+  renderRegion(
+    region: Region,
+    options: RenderOptions = {}
+  ): Promise<ProcessedImage> {
+    return this.schedule(options.priority, () =>
+      this.libraw.render_region(region, options)
+    );
+  }
+
+  /**
+   * Develops the image into a float32 RGB tensor for inference, resized to
+   * `width` by `height`. Samples are in [0, 1] before `mean` and `std` are
+   * applied. The image goes straight from the raw data to `out`, without an
+   * intermediate 8 or 16 bit image; large reductions average the raw
+   * samples of each output pixel instead of demosaicing at full size.
+   * @param out receives `width * height * 3` samples
+   * @param options shape, layout and normalization of the tensor
+   */
+  async renderTensor(
+    out: Float32Array,
+    options: TensorOptions
+  ): Promise<Float32Array> {
+    await this.schedule(options.priority, () =>
+      this.libraw.render_tensor(out, options)
+    );
+    return out;
+  }
+
+  /**
+   * Develops the image, or a region of it, with the pipeline of
+   * {@link LibRaw.renderRegion} and encodes it as JPEG or TIFF on the
+   * worker pool. Rows go from the renderer straight into the encoder, so
+   * only the encoded file is returned and no uncompressed copy of the
+   * whole image is made for JPEG. TIFF output is 16 bit unless `bits` is
+   * given, with samples in the byte order of this machine.
+   * @param options format, quality, ICC profile, region and depth
+   */
+  renderEncoded(options: EncodedRenderOptions): Promise<Buffer> {
+    return this.schedule(options.priority, () =>
+      this.libraw.render_encoded(options)
+    );
+  }
+
+  /**
+   * Archives the raw frame of the open image, margins included, so it can
+   * be kept compactly and reprocessed later. Samples are packed to the
+   * bits the frame needs, at least `color.raw_bps`, and by default
+   * compressed losslessly, typically to well under half of their 16 bit
+   * size. Tiles of rows are coded in parallel on the worker pool; use
+   * {@link LibRaw.decodeRaw} to get the samples back. Only raw data with
+   * one sample per pixel, such as Bayer and X-Trans, can be archived.
+   * @param options compression and tile height
+   */
+  exportRaw(options: RawExportOptions = {}): Promise<Buffer> {
+    return this.schedule(options.priority, () =>
+      this.libraw.export_raw(options)
+    );
+  }
+
+  /**
+   * Develops the whole image as a sequence of full width bands, top to
+   * bottom, using the same pipeline as {@link LibRaw.renderRegion}. Only
+   * the raw data and the band being produced are held in memory, unlike
+   * a full `dcraw_process`, so large images can be piped into an encoder or
+   * a file with bounded memory. The next band is developed only when the
+   * consumer asks for it.
+   * @param options band height, output depth and coordinate origin
+   */
+  async *renderBands(options: BandOptions = {}): AsyncGenerator<ImageBand> {
+    const { bandHeight = 256, ...renderOptions } = options;
+    if (!Number.isInteger(bandHeight) || bandHeight < 1) {
+      throw new TypeError('bandHeight must be a positive integer');
+    }
+    let y = 0;
+    let imageHeight = Infinity;
+    while (y < imageHeight) {
+      const top = y;
+      const band = await this.schedule(renderOptions.priority, () =>
+        this.libraw.render_rows(top, bandHeight, renderOptions)
+      );
+      imageHeight = band.imageHeight;
+      y += band.height;
+      yield band;
+    }
+  }
+
+  /**
+   * Stream of the raw pixel bytes produced by {@link LibRaw.renderBands},
+   * for piping into an encoder or a file.
+   * @param options band height, output depth and coordinate origin
+   */
+  renderStream(options: BandOptions = {}): Readable {
+    const bands = this.renderBands(options);
+    return Readable.from(
+      (async function* () {
+        for await (const band of bands) {
+          yield band.data;
+        }
+      })(),
+      { objectMode: false }
+    );
+  }
+
   cameraCount(): Promise<number> {
     return this.accessLibRaw(() => this.libraw.cameraCount());
   }
 
+  /**
+   * Returns the names of all cameras supported by LibRaw, as a new array
+   * on every call.
+   */
   cameraList(): Promise<string[]> {
-    return this.accessLibRaw(() => this.libraw.cameraList());
+    return this.accessLibRaw(() => this.libraw.cameraList().slice());
   }
 
   /**
@@ -155,17 +1126,19 @@ export class LibRaw {
 
   /**
    * Unpacks the RAW files of the image, calculates the black level (not for all formats).
+   * @param options scheduling class of the call
    */
-  unpack(): Promise<number> {
-    return this.accessLibRaw(() => this.libraw.unpack());
+  unpack(options: CallOptions = {}): Promise<number> {
+    return this.schedule(options.priority, () => this.libraw.unpack());
   }
 
   /**
    * Reads (or unpacks) the image preview (thumbnail), placing the
    * result into the imgdata.thumbnail.thumb buffer.
+   * @param options scheduling class of the call
    */
-  unpackThumb(): Promise<number> {
-    return this.accessLibRaw(() => this.libraw.unpack_thumb());
+  unpackThumb(options: CallOptions = {}): Promise<number> {
+    return this.schedule(options.priority, () => this.libraw.unpack_thumb());
   }
 
   version(): Promise<string> {
@@ -179,15 +1152,66 @@ export class LibRaw {
   /**
    * Abstracts interactions with LibRaw to avoid boilerplate
    * async code repetitions in public methods.
+   *
+   * Decoding work runs on the addon's native thread pool, so calls are
+   * chained to make sure each one observes the effects of the calls made
+   * before it on the same instance.
    * @param executor the interaction with LibRaw
    */
-  private accessLibRaw<T>(executor: () => T): Promise<T> {
-    return new Promise((resolve, reject) => {
-      try {
-        resolve(executor());
-      } catch (e: unknown) {
-        reject(e);
-      }
+  private accessLibRaw<T>(executor: () => T | Promise<T>): Promise<T> {
+    const result = this.pending.then(executor);
+    this.pending = result.catch(() => undefined);
+    return result;
+  }
+
+  /**
+   * Like {@link LibRaw.accessLibRaw}, but queues the native work of the
+   * call in the given scheduling class.
+   * @param priority the scheduling class, `normal` when omitted
+   * @param executor the interaction with LibRaw
+   */
+  private schedule<T>(
+    priority: Priority | undefined,
+    executor: () => T | Promise<T>
+  ): Promise<T> {
+    return this.accessLibRaw(() => {
+      this.libraw.set_priority(priority ?? 'normal');
+      return executor();
     });
   }
 }
+
+/**
+ * Hands out idle `LibRaw` instances to the files being ingested, so every
+ * in-flight file has its own processor and processors are reused between
+ * files. With decode workers, files are handed to them instead.
+ */
+class InstanceSet {
+  private all: LibRaw[] = [];
+  private idle: LibRaw[] = [];
+
+  constructor(private workers?: DecodeWorkers) {}
+
+  async extract(
+    filename: string,
+    options: ExtractOptions = {}
+  ): Promise<ExtractResult> {
+    if (this.workers) {
+      return this.workers.extract(filename, options);
+    }
+    let libraw = this.idle.pop();
+    if (!libraw) {
+      libraw = new LibRaw();
+      this.all.push(libraw);
+    }
+    try {
+      return await libraw.extract(filename, options);
+    } finally {
+      this.idle.push(libraw);
+    }
+  }
+
+  async recycle(): Promise<void> {
+    await Promise.all(this.all.map((libraw) => libraw.recycle()));
+  }
+}
@@ -0,0 +1,831 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_LIBRAW_FIELDS_H
+#define LIBRAWJS_LIBRAW_FIELDS_H
+
+#include "fields.h"
+#include "libraw/libraw.h"
+
+/*
+ * Field tables for the LibRaw structs exposed to JS. Adding a member to the
+ * wrapped metadata is a matter of adding a line to the relevant table.
+ *
+ * Members that need special handling (`libraw_iparams_t::xmpdata`,
+ * `libraw_colordata_t::profile`) are intentionally left out and dealt with
+ * by the consumers.
+ */
+
+template <>
+struct FieldTable<libraw_iparams_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_iparams_t, guard),
+      FIELD(libraw_iparams_t, make),
+      FIELD(libraw_iparams_t, model),
+      FIELD(libraw_iparams_t, software),
+      FIELD(libraw_iparams_t, normalized_make),
+      FIELD(libraw_iparams_t, normalized_model),
+      FIELD(libraw_iparams_t, maker_index),
+      FIELD(libraw_iparams_t, raw_count),
+      FIELD(libraw_iparams_t, dng_version),
+      FIELD(libraw_iparams_t, is_foveon),
+      FIELD(libraw_iparams_t, colors),
+      FIELD(libraw_iparams_t, filters),
+      FIELD_ARRAY(libraw_iparams_t, xtrans),
+      FIELD_ARRAY(libraw_iparams_t, xtrans_abs),
+      FIELD(libraw_iparams_t, cdesc),
+      FIELD(libraw_iparams_t, xmplen));
+};
+
+template <>
+struct FieldTable<libraw_raw_inset_crop_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_raw_inset_crop_t, cleft),
+      FIELD(libraw_raw_inset_crop_t, ctop),
+      FIELD(libraw_raw_inset_crop_t, cwidth),
+      FIELD(libraw_raw_inset_crop_t, cheight));
+};
+
+template <>
+struct FieldTable<libraw_image_sizes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_image_sizes_t, raw_height),
+      FIELD(libraw_image_sizes_t, raw_width),
+      FIELD(libraw_image_sizes_t, height),
+      FIELD(libraw_image_sizes_t, width),
+      FIELD(libraw_image_sizes_t, top_margin),
+      FIELD(libraw_image_sizes_t, left_margin),
+      FIELD(libraw_image_sizes_t, iheight),
+      FIELD(libraw_image_sizes_t, iwidth),
+      FIELD(libraw_image_sizes_t, raw_pitch),
+      FIELD(libraw_image_sizes_t, pixel_aspect),
+      FIELD(libraw_image_sizes_t, flip),
+      FIELD_ARRAY(libraw_image_sizes_t, mask),
+      FIELD(libraw_image_sizes_t, raw_inset_crops));
+};
+
+template <>
+struct FieldTable<libraw_dnglens_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_dnglens_t, MinFocal),
+      FIELD(libraw_dnglens_t, MaxFocal),
+      FIELD(libraw_dnglens_t, MaxAp4MinFocal),
+      FIELD(libraw_dnglens_t, MaxAp4MaxFocal));
+};
+
+template <>
+struct FieldTable<libraw_makernotes_lens_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      // published from `Lens` since the first release; kept for compatibility
+      FIELD_AS(libraw_makernotes_lens_t, "LensID", Lens),
+      FIELD(libraw_makernotes_lens_t, Lens),
+      FIELD(libraw_makernotes_lens_t, LensFormat),
+      FIELD(libraw_makernotes_lens_t, LensMount),
+      FIELD(libraw_makernotes_lens_t, CamID),
+      FIELD(libraw_makernotes_lens_t, CameraFormat),
+      FIELD(libraw_makernotes_lens_t, CameraMount),
+      FIELD(libraw_makernotes_lens_t, body),
+      FIELD(libraw_makernotes_lens_t, FocalType),
+      FIELD(libraw_makernotes_lens_t, LensFeatures_pre),
+      FIELD(libraw_makernotes_lens_t, LensFeatures_suf),
+      FIELD(libraw_makernotes_lens_t, MinFocal),
+      FIELD(libraw_makernotes_lens_t, MaxFocal),
+      FIELD(libraw_makernotes_lens_t, MaxAp4MinFocal),
+      FIELD(libraw_makernotes_lens_t, MaxAp4MaxFocal),
+      FIELD(libraw_makernotes_lens_t, MinAp4MinFocal),
+      FIELD(libraw_makernotes_lens_t, MinAp4MaxFocal),
+      FIELD(libraw_makernotes_lens_t, MaxAp),
+      FIELD(libraw_makernotes_lens_t, MinAp),
+      FIELD(libraw_makernotes_lens_t, CurFocal),
+      FIELD(libraw_makernotes_lens_t, CurAp),
+      FIELD(libraw_makernotes_lens_t, MaxAp4CurFocal),
+      FIELD(libraw_makernotes_lens_t, MinAp4CurFocal),
+      FIELD(libraw_makernotes_lens_t, MinFocusDistance),
+      FIELD(libraw_makernotes_lens_t, FocusRangeIndex),
+      FIELD(libraw_makernotes_lens_t, LensFStops),
+      FIELD(libraw_makernotes_lens_t, TeleconverterID),
+      FIELD(libraw_makernotes_lens_t, Teleconverter),
+      FIELD(libraw_makernotes_lens_t, AdapterID),
+      FIELD(libraw_makernotes_lens_t, Adapter),
+      FIELD(libraw_makernotes_lens_t, AttachmentID),
+      FIELD(libraw_makernotes_lens_t, Attachment),
+      FIELD(libraw_makernotes_lens_t, FocalUnits),
+      FIELD(libraw_makernotes_lens_t, FocalLengthIn35mmFormat));
+};
+
+template <>
+struct FieldTable<libraw_nikonlens_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_nikonlens_t, EffectiveMaxAp),
+      FIELD(libraw_nikonlens_t, LensIDNumber),
+      FIELD(libraw_nikonlens_t, LensFStops),
+      FIELD(libraw_nikonlens_t, MCUVersion),
+      FIELD(libraw_nikonlens_t, LensType));
+};
+
+template <>
+struct FieldTable<libraw_lensinfo_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_lensinfo_t, MinFocal),
+      FIELD(libraw_lensinfo_t, MaxFocal),
+      FIELD(libraw_lensinfo_t, MaxAp4MinFocal),
+      FIELD(libraw_lensinfo_t, MaxAp4MaxFocal),
+      FIELD(libraw_lensinfo_t, EXIF_MaxAp),
+      FIELD(libraw_lensinfo_t, LensMake),
+      FIELD(libraw_lensinfo_t, Lens),
+      FIELD(libraw_lensinfo_t, LensSerial),
+      FIELD(libraw_lensinfo_t, InternalLensSerial),
+      FIELD(libraw_lensinfo_t, FocalLengthIn35mmFormat),
+      FIELD(libraw_lensinfo_t, nikon),
+      FIELD(libraw_lensinfo_t, dng),
+      FIELD(libraw_lensinfo_t, makernotes));
+};
+
+template <>
+struct FieldTable<libraw_area_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_area_t, t),
+      FIELD(libraw_area_t, l),
+      FIELD(libraw_area_t, b),
+      FIELD(libraw_area_t, r));
+};
+
+template <>
+struct FieldTable<libraw_canon_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_canon_makernotes_t, ColorDataVer),
+      FIELD(libraw_canon_makernotes_t, ColorDataSubVer),
+      FIELD(libraw_canon_makernotes_t, SpecularWhiteLevel),
+      FIELD(libraw_canon_makernotes_t, NormalWhiteLevel),
+      FIELD_ARRAY(libraw_canon_makernotes_t, ChannelBlackLevel),
+      FIELD(libraw_canon_makernotes_t, AverageBlackLevel),
+      FIELD_ARRAY(libraw_canon_makernotes_t, multishot),
+      FIELD(libraw_canon_makernotes_t, MeteringMode),
+      FIELD(libraw_canon_makernotes_t, SpotMeteringMode),
+      FIELD(libraw_canon_makernotes_t, FlashMeteringMode),
+      FIELD(libraw_canon_makernotes_t, FlashExposureLock),
+      FIELD(libraw_canon_makernotes_t, ExposureMode),
+      FIELD(libraw_canon_makernotes_t, AESetting),
+      FIELD(libraw_canon_makernotes_t, ImageStabilization),
+      FIELD(libraw_canon_makernotes_t, FlashMode),
+      FIELD(libraw_canon_makernotes_t, FlashActivity),
+      FIELD(libraw_canon_makernotes_t, FlashBits),
+      FIELD(libraw_canon_makernotes_t, ManualFlashOutput),
+      FIELD(libraw_canon_makernotes_t, FlashOutput),
+      FIELD(libraw_canon_makernotes_t, FlashGuideNumber),
+      FIELD(libraw_canon_makernotes_t, ContinuousDrive),
+      FIELD(libraw_canon_makernotes_t, SensorWidth),
+      FIELD(libraw_canon_makernotes_t, SensorHeight),
+      FIELD(libraw_canon_makernotes_t, AFMicroAdjMode),
+      FIELD(libraw_canon_makernotes_t, AFMicroAdjValue),
+      FIELD(libraw_canon_makernotes_t, MakernotesFlip),
+      FIELD(libraw_canon_makernotes_t, RecordMode),
+      FIELD(libraw_canon_makernotes_t, SRAWQuality),
+      FIELD(libraw_canon_makernotes_t, wbi),
+      FIELD(libraw_canon_makernotes_t, RF_lensID),
+      FIELD(libraw_canon_makernotes_t, AutoLightingOptimizer),
+      FIELD(libraw_canon_makernotes_t, HighlightTonePriority),
+      FIELD(libraw_canon_makernotes_t, Quality),
+      FIELD(libraw_canon_makernotes_t, CanonLog),
+      FIELD(libraw_canon_makernotes_t, DefaultCropAbsolute),
+      FIELD(libraw_canon_makernotes_t, RecommendedImageArea),
+      FIELD(libraw_canon_makernotes_t, LeftOpticalBlack),
+      FIELD(libraw_canon_makernotes_t, UpperOpticalBlack),
+      FIELD(libraw_canon_makernotes_t, ActiveArea),
+      FIELD_ARRAY(libraw_canon_makernotes_t, ISOgain));
+};
+
+template <>
+struct FieldTable<libraw_sensor_highspeed_crop_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_sensor_highspeed_crop_t, cleft),
+      FIELD(libraw_sensor_highspeed_crop_t, ctop),
+      FIELD(libraw_sensor_highspeed_crop_t, cwidth),
+      FIELD(libraw_sensor_highspeed_crop_t, cheight));
+};
+
+template <>
+struct FieldTable<libraw_nikon_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_nikon_makernotes_t, ExposureBracketValue),
+      FIELD(libraw_nikon_makernotes_t, ActiveDLighting),
+      FIELD(libraw_nikon_makernotes_t, ShootingMode),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, ImageStabilization),
+      FIELD(libraw_nikon_makernotes_t, VibrationReduction),
+      FIELD(libraw_nikon_makernotes_t, VRMode),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, FlashSetting),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, FlashType),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, FlashExposureCompensation),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, ExternalFlashExposureComp),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, FlashExposureBracketValue),
+      FIELD(libraw_nikon_makernotes_t, FlashMode),
+      FIELD(libraw_nikon_makernotes_t, FlashExposureCompensation2),
+      FIELD(libraw_nikon_makernotes_t, FlashExposureCompensation3),
+      FIELD(libraw_nikon_makernotes_t, FlashExposureCompensation4),
+      FIELD(libraw_nikon_makernotes_t, FlashSource),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, FlashFirmware),
+      FIELD(libraw_nikon_makernotes_t, ExternalFlashFlags),
+      FIELD(libraw_nikon_makernotes_t, FlashControlCommanderMode),
+      FIELD(libraw_nikon_makernotes_t, FlashOutputAndCompensation),
+      FIELD(libraw_nikon_makernotes_t, FlashFocalLength),
+      FIELD(libraw_nikon_makernotes_t, FlashGNDistance),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, FlashGroupControlMode),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, FlashGroupOutputAndCompensation),
+      FIELD(libraw_nikon_makernotes_t, FlashColorFilter),
+      FIELD(libraw_nikon_makernotes_t, NEFCompression),
+      FIELD(libraw_nikon_makernotes_t, ExposureMode),
+      FIELD(libraw_nikon_makernotes_t, ExposureProgram),
+      FIELD(libraw_nikon_makernotes_t, nMEshots),
+      FIELD(libraw_nikon_makernotes_t, MEgainOn),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, ME_WB),
+      FIELD(libraw_nikon_makernotes_t, AFFineTune),
+      FIELD(libraw_nikon_makernotes_t, AFFineTuneIndex),
+      FIELD(libraw_nikon_makernotes_t, AFFineTuneAdj),
+      FIELD(libraw_nikon_makernotes_t, LensDataVersion),
+      FIELD(libraw_nikon_makernotes_t, FlashInfoVersion),
+      FIELD(libraw_nikon_makernotes_t, ColorBalanceVersion),
+      FIELD(libraw_nikon_makernotes_t, key),
+      FIELD_ARRAY(libraw_nikon_makernotes_t, NEFBitDepth),
+      FIELD(libraw_nikon_makernotes_t, HighSpeedCropFormat),
+      FIELD(libraw_nikon_makernotes_t, SensorHighSpeedCrop),
+      FIELD(libraw_nikon_makernotes_t, SensorWidth),
+      FIELD(libraw_nikon_makernotes_t, SensorHeight));
+};
+
+template <>
+struct FieldTable<libraw_hasselblad_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_hasselblad_makernotes_t, BaseISO),
+      FIELD(libraw_hasselblad_makernotes_t, Gain),
+      FIELD(libraw_hasselblad_makernotes_t, Sensor),
+      FIELD(libraw_hasselblad_makernotes_t, SensorUnit),
+      FIELD(libraw_hasselblad_makernotes_t, HostBody),
+      FIELD(libraw_hasselblad_makernotes_t, SensorCode),
+      FIELD(libraw_hasselblad_makernotes_t, SensorSubCode),
+      FIELD(libraw_hasselblad_makernotes_t, CoatingCode),
+      FIELD(libraw_hasselblad_makernotes_t, uncropped),
+      FIELD(libraw_hasselblad_makernotes_t, CaptureSequenceInitiator),
+      FIELD(libraw_hasselblad_makernotes_t, SensorUnitConnector),
+      FIELD(libraw_hasselblad_makernotes_t, format),
+      FIELD_ARRAY(libraw_hasselblad_makernotes_t, nIFD_CM),
+      FIELD_ARRAY(libraw_hasselblad_makernotes_t, RecommendedCrop),
+      FIELD_ARRAY(libraw_hasselblad_makernotes_t, mnColorMatrix));
+};
+
+template <>
+struct FieldTable<libraw_fuji_info_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_fuji_info_t, ExpoMidPointShift),
+      FIELD(libraw_fuji_info_t, DynamicRange),
+      FIELD(libraw_fuji_info_t, FilmMode),
+      FIELD(libraw_fuji_info_t, DynamicRangeSetting),
+      FIELD(libraw_fuji_info_t, DevelopmentDynamicRange),
+      FIELD(libraw_fuji_info_t, AutoDynamicRange),
+      FIELD(libraw_fuji_info_t, DRangePriority),
+      FIELD(libraw_fuji_info_t, DRangePriorityAuto),
+      FIELD(libraw_fuji_info_t, DRangePriorityFixed),
+      FIELD(libraw_fuji_info_t, BrightnessCompensation),
+      FIELD(libraw_fuji_info_t, FocusMode),
+      FIELD(libraw_fuji_info_t, AFMode),
+      FIELD_ARRAY(libraw_fuji_info_t, FocusPixel),
+      FIELD(libraw_fuji_info_t, PrioritySettings),
+      FIELD(libraw_fuji_info_t, FocusSettings),
+      FIELD(libraw_fuji_info_t, AF_C_Settings),
+      FIELD(libraw_fuji_info_t, FocusWarning),
+      FIELD_ARRAY(libraw_fuji_info_t, ImageStabilization),
+      FIELD(libraw_fuji_info_t, FlashMode),
+      FIELD(libraw_fuji_info_t, WB_Preset),
+      FIELD(libraw_fuji_info_t, ShutterType),
+      FIELD(libraw_fuji_info_t, ExrMode),
+      FIELD(libraw_fuji_info_t, Macro),
+      FIELD(libraw_fuji_info_t, Rating),
+      FIELD(libraw_fuji_info_t, CropMode),
+      FIELD(libraw_fuji_info_t, SerialSignature),
+      FIELD(libraw_fuji_info_t, SensorID),
+      FIELD(libraw_fuji_info_t, RAFVersion),
+      FIELD(libraw_fuji_info_t, RAFDataGeneration),
+      FIELD(libraw_fuji_info_t, RAFDataVersion),
+      FIELD(libraw_fuji_info_t, isTSNERDTS),
+      FIELD(libraw_fuji_info_t, DriveMode),
+      FIELD_ARRAY(libraw_fuji_info_t, BlackLevel),
+      FIELD_ARRAY(libraw_fuji_info_t, RAFData_ImageSizeTable),
+      FIELD(libraw_fuji_info_t, AutoBracketing),
+      FIELD(libraw_fuji_info_t, SequenceNumber),
+      FIELD(libraw_fuji_info_t, SeriesLength),
+      FIELD_ARRAY(libraw_fuji_info_t, PixelShiftOffset),
+      FIELD(libraw_fuji_info_t, ImageCount));
+};
+
+template <>
+struct FieldTable<libraw_olympus_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_olympus_makernotes_t, CameraType2),
+      FIELD(libraw_olympus_makernotes_t, ValidBits),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, SensorCalibration),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, DriveMode),
+      FIELD(libraw_olympus_makernotes_t, ColorSpace),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, FocusMode),
+      FIELD(libraw_olympus_makernotes_t, AutoFocus),
+      FIELD(libraw_olympus_makernotes_t, AFPoint),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, AFAreas),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, AFPointSelected),
+      FIELD(libraw_olympus_makernotes_t, AFResult),
+      FIELD(libraw_olympus_makernotes_t, AFFineTune),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, AFFineTuneAdj),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, SpecialMode),
+      FIELD(libraw_olympus_makernotes_t, ZoomStepCount),
+      FIELD(libraw_olympus_makernotes_t, FocusStepCount),
+      FIELD(libraw_olympus_makernotes_t, FocusStepInfinity),
+      FIELD(libraw_olympus_makernotes_t, FocusStepNear),
+      FIELD(libraw_olympus_makernotes_t, FocusDistance),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, AspectFrame),
+      FIELD_ARRAY(libraw_olympus_makernotes_t, StackedImage),
+      FIELD(libraw_olympus_makernotes_t, isLiveND),
+      FIELD(libraw_olympus_makernotes_t, Panorama_mode),
+      FIELD(libraw_olympus_makernotes_t, Panorama_frameNum));
+};
+
+template <>
+struct FieldTable<libraw_sony_info_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_sony_info_t, CameraType),
+      FIELD(libraw_sony_info_t, Sony0x9400_version),
+      FIELD(libraw_sony_info_t, Sony0x9400_ReleaseMode2),
+      FIELD(libraw_sony_info_t, Sony0x9400_SequenceImageNumber),
+      FIELD(libraw_sony_info_t, Sony0x9400_SequenceLength1),
+      FIELD(libraw_sony_info_t, Sony0x9400_SequenceFileNumber),
+      FIELD(libraw_sony_info_t, Sony0x9400_SequenceLength2),
+      FIELD(libraw_sony_info_t, AFAreaModeSetting),
+      FIELD(libraw_sony_info_t, AFAreaMode),
+      FIELD_ARRAY(libraw_sony_info_t, FlexibleSpotPosition),
+      FIELD(libraw_sony_info_t, AFPointSelected),
+      FIELD(libraw_sony_info_t, AFPointSelected_0x201e),
+      FIELD(libraw_sony_info_t, nAFPointsUsed),
+      FIELD_ARRAY(libraw_sony_info_t, AFPointsUsed),
+      FIELD(libraw_sony_info_t, AFTracking),
+      FIELD(libraw_sony_info_t, AFType),
+      FIELD_ARRAY(libraw_sony_info_t, FocusLocation),
+      FIELD(libraw_sony_info_t, FocusPosition),
+      FIELD(libraw_sony_info_t, AFMicroAdjValue),
+      FIELD(libraw_sony_info_t, AFMicroAdjOn),
+      FIELD(libraw_sony_info_t, AFMicroAdjRegisteredLenses),
+      FIELD(libraw_sony_info_t, VariableLowPassFilter),
+      FIELD(libraw_sony_info_t, LongExposureNoiseReduction),
+      FIELD(libraw_sony_info_t, HighISONoiseReduction),
+      FIELD_ARRAY(libraw_sony_info_t, HDR),
+      FIELD(libraw_sony_info_t, group2010),
+      FIELD(libraw_sony_info_t, group9050),
+      FIELD(libraw_sony_info_t, real_iso_offset),
+      FIELD(libraw_sony_info_t, MeteringMode_offset),
+      FIELD(libraw_sony_info_t, ExposureProgram_offset),
+      FIELD(libraw_sony_info_t, ReleaseMode2_offset),
+      FIELD(libraw_sony_info_t, MinoltaCamID),
+      FIELD(libraw_sony_info_t, firmware),
+      FIELD(libraw_sony_info_t, ImageCount3_offset),
+      FIELD(libraw_sony_info_t, ImageCount3),
+      FIELD(libraw_sony_info_t, ElectronicFrontCurtainShutter),
+      FIELD(libraw_sony_info_t, MeteringMode2),
+      FIELD_ARRAY(libraw_sony_info_t, SonyDateTime),
+      FIELD(libraw_sony_info_t, ShotNumberSincePowerUp),
+      FIELD(libraw_sony_info_t, PixelShiftGroupPrefix),
+      FIELD(libraw_sony_info_t, PixelShiftGroupID),
+      FIELD(libraw_sony_info_t, nShotsInPixelShiftGroup),
+      FIELD(libraw_sony_info_t, numInPixelShiftGroup),
+      FIELD(libraw_sony_info_t, prd_ImageHeight),
+      FIELD(libraw_sony_info_t, prd_ImageWidth),
+      FIELD(libraw_sony_info_t, prd_Total_bps),
+      FIELD(libraw_sony_info_t, prd_Active_bps),
+      FIELD(libraw_sony_info_t, prd_StorageMethod),
+      FIELD(libraw_sony_info_t, prd_BayerPattern),
+      FIELD(libraw_sony_info_t, SonyRawFileType),
+      FIELD(libraw_sony_info_t, RAWFileType),
+      FIELD(libraw_sony_info_t, RawSizeType),
+      FIELD(libraw_sony_info_t, Quality),
+      FIELD(libraw_sony_info_t, FileFormat),
+      FIELD_ARRAY(libraw_sony_info_t, MetaVersion));
+};
+
+template <>
+struct FieldTable<libraw_kodak_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_kodak_makernotes_t, BlackLevelTop),
+      FIELD(libraw_kodak_makernotes_t, BlackLevelBottom),
+      FIELD(libraw_kodak_makernotes_t, offset_left),
+      FIELD(libraw_kodak_makernotes_t, offset_top),
+      FIELD(libraw_kodak_makernotes_t, clipBlack),
+      FIELD(libraw_kodak_makernotes_t, clipWhite),
+      FIELD_ARRAY(libraw_kodak_makernotes_t, romm_camDaylight),
+      FIELD_ARRAY(libraw_kodak_makernotes_t, romm_camTungsten),
+      FIELD_ARRAY(libraw_kodak_makernotes_t, romm_camFluorescent),
+      FIELD_ARRAY(libraw_kodak_makernotes_t, romm_camFlash),
+      FIELD_ARRAY(libraw_kodak_makernotes_t, romm_camCustom),
+      FIELD_ARRAY(libraw_kodak_makernotes_t, romm_camAuto),
+      FIELD(libraw_kodak_makernotes_t, val018percent),
+      FIELD(libraw_kodak_makernotes_t, val100percent),
+      FIELD(libraw_kodak_makernotes_t, val170percent),
+      FIELD(libraw_kodak_makernotes_t, MakerNoteKodak8a),
+      FIELD(libraw_kodak_makernotes_t, ISOCalibrationGain),
+      FIELD(libraw_kodak_makernotes_t, AnalogISO));
+};
+
+template <>
+struct FieldTable<libraw_panasonic_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_panasonic_makernotes_t, Compression),
+      FIELD(libraw_panasonic_makernotes_t, BlackLevelDim),
+      FIELD_ARRAY(libraw_panasonic_makernotes_t, BlackLevel),
+      FIELD(libraw_panasonic_makernotes_t, Multishot),
+      FIELD(libraw_panasonic_makernotes_t, gamma),
+      FIELD_ARRAY(libraw_panasonic_makernotes_t, HighISOMultiplier),
+      FIELD(libraw_panasonic_makernotes_t, FocusStepNear),
+      FIELD(libraw_panasonic_makernotes_t, FocusStepCount),
+      FIELD(libraw_panasonic_makernotes_t, ZoomPosition),
+      FIELD(libraw_panasonic_makernotes_t, LensManufacturer));
+};
+
+template <>
+struct FieldTable<libraw_pentax_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD_ARRAY(libraw_pentax_makernotes_t, FocusMode),
+      FIELD_ARRAY(libraw_pentax_makernotes_t, AFPointSelected),
+      FIELD(libraw_pentax_makernotes_t, AFPointsInFocus),
+      FIELD(libraw_pentax_makernotes_t, FocusPosition),
+      FIELD_ARRAY(libraw_pentax_makernotes_t, DriveMode),
+      FIELD(libraw_pentax_makernotes_t, AFAdjustment),
+      FIELD(libraw_pentax_makernotes_t, MultiExposure),
+      FIELD(libraw_pentax_makernotes_t, Quality));
+};
+
+template <>
+struct FieldTable<libraw_p1_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_p1_makernotes_t, Software),
+      FIELD(libraw_p1_makernotes_t, SystemType),
+      FIELD(libraw_p1_makernotes_t, FirmwareString),
+      FIELD(libraw_p1_makernotes_t, SystemModel));
+};
+
+template <>
+struct FieldTable<libraw_samsung_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD_ARRAY(libraw_samsung_makernotes_t, ImageSizeFull),
+      FIELD_ARRAY(libraw_samsung_makernotes_t, ImageSizeCrop),
+      FIELD_ARRAY(libraw_samsung_makernotes_t, ColorSpace),
+      FIELD_ARRAY(libraw_samsung_makernotes_t, key),
+      FIELD(libraw_samsung_makernotes_t, DigitalGain),
+      FIELD(libraw_samsung_makernotes_t, DeviceType),
+      FIELD(libraw_samsung_makernotes_t, LensFirmware));
+};
+
+template <>
+struct FieldTable<libraw_metadata_common_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_metadata_common_t, FlashEC),
+      FIELD(libraw_metadata_common_t, FlashGN),
+      FIELD(libraw_metadata_common_t, CameraTemperature),
+      FIELD(libraw_metadata_common_t, SensorTemperature),
+      FIELD(libraw_metadata_common_t, SensorTemperature2),
+      FIELD(libraw_metadata_common_t, LensTemperature),
+      FIELD(libraw_metadata_common_t, AmbientTemperature),
+      FIELD(libraw_metadata_common_t, BatteryTemperature),
+      FIELD(libraw_metadata_common_t, exifAmbientTemperature),
+      FIELD(libraw_metadata_common_t, exifHumidity),
+      FIELD(libraw_metadata_common_t, exifPressure),
+      FIELD(libraw_metadata_common_t, exifWaterDepth),
+      FIELD(libraw_metadata_common_t, exifAcceleration),
+      FIELD(libraw_metadata_common_t, exifCameraElevationAngle),
+      FIELD(libraw_metadata_common_t, real_ISO),
+      FIELD(libraw_metadata_common_t, exifExposureIndex),
+      FIELD(libraw_metadata_common_t, ColorSpace),
+      FIELD(libraw_metadata_common_t, firmware),
+      FIELD(libraw_metadata_common_t, ExposureCalibrationShift),
+      FIELD(libraw_metadata_common_t, afcount));
+};
+
+template <>
+struct FieldTable<libraw_ricoh_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_ricoh_makernotes_t, AFStatus),
+      FIELD_ARRAY(libraw_ricoh_makernotes_t, AFAreaXPosition),
+      FIELD_ARRAY(libraw_ricoh_makernotes_t, AFAreaYPosition),
+      FIELD(libraw_ricoh_makernotes_t, AFAreaMode),
+      FIELD(libraw_ricoh_makernotes_t, SensorWidth),
+      FIELD(libraw_ricoh_makernotes_t, SensorHeight),
+      FIELD(libraw_ricoh_makernotes_t, CroppedImageWidth),
+      FIELD(libraw_ricoh_makernotes_t, CroppedImageHeight),
+      FIELD(libraw_ricoh_makernotes_t, WideAdapter),
+      FIELD(libraw_ricoh_makernotes_t, CropMode),
+      FIELD(libraw_ricoh_makernotes_t, NDFilter),
+      FIELD(libraw_ricoh_makernotes_t, AutoBracketing),
+      FIELD(libraw_ricoh_makernotes_t, MacroMode),
+      FIELD(libraw_ricoh_makernotes_t, FlashMode),
+      FIELD(libraw_ricoh_makernotes_t, FlashExposureComp),
+      FIELD(libraw_ricoh_makernotes_t, ManualFlashOutput));
+};
+
+template <>
+struct FieldTable<libraw_makernotes_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_makernotes_t, canon),
+      FIELD(libraw_makernotes_t, nikon),
+      FIELD(libraw_makernotes_t, hasselblad),
+      FIELD(libraw_makernotes_t, fuji),
+      FIELD(libraw_makernotes_t, olympus),
+      FIELD(libraw_makernotes_t, sony),
+      FIELD(libraw_makernotes_t, kodak),
+      FIELD(libraw_makernotes_t, panasonic),
+      FIELD(libraw_makernotes_t, pentax),
+      FIELD(libraw_makernotes_t, ricoh),
+      FIELD(libraw_makernotes_t, phaseone),
+      FIELD(libraw_makernotes_t, samsung),
+      FIELD(libraw_makernotes_t, common));
+};
+
+template <>
+struct FieldTable<libraw_shootinginfo_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_shootinginfo_t, DriveMode),
+      FIELD(libraw_shootinginfo_t, FocusMode),
+      FIELD(libraw_shootinginfo_t, MeteringMode),
+      FIELD(libraw_shootinginfo_t, AFPoint),
+      FIELD(libraw_shootinginfo_t, ExposureMode),
+      FIELD(libraw_shootinginfo_t, ExposureProgram),
+      FIELD(libraw_shootinginfo_t, ImageStabilization),
+      FIELD(libraw_shootinginfo_t, BodySerial),
+      FIELD(libraw_shootinginfo_t, InternalBodySerial));
+};
+
+template <>
+struct FieldTable<libraw_output_params_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD_ARRAY(libraw_output_params_t, greybox),
+      FIELD_ARRAY(libraw_output_params_t, cropbox),
+      FIELD_ARRAY(libraw_output_params_t, aber),
+      FIELD_ARRAY(libraw_output_params_t, gamm),
+      FIELD_ARRAY(libraw_output_params_t, user_mul),
+      FIELD(libraw_output_params_t, bright),
+      FIELD(libraw_output_params_t, threshold),
+      FIELD(libraw_output_params_t, half_size),
+      FIELD(libraw_output_params_t, four_color_rgb),
+      FIELD(libraw_output_params_t, highlight),
+      FIELD(libraw_output_params_t, use_auto_wb),
+      FIELD(libraw_output_params_t, use_camera_wb),
+      FIELD(libraw_output_params_t, use_camera_matrix),
+      FIELD(libraw_output_params_t, output_color),
+      FIELD(libraw_output_params_t, output_bps),
+      FIELD(libraw_output_params_t, output_tiff),
+      FIELD(libraw_output_params_t, output_flags),
+      FIELD(libraw_output_params_t, user_flip),
+      FIELD(libraw_output_params_t, user_qual),
+      FIELD(libraw_output_params_t, user_black),
+      FIELD_ARRAY(libraw_output_params_t, user_cblack),
+      FIELD(libraw_output_params_t, user_sat),
+      FIELD(libraw_output_params_t, med_passes),
+      FIELD(libraw_output_params_t, auto_bright_thr),
+      FIELD(libraw_output_params_t, adjust_maximum_thr),
+      FIELD(libraw_output_params_t, no_auto_bright),
+      FIELD(libraw_output_params_t, use_fuji_rotate),
+      FIELD(libraw_output_params_t, green_matching),
+      FIELD(libraw_output_params_t, dcb_iterations),
+      FIELD(libraw_output_params_t, dcb_enhance_fl),
+      FIELD(libraw_output_params_t, fbdd_noiserd),
+      FIELD(libraw_output_params_t, exp_correc),
+      FIELD(libraw_output_params_t, exp_shift),
+      FIELD(libraw_output_params_t, exp_preser),
+      FIELD(libraw_output_params_t, no_auto_scale),
+      FIELD(libraw_output_params_t, no_interpolation));
+};
+
+template <>
+struct FieldTable<libraw_internal_output_params_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_internal_output_params_t, mix_green),
+      FIELD(libraw_internal_output_params_t, raw_color),
+      FIELD(libraw_internal_output_params_t, zero_is_bad),
+      FIELD(libraw_internal_output_params_t, shrink),
+      FIELD(libraw_internal_output_params_t, fuji_width));
+};
+
+template <>
+struct FieldTable<libraw_P1_color_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD_ARRAY(libraw_P1_color_t, romm_cam));
+};
+
+template <>
+struct FieldTable<libraw_dng_levels_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_dng_levels_t, parsedfields),
+      FIELD_ARRAY(libraw_dng_levels_t, dng_cblack),
+      FIELD(libraw_dng_levels_t, dng_black),
+      FIELD_ARRAY(libraw_dng_levels_t, dng_fcblack),
+      FIELD(libraw_dng_levels_t, dng_fblack),
+      FIELD_ARRAY(libraw_dng_levels_t, dng_whitelevel),
+      FIELD_ARRAY(libraw_dng_levels_t, default_crop),
+      FIELD(libraw_dng_levels_t, preview_colorspace),
+      FIELD_ARRAY(libraw_dng_levels_t, analogbalance),
+      FIELD_ARRAY(libraw_dng_levels_t, asshotneutral),
+      FIELD(libraw_dng_levels_t, baseline_exposure),
+      FIELD(libraw_dng_levels_t, LinearResponseLimit));
+};
+
+template <>
+struct FieldTable<libraw_dng_color_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_dng_color_t, parsedfields),
+      FIELD(libraw_dng_color_t, illuminant),
+      FIELD_ARRAY(libraw_dng_color_t, calibration),
+      FIELD_ARRAY(libraw_dng_color_t, colormatrix),
+      FIELD_ARRAY(libraw_dng_color_t, forwardmatrix));
+};
+
+template <>
+struct FieldTable<ph1_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(ph1_t, format),
+      FIELD(ph1_t, key_off),
+      FIELD(ph1_t, tag_21a),
+      FIELD(ph1_t, t_black),
+      FIELD(ph1_t, split_col),
+      FIELD(ph1_t, black_col),
+      FIELD(ph1_t, split_row),
+      FIELD(ph1_t, black_row),
+      FIELD(ph1_t, tag_210));
+};
+
+template <>
+struct FieldTable<libraw_colordata_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD_ARRAY(libraw_colordata_t, curve),
+      FIELD_ARRAY(libraw_colordata_t, cblack),
+      FIELD(libraw_colordata_t, black),
+      FIELD(libraw_colordata_t, data_maximum),
+      FIELD(libraw_colordata_t, maximum),
+      FIELD_ARRAY(libraw_colordata_t, linear_max),
+      FIELD(libraw_colordata_t, fmaximum),
+      FIELD(libraw_colordata_t, fnorm),
+      FIELD_ARRAY(libraw_colordata_t, white),
+      FIELD_ARRAY(libraw_colordata_t, cam_mul),
+      FIELD_ARRAY(libraw_colordata_t, pre_mul),
+      FIELD_ARRAY(libraw_colordata_t, cmatrix),
+      FIELD_ARRAY(libraw_colordata_t, ccm),
+      FIELD_ARRAY(libraw_colordata_t, rgb_cam),
+      FIELD_ARRAY(libraw_colordata_t, cam_xyz),
+      FIELD(libraw_colordata_t, phase_one_data),
+      FIELD(libraw_colordata_t, flash_used),
+      FIELD(libraw_colordata_t, canon_ev),
+      FIELD(libraw_colordata_t, model2),
+      FIELD(libraw_colordata_t, UniqueCameraModel),
+      FIELD(libraw_colordata_t, LocalizedCameraModel),
+      FIELD(libraw_colordata_t, ImageUniqueID),
+      FIELD(libraw_colordata_t, RawDataUniqueID),
+      FIELD(libraw_colordata_t, OriginalRawFileName),
+      FIELD(libraw_colordata_t, profile_length),
+      FIELD_ARRAY(libraw_colordata_t, black_stat),
+      FIELD(libraw_colordata_t, dng_color),
+      FIELD(libraw_colordata_t, dng_levels),
+      FIELD_ARRAY(libraw_colordata_t, WB_Coeffs),
+      FIELD_ARRAY(libraw_colordata_t, WBCT_Coeffs),
+      FIELD(libraw_colordata_t, as_shot_wb_applied),
+      FIELD(libraw_colordata_t, P1_color),
+      FIELD(libraw_colordata_t, raw_bps),
+      FIELD(libraw_colordata_t, ExifColorSpace));
+};
+
+template <>
+struct FieldTable<libraw_gps_info_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD_ARRAY(libraw_gps_info_t, latitude),
+      FIELD_ARRAY(libraw_gps_info_t, longitude),
+      FIELD_ARRAY(libraw_gps_info_t, gpstimestamp),
+      FIELD(libraw_gps_info_t, altitude),
+      FIELD(libraw_gps_info_t, altref),
+      FIELD(libraw_gps_info_t, latref),
+      FIELD(libraw_gps_info_t, longref),
+      FIELD(libraw_gps_info_t, gpsstatus),
+      FIELD(libraw_gps_info_t, gpsparsed));
+};
+
+template <>
+struct FieldTable<libraw_imgother_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_imgother_t, iso_speed),
+      FIELD(libraw_imgother_t, shutter),
+      FIELD(libraw_imgother_t, aperture),
+      FIELD(libraw_imgother_t, focal_len),
+      FIELD(libraw_imgother_t, timestamp),
+      FIELD(libraw_imgother_t, shot_order),
+      FIELD_ARRAY(libraw_imgother_t, gpsdata),
+      FIELD(libraw_imgother_t, parsed_gps),
+      FIELD(libraw_imgother_t, desc),
+      FIELD(libraw_imgother_t, artist),
+      FIELD_ARRAY(libraw_imgother_t, analogbalance));
+};
+
+template <>
+struct FieldTable<libraw_thumbnail_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_thumbnail_t, twidth),
+      FIELD(libraw_thumbnail_t, theight),
+      FIELD(libraw_thumbnail_t, tlength),
+      FIELD(libraw_thumbnail_t, tcolors));
+};
+
+template <>
+struct FieldTable<libraw_rawdata_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_rawdata_t, iparams),
+      FIELD(libraw_rawdata_t, sizes),
+      FIELD(libraw_rawdata_t, ioparams),
+      FIELD(libraw_rawdata_t, color));
+};
+
+template <>
+struct FieldTable<libraw_raw_unpack_params_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_raw_unpack_params_t, use_rawspeed),
+      FIELD(libraw_raw_unpack_params_t, use_dngsdk),
+      FIELD(libraw_raw_unpack_params_t, options),
+      FIELD(libraw_raw_unpack_params_t, shot_select),
+      FIELD(libraw_raw_unpack_params_t, specials),
+      FIELD(libraw_raw_unpack_params_t, max_raw_memory_mb),
+      FIELD(libraw_raw_unpack_params_t, sony_arw2_posterization_thr),
+      FIELD(libraw_raw_unpack_params_t, coolscan_nef_gamma),
+      FIELD_ARRAY(libraw_raw_unpack_params_t, p4shot_order));
+};
+
+template <>
+struct FieldTable<libraw_data_t>
+{
+  static constexpr auto fields = std::make_tuple(
+      FIELD(libraw_data_t, sizes),
+      FIELD(libraw_data_t, idata),
+      FIELD(libraw_data_t, lens),
+      FIELD(libraw_data_t, makernotes),
+      FIELD(libraw_data_t, shootinginfo),
+      FIELD(libraw_data_t, params),
+      FIELD(libraw_data_t, rawparams),
+      FIELD(libraw_data_t, progress_flags),
+      FIELD(libraw_data_t, process_warnings),
+      FIELD(libraw_data_t, color),
+      FIELD(libraw_data_t, other),
+      FIELD(libraw_data_t, thumbnail),
+      FIELD(libraw_data_t, rawdata));
+};
+
+#endif
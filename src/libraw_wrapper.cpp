@@ -22,9 +22,49 @@
 
 #include <napi.h>
 #include "libraw_wrapper.h"
+#include "addon.h"
+#include "async_job.h"
+#include "camera_index.h"
+#include "hot_file_cache.h"
+#include "processor_pool.h"
+#include "trace.h"
+#include "worker_pool.h"
 #include "wraptypes.h"
 #include <fstream>
 
+/*
+ * Runs a single LibRaw call against a wrapper's processor on the worker pool
+ * and resolves with the call's return code.
+ */
+class ProcessorCall : public AsyncJob
+{
+public:
+  ProcessorCall(const Napi::CallbackInfo &info, const char *name, LibRawWrapper *wrapper,
+                std::function<int(LibRaw *)> call)
+      : AsyncJob(info.Env(), name), wrapper_(wrapper), call_(std::move(call))
+  {
+    // the JS object owns `wrapper`, it must outlive the job
+    this->Retain(info.This().As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    this->result_ = this->call_(this->wrapper_->processor_);
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    return Napi::Number::New(env, this->result_);
+  }
+
+private:
+  LibRawWrapper *wrapper_;
+  std::function<int(LibRaw *)> call_;
+  int result_ = 0;
+};
+
 Napi::Object LibRawWrapper::Init(Napi::Env &env, Napi::Object &exports)
 {
   Napi::HandleScope scope(env);
@@ -36,35 +76,393 @@ Napi::Object LibRawWrapper::Init(Napi::Env &env, Napi::Object &exports)
           {InstanceMethod("getMetadata", &LibRawWrapper::GetMetadata),
            InstanceMethod("getThumbnail", &LibRawWrapper::GetThumbnail),
            InstanceMethod("getXmp", &LibRawWrapper::GetXmpData),
+           InstanceMethod("getXmpFields", &LibRawWrapper::GetXmpFields),
+           InstanceMethod("getMetadataFields", &LibRawWrapper::GetMetadataFields),
+           InstanceMethod("setExifTags", &LibRawWrapper::SetExifTags),
+           InstanceMethod("getExifTags", &LibRawWrapper::GetExifTags),
            InstanceMethod("cameraCount", &LibRawWrapper::CameraCount),
            InstanceMethod("cameraList", &LibRawWrapper::CameraList),
+           InstanceMethod("export_raw", &LibRawWrapper::ExportRaw),
+           InstanceMethod("extract", &LibRawWrapper::Extract),
            InstanceMethod("open_file", &LibRawWrapper::OpenFile),
            InstanceMethod("open_buffer", &LibRawWrapper::OpenBuffer),
+           InstanceMethod("open_fd", &LibRawWrapper::OpenFd),
+           InstanceMethod("perceptual_hash", &LibRawWrapper::PerceptualHashes),
+           InstanceMethod("preview", &LibRawWrapper::Preview),
+           InstanceMethod("render_region", &LibRawWrapper::RenderRegion),
+           InstanceMethod("render_rows", &LibRawWrapper::RenderRows),
+           InstanceMethod("render_tensor", &LibRawWrapper::RenderTensor),
+           InstanceMethod("render_encoded", &LibRawWrapper::RenderEncoded),
+           InstanceMethod("shot_count", &LibRawWrapper::ShotCount),
+           InstanceMethod("unpack_shots", &LibRawWrapper::UnpackShots),
            InstanceMethod("unpack", &LibRawWrapper::Unpack),
            InstanceMethod("unpack_thumb", &LibRawWrapper::UnpackThumb),
            InstanceMethod("recycle", &LibRawWrapper::Recycle),
            InstanceMethod("error_count", &LibRawWrapper::ErrorCount),
            InstanceMethod("recycle_datastream", &LibRawWrapper::RecycleDatastream),
            InstanceMethod("strerror", &LibRawWrapper::StrError),
+           InstanceMethod("set_priority", &LibRawWrapper::SetPriority),
            InstanceMethod("version", &LibRawWrapper::Version),
-           InstanceMethod("versionNumber", &LibRawWrapper::VersionNumber)});
+           InstanceMethod("versionNumber", &LibRawWrapper::VersionNumber),
+           StaticMethod("poolSize", &LibRawWrapper::PoolSize),
+           StaticMethod("isSupported", &LibRawWrapper::IsSupported),
+           StaticMethod("hammingSearch", &LibRawWrapper::HammingSearch),
+           StaticMethod("stack", &LibRawWrapper::Stack),
+           StaticMethod("decodeRaw", &LibRawWrapper::DecodeRaw),
+           StaticMethod("configureScheduler", &LibRawWrapper::ConfigureScheduler),
+           StaticMethod("schedulerStats", &LibRawWrapper::SchedulerStats),
+           StaticMethod("configureCache", &LibRawWrapper::ConfigureCache),
+           StaticMethod("cacheStats", &LibRawWrapper::CacheStats),
+           StaticMethod("configureRenderCache", &LibRawWrapper::ConfigureRenderCache),
+           StaticMethod("renderCacheStats", &LibRawWrapper::RenderCacheStats),
+           StaticMethod("prefetch", &LibRawWrapper::Prefetch),
+           StaticMethod("cancelPrefetch", &LibRawWrapper::CancelPrefetch),
+           StaticMethod("prefetchStats", &LibRawWrapper::PrefetchStats),
+           StaticMethod("ringCreate", &LibRawWrapper::RingCreate),
+           StaticMethod("ringAttach", &LibRawWrapper::RingAttach),
+           StaticMethod("ringWrite", &LibRawWrapper::RingWrite),
+           StaticMethod("ringView", &LibRawWrapper::RingView),
+           StaticMethod("startTrace", &LibRawWrapper::StartTrace),
+           StaticMethod("stopTrace", &LibRawWrapper::StopTrace)});
 
+  AddonData::Get(env)->wrapperConstructor = Napi::Persistent(func);
   exports.Set("LibRawWrapper", func);
   return exports;
 }
 
+static const char *const PRIORITY_NAMES[PriorityCount] = {"interactive", "normal", "background"};
+
+bool LibRawWrapper::ParsePriority(Napi::Value value, Priority &priority)
+{
+  if (!value.IsString())
+  {
+    return false;
+  }
+  std::string name = value.As<Napi::String>().Utf8Value();
+  for (std::size_t i = 0; i < PriorityCount; i++)
+  {
+    if (name == PRIORITY_NAMES[i])
+    {
+      priority = static_cast<Priority>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * configureScheduler({ limits?: { [priority]: number }, affinity?: number[],
+ *                      threadsPerCall?: number })
+ *
+ * A limit of 0 removes the cap of that class. An empty affinity list lets
+ * the worker threads run on any CPU again. threadsPerCall bounds how many
+ * pool threads one call's parallel stages may use, 0 for every idle one.
+ */
+Napi::Value LibRawWrapper::ConfigureScheduler(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsObject())
+  {
+    Napi::TypeError::New(env, "configureScheduler received an invalid argument, options must be an object.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object options = info[0].As<Napi::Object>();
+
+  // every option is checked before any is applied
+  Napi::Value threadsPerCall = options.Get("threadsPerCall");
+  if (!threadsPerCall.IsUndefined() && (!threadsPerCall.IsNumber() || !(threadsPerCall.As<Napi::Number>().DoubleValue() >= 0)))
+  {
+    Napi::TypeError::New(env, "configureScheduler received an invalid argument, threadsPerCall must be a non-negative number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Napi::Value limits = options.Get("limits");
+  std::vector<std::pair<Priority, std::size_t>> caps;
+  if (!limits.IsUndefined())
+  {
+    if (!limits.IsObject())
+    {
+      Napi::TypeError::New(env, "configureScheduler received an invalid argument, limits must be an object.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    Napi::Array names = limits.As<Napi::Object>().GetPropertyNames();
+    for (uint32_t i = 0; i < names.Length(); i++)
+    {
+      Priority priority;
+      Napi::Value limit = limits.As<Napi::Object>().Get(names.Get(i));
+      if (!ParsePriority(names.Get(i), priority) || !limit.IsNumber() || !(limit.As<Napi::Number>().DoubleValue() >= 0))
+      {
+        Napi::TypeError::New(env, "configureScheduler received an invalid argument, limits must map interactive, normal or background to a non-negative number.").ThrowAsJavaScriptException();
+        return env.Undefined();
+      }
+      caps.emplace_back(priority, limit.As<Napi::Number>().Uint32Value());
+    }
+  }
+
+  Napi::Value affinity = options.Get("affinity");
+  std::vector<int> cpus;
+  if (!affinity.IsUndefined())
+  {
+    if (affinity.IsArray())
+    {
+      Napi::Array array = affinity.As<Napi::Array>();
+      for (uint32_t i = 0; i < array.Length(); i++)
+      {
+        Napi::Value cpu = array.Get(i);
+        if (!cpu.IsNumber() || cpu.As<Napi::Number>().Int32Value() < 0)
+        {
+          cpus.clear();
+          break;
+        }
+        cpus.push_back(cpu.As<Napi::Number>().Int32Value());
+      }
+    }
+    if (!affinity.IsArray() || cpus.size() != affinity.As<Napi::Array>().Length())
+    {
+      Napi::TypeError::New(env, "configureScheduler received an invalid argument, affinity must be an array of CPU numbers.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // the affinity is the only setting that can fail, so it goes first
+  WorkerPool &pool = WorkerPool::Instance();
+  if (!affinity.IsUndefined() && !pool.SetAffinity(cpus))
+  {
+    Napi::Error::New(env, "configureScheduler could not set the CPU affinity of the worker threads.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!threadsPerCall.IsUndefined())
+  {
+    pool.SetThreadsPerCall(threadsPerCall.As<Napi::Number>().Uint32Value());
+  }
+  for (const auto &cap : caps)
+  {
+    pool.SetLimit(cap.first, cap.second);
+  }
+  return env.Undefined();
+}
+
+/*
+ * Queue depth, running tasks and queueing delay per priority class. Wait
+ * times accumulate since the last call that passed `reset`.
+ */
+Napi::Value LibRawWrapper::SchedulerStats(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  bool reset = info[0].IsBoolean() && info[0].As<Napi::Boolean>().Value();
+  Napi::Object result = Napi::Object::New(env);
+  for (std::size_t i = 0; i < PriorityCount; i++)
+  {
+    PriorityStats stats = WorkerPool::Instance().Stats(static_cast<Priority>(i), reset);
+    Napi::Object entry = Napi::Object::New(env);
+    entry.Set("queued", Napi::Number::New(env, stats.queued));
+    entry.Set("running", Napi::Number::New(env, stats.running));
+    entry.Set("limit", Napi::Number::New(env, stats.limit));
+    entry.Set("started", Napi::Number::New(env, static_cast<double>(stats.started)));
+    entry.Set("helpers", Napi::Number::New(env, static_cast<double>(stats.helpers)));
+    entry.Set("meanWaitMs", Napi::Number::New(env, stats.started ? stats.totalWaitMs / stats.started : 0));
+    entry.Set("maxWaitMs", Napi::Number::New(env, stats.maxWaitMs));
+    result.Set(PRIORITY_NAMES[i], entry);
+  }
+  return result;
+}
+
+/*
+ * configureCache({ maxBytes: number, maxEntries?: number })
+ *
+ * A maxBytes of 0 disables the hot-file cache and releases its processors.
+ * maxEntries keeps its previous value when omitted, 0 means no limit.
+ */
+Napi::Value LibRawWrapper::ConfigureCache(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsObject())
+  {
+    Napi::TypeError::New(env, "configureCache received an invalid argument, options must be an object.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object options = info[0].As<Napi::Object>();
+  Napi::Value maxBytes = options.Get("maxBytes");
+  if (!maxBytes.IsNumber() || !(maxBytes.As<Napi::Number>().DoubleValue() >= 0))
+  {
+    Napi::TypeError::New(env, "configureCache received an invalid argument, maxBytes must be a non-negative number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  HotFileCache &cache = HotFileCache::Instance();
+  std::size_t entries = cache.Stats().maxEntries;
+  Napi::Value maxEntries = options.Get("maxEntries");
+  if (!maxEntries.IsUndefined())
+  {
+    if (!maxEntries.IsNumber() || !(maxEntries.As<Napi::Number>().DoubleValue() >= 0))
+    {
+      Napi::TypeError::New(env, "configureCache received an invalid argument, maxEntries must be a non-negative number.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    entries = maxEntries.As<Napi::Number>().Uint32Value();
+  }
+  cache.Configure(static_cast<std::size_t>(maxBytes.As<Napi::Number>().DoubleValue()), entries);
+  return env.Undefined();
+}
+
+Napi::Value LibRawWrapper::CacheStats(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  HotFileCacheStats stats = HotFileCache::Instance().Stats();
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("entries", Napi::Number::New(env, stats.entries));
+  result.Set("bytes", Napi::Number::New(env, stats.bytes));
+  result.Set("maxBytes", Napi::Number::New(env, stats.maxBytes));
+  result.Set("maxEntries", Napi::Number::New(env, stats.maxEntries));
+  result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+  result.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+  return result;
+}
+
+/*
+ * prefetch(paths: string[], maxBytes: number)
+ *
+ * Hints files that are about to be extracted, in order, and sets how many
+ * bytes may be read ahead of their use. Every hinted path must be
+ * extracted or cancelled.
+ */
+Napi::Value LibRawWrapper::Prefetch(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsArray())
+  {
+    Napi::TypeError::New(env, "prefetch received an invalid argument, paths must be an array of strings.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!info[1].IsNumber() || !(info[1].As<Napi::Number>().DoubleValue() >= 0))
+  {
+    Napi::TypeError::New(env, "prefetch received an invalid argument, maxBytes must be a non-negative number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array array = info[0].As<Napi::Array>();
+  std::vector<std::string> paths;
+  for (uint32_t i = 0; i < array.Length(); i++)
+  {
+    Napi::Value path = array.Get(i);
+    if (!path.IsString())
+    {
+      Napi::TypeError::New(env, "prefetch received an invalid argument, paths must be an array of strings.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    paths.push_back(path.As<Napi::String>().Utf8Value());
+  }
+  Prefetcher &prefetcher = Prefetcher::Instance();
+  prefetcher.SetBudget(static_cast<std::size_t>(info[1].As<Napi::Number>().DoubleValue()));
+  for (const std::string &path : paths)
+  {
+    prefetcher.Hint(path);
+  }
+  return env.Undefined();
+}
+
+// cancelPrefetch(paths: string[]), drops one hint per path
+Napi::Value LibRawWrapper::CancelPrefetch(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsArray())
+  {
+    Napi::TypeError::New(env, "cancelPrefetch received an invalid argument, paths must be an array of strings.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array array = info[0].As<Napi::Array>();
+  for (uint32_t i = 0; i < array.Length(); i++)
+  {
+    Napi::Value path = array.Get(i);
+    if (path.IsString())
+    {
+      Prefetcher::Instance().Cancel(path.As<Napi::String>().Utf8Value());
+    }
+  }
+  return env.Undefined();
+}
+
+Napi::Value LibRawWrapper::PrefetchStats(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  ::PrefetchStats stats = Prefetcher::Instance().Stats();
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("queued", Napi::Number::New(env, stats.queued));
+  result.Set("ready", Napi::Number::New(env, stats.ready));
+  result.Set("bytes", Napi::Number::New(env, stats.bytes));
+  result.Set("held", Napi::Number::New(env, stats.held));
+  result.Set("pooled", Napi::Number::New(env, stats.pooled));
+  result.Set("maxBytes", Napi::Number::New(env, stats.maxBytes));
+  result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+  result.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+  return result;
+}
+
+/*
+ * startTrace(eventsPerThread: number)
+ *
+ * Starts recording spans, dropping those of a previous trace. Each thread
+ * keeps its last `eventsPerThread` events.
+ */
+Napi::Value LibRawWrapper::StartTrace(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsNumber() || !(info[0].As<Napi::Number>().DoubleValue() >= 1))
+  {
+    Napi::TypeError::New(env, "startTrace received an invalid argument, eventsPerThread must be a positive number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Tracer::Instance().Start(static_cast<std::size_t>(info[0].As<Napi::Number>().DoubleValue()));
+  return env.Undefined();
+}
+
+// stopTrace(): string, the recorded spans as Chrome Trace Event JSON
+Napi::Value LibRawWrapper::StopTrace(const Napi::CallbackInfo &info)
+{
+  return Napi::String::New(info.Env(), Tracer::Instance().Stop());
+}
+
+/*
+ * Selects the class of the jobs this instance queues from now on. The JS
+ * side sets it right before each call, so it applies per call.
+ */
+void LibRawWrapper::SetPriority(const Napi::CallbackInfo &info)
+{
+  if (!ParsePriority(info[0], this->priority_))
+  {
+    Napi::TypeError::New(info.Env(), "priority must be interactive, normal or background.").ThrowAsJavaScriptException();
+  }
+}
+
+/*
+ * Number of native worker threads, i.e. how many decodes can make progress
+ * at the same time.
+ */
+Napi::Value LibRawWrapper::PoolSize(const Napi::CallbackInfo &info)
+{
+  return Napi::Number::New(info.Env(), WorkerPool::Instance().Size());
+}
+
 LibRawWrapper::LibRawWrapper(const Napi::CallbackInfo &info) : Napi::ObjectWrap<LibRawWrapper>(info)
 {
-  this->processor_ = new LibRaw();
+  this->processor_ = ProcessorPool::Instance().Acquire();
+  // collects nothing until tags are requested
+  this->processor_->set_exifparser_handler(ExifTagCollector::Callback, &this->exif_);
+}
+
+Napi::Value LibRawWrapper::QueueCall(const Napi::CallbackInfo &info, const char *name,
+                                     std::function<int(LibRaw *)> call)
+{
+  return (new ProcessorCall(info, name, this, std::move(call)))->Queue(this->priority_);
 }
 
 Napi::Value LibRawWrapper::GetThumbnail(const Napi::CallbackInfo &info)
 {
   Napi::Env env = info.Env();
+  std::lock_guard<std::mutex> lock(this->mutex_);
 
+  // copied, processors are pooled and the thumbnail memory is reused
   if (this->processor_->imgdata.thumbnail.thumb)
   {
-    return Napi::Buffer<char>::New(
+    return Napi::Buffer<char>::Copy(
         env,
         this->processor_->imgdata.thumbnail.thumb,
         this->processor_->imgdata.thumbnail.tlength);
@@ -81,11 +479,12 @@ Napi::Value LibRawWrapper::GetThumbnail(const Napi::CallbackInfo &info)
 Napi::Value LibRawWrapper::GetXmpData(const Napi::CallbackInfo &info)
 {
   Napi::Env env = info.Env();
+  std::lock_guard<std::mutex> lock(this->mutex_);
 
   char *xmp = this->processor_->imgdata.idata.xmpdata;
   if (xmp)
   {
-    return Napi::Buffer<char>::New(
+    return Napi::Buffer<char>::Copy(
         env,
         xmp,
         this->processor_->imgdata.idata.xmplen);
@@ -93,11 +492,68 @@ Napi::Value LibRawWrapper::GetXmpData(const Napi::CallbackInfo &info)
   return Napi::Object::New(env);
 }
 
+/*
+ * Reads selected properties from the XMP packet without handing the whole
+ * packet to JS; see xmp.h.
+ */
+Napi::Value LibRawWrapper::GetXmpFields(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  std::vector<XmpField> fields;
+  if (!ReadXmpSpec(env, info[0], "getXmpFields", fields))
+  {
+    return env.Undefined();
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  std::vector<XmpValue> values;
+  libraw_iparams_t &idata = this->processor_->imgdata.idata;
+  ReadXmp(idata.xmpdata, idata.xmplen, fields, values);
+  return WrapXmpFields(env, fields, values);
+}
+
+/*
+ * Selects the tags collected while the next files are opened.
+ */
+void LibRawWrapper::SetExifTags(const Napi::CallbackInfo &info)
+{
+  std::vector<ExifTagRequest> requests;
+  if (!ReadExifTagSpec(info.Env(), info[0], "setExifTags", requests))
+  {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->exif_.SetRequests(std::move(requests));
+}
+
+Napi::Value LibRawWrapper::GetExifTags(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return WrapExifTags(env, this->exif_);
+}
+
 Napi::Value LibRawWrapper::GetMetadata(const Napi::CallbackInfo &info)
 {
   Napi::Env env = info.Env();
-  libraw_data_t data = this->processor_->imgdata;
-  return WrapLibRawData(&env, &data);
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return WrapLibRawData(&env, &this->processor_->imgdata);
+}
+
+/*
+ * getMetadataFields(paths) reads only the named members, e.g.
+ * `['idata.make', 'other.iso_speed']`, instead of the whole metadata.
+ */
+Napi::Value LibRawWrapper::GetMetadataFields(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  std::vector<std::pair<std::string, FieldRef>> fields;
+  if (!ResolveMetadataFields(env, info[0], "getMetadataFields", fields))
+  {
+    return env.Undefined();
+  }
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return WrapMetadataFields(env, this->processor_->imgdata, fields);
 }
 
 Napi::Value LibRawWrapper::OpenFile(const Napi::CallbackInfo &info)
@@ -106,123 +562,390 @@ Napi::Value LibRawWrapper::OpenFile(const Napi::CallbackInfo &info)
   if (!info[0].IsString())
   {
     Napi::TypeError::New(env, "openFile received an invalid argument, filename must be a string.").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
   if (info.Length() == 2 && !info[1].IsNumber())
   {
     Napi::TypeError::New(env, "openFile received an invalid argument, bigfile_size must be a number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  std::string filename = info[0].As<Napi::String>().Utf8Value();
+  // closing the previous input may swap the processor, so `processor_` is
+  // read again afterwards
+  return this->QueueCall(info, "openFile", [this, filename](LibRaw *)
+                         {
+    TraceSpan::SetFile(filename);
+    this->CloseInput();
+    if (this->OpenCached(filename))
+    {
+      return static_cast<int>(LIBRAW_SUCCESS);
+    }
+    TraceSpan span("parse");
+    int ret = this->processor_->open_file(filename.c_str());
+    if (ret == LIBRAW_SUCCESS)
+    {
+      this->inputPath_ = filename;
+      this->cacheable_ = !this->fileId_.path.empty();
+    }
+    return ret; });
+}
+
+/*
+ * Accepts any ArrayBuffer view (Buffer, TypedArray, DataView), including
+ * views over a SharedArrayBuffer. The view's bytes are read in place; the
+ * view is referenced until the datastream is recycled.
+ */
+Napi::Value LibRawWrapper::OpenBuffer(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (info.Length() != 1 || !(info[0].IsTypedArray() || info[0].IsDataView()))
+  {
+    Napi::TypeError::New(env, "openBuffer received a null argument, buffer is required.").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
-  Napi::String filename = info[0].As<Napi::String>();
-  int ret;
-  if (info.Length() == 2)
+  void *data = nullptr;
+  std::size_t length = 0;
+  napi_status status;
+  if (info[0].IsTypedArray())
   {
-    ret = this->processor_->open_file(
-        filename.Utf8Value().c_str());
+    napi_typedarray_type type;
+    std::size_t count;
+    status = napi_get_typedarray_info(env, info[0], &type, &count, &data, nullptr, nullptr);
+    length = info[0].As<Napi::TypedArray>().ByteLength();
   }
   else
   {
-    ret = this->processor_->open_file(filename.Utf8Value().c_str());
+    status = napi_get_dataview_info(env, info[0], &length, &data, nullptr, nullptr);
   }
+  NAPI_THROW_IF_FAILED(env, status, env.Undefined());
 
-  return Napi::Value::From(env, ret);
+  this->buffer_ = Napi::Persistent(info[0].As<Napi::Object>());
+  return this->QueueCall(info, "openBuffer", [this, data, length](LibRaw *)
+                         {
+    this->CloseInput();
+    TraceSpan span("parse");
+    int ret = this->processor_->open_buffer(data, length);
+    if (ret == LIBRAW_SUCCESS)
+    {
+      this->inputData_ = data;
+      this->inputSize_ = length;
+    }
+    return ret; });
 }
 
-Napi::Value LibRawWrapper::OpenBuffer(const Napi::CallbackInfo &info)
+/*
+ * Opens an already open file descriptor through a pread based datastream.
+ * Returns a positive errno if the descriptor cannot be used.
+ */
+Napi::Value LibRawWrapper::OpenFd(const Napi::CallbackInfo &info)
 {
   Napi::Env env = info.Env();
-  if (info.Length() != 1 || !info[0].IsBuffer())
+  if (!info[0].IsNumber())
   {
-    Napi::TypeError::New(env, "openBuffer received a null argument, buffer is required.").ThrowAsJavaScriptException();
+    Napi::TypeError::New(env, "openFd received an invalid argument, fd must be a number.").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
-  Napi::Buffer<char> buffer = info[0].As<Napi::Buffer<char>>();
-  return Napi::Value::From(
-      env,
-      this->processor_->open_buffer(buffer.Data(), buffer.Length()));
+  int fd = info[0].As<Napi::Number>().Int32Value();
+  this->buffer_.Reset();
+  return this->QueueCall(info, "openFd", [this, fd](LibRaw *)
+                         {
+    this->CloseInput();
+    std::unique_ptr<FdDatastream> stream(new FdDatastream(fd));
+    if (!stream->valid())
+    {
+      return stream->error();
+    }
+    TraceSpan span("parse");
+    int ret = this->processor_->open_datastream(stream.get());
+    if (ret == LIBRAW_SUCCESS)
+    {
+      this->stream_ = std::move(stream);
+    }
+    return ret; });
 }
 
 Napi::Value LibRawWrapper::Unpack(const Napi::CallbackInfo &info)
 {
-  return Napi::Value::From(
-      info.Env(),
-      this->processor_->unpack());
+  return this->QueueCall(info, "unpack", [this](LibRaw *processor)
+                         {
+    if (this->reusedProgress_ & LIBRAW_PROGRESS_LOAD_RAW)
+    {
+      this->reusedProgress_ &= ~LIBRAW_PROGRESS_LOAD_RAW;
+      return static_cast<int>(LIBRAW_SUCCESS);
+    }
+    if (this->InputTruncated())
+    {
+      return static_cast<int>(LIBRAW_IO_ERROR);
+    }
+    TraceSpan span("unpack");
+    return processor->unpack(); });
 }
 
 Napi::Value LibRawWrapper::UnpackThumb(const Napi::CallbackInfo &info)
 {
-  return Napi::Value::From(
-      info.Env(),
-      this->processor_->unpack_thumb());
+  return this->QueueCall(info, "unpackThumb", [this](LibRaw *processor)
+                         {
+    if (this->reusedProgress_ & LIBRAW_PROGRESS_THUMB_LOAD)
+    {
+      this->reusedProgress_ &= ~LIBRAW_PROGRESS_THUMB_LOAD;
+      return static_cast<int>(LIBRAW_SUCCESS);
+    }
+    if (this->InputTruncated())
+    {
+      return static_cast<int>(LIBRAW_IO_ERROR);
+    }
+    TraceSpan span("thumbnail");
+    return processor->unpack_thumb(); });
+}
+
+/*
+ * For jobs that need the thumbnail, LibRaw refuses to load it twice.
+ */
+int LibRawWrapper::LoadThumbnail()
+{
+  if (this->processor_->imgdata.progress_flags & LIBRAW_PROGRESS_THUMB_LOAD)
+  {
+    return LIBRAW_SUCCESS;
+  }
+  if (this->InputTruncated())
+  {
+    return LIBRAW_IO_ERROR;
+  }
+  TraceSpan span("thumbnail");
+  return this->processor_->unpack_thumb();
+}
+
+/*
+ * Whether the file behind a mapped input has shrunk since it was mapped.
+ * LibRaw reading the missing pages would raise SIGBUS, so unpacking fails
+ * with an I/O error instead.
+ */
+bool LibRawWrapper::InputTruncated() const
+{
+  return this->inputData_ && this->inputData_ == this->mapped_.Data() && this->mapped_.Truncated();
 }
 
 void LibRawWrapper::Recycle(const Napi::CallbackInfo &info)
 {
-  this->processor_->recycle();
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->CloseInput();
+  this->buffer_.Reset();
 }
 
 Napi::Value LibRawWrapper::ErrorCount(const Napi::CallbackInfo &info)
 {
+  std::lock_guard<std::mutex> lock(this->mutex_);
   return Napi::Value::From(
       info.Env(),
       this->processor_->error_count());
 }
 
+/*
+ * The library-wide queries below use LibRaw's static API: `processor_` may
+ * be swapped by a pool job at any time.
+ */
 Napi::Value LibRawWrapper::VersionNumber(const Napi::CallbackInfo &info)
 {
   return Napi::Value::From(
       info.Env(),
-      this->processor_->versionNumber());
+      LibRaw::versionNumber());
 }
 
 Napi::Value LibRawWrapper::Version(const Napi::CallbackInfo &info)
 {
   return Napi::Value::From(
       info.Env(),
-      this->processor_->version());
+      LibRaw::version());
 }
 
 Napi::Value LibRawWrapper::CameraCount(const Napi::CallbackInfo &info)
 {
   return Napi::Value::From(
       info.Env(),
-      this->processor_->cameraCount());
+      LibRaw::cameraCount());
 }
 
 /*
- * `cameraList` provides a null-terminated list of camera names.
- * This function finds the limit and then allocates an Napi::Array with the
- * found limit, and loads the values to return.
- *
- * This function can almost certainly be refactored for better efficiency and readability.
+ * `cameraList` provides a null-terminated list of camera names. The list
+ * never changes, so the JS array is built once per environment and frozen;
+ * the JS side hands out copies of it.
  */
 Napi::Value LibRawWrapper::CameraList(const Napi::CallbackInfo &info)
 {
-  const char **cameraList = this->processor_->cameraList();
-  size_t i = 0;
-  while (cameraList[i] != nullptr)
+  Napi::Env env = info.Env();
+  AddonData *data = AddonData::Get(env);
+  if (data->cameraList.IsEmpty())
   {
-    i++;
+    const char **cameraList = LibRaw::cameraList();
+    size_t i = 0;
+    while (cameraList[i] != nullptr)
+    {
+      i++;
+    }
+    Napi::Array cameraListArray = Napi::Array::New(env, i);
+    for (size_t idx = 0; idx < i; idx++)
+    {
+      cameraListArray[idx] = cameraList[idx];
+    }
+    env.Global()
+        .Get("Object")
+        .As<Napi::Object>()
+        .Get("freeze")
+        .As<Napi::Function>()
+        .Call({cameraListArray});
+    data->cameraList = Napi::Persistent(cameraListArray);
   }
-  Napi::Array cameraListArray = Napi::Array::New(info.Env(), i);
-  for (size_t idx = 0; idx < i; idx++)
+  return data->cameraList.Value();
+}
+
+/*
+ * Looks a make and model up in the supported camera index. Both are
+ * normalized the same way, so `idata.normalized_make` / `normalized_model`
+ * and raw EXIF strings can be passed as is.
+ */
+Napi::Value LibRawWrapper::IsSupported(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsString() || !info[1].IsString())
   {
-    cameraListArray[idx] = cameraList[idx];
+    Napi::TypeError::New(env, "isSupported received an invalid argument, make and model must be strings.").ThrowAsJavaScriptException();
+    return env.Undefined();
   }
-  return cameraListArray;
+  return Napi::Boolean::New(
+      env,
+      CameraIndex::Instance().Contains(
+          info[0].As<Napi::String>().Utf8Value(),
+          info[1].As<Napi::String>().Utf8Value()));
 }
 
 Napi::Value LibRawWrapper::StrError(const Napi::CallbackInfo &info)
 {
   return Napi::Value::From(
       info.Env(),
-      this->processor_->strerror(info[0].As<Napi::Number>().Int32Value()));
+      libraw_strerror(info[0].As<Napi::Number>().Int32Value()));
 }
 
 void LibRawWrapper::RecycleDatastream(const Napi::CallbackInfo &info)
 {
+  std::lock_guard<std::mutex> lock(this->mutex_);
   this->processor_->recycle_datastream();
+  this->ReleaseInput();
+  this->buffer_.Reset();
+}
+
+void LibRawWrapper::ReleaseInput()
+{
+  this->mapped_.Close();
+  if (this->prefetched_.data)
+  {
+    Prefetcher::Instance().Recycle(this->prefetched_);
+  }
+  this->stream_.reset();
+  this->inputPath_.clear();
+  this->inputData_ = nullptr;
+  this->inputSize_ = 0;
+  this->cacheable_ = false;
+  this->reusedProgress_ = 0;
+}
+
+/*
+ * Closes the open input before another one is opened or the instance is
+ * recycled. A file opened by path is handed to the hot-file cache together
+ * with its processor, and the instance carries on with a fresh processor.
+ */
+void LibRawWrapper::CloseInput()
+{
+  if (this->CacheInput())
+  {
+    this->processor_ = ProcessorPool::Instance().Acquire();
+    this->processor_->set_exifparser_handler(ExifTagCollector::Callback, &this->exif_);
+  }
+  else
+  {
+    this->processor_->recycle();
+  }
+  this->ReleaseInput();
+  this->exif_.Reset();
+}
+
+/*
+ * Returns true if the cache took the processor; `processor_` must not be
+ * used afterwards.
+ */
+bool LibRawWrapper::CacheInput()
+{
+  if (!this->cacheable_)
+  {
+    return false;
+  }
+  this->cacheable_ = false;
+  HotFile file;
+  file.identity = this->fileId_;
+  file.processor = this->processor_;
+  file.mapped = std::move(this->mapped_);
+  file.exif = this->exif_;
+  // detached before another instance can take the processor over
+  this->processor_->set_exifparser_handler(nullptr, nullptr);
+  if (!HotFileCache::Instance().Put(file))
+  {
+    this->processor_->set_exifparser_handler(ExifTagCollector::Callback, &this->exif_);
+    this->mapped_ = std::move(file.mapped);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Looks `filename` up in the hot-file cache, right after `CloseInput`. On a
+ * hit the cached processor replaces this instance's, with the file open and
+ * possibly unpacked. On a miss `fileId_` is kept, so the caller can mark the
+ * input cacheable once it has opened the file itself.
+ */
+bool LibRawWrapper::OpenCached(const std::string &filename)
+{
+  HotFileCache &cache = HotFileCache::Instance();
+  if (!cache.Enabled() || StatFile(filename, this->fileId_) != 0)
+  {
+    this->fileId_ = FileIdentity();
+    return false;
+  }
+  HotFile file;
+  if (!cache.Take(this->fileId_, this->exif_.Requests(), file))
+  {
+    return false;
+  }
+  ProcessorPool::Instance().Release(this->processor_);
+  this->processor_ = file.processor;
+  this->processor_->set_exifparser_handler(ExifTagCollector::Callback, &this->exif_);
+  if (!this->exif_.Requests().empty())
+  {
+    this->exif_ = std::move(file.exif);
+  }
+  this->mapped_ = std::move(file.mapped);
+  if (this->mapped_.Data())
+  {
+    this->inputData_ = this->mapped_.Data();
+    this->inputSize_ = this->mapped_.Size();
+  }
+  else
+  {
+    this->inputPath_ = filename;
+  }
+  this->cacheable_ = true;
+  this->reusedProgress_ =
+      this->processor_->imgdata.progress_flags & (LIBRAW_PROGRESS_LOAD_RAW | LIBRAW_PROGRESS_THUMB_LOAD);
+  return true;
 }
 
 LibRawWrapper::~LibRawWrapper()
 {
-  this->processor_->recycle();
-  delete this->processor_;
+  if (!this->CacheInput())
+  {
+    ProcessorPool::Instance().Release(this->processor_);
+  }
+  // counted against the read-ahead budget until it is returned
+  if (this->prefetched_.data)
+  {
+    Prefetcher::Instance().Recycle(this->prefetched_);
+  }
 }
@@ -21,20 +21,64 @@
  */
 
 #include <napi.h>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include "libraw/libraw.h"
+#include "exif_tags.h"
+#include "fd_datastream.h"
+#include "hot_file_cache.h"
+#include "mapped_file.h"
+#include "prefetch.h"
+#include "worker_pool.h"
 
 class LibRawWrapper: public Napi::ObjectWrap<LibRawWrapper> {
   public:
     static Napi::Object Init(Napi::Env& env, Napi::Object& exports);
+    static Napi::Value PoolSize(const Napi::CallbackInfo& info);
+    static Napi::Value IsSupported(const Napi::CallbackInfo& info);
+    static Napi::Value HammingSearch(const Napi::CallbackInfo& info);
+    static Napi::Value Stack(const Napi::CallbackInfo& info);
+    static Napi::Value DecodeRaw(const Napi::CallbackInfo& info);
+    static Napi::Value ConfigureScheduler(const Napi::CallbackInfo& info);
+    static Napi::Value SchedulerStats(const Napi::CallbackInfo& info);
+    static Napi::Value ConfigureCache(const Napi::CallbackInfo& info);
+    static Napi::Value CacheStats(const Napi::CallbackInfo& info);
+    static Napi::Value ConfigureRenderCache(const Napi::CallbackInfo& info);
+    static Napi::Value RenderCacheStats(const Napi::CallbackInfo& info);
+    static Napi::Value Prefetch(const Napi::CallbackInfo& info);
+    static Napi::Value CancelPrefetch(const Napi::CallbackInfo& info);
+    static Napi::Value PrefetchStats(const Napi::CallbackInfo& info);
+    static Napi::Value RingCreate(const Napi::CallbackInfo& info);
+    static Napi::Value RingAttach(const Napi::CallbackInfo& info);
+    static Napi::Value RingWrite(const Napi::CallbackInfo& info);
+    static Napi::Value RingView(const Napi::CallbackInfo& info);
+    static Napi::Value StartTrace(const Napi::CallbackInfo& info);
+    static Napi::Value StopTrace(const Napi::CallbackInfo& info);
     LibRawWrapper(const Napi::CallbackInfo& info);
     ~LibRawWrapper();
     Napi::Value CameraCount(const Napi::CallbackInfo& info);
     Napi::Value CameraList(const Napi::CallbackInfo& info);
+    Napi::Value ExportRaw(const Napi::CallbackInfo& info);
+    Napi::Value Extract(const Napi::CallbackInfo& info);
     Napi::Value GetMetadata(const Napi::CallbackInfo& info);
+    Napi::Value GetMetadataFields(const Napi::CallbackInfo& info);
     Napi::Value GetThumbnail(const Napi::CallbackInfo& info);
     Napi::Value GetXmpData(const Napi::CallbackInfo& info);
+    Napi::Value GetXmpFields(const Napi::CallbackInfo& info);
+    Napi::Value GetExifTags(const Napi::CallbackInfo& info);
+    void SetExifTags(const Napi::CallbackInfo& info);
     Napi::Value OpenFile(const Napi::CallbackInfo& info);
     Napi::Value OpenBuffer(const Napi::CallbackInfo& info);
+    Napi::Value OpenFd(const Napi::CallbackInfo& info);
+    Napi::Value PerceptualHashes(const Napi::CallbackInfo& info);
+    Napi::Value Preview(const Napi::CallbackInfo& info);
+    Napi::Value RenderRegion(const Napi::CallbackInfo& info);
+    Napi::Value RenderRows(const Napi::CallbackInfo& info);
+    Napi::Value RenderTensor(const Napi::CallbackInfo& info);
+    Napi::Value RenderEncoded(const Napi::CallbackInfo& info);
+    Napi::Value ShotCount(const Napi::CallbackInfo& info);
+    Napi::Value UnpackShots(const Napi::CallbackInfo& info);
     Napi::Value Unpack(const Napi::CallbackInfo& info);
     Napi::Value UnpackThumb(const Napi::CallbackInfo& info);
     Napi::Value ErrorCount(const Napi::CallbackInfo& info);
@@ -42,7 +86,55 @@ class LibRawWrapper: public Napi::ObjectWrap<LibRawWrapper> {
     Napi::Value VersionNumber(const Napi::CallbackInfo& info);
     Napi::Value StrError(const Napi::CallbackInfo& info);
     void RecycleDatastream(const Napi::CallbackInfo& info);
+    void SetPriority(const Napi::CallbackInfo& info);
     void Recycle(const Napi::CallbackInfo& info);
   private:
+    friend class ProcessorCall;
+    friend class ExportRawJob;
+    friend class ExtractJob;
+    friend class RenderRegionJob;
+    friend class RenderTensorJob;
+    friend class RenderEncodedJob;
+    friend class UnpackShotsJob;
+    friend class PerceptualHashJob;
+    friend class PreviewJob;
+    // parses a scheduling class name, returns false for anything else
+    static bool ParsePriority(Napi::Value value, Priority& priority);
+    Napi::Value QueueCall(const Napi::CallbackInfo& info, const char* name, std::function<int(LibRaw*)> call);
+    // drops native inputs once LibRaw no longer reads from them
+    void ReleaseInput();
+    // closes the open input, handing a file opened by path to the hot-file cache
+    void CloseInput();
+    bool CacheInput();
+    // takes over a cached processor that has `filename` open
+    bool OpenCached(const std::string& filename);
+    // unpack_thumb, unless the thumbnail is loaded already
+    int LoadThumbnail();
+    // whether a mapped input file has been truncated under the mapping
+    bool InputTruncated() const;
     LibRaw* processor_;
+    // serializes access to `processor_` between the JS thread and the pool
+    std::mutex mutex_;
+    // pins the memory handed to `open_buffer` while LibRaw reads it
+    Napi::ObjectReference buffer_;
+    // file mapped by `extract` when the datastream is backed by memory
+    MappedFile mapped_;
+    // file read ahead for `extract`, the datastream reads from it
+    PrefetchBuffer prefetched_;
+    // datastream opened by `open_fd`, LibRaw does not own it
+    std::unique_ptr<FdDatastream> stream_;
+    // where the open image came from, so it can be opened again (e.g. per shot)
+    std::string inputPath_;
+    const void* inputData_ = nullptr;
+    std::size_t inputSize_ = 0;
+    // extra tags gathered by LibRaw's EXIF callback while opening
+    ExifTagCollector exif_;
+    // identity of the file opened by path, its path is empty when it cannot be cached
+    FileIdentity fileId_;
+    bool cacheable_ = false;
+    // LIBRAW_PROGRESS_LOAD_RAW/THUMB_LOAD of a processor taken from the cache,
+    // the next unpack/unpack_thumb succeed without repeating the work
+    unsigned reusedProgress_ = 0;
+    // scheduling class of the jobs queued next
+    Priority priority_ = Priority::Normal;
 };
\ No newline at end of file
@@ -0,0 +1,109 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "mapped_file.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile()
+{
+  this->Close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept : data_(other.data_), size_(other.size_), fd_(other.fd_)
+{
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.fd_ = -1;
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+  if (this != &other)
+  {
+    this->Close();
+    this->data_ = other.data_;
+    this->size_ = other.size_;
+    this->fd_ = other.fd_;
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.fd_ = -1;
+  }
+  return *this;
+}
+
+int MappedFile::Open(const std::string &path, bool writable)
+{
+  this->Close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return errno;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0)
+  {
+    int err = errno;
+    ::close(fd);
+    return err;
+  }
+  if (st.st_size > 0)
+  {
+    void *data = mmap(nullptr, st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      int err = errno;
+      ::close(fd);
+      return err;
+    }
+    this->data_ = static_cast<char *>(data);
+    this->size_ = st.st_size;
+    this->fd_ = fd;
+    // the whole file is read front to back at least once
+    madvise(data, this->size_, MADV_SEQUENTIAL);
+    return 0;
+  }
+  ::close(fd);
+  return 0;
+}
+
+bool MappedFile::Truncated() const
+{
+  struct stat st;
+  return this->data_ && fstat(this->fd_, &st) == 0 && static_cast<std::size_t>(st.st_size) < this->size_;
+}
+
+void MappedFile::Close()
+{
+  if (this->data_)
+  {
+    munmap(this->data_, this->size_);
+    ::close(this->fd_);
+    this->data_ = nullptr;
+    this->size_ = 0;
+    this->fd_ = -1;
+  }
+}
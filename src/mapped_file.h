@@ -0,0 +1,71 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_MAPPED_FILE_H
+#define LIBRAWJS_MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+
+/*
+ * Read-only memory mapping of a whole file. Used where the same bytes are
+ * needed by more than one consumer (hashing and LibRaw's buffer datastream)
+ * so the file is only read from disk once.
+ *
+ * Reading a page of the mapping past the end of the file raises SIGBUS, so
+ * a file truncated by another process while it is mapped would kill this
+ * one. Readers call `Truncated` right before reading the mapping at length,
+ * such as before an unpack; a truncation racing with the read itself is
+ * not caught.
+ */
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  /*
+   * Returns 0 on success, otherwise an errno value. A `writable` mapping is
+   * copy-on-write: writes are private to the process and never reach the
+   * file.
+   */
+  int Open(const std::string &path, bool writable = false);
+  void Close();
+
+  const char *Data() const { return this->data_; }
+  std::size_t Size() const { return this->size_; }
+
+  // whether the file is now shorter than the mapping
+  bool Truncated() const;
+
+private:
+  char *data_ = nullptr;
+  std::size_t size_ = 0;
+  // kept open to check the size of the mapped file, even if it is renamed
+  int fd_ = -1;
+};
+
+#endif
@@ -0,0 +1,125 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "parallel.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+  // more ranges than threads so a slow range does not hold up the call
+  const std::size_t RangesPerThread = 4;
+
+  struct Loop
+  {
+    const std::function<void(std::size_t, std::size_t)> *fn;
+    std::size_t count;
+    std::size_t step;
+    std::size_t ranges;
+    std::atomic<std::size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::size_t done = 0;
+    std::exception_ptr error;
+
+    // claims and runs ranges until none are left; `fn` is only touched
+    // for a claimed range, so a late helper never outlives the caller's
+    void Run()
+    {
+      std::size_t ran = 0;
+      std::exception_ptr error;
+      for (std::size_t range; (range = this->next.fetch_add(1)) < this->ranges; ran++)
+      {
+        std::size_t begin = range * this->step;
+        try
+        {
+          if (!error)
+          {
+            (*this->fn)(begin, std::min(begin + this->step, this->count));
+          }
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+      }
+      if (ran == 0)
+      {
+        return;
+      }
+      std::lock_guard<std::mutex> lock(this->mutex);
+      if (error && !this->error)
+      {
+        this->error = error;
+      }
+      this->done += ran;
+      if (this->done == this->ranges)
+      {
+        this->cv.notify_all();
+      }
+    }
+  };
+}
+
+void ParallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &fn)
+{
+  if (count == 0)
+  {
+    return;
+  }
+  grain = std::max<std::size_t>(grain, 1);
+  WorkerPool &pool = WorkerPool::Instance();
+  std::size_t ranges = std::min((count + grain - 1) / grain, pool.Size() * RangesPerThread);
+  if (ranges <= 1)
+  {
+    fn(0, count);
+    return;
+  }
+
+  auto loop = std::make_shared<Loop>();
+  loop->fn = &fn;
+  loop->count = count;
+  loop->step = (count + ranges - 1) / ranges;
+  loop->ranges = (count + loop->step - 1) / loop->step;
+  pool.SubmitHelpers([loop]()
+                     { loop->Run(); },
+                     std::min(loop->ranges, pool.Size()) - 1);
+  loop->Run();
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(loop->mutex);
+    loop->cv.wait(lock, [&]()
+                  { return loop->done == loop->ranges; });
+    // a helper may still hold the loop, so take the error out of it
+    error = std::move(loop->error);
+  }
+  if (error)
+  {
+    std::rethrow_exception(error);
+  }
+}
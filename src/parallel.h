@@ -0,0 +1,43 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_PARALLEL_H
+#define LIBRAWJS_PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+/*
+ * Splits `[0, count)` into contiguous ranges of at least `grain` items and
+ * runs `fn(begin, end)` for each range. The calling thread works through
+ * the ranges itself and recruits idle `WorkerPool` threads to help, within
+ * the pool's per-call budget, and the call returns once every range has
+ * been processed. An exception thrown by `fn` is rethrown to the caller.
+ *
+ * Helpers claim ranges as they start, so the caller never waits on one
+ * that has not started yet; this keeps nested use from a pool task safe
+ * even when every pool thread is busy, in which case the caller simply
+ * runs all of the ranges.
+ */
+void ParallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &fn);
+
+#endif
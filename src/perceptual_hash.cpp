@@ -0,0 +1,119 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include <cstring>
+#include <vector>
+#include "async_job.h"
+#include "libraw_wrapper.h"
+#include "phash.h"
+
+/*
+ * Unpacks the thumbnail of the open image and computes its perceptual
+ * hashes on the worker pool.
+ */
+class PerceptualHashJob : public AsyncJob
+{
+public:
+  PerceptualHashJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper)
+      : AsyncJob(info.Env(), "perceptualHash"), wrapper_(wrapper)
+  {
+    this->Retain(info.This().As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    LibRaw *processor = this->wrapper_->processor_;
+
+    int ret = this->wrapper_->LoadThumbnail();
+    if (ret != LIBRAW_SUCCESS)
+    {
+      this->SetError(std::string("perceptualHash could not unpack the thumbnail: ") + libraw_strerror(ret));
+      return;
+    }
+    if (!HashThumbnail(processor->imgdata.thumbnail, this->hash_))
+    {
+      this->SetError("perceptualHash cannot decode the thumbnail.");
+    }
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("dhash", Napi::BigInt::New(env, this->hash_.dhash));
+    result.Set("phash", Napi::BigInt::New(env, this->hash_.phash));
+    return result;
+  }
+
+private:
+  LibRawWrapper *wrapper_;
+  PerceptualHash hash_ = {};
+};
+
+Napi::Value LibRawWrapper::PerceptualHashes(const Napi::CallbackInfo &info)
+{
+  return (new PerceptualHashJob(info, this))->Queue(this->priority_);
+}
+
+/*
+ * hammingSearch(hashes: BigUint64Array, query: bigint, maxDistance: number)
+ * returns the indices of matching hashes as a Uint32Array.
+ */
+Napi::Value LibRawWrapper::HammingSearch(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsTypedArray() || info[0].As<Napi::TypedArray>().TypedArrayType() != napi_biguint64_array)
+  {
+    Napi::TypeError::New(env, "hammingSearch received an invalid argument, hashes must be a BigUint64Array.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!info[1].IsBigInt())
+  {
+    Napi::TypeError::New(env, "hammingSearch received an invalid argument, query must be a bigint.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!info[2].IsNumber() || info[2].As<Napi::Number>().Int32Value() < 0)
+  {
+    Napi::TypeError::New(env, "hammingSearch received an invalid argument, maxDistance must be a non-negative number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  napi_typedarray_type type;
+  std::size_t count;
+  void *data;
+  napi_status status = napi_get_typedarray_info(env, info[0], &type, &count, &data, nullptr, nullptr);
+  NAPI_THROW_IF_FAILED(env, status, env.Undefined());
+
+  bool lossless;
+  uint64_t query = info[1].As<Napi::BigInt>().Uint64Value(&lossless);
+  std::vector<uint32_t> matches;
+  ::HammingSearch(static_cast<const uint64_t *>(data), count, query, info[2].As<Napi::Number>().Uint32Value(), matches);
+
+  Napi::Uint32Array result = Napi::Uint32Array::New(env, matches.size());
+  if (!matches.empty())
+  {
+    std::memcpy(result.Data(), matches.data(), matches.size() * sizeof(uint32_t));
+  }
+  return result;
+}
@@ -0,0 +1,299 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "phash.h"
+#include "parallel.h"
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+
+extern "C"
+{
+#include <jpeglib.h>
+}
+
+namespace
+{
+  const double kPi = 3.14159265358979323846;
+
+  struct JpegError
+  {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+  };
+
+  void OnJpegError(j_common_ptr info)
+  {
+    std::longjmp(reinterpret_cast<JpegError *>(info->err)->jump, 1);
+  }
+
+  void IgnoreJpegMessage(j_common_ptr, int) {}
+
+  /* box filtered reduction of an 8 bit gray image to `width` x `height` */
+  std::vector<float> Reduce(const std::vector<float> &gray, int srcWidth, int srcHeight, int width, int height)
+  {
+    std::vector<float> out(static_cast<std::size_t>(width) * height);
+    for (int y = 0; y < height; y++)
+    {
+      int top = y * srcHeight / height;
+      int bottom = std::max((y + 1) * srcHeight / height, top + 1);
+      for (int x = 0; x < width; x++)
+      {
+        int left = x * srcWidth / width;
+        int right = std::max((x + 1) * srcWidth / width, left + 1);
+        float sum = 0;
+        for (int r = top; r < bottom; r++)
+        {
+          for (int c = left; c < right; c++)
+          {
+            sum += gray[static_cast<std::size_t>(r) * srcWidth + c];
+          }
+        }
+        out[y * width + x] = sum / ((bottom - top) * (right - left));
+      }
+    }
+    return out;
+  }
+
+  uint64_t DHash(const std::vector<float> &gray, int width, int height)
+  {
+    std::vector<float> small = Reduce(gray, width, height, 9, 8);
+    uint64_t hash = 0;
+    for (int y = 0; y < 8; y++)
+    {
+      for (int x = 0; x < 8; x++)
+      {
+        hash = (hash << 1) | (small[y * 9 + x] < small[y * 9 + x + 1] ? 1 : 0);
+      }
+    }
+    return hash;
+  }
+
+  uint64_t PHash(const std::vector<float> &gray, int width, int height)
+  {
+    const int n = 32;
+    std::vector<float> small = Reduce(gray, width, height, n, n);
+
+    // separable DCT-II, only the 8 lowest frequencies are needed per axis
+    static const std::vector<double> basis = []
+    {
+      std::vector<double> b(8 * n);
+      for (int u = 0; u < 8; u++)
+      {
+        for (int x = 0; x < n; x++)
+        {
+          b[u * n + x] = std::cos((2 * x + 1) * u * kPi / (2 * n));
+        }
+      }
+      return b;
+    }();
+
+    double rows[n * 8];
+    for (int y = 0; y < n; y++)
+    {
+      for (int u = 0; u < 8; u++)
+      {
+        double sum = 0;
+        for (int x = 0; x < n; x++)
+        {
+          sum += small[y * n + x] * basis[u * n + x];
+        }
+        rows[y * 8 + u] = sum;
+      }
+    }
+    double coefficients[64];
+    for (int v = 0; v < 8; v++)
+    {
+      for (int u = 0; u < 8; u++)
+      {
+        double sum = 0;
+        for (int y = 0; y < n; y++)
+        {
+          sum += rows[y * 8 + u] * basis[v * n + y];
+        }
+        coefficients[v * 8 + u] = sum;
+      }
+    }
+
+    // the median leaves out the DC term, which only carries brightness
+    double sorted[63];
+    std::copy(coefficients + 1, coefficients + 64, sorted);
+    std::nth_element(sorted, sorted + 31, sorted + 63);
+    double median = sorted[31];
+
+    uint64_t hash = 0;
+    for (int i = 0; i < 64; i++)
+    {
+      hash = (hash << 1) | (coefficients[i] > median ? 1 : 0);
+    }
+    return hash;
+  }
+
+  void HashGray(const std::vector<float> &gray, int width, int height, PerceptualHash &hash)
+  {
+    hash.dhash = DHash(gray, width, height);
+    hash.phash = PHash(gray, width, height);
+  }
+
+  void SearchRange(const uint64_t *hashes, std::size_t first, std::size_t last, uint64_t query, unsigned maxDistance, std::vector<uint32_t> &matches)
+  {
+    for (std::size_t i = first; i < last; i++)
+    {
+      if (static_cast<unsigned>(__builtin_popcountll(hashes[i] ^ query)) <= maxDistance)
+      {
+        matches.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+  /* the same loop compiled to the POPCNT instruction */
+  __attribute__((target("popcnt"))) void SearchRangePopcnt(const uint64_t *hashes, std::size_t first, std::size_t last, uint64_t query, unsigned maxDistance, std::vector<uint32_t> &matches)
+  {
+    for (std::size_t i = first; i < last; i++)
+    {
+      if (static_cast<unsigned>(__builtin_popcountll(hashes[i] ^ query)) <= maxDistance)
+      {
+        matches.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+
+  using SearchFn = void (*)(const uint64_t *, std::size_t, std::size_t, uint64_t, unsigned, std::vector<uint32_t> &);
+
+  SearchFn Search()
+  {
+    static const SearchFn search = __builtin_cpu_supports("popcnt") ? SearchRangePopcnt : SearchRange;
+    return search;
+  }
+#else
+  using SearchFn = void (*)(const uint64_t *, std::size_t, std::size_t, uint64_t, unsigned, std::vector<uint32_t> &);
+
+  SearchFn Search()
+  {
+    return SearchRange;
+  }
+#endif
+}
+
+bool HashJpeg(const unsigned char *data, std::size_t size, PerceptualHash &hash)
+{
+  jpeg_decompress_struct info;
+  JpegError error;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = OnJpegError;
+  error.manager.emit_message = IgnoreJpegMessage;
+
+  // declared before setjmp so a longjmp does not skip their destructors
+  std::vector<float> gray;
+  std::vector<JSAMPLE> row;
+  if (setjmp(error.jump))
+  {
+    jpeg_destroy_decompress(&info);
+    return false;
+  }
+
+  jpeg_create_decompress(&info);
+  jpeg_mem_src(&info, const_cast<unsigned char *>(data), static_cast<unsigned long>(size));
+  jpeg_read_header(&info, TRUE);
+  info.out_color_space = JCS_GRAYSCALE;
+  info.scale_num = 1;
+  info.scale_denom = 8;
+  jpeg_start_decompress(&info);
+
+  int width = info.output_width;
+  int height = info.output_height;
+  gray.resize(static_cast<std::size_t>(width) * height);
+  row.resize(width);
+  while (info.output_scanline < info.output_height)
+  {
+    JSAMPROW rows[1] = {row.data()};
+    JDIMENSION y = info.output_scanline;
+    jpeg_read_scanlines(&info, rows, 1);
+    std::copy(row.begin(), row.end(), gray.begin() + static_cast<std::size_t>(y) * width);
+  }
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+
+  HashGray(gray, width, height, hash);
+  return true;
+}
+
+void HashPixels(const unsigned char *pixels, int width, int height, int colors, PerceptualHash &hash)
+{
+  std::vector<float> gray(static_cast<std::size_t>(width) * height);
+  for (std::size_t i = 0; i < gray.size(); i++)
+  {
+    const unsigned char *p = pixels + i * colors;
+    // BT.601 luma, as libjpeg's grayscale conversion
+    gray[i] = colors >= 3 ? 0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] : p[0];
+  }
+  HashGray(gray, width, height, hash);
+}
+
+bool HashThumbnail(const libraw_thumbnail_t &thumbnail, PerceptualHash &hash)
+{
+  if (!thumbnail.thumb || !thumbnail.tlength)
+  {
+    return false;
+  }
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(thumbnail.thumb);
+  if (thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG)
+  {
+    return HashJpeg(data, thumbnail.tlength, hash);
+  }
+  std::size_t pixels = static_cast<std::size_t>(thumbnail.twidth) * thumbnail.theight;
+  if (thumbnail.tformat == LIBRAW_THUMBNAIL_BITMAP && pixels && (thumbnail.tcolors == 1 || thumbnail.tcolors == 3) &&
+      thumbnail.tlength >= pixels * thumbnail.tcolors)
+  {
+    HashPixels(data, thumbnail.twidth, thumbnail.theight, thumbnail.tcolors, hash);
+    return true;
+  }
+  return false;
+}
+
+void HammingSearch(const uint64_t *hashes, std::size_t count, uint64_t query, unsigned maxDistance, std::vector<uint32_t> &matches)
+{
+  SearchFn search = Search();
+  // small inputs are not worth starting threads for
+  const std::size_t grain = 1 << 20;
+  if (count <= grain)
+  {
+    search(hashes, 0, count, query, maxDistance, matches);
+    return;
+  }
+
+  std::size_t chunks = (count + grain - 1) / grain;
+  std::vector<std::vector<uint32_t>> partial(chunks);
+  ParallelFor(chunks, 1, [&](std::size_t first, std::size_t last)
+              {
+    for (std::size_t chunk = first; chunk < last; chunk++)
+    {
+      std::size_t begin = chunk * grain;
+      search(hashes, begin, std::min(begin + grain, count), query, maxDistance, partial[chunk]);
+    } });
+  for (const std::vector<uint32_t> &part : partial)
+  {
+    matches.insert(matches.end(), part.begin(), part.end());
+  }
+}
@@ -0,0 +1,68 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_PHASH_H
+#define LIBRAWJS_PHASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "libraw/libraw.h"
+
+/*
+ * 64 bit perceptual hashes of thumbnails, for near-duplicate detection.
+ *
+ * `dhash` compares horizontally adjacent pixels of a 9x8 reduction, `phash`
+ * thresholds the 8x8 lowest frequencies of the DCT of a 32x32 reduction
+ * against their median. Both operate on luma. JPEG thumbnails are decoded
+ * by libjpeg at 1/8 scale, which only runs the DC part of the IDCT and is
+ * far cheaper than a full decode.
+ */
+struct PerceptualHash
+{
+  uint64_t dhash;
+  uint64_t phash;
+};
+
+/*
+ * Hashes a JPEG image. Returns false if it cannot be decoded.
+ */
+bool HashJpeg(const unsigned char *data, std::size_t size, PerceptualHash &hash);
+
+/*
+ * Hashes an 8 bit image with `colors` interleaved channels (1 or 3).
+ */
+void HashPixels(const unsigned char *pixels, int width, int height, int colors, PerceptualHash &hash);
+
+/*
+ * Hashes an unpacked LibRaw thumbnail, JPEG or 8 bit bitmap. Returns false
+ * for other formats or if it cannot be decoded.
+ */
+bool HashThumbnail(const libraw_thumbnail_t &thumbnail, PerceptualHash &hash);
+
+/*
+ * Appends to `matches` the indices of all hashes within `maxDistance` bits
+ * of `query`, in ascending order.
+ */
+void HammingSearch(const uint64_t *hashes, std::size_t count, uint64_t query, unsigned maxDistance, std::vector<uint32_t> &matches);
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "prefetch.h"
+#include "trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+namespace
+{
+  // large enough for a spinning disk to stream, small enough to cancel
+  const std::size_t kReadChunk = 4 * 1024 * 1024;
+
+  bool ReadAll(int fd, char *out, std::size_t size)
+  {
+#ifdef __APPLE__
+    fcntl(fd, F_RDAHEAD, 1);
+#else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    std::size_t done = 0;
+    while (done < size)
+    {
+      ssize_t n = ::read(fd, out + done, std::min(kReadChunk, size - done));
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        return false;
+      }
+      done += n;
+    }
+    return true;
+  }
+}
+
+Prefetcher &Prefetcher::Instance()
+{
+  static Prefetcher *prefetcher = new Prefetcher();
+  return *prefetcher;
+}
+
+void Prefetcher::SetBudget(std::size_t maxBytes)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->maxBytes_ = maxBytes;
+  this->TrimPool(0);
+  this->changed_.notify_all();
+}
+
+void Prefetcher::Hint(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  if (!this->started_)
+  {
+    // like the worker pool, the thread lives until the process exits
+    std::thread(&Prefetcher::Run, this).detach();
+    this->started_ = true;
+  }
+  Item item;
+  item.id = this->nextId_++;
+  item.path = path;
+  this->items_.push_back(std::move(item));
+  this->changed_.notify_all();
+}
+
+void Prefetcher::Cancel(const std::string &path)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  auto item = this->Find(path);
+  if (item == this->items_.end())
+  {
+    return;
+  }
+  if (item->state == State::Reading)
+  {
+    // dropped by the I/O thread once the read completes
+    item->cancelled = true;
+    return;
+  }
+  this->Drop(item);
+}
+
+bool Prefetcher::Take(const std::string &path, PrefetchBuffer &buffer)
+{
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  auto item = this->Find(path);
+  if (item == this->items_.end())
+  {
+    return false;
+  }
+  item->taken = true;
+  // a started read is always finished, it does not wait for the budget
+  this->changed_.wait(lock, [&]
+                      { return item->state != State::Reading; });
+  bool ready = item->state == State::Ready;
+  if (ready)
+  {
+    buffer = std::move(item->buffer);
+    this->bytes_ -= buffer.capacity;
+    this->held_ += buffer.capacity;
+    this->hits_++;
+  }
+  else
+  {
+    this->misses_++;
+  }
+  this->Drop(item);
+  return ready;
+}
+
+void Prefetcher::Recycle(PrefetchBuffer &buffer)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->held_ -= buffer.capacity;
+  this->Release(buffer);
+  // the budget may have room for the next read now
+  this->changed_.notify_all();
+}
+
+PrefetchStats Prefetcher::Stats()
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  PrefetchStats stats = {0, 0, this->bytes_, this->held_, this->pooled_, this->maxBytes_, this->hits_, this->misses_};
+  for (const Item &item : this->items_)
+  {
+    stats.queued += item.state == State::Queued;
+    stats.ready += item.state == State::Ready;
+  }
+  return stats;
+}
+
+/*
+ * Reads the oldest queued file once the budget has room for it. Files are
+ * opened and measured before they fit, so the next read can start as soon
+ * as a buffer is taken. A file that is being read is never waited on by
+ * anything but its reader, which keeps `Take` from depending on the
+ * budget.
+ */
+void Prefetcher::Run()
+{
+  Tracer::NameThread("prefetch");
+  std::unique_lock<std::mutex> lock(this->mutex_);
+  for (;;)
+  {
+    auto next = std::find_if(this->items_.begin(), this->items_.end(), [](const Item &item)
+                             { return item.state == State::Queued; });
+    if (next == this->items_.end())
+    {
+      this->changed_.wait(lock);
+      continue;
+    }
+
+    if (next->fd < 0)
+    {
+      uint64_t id = next->id;
+      std::string path = next->path;
+      lock.unlock();
+      int fd = ::open(path.c_str(), O_RDONLY);
+      struct stat st;
+      bool opened = fd >= 0 && fstat(fd, &st) == 0;
+      lock.lock();
+      next = this->FindId(id);
+      if (next == this->items_.end() || !opened)
+      {
+        if (fd >= 0)
+        {
+          ::close(fd);
+        }
+        if (next != this->items_.end())
+        {
+          next->state = State::Failed;
+          this->changed_.notify_all();
+        }
+        continue;
+      }
+      next->fd = fd;
+      next->size = st.st_size;
+    }
+
+    std::size_t used = this->bytes_ + this->held_;
+    if (used > 0 && used + next->size > this->maxBytes_)
+    {
+      this->changed_.wait(lock);
+      continue;
+    }
+
+    next->state = State::Reading;
+    PrefetchBuffer buffer = this->Allocate(next->size);
+    this->bytes_ += buffer.capacity;
+    int fd = next->fd;
+    std::size_t size = next->size;
+    next->fd = -1;
+    lock.unlock();
+    bool ok = ReadAll(fd, buffer.data.get(), size);
+    ::close(fd);
+    lock.lock();
+
+    next->state = ok ? State::Ready : State::Failed;
+    if (ok)
+    {
+      next->buffer = std::move(buffer);
+      next->buffer.size = size;
+    }
+    else
+    {
+      // nothing to hand over, the reader falls back to its own read
+      this->bytes_ -= buffer.capacity;
+      this->Release(buffer);
+    }
+    if (next->cancelled)
+    {
+      this->Drop(next);
+    }
+    this->changed_.notify_all();
+  }
+}
+
+PrefetchBuffer Prefetcher::Allocate(std::size_t size)
+{
+  auto best = this->pool_.end();
+  for (auto it = this->pool_.begin(); it != this->pool_.end(); ++it)
+  {
+    if (it->capacity >= size && (best == this->pool_.end() || it->capacity < best->capacity))
+    {
+      best = it;
+    }
+  }
+  PrefetchBuffer buffer;
+  if (best != this->pool_.end())
+  {
+    buffer = std::move(*best);
+    this->pooled_ -= buffer.capacity;
+    this->pool_.erase(best);
+  }
+  else
+  {
+    buffer.capacity = std::max<std::size_t>(size, 1);
+    this->TrimPool(buffer.capacity);
+    buffer.data.reset(new char[buffer.capacity]);
+  }
+  return buffer;
+}
+
+void Prefetcher::Release(PrefetchBuffer &buffer)
+{
+  if (buffer.data && this->bytes_ + this->held_ + this->pooled_ + buffer.capacity <= this->maxBytes_)
+  {
+    this->pooled_ += buffer.capacity;
+    buffer.size = 0;
+    this->pool_.push_back(std::move(buffer));
+  }
+  buffer = PrefetchBuffer();
+}
+
+void Prefetcher::TrimPool(std::size_t extra)
+{
+  while (!this->pool_.empty() && this->bytes_ + this->held_ + this->pooled_ + extra > this->maxBytes_)
+  {
+    this->pooled_ -= this->pool_.back().capacity;
+    this->pool_.pop_back();
+  }
+}
+
+std::list<Prefetcher::Item>::iterator Prefetcher::Find(const std::string &path)
+{
+  return std::find_if(this->items_.begin(), this->items_.end(), [&](const Item &item)
+                      { return item.path == path && !item.taken && !item.cancelled; });
+}
+
+std::list<Prefetcher::Item>::iterator Prefetcher::FindId(uint64_t id)
+{
+  return std::find_if(this->items_.begin(), this->items_.end(), [&](const Item &item)
+                      { return item.id == id; });
+}
+
+void Prefetcher::Drop(std::list<Item>::iterator item)
+{
+  if (item->fd >= 0)
+  {
+    ::close(item->fd);
+  }
+  // a ready item that was not taken still holds its buffer
+  if (item->buffer.data)
+  {
+    this->bytes_ -= item->buffer.capacity;
+    this->Release(item->buffer);
+  }
+  this->items_.erase(item);
+  this->changed_.notify_all();
+}
@@ -0,0 +1,154 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_PREFETCH_H
+#define LIBRAWJS_PREFETCH_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// the contents of a file read ahead of its use
+struct PrefetchBuffer
+{
+  std::unique_ptr<char[]> data;
+  std::size_t capacity = 0;
+  std::size_t size = 0;
+};
+
+struct PrefetchStats
+{
+  // hinted files not read yet
+  std::size_t queued;
+  // files read and waiting to be taken
+  std::size_t ready;
+  // bytes held or being read for files not taken yet
+  std::size_t bytes;
+  // bytes of buffers taken and not recycled yet
+  std::size_t held;
+  // bytes of idle buffers kept for reuse
+  std::size_t pooled;
+  std::size_t maxBytes;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/*
+ * Reads files ahead of their use, so decoding does not wait on the disk.
+ *
+ * LibRaw's file datastream reads on demand in small pieces, which leaves
+ * the decode threads idle on slow disks. Batch callers hint the files they
+ * are about to open; a dedicated I/O thread reads them in hint order, in
+ * large sequential reads, into pooled buffers, and the decode later takes
+ * the buffer and parses it from memory. The thread runs ahead as far as
+ * the byte budget allows (at least one file), so reads of the next files
+ * overlap with decoding the current ones.
+ *
+ * The budget covers all memory of the prefetcher: buffers being read or
+ * waiting to be taken, buffers taken and not recycled yet, and the pool of
+ * idle buffers. Only a single file larger than the budget, read while
+ * nothing else is held, exceeds it.
+ *
+ * The prefetcher is process-wide, like the worker pool. Hints that will
+ * not be used must be cancelled, or their buffers hold the budget.
+ */
+class Prefetcher
+{
+public:
+  static Prefetcher &Instance();
+
+  void SetBudget(std::size_t maxBytes);
+  void Hint(const std::string &path);
+  // drops the oldest hint for `path`
+  void Cancel(const std::string &path);
+
+  /*
+   * Hands over the contents of the oldest hint for `path`, waiting if it is
+   * being read. Returns false, dropping the hint, if the file has not been
+   * started or could not be read; the caller then reads it itself.
+   */
+  bool Take(const std::string &path, PrefetchBuffer &buffer);
+  // returns a buffer handed out by `Take` for reuse
+  void Recycle(PrefetchBuffer &buffer);
+
+  PrefetchStats Stats();
+
+private:
+  enum class State
+  {
+    Queued,
+    Reading,
+    Ready,
+    Failed,
+  };
+
+  struct Item
+  {
+    uint64_t id;
+    std::string path;
+    State state = State::Queued;
+    // opened and measured by the I/O thread, -1 until then
+    int fd = -1;
+    std::size_t size = 0;
+    // a reader is waiting for the item, or it is no longer wanted
+    bool taken = false;
+    bool cancelled = false;
+    PrefetchBuffer buffer;
+  };
+
+  Prefetcher() = default;
+
+  void Run();
+  PrefetchBuffer Allocate(std::size_t size);
+  // pools an idle buffer if the budget has room for it, frees it otherwise
+  void Release(PrefetchBuffer &buffer);
+  // frees pooled buffers until `extra` more bytes fit the budget
+  void TrimPool(std::size_t extra);
+  // the oldest item for `path` that is still wanted
+  std::list<Item>::iterator Find(const std::string &path);
+  std::list<Item>::iterator FindId(uint64_t id);
+  // unlinks an item, releasing what it holds
+  void Drop(std::list<Item>::iterator item);
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::list<Item> items_;
+  // idle buffers, bounded by the budget
+  std::vector<PrefetchBuffer> pool_;
+  std::size_t pooled_ = 0;
+  std::size_t maxBytes_ = 0;
+  // capacity of the buffers of items being read or ready
+  std::size_t bytes_ = 0;
+  // capacity of the buffers handed out by `Take`
+  std::size_t held_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t nextId_ = 0;
+  bool started_ = false;
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "preview.h"
+#include <algorithm>
+#include <csetjmp>
+#include <cstdint>
+#include <cstdio>
+
+extern "C"
+{
+#include <jpeglib.h>
+}
+
+namespace
+{
+  struct JpegError
+  {
+    jpeg_error_mgr manager;
+    std::jmp_buf jump;
+  };
+
+  void OnJpegError(j_common_ptr info)
+  {
+    std::longjmp(reinterpret_cast<JpegError *>(info->err)->jump, 1);
+  }
+
+  void IgnoreJpegMessage(j_common_ptr, int) {}
+
+  void FitSize(int width, int height, int maxSize, int &outWidth, int &outHeight)
+  {
+    double scale = std::min(1.0, static_cast<double>(maxSize) / std::max(width, height));
+    outWidth = std::max(1, static_cast<int>(width * scale + 0.5));
+    outHeight = std::max(1, static_cast<int>(height * scale + 0.5));
+  }
+}
+
+void FitPixels(const unsigned char *pixels, int width, int height, int colors, int maxSize, PreviewImage &image)
+{
+  FitSize(width, height, maxSize, image.width, image.height);
+  image.data.resize(static_cast<std::size_t>(image.width) * image.height * 3);
+
+  std::vector<uint64_t> sums(static_cast<std::size_t>(image.width) * 3);
+  for (int y = 0; y < image.height; y++)
+  {
+    int top = static_cast<int>(static_cast<long long>(y) * height / image.height);
+    int bottom = std::max(static_cast<int>(static_cast<long long>(y + 1) * height / image.height), top + 1);
+    std::fill(sums.begin(), sums.end(), 0);
+    for (int row = top; row < bottom; row++)
+    {
+      const unsigned char *line = pixels + static_cast<std::size_t>(row) * width * colors;
+      for (int x = 0; x < image.width; x++)
+      {
+        int left = static_cast<int>(static_cast<long long>(x) * width / image.width);
+        int right = std::max(static_cast<int>(static_cast<long long>(x + 1) * width / image.width), left + 1);
+        for (int col = left; col < right; col++)
+        {
+          const unsigned char *p = line + static_cast<std::size_t>(col) * colors;
+          for (int c = 0; c < 3; c++)
+          {
+            sums[x * 3 + c] += p[colors >= 3 ? c : 0];
+          }
+        }
+      }
+    }
+    char *out = image.data.data() + static_cast<std::size_t>(y) * image.width * 3;
+    for (int x = 0; x < image.width; x++)
+    {
+      int left = static_cast<int>(static_cast<long long>(x) * width / image.width);
+      int right = std::max(static_cast<int>(static_cast<long long>(x + 1) * width / image.width), left + 1);
+      uint64_t count = static_cast<uint64_t>(bottom - top) * (right - left);
+      for (int c = 0; c < 3; c++)
+      {
+        out[x * 3 + c] = static_cast<char>((sums[x * 3 + c] + count / 2) / count);
+      }
+    }
+  }
+}
+
+bool FitJpeg(const unsigned char *data, std::size_t size, int maxSize, PreviewImage &image)
+{
+  jpeg_decompress_struct info;
+  JpegError error;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = OnJpegError;
+  error.manager.emit_message = IgnoreJpegMessage;
+
+  // declared before setjmp so a longjmp does not skip their destructors
+  std::vector<unsigned char> pixels;
+  if (setjmp(error.jump))
+  {
+    jpeg_destroy_decompress(&info);
+    return false;
+  }
+
+  jpeg_create_decompress(&info);
+  jpeg_mem_src(&info, const_cast<unsigned char *>(data), static_cast<unsigned long>(size));
+  jpeg_read_header(&info, TRUE);
+  info.out_color_space = JCS_RGB;
+
+  // the smallest n/8 scale whose output still covers the target
+  int width;
+  int height;
+  FitSize(info.image_width, info.image_height, maxSize, width, height);
+  info.scale_denom = 8;
+  info.scale_num = 8;
+  for (unsigned num = 1; num < 8; num++)
+  {
+    if ((static_cast<long long>(info.image_width) * num + 7) / 8 >= width &&
+        (static_cast<long long>(info.image_height) * num + 7) / 8 >= height)
+    {
+      info.scale_num = num;
+      break;
+    }
+  }
+  jpeg_start_decompress(&info);
+
+  std::size_t stride = static_cast<std::size_t>(info.output_width) * info.output_components;
+  pixels.resize(stride * info.output_height);
+  while (info.output_scanline < info.output_height)
+  {
+    JSAMPROW rows[1] = {pixels.data() + info.output_scanline * stride};
+    jpeg_read_scanlines(&info, rows, 1);
+  }
+  int components = info.output_components;
+  int outputWidth = info.output_width;
+  int outputHeight = info.output_height;
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+
+  FitPixels(pixels.data(), outputWidth, outputHeight, components, maxSize, image);
+  return true;
+}
+
+bool FitThumbnail(const libraw_thumbnail_t &thumbnail, int maxSize, PreviewImage &image)
+{
+  if (!thumbnail.thumb || !thumbnail.tlength)
+  {
+    return false;
+  }
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(thumbnail.thumb);
+  if (thumbnail.tformat == LIBRAW_THUMBNAIL_JPEG)
+  {
+    return FitJpeg(data, thumbnail.tlength, maxSize, image);
+  }
+  std::size_t pixels = static_cast<std::size_t>(thumbnail.twidth) * thumbnail.theight;
+  if (thumbnail.tformat == LIBRAW_THUMBNAIL_BITMAP && pixels && (thumbnail.tcolors == 1 || thumbnail.tcolors == 3) &&
+      thumbnail.tlength >= pixels * thumbnail.tcolors)
+  {
+    FitPixels(data, thumbnail.twidth, thumbnail.theight, thumbnail.tcolors, maxSize, image);
+    return true;
+  }
+  return false;
+}
@@ -0,0 +1,63 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_PREVIEW_H
+#define LIBRAWJS_PREVIEW_H
+
+#include <cstddef>
+#include <vector>
+#include "libraw/libraw.h"
+
+/*
+ * Resized 8 bit RGB versions of embedded thumbnails.
+ *
+ * JPEG thumbnails are decoded with libjpeg's DCT scaling at the smallest
+ * scale that is still at least as large as the target, so a 1024 pixel
+ * preview of a 6000 pixel JPEG costs a quarter scale decode, and the rest
+ * is box filtered. Images already within the target size keep their size.
+ */
+struct PreviewImage
+{
+  int width = 0;
+  int height = 0;
+  // interleaved RGB
+  std::vector<char> data;
+};
+
+/*
+ * Fits an 8 bit image with `colors` interleaved channels (1 or 3) into
+ * `maxSize` x `maxSize`, keeping its aspect ratio.
+ */
+void FitPixels(const unsigned char *pixels, int width, int height, int colors, int maxSize, PreviewImage &image);
+
+/*
+ * Decodes and fits a JPEG image. Returns false if it cannot be decoded.
+ */
+bool FitJpeg(const unsigned char *data, std::size_t size, int maxSize, PreviewImage &image);
+
+/*
+ * Fits an unpacked LibRaw thumbnail, JPEG or 8 bit bitmap. Returns false
+ * for other formats or if it cannot be decoded.
+ */
+bool FitThumbnail(const libraw_thumbnail_t &thumbnail, int maxSize, PreviewImage &image);
+
+#endif
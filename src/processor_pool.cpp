@@ -0,0 +1,70 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "processor_pool.h"
+#include <thread>
+
+ProcessorPool &ProcessorPool::Instance()
+{
+  static ProcessorPool *pool = new ProcessorPool(std::thread::hardware_concurrency());
+  return *pool;
+}
+
+ProcessorPool::ProcessorPool(std::size_t maxIdle) : maxIdle_(maxIdle)
+{
+  LibRaw *processor = new LibRaw();
+  this->defaultParams_ = processor->imgdata.params;
+  this->defaultRawParams_ = processor->imgdata.rawparams;
+  this->idle_.push_back(processor);
+}
+
+LibRaw *ProcessorPool::Acquire()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (!this->idle_.empty())
+    {
+      LibRaw *processor = this->idle_.back();
+      this->idle_.pop_back();
+      return processor;
+    }
+  }
+  return new LibRaw();
+}
+
+void ProcessorPool::Release(LibRaw *processor)
+{
+  processor->recycle();
+  processor->set_exifparser_handler(nullptr, nullptr);
+  processor->imgdata.params = this->defaultParams_;
+  processor->imgdata.rawparams = this->defaultRawParams_;
+
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (this->idle_.size() < this->maxIdle_)
+    {
+      this->idle_.push_back(processor);
+      return;
+    }
+  }
+  delete processor;
+}
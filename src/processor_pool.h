@@ -0,0 +1,57 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_PROCESSOR_POOL_H
+#define LIBRAWJS_PROCESSOR_POOL_H
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+#include "libraw/libraw.h"
+
+/*
+ * Process-wide cache of idle `LibRaw` processors.
+ *
+ * A `LibRaw` object is large and allocating one per JS instance is wasteful
+ * when instances are short-lived. Released processors are recycled, have
+ * their parameters reset to the library defaults, and are handed to the next
+ * caller from any Node environment.
+ */
+class ProcessorPool
+{
+public:
+  static ProcessorPool &Instance();
+
+  LibRaw *Acquire();
+  void Release(LibRaw *processor);
+
+private:
+  explicit ProcessorPool(std::size_t maxIdle);
+
+  std::mutex mutex_;
+  std::vector<LibRaw *> idle_;
+  std::size_t maxIdle_;
+  libraw_output_params_t defaultParams_;
+  libraw_raw_unpack_params_t defaultRawParams_;
+};
+
+#endif
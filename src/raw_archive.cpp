@@ -0,0 +1,207 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "async_job.h"
+#include "libraw_wrapper.h"
+#include "raw_codec.h"
+#include "trace.h"
+
+/*
+ * Packs the whole raw frame of the open image, margins included, into an
+ * archive on the worker pool, unpacking the image first if needed.
+ */
+class ExportRawJob : public AsyncJob
+{
+public:
+  ExportRawJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper, RawCompression compression, uint32_t tileRows)
+      : AsyncJob(info.Env(), "exportRaw"), wrapper_(wrapper), compression_(compression), tileRows_(tileRows)
+  {
+    this->Retain(info.This().As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    LibRaw *processor = this->wrapper_->processor_;
+
+    if (!processor->imgdata.rawdata.raw_alloc)
+    {
+      TraceSpan span("unpack");
+      int ret = this->wrapper_->InputTruncated() ? LIBRAW_IO_ERROR : processor->unpack();
+      if (ret != LIBRAW_SUCCESS)
+      {
+        this->SetError(std::string("exportRaw could not unpack the image: ") + libraw_strerror(ret));
+        return;
+      }
+    }
+    // color images (sRAW, linear DNG) have no single sample plane
+    if (!processor->imgdata.rawdata.raw_image)
+    {
+      this->SetError("exportRaw only supports raw data with one sample per pixel.");
+      return;
+    }
+
+    const libraw_image_sizes_t &sizes = processor->imgdata.sizes;
+    RawPlane plane;
+    plane.width = sizes.raw_width;
+    plane.height = sizes.raw_height;
+    plane.topMargin = sizes.top_margin;
+    plane.leftMargin = sizes.left_margin;
+    plane.visibleWidth = sizes.width;
+    plane.visibleHeight = sizes.height;
+    plane.bits = processor->imgdata.color.raw_bps;
+    TraceSpan span("encode");
+    EncodeRawPlane(plane, processor->imgdata.rawdata.raw_image, sizes.raw_pitch / sizeof(uint16_t), this->compression_,
+                   this->tileRows_, this->data_);
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    return MoveToBuffer(env, std::move(this->data_));
+  }
+
+private:
+  LibRawWrapper *wrapper_;
+  RawCompression compression_;
+  uint32_t tileRows_;
+  std::vector<char> data_;
+};
+
+/*
+ * Decodes an archive made by `exportRaw` on the worker pool. The archive
+ * is read in place and referenced until the job settles.
+ */
+class DecodeRawJob : public AsyncJob
+{
+public:
+  DecodeRawJob(const Napi::CallbackInfo &info, const char *data, std::size_t size)
+      : AsyncJob(info.Env(), "decodeRaw"), data_(data), size_(size)
+  {
+    // the archive is read in place from the pool
+    this->Retain(info[0].As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::string error;
+    TraceSpan span("decode");
+    if (!DecodeRawPlane(this->data_, this->size_, this->plane_, this->samples_, error))
+    {
+      this->SetError("decodeRaw could not decode the archive: " + error + ".");
+    }
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", this->plane_.width);
+    result.Set("height", this->plane_.height);
+    result.Set("topMargin", this->plane_.topMargin);
+    result.Set("leftMargin", this->plane_.leftMargin);
+    result.Set("visibleWidth", this->plane_.visibleWidth);
+    result.Set("visibleHeight", this->plane_.visibleHeight);
+    result.Set("bits", this->plane_.bits);
+    result.Set("data", MoveToBuffer(env, std::move(this->samples_)));
+    return result;
+  }
+
+private:
+  const char *data_;
+  std::size_t size_;
+  RawPlane plane_;
+  std::vector<char> samples_;
+};
+
+/*
+ * exportRaw(options) where options may hold `compression` ('lossless' or
+ * 'none') and `tileRows`.
+ */
+Napi::Value LibRawWrapper::ExportRaw(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  Napi::Object options = info[0].IsObject() ? info[0].As<Napi::Object>() : Napi::Object::New(env);
+
+  Napi::Value compression = options.Get("compression");
+  std::string compressionName = compression.IsUndefined() ? "lossless" : compression.ToString().Utf8Value();
+  if (compressionName != "lossless" && compressionName != "none")
+  {
+    Napi::TypeError::New(env, "exportRaw received an invalid argument, compression must be 'lossless' or 'none'.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Value tileRows = options.Get("tileRows");
+  int rows = tileRows.IsUndefined() ? 64 : tileRows.ToNumber().Int32Value();
+  if (rows < 1)
+  {
+    Napi::TypeError::New(env, "exportRaw received an invalid argument, tileRows must be a positive number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  RawCompression mode = compressionName == "none" ? RawCompression::None : RawCompression::Rice;
+  return (new ExportRawJob(info, this, mode, static_cast<uint32_t>(rows)))->Queue(this->priority_);
+}
+
+/*
+ * decodeRaw(archive, options) where options may hold `priority`. Static,
+ * an archive is decoded without a processor.
+ */
+Napi::Value LibRawWrapper::DecodeRaw(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!(info[0].IsTypedArray() || info[0].IsDataView()))
+  {
+    Napi::TypeError::New(env, "decodeRaw received an invalid argument, archive must be a Buffer or an ArrayBuffer view.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  void *data = nullptr;
+  std::size_t length = 0;
+  napi_status status;
+  if (info[0].IsTypedArray())
+  {
+    napi_typedarray_type type;
+    std::size_t count;
+    status = napi_get_typedarray_info(env, info[0], &type, &count, &data, nullptr, nullptr);
+    length = info[0].As<Napi::TypedArray>().ByteLength();
+  }
+  else
+  {
+    status = napi_get_dataview_info(env, info[0], &length, &data, nullptr, nullptr);
+  }
+  NAPI_THROW_IF_FAILED(env, status, env.Undefined());
+
+  Priority priority = Priority::Normal;
+  if (info[1].IsObject())
+  {
+    Napi::Value priorityName = info[1].As<Napi::Object>().Get("priority");
+    if (!priorityName.IsUndefined() && !ParsePriority(priorityName, priority))
+    {
+      Napi::TypeError::New(env, "decodeRaw received an invalid argument, priority must be interactive, normal or background.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+  return (new DecodeRawJob(info, static_cast<const char *>(data), length))->Queue(priority);
+}
@@ -0,0 +1,466 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "raw_codec.h"
+#include <algorithm>
+#include <cstring>
+#include "hash.h"
+#include "parallel.h"
+
+static const char kMagic[4] = {'L', 'R', 'P', 'K'};
+static const uint8_t kVersion = 1;
+static const std::size_t kHeaderSize = 8 + 8 * 4;
+// byte size and XXH64 of the samples of a tile
+static const std::size_t kEntrySize = 12;
+// samples sharing one Rice parameter
+static const uint32_t kBlock = 32;
+// unary quotients this long escape to the plain residual
+static const unsigned kLimit = 16;
+
+static void PutLE32(std::vector<char> &out, std::size_t at, uint32_t value)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    out[at + i] = static_cast<char>(value >> (8 * i));
+  }
+}
+
+static uint32_t GetLE32(const char *data)
+{
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+}
+
+static uint64_t DigestTile(const uint16_t *samples, std::size_t pitch, uint32_t width, uint32_t rows)
+{
+  Xxh64 digest;
+  for (uint32_t y = 0; y < rows; y++)
+  {
+    digest.Update(samples + y * pitch, width * sizeof(uint16_t));
+  }
+  return digest.Digest();
+}
+
+class BitWriter
+{
+public:
+  explicit BitWriter(std::vector<char> &out) : out_(out) {}
+
+  // `count` is at most 32
+  void Put(uint32_t value, unsigned count)
+  {
+    this->bits_ = (this->bits_ << count) | value;
+    this->count_ += count;
+    while (this->count_ >= 8)
+    {
+      this->count_ -= 8;
+      this->out_.push_back(static_cast<char>(this->bits_ >> this->count_));
+    }
+  }
+
+  void Flush()
+  {
+    if (this->count_ > 0)
+    {
+      this->Put(0, 8 - this->count_);
+    }
+  }
+
+private:
+  std::vector<char> &out_;
+  uint64_t bits_ = 0;
+  unsigned count_ = 0;
+};
+
+/*
+ * Reads past the end of the input as zeros and remembers doing so, so
+ * that a truncated tile is caught once it has been decoded.
+ */
+class BitReader
+{
+public:
+  BitReader(const char *data, std::size_t size)
+      : next_(reinterpret_cast<const uint8_t *>(data)), end_(next_ + size) {}
+
+  uint32_t Get(unsigned count)
+  {
+    if (count == 0)
+    {
+      return 0;
+    }
+    this->Fill();
+    uint32_t value = static_cast<uint32_t>(this->bits_ >> (64 - count));
+    this->bits_ <<= count;
+    this->count_ -= count;
+    return value;
+  }
+
+  // counts leading ones, up to `kLimit`, and skips them and the zero after
+  unsigned Unary()
+  {
+    this->Fill();
+    uint32_t peek = static_cast<uint32_t>(this->bits_ >> 48);
+    if (peek == 0xFFFF)
+    {
+      this->bits_ <<= kLimit;
+      this->count_ -= kLimit;
+      return kLimit;
+    }
+    unsigned ones = __builtin_clz(~(peek << 16));
+    this->bits_ <<= ones + 1;
+    this->count_ -= ones + 1;
+    return ones;
+  }
+
+  // whether the input was used up to its final, partial byte
+  bool Exhausted() const
+  {
+    std::size_t left = static_cast<std::size_t>(this->end_ - this->next_) * 8 + this->count_;
+    std::size_t padding = this->padded_ * 8;
+    return left >= padding && left - padding < 8;
+  }
+
+private:
+  void Fill()
+  {
+    while (this->count_ <= 56)
+    {
+      uint8_t byte = 0;
+      if (this->next_ < this->end_)
+      {
+        byte = *this->next_++;
+      }
+      else
+      {
+        this->padded_++;
+      }
+      this->bits_ |= static_cast<uint64_t>(byte) << (56 - this->count_);
+      this->count_ += 8;
+    }
+  }
+
+  const uint8_t *next_;
+  const uint8_t *end_;
+  uint64_t bits_ = 0;
+  unsigned count_ = 0;
+  std::size_t padded_ = 0;
+};
+
+/*
+ * LOCO-I median predictor over the same-color neighbors of a Bayer or
+ * similar 2x2 mosaic, restarted at the top of every tile.
+ */
+static inline uint32_t Predict(const uint16_t *row, const uint16_t *up, uint32_t x)
+{
+  if (up == nullptr)
+  {
+    return x >= 2 ? row[x - 2] : 0;
+  }
+  if (x < 2)
+  {
+    return up[x];
+  }
+  uint32_t a = row[x - 2];
+  uint32_t b = up[x];
+  uint32_t c = up[x - 2];
+  if (c >= std::max(a, b))
+  {
+    return std::min(a, b);
+  }
+  if (c <= std::min(a, b))
+  {
+    return std::max(a, b);
+  }
+  return a + b - c;
+}
+
+static void EncodeTile(const uint16_t *samples, std::size_t pitch, uint32_t width, uint32_t rows, unsigned bits,
+                       RawCompression compression, std::vector<char> &out)
+{
+  out.reserve(static_cast<std::size_t>(width) * rows * sizeof(uint16_t));
+  BitWriter writer(out);
+  if (compression == RawCompression::None)
+  {
+    for (uint32_t y = 0; y < rows; y++)
+    {
+      const uint16_t *row = samples + y * pitch;
+      for (uint32_t x = 0; x < width; x++)
+      {
+        writer.Put(row[x], bits);
+      }
+    }
+    writer.Flush();
+    return;
+  }
+
+  uint32_t mask = (1u << bits) - 1;
+  uint32_t half = 1u << (bits - 1);
+  std::vector<uint32_t> residuals(width);
+  for (uint32_t y = 0; y < rows; y++)
+  {
+    const uint16_t *row = samples + y * pitch;
+    const uint16_t *up = y >= 2 ? row - 2 * pitch : nullptr;
+    for (uint32_t x = 0; x < width; x++)
+    {
+      // the residual modulo 2^bits, zigzagged from [-half, half)
+      uint32_t delta = (row[x] - Predict(row, up, x)) & mask;
+      residuals[x] = delta < half ? delta * 2 : (mask - delta) * 2 + 1;
+    }
+    for (uint32_t begin = 0; begin < width; begin += kBlock)
+    {
+      uint32_t end = std::min(width, begin + kBlock);
+      uint64_t sum = 0;
+      for (uint32_t x = begin; x < end; x++)
+      {
+        sum += residuals[x];
+      }
+      unsigned k = 0;
+      while (k < bits && (static_cast<uint64_t>(end - begin) << (k + 1)) <= sum)
+      {
+        k++;
+      }
+      writer.Put(k, 5);
+      for (uint32_t x = begin; x < end; x++)
+      {
+        uint32_t quotient = residuals[x] >> k;
+        if (quotient >= kLimit)
+        {
+          writer.Put((1u << kLimit) - 1, kLimit);
+          writer.Put(residuals[x], bits);
+        }
+        else
+        {
+          writer.Put(((1u << quotient) - 1) << 1, quotient + 1);
+          writer.Put(residuals[x] & ((1u << k) - 1), k);
+        }
+      }
+    }
+  }
+  writer.Flush();
+}
+
+static bool DecodeTile(const char *data, std::size_t size, uint16_t *samples, uint32_t width, uint32_t rows,
+                       unsigned bits, RawCompression compression)
+{
+  BitReader reader(data, size);
+  if (compression == RawCompression::None)
+  {
+    for (uint32_t y = 0; y < rows; y++)
+    {
+      uint16_t *row = samples + static_cast<std::size_t>(y) * width;
+      for (uint32_t x = 0; x < width; x++)
+      {
+        row[x] = static_cast<uint16_t>(reader.Get(bits));
+      }
+    }
+    return reader.Exhausted();
+  }
+
+  uint32_t mask = (1u << bits) - 1;
+  for (uint32_t y = 0; y < rows; y++)
+  {
+    uint16_t *row = samples + static_cast<std::size_t>(y) * width;
+    const uint16_t *up = y >= 2 ? row - 2 * static_cast<std::size_t>(width) : nullptr;
+    for (uint32_t begin = 0; begin < width; begin += kBlock)
+    {
+      uint32_t end = std::min(width, begin + kBlock);
+      unsigned k = reader.Get(5);
+      if (k > bits)
+      {
+        return false;
+      }
+      for (uint32_t x = begin; x < end; x++)
+      {
+        unsigned quotient = reader.Unary();
+        uint32_t residual = quotient == kLimit ? reader.Get(bits) : (quotient << k) | reader.Get(k);
+        if (residual > mask)
+        {
+          return false;
+        }
+        uint32_t delta = residual & 1 ? mask - (residual >> 1) : residual >> 1;
+        row[x] = static_cast<uint16_t>((Predict(row, up, x) + delta) & mask);
+      }
+    }
+  }
+  return reader.Exhausted();
+}
+
+void EncodeRawPlane(RawPlane plane, const uint16_t *samples, std::size_t pitch, RawCompression compression, uint32_t tileRows,
+                    std::vector<char> &out)
+{
+  uint32_t tiles = (plane.height + tileRows - 1) / tileRows;
+  std::vector<uint16_t> largest(tiles, 0);
+  std::vector<std::vector<char>> encoded(tiles);
+  std::vector<uint64_t> digests(tiles);
+  auto rowsOf = [&](uint32_t tile)
+  { return std::min(tileRows, plane.height - tile * tileRows); };
+
+  ParallelFor(tiles, 1, [&](std::size_t first, std::size_t last)
+              {
+    for (std::size_t tile = first; tile < last; tile++)
+    {
+      const uint16_t *row = samples + tile * tileRows * pitch;
+      for (uint32_t y = 0; y < rowsOf(tile); y++, row += pitch)
+      {
+        largest[tile] = std::max(largest[tile], *std::max_element(row, row + plane.width));
+      }
+    } });
+  unsigned needed = 1;
+  uint16_t top = *std::max_element(largest.begin(), largest.end());
+  while (needed < 16 && (top >> needed) != 0)
+  {
+    needed++;
+  }
+  plane.bits = std::min(16u, std::max(plane.bits, needed));
+
+  ParallelFor(tiles, 1, [&](std::size_t first, std::size_t last)
+              {
+    for (std::size_t tile = first; tile < last; tile++)
+    {
+      const uint16_t *first = samples + tile * tileRows * pitch;
+      EncodeTile(first, pitch, plane.width, rowsOf(tile), plane.bits, compression, encoded[tile]);
+      digests[tile] = DigestTile(first, pitch, plane.width, rowsOf(tile));
+    } });
+
+  std::size_t size = kHeaderSize + kEntrySize * tiles;
+  for (const std::vector<char> &tile : encoded)
+  {
+    size += tile.size();
+  }
+  out.assign(size, 0);
+  std::memcpy(out.data(), kMagic, 4);
+  out[4] = static_cast<char>(kVersion);
+  out[5] = static_cast<char>(compression);
+  out[6] = static_cast<char>(plane.bits);
+  const uint32_t fields[] = {plane.width, plane.height, plane.topMargin, plane.leftMargin,
+                             plane.visibleWidth, plane.visibleHeight, tileRows, tiles};
+  std::size_t at = 8;
+  for (uint32_t field : fields)
+  {
+    PutLE32(out, at, field);
+    at += 4;
+  }
+  for (uint32_t tile = 0; tile < tiles; tile++)
+  {
+    PutLE32(out, at, static_cast<uint32_t>(encoded[tile].size()));
+    PutLE32(out, at + 4, static_cast<uint32_t>(digests[tile]));
+    PutLE32(out, at + 8, static_cast<uint32_t>(digests[tile] >> 32));
+    at += kEntrySize;
+  }
+  for (const std::vector<char> &tile : encoded)
+  {
+    std::memcpy(out.data() + at, tile.data(), tile.size());
+    at += tile.size();
+  }
+}
+
+bool DecodeRawPlane(const char *data, std::size_t size, RawPlane &plane, std::vector<char> &out, std::string &error)
+{
+  if (size < kHeaderSize || std::memcmp(data, kMagic, 4) != 0)
+  {
+    error = "not a raw archive";
+    return false;
+  }
+  if (static_cast<uint8_t>(data[4]) != kVersion)
+  {
+    error = "unsupported archive version";
+    return false;
+  }
+  uint8_t compression = static_cast<uint8_t>(data[5]);
+  plane.bits = static_cast<uint8_t>(data[6]);
+  plane.width = GetLE32(data + 8);
+  plane.height = GetLE32(data + 12);
+  plane.topMargin = GetLE32(data + 16);
+  plane.leftMargin = GetLE32(data + 20);
+  plane.visibleWidth = GetLE32(data + 24);
+  plane.visibleHeight = GetLE32(data + 28);
+  uint32_t tileRows = GetLE32(data + 32);
+  uint32_t tiles = GetLE32(data + 36);
+  // LibRaw frames are at most 65535 pixels across either way
+  if (compression > static_cast<uint8_t>(RawCompression::Rice) || data[7] != 0 || plane.bits < 1 || plane.bits > 16 ||
+      plane.width < 1 || plane.width > 65535 || plane.height < 1 || plane.height > 65535 || tileRows < 1 ||
+      tiles != (plane.height - 1) / tileRows + 1 || plane.visibleWidth > plane.width - std::min(plane.width, plane.leftMargin) ||
+      plane.visibleHeight > plane.height - std::min(plane.height, plane.topMargin))
+  {
+    error = "the archive header is corrupt";
+    return false;
+  }
+  if (size - kHeaderSize < kEntrySize * tiles)
+  {
+    error = "the archive is truncated";
+    return false;
+  }
+
+  std::vector<std::size_t> offsets(tiles + 1);
+  offsets[0] = kHeaderSize + kEntrySize * tiles;
+  for (uint32_t tile = 0; tile < tiles; tile++)
+  {
+    offsets[tile + 1] = offsets[tile] + GetLE32(data + kHeaderSize + kEntrySize * tile);
+  }
+  if (offsets[tiles] != size)
+  {
+    error = "the archive is truncated";
+    return false;
+  }
+  // the tile sizes must fit the header before the plane is allocated, so a
+  // small archive cannot claim a huge frame
+  for (uint32_t tile = 0; tile < tiles; tile++)
+  {
+    uint64_t rows = std::min(tileRows, plane.height - tile * tileRows);
+    uint64_t bits = compression == static_cast<uint8_t>(RawCompression::None)
+                        ? rows * plane.width * plane.bits
+                        // at least one bit per sample and a parameter per block
+                        : rows * (plane.width + 5 * ((plane.width + kBlock - 1) / kBlock));
+    uint64_t bytes = offsets[tile + 1] - offsets[tile];
+    bool fits = compression == static_cast<uint8_t>(RawCompression::None) ? bytes == (bits + 7) / 8 : bytes >= (bits + 7) / 8;
+    if (!fits)
+    {
+      error = "tile " + std::to_string(tile) + " is corrupt";
+      return false;
+    }
+  }
+
+  out.resize(static_cast<std::size_t>(plane.width) * plane.height * sizeof(uint16_t));
+  uint16_t *samples = reinterpret_cast<uint16_t *>(out.data());
+  std::vector<char> valid(tiles, 0);
+  ParallelFor(tiles, 1, [&](std::size_t first, std::size_t last)
+              {
+    for (std::size_t tile = first; tile < last; tile++)
+    {
+      uint32_t rows = std::min(tileRows, plane.height - static_cast<uint32_t>(tile) * tileRows);
+      uint16_t *first = samples + tile * tileRows * plane.width;
+      const char *entry = data + kHeaderSize + kEntrySize * tile;
+      uint64_t digest = GetLE32(entry + 4) | static_cast<uint64_t>(GetLE32(entry + 8)) << 32;
+      valid[tile] = DecodeTile(data + offsets[tile], offsets[tile + 1] - offsets[tile], first, plane.width, rows,
+                               plane.bits, static_cast<RawCompression>(compression)) &&
+                    DigestTile(first, plane.width, plane.width, rows) == digest;
+    } });
+  for (uint32_t tile = 0; tile < tiles; tile++)
+  {
+    if (!valid[tile])
+    {
+      error = "tile " + std::to_string(tile) + " is corrupt";
+      return false;
+    }
+  }
+  return true;
+}
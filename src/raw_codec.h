@@ -0,0 +1,84 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_RAW_CODEC_H
+#define LIBRAWJS_RAW_CODEC_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Compact archive format for a raw frame (`rawdata.raw_image`, margins
+ * included), so sensor data can be stored and reprocessed later.
+ *
+ * Samples are stored with only as many bits as the frame needs, at least
+ * `color.raw_bps`. Rows are split into tiles that are coded independently,
+ * in parallel, and can be decoded in parallel. A tile is either plain
+ * bit-packed samples, or losslessly compressed: every sample is predicted
+ * from its same-color neighbors two pixels left, up and up-left with the
+ * LOCO-I median predictor, and the residuals are Rice coded with a
+ * parameter picked per block of 32 samples. Residuals are taken modulo
+ * 2^bits, and a length limited code escapes to the plain residual, so no
+ * sample costs much more than its packed size. Every tile carries the
+ * XXH64 of its samples, so damage is caught when it is decoded.
+ *
+ * The header and tile table are little endian:
+ *
+ *   "LRPK", version, compression, bits, 0
+ *   width, height, top margin, left margin, visible width and height,
+ *   rows per tile, tile count (uint32 each)
+ *   per tile, its byte size (uint32) and the XXH64 of its samples (uint64)
+ *   the tiles
+ */
+enum class RawCompression : uint8_t
+{
+  None = 0,
+  Rice = 1,
+};
+
+struct RawPlane
+{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t topMargin = 0;
+  uint32_t leftMargin = 0;
+  uint32_t visibleWidth = 0;
+  uint32_t visibleHeight = 0;
+  unsigned bits = 0;
+};
+
+/*
+ * Encodes `plane.width` x `plane.height` samples, `pitch` samples apart
+ * row to row. `plane.bits` is raised to what the largest sample needs.
+ */
+void EncodeRawPlane(RawPlane plane, const uint16_t *samples, std::size_t pitch, RawCompression compression, uint32_t tileRows,
+                    std::vector<char> &out);
+
+/*
+ * Decodes an archive into `out` as `width * height` native endian 16 bit
+ * samples. Returns false and sets `error` for malformed input.
+ */
+bool DecodeRawPlane(const char *data, std::size_t size, RawPlane &plane, std::vector<char> &out, std::string &error);
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "render_cache.h"
+#include "hash.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  int64_t Now()
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+  }
+
+  bool EndsWith(const std::string &name, const char *suffix)
+  {
+    std::size_t length = std::char_traits<char>::length(suffix);
+    return name.size() > length && name.compare(name.size() - length, length, suffix) == 0;
+  }
+
+  bool WriteAll(int fd, const void *data, std::size_t size)
+  {
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+      ssize_t n = ::write(fd, bytes, size);
+      if (n < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (n <= 0)
+      {
+        return false;
+      }
+      bytes += n;
+      size -= n;
+    }
+    return true;
+  }
+
+  // name of the file recording the digest of `identity`
+  std::string DigestName(const FileIdentity &identity)
+  {
+    std::string id = identity.path + '\n' + std::to_string(identity.device) + ':' + std::to_string(identity.inode) +
+                     ':' + std::to_string(identity.size) + ':' + std::to_string(identity.mtimeNs);
+    return Xxh64::ToHex(Xxh64::Hash(id.data(), id.size())) + ".id";
+  }
+
+  // temporary files older than this are left over from a crash
+  const int64_t kStaleTempNs = 3600LL * 1000000000;
+}
+
+RenderCache &RenderCache::Instance()
+{
+  static RenderCache *cache = new RenderCache();
+  return *cache;
+}
+
+int RenderCache::Configure(const std::string &directory, std::size_t maxBytes)
+{
+  std::vector<std::string> evicted;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->directory_.clear();
+    this->maxBytes_ = 0;
+    this->bytes_ = 0;
+    this->entries_.clear();
+    if (directory.empty() || maxBytes == 0)
+    {
+      return 0;
+    }
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+    {
+      return errno;
+    }
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+    {
+      return errno;
+    }
+    this->directory_ = directory;
+    this->maxBytes_ = maxBytes;
+    int64_t now = Now();
+    while (dirent *item = readdir(dir))
+    {
+      std::string name = item->d_name;
+      struct stat st;
+      if (stat(this->PathOf(name).c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+      {
+        continue;
+      }
+      int64_t mtime = static_cast<int64_t>(st.st_mtime) * 1000000000;
+      if (name.compare(0, 5, ".tmp-") == 0 && now - mtime > kStaleTempNs)
+      {
+        evicted.push_back(this->PathOf(name));
+      }
+      else if (EndsWith(name, ".bin") || EndsWith(name, ".id"))
+      {
+        this->entries_[name] = Entry{static_cast<std::size_t>(st.st_size), mtime};
+        this->bytes_ += st.st_size;
+      }
+    }
+    closedir(dir);
+    this->Account(std::string(), 0, evicted);
+  }
+  this->Unlink(evicted);
+  return 0;
+}
+
+bool RenderCache::Enabled()
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return !this->directory_.empty();
+}
+
+bool RenderCache::FindDigest(const FileIdentity &identity, uint64_t &digest)
+{
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (this->directory_.empty())
+    {
+      return false;
+    }
+    path = this->PathOf(DigestName(identity));
+  }
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  char hex[17] = {};
+  ssize_t n = ::read(fd, hex, 16);
+  ::close(fd);
+  if (n != 16)
+  {
+    return false;
+  }
+  char *end = nullptr;
+  digest = std::strtoull(hex, &end, 16);
+  return end == hex + 16;
+}
+
+void RenderCache::StoreDigest(const FileIdentity &identity, uint64_t digest)
+{
+  std::string hex = Xxh64::ToHex(digest);
+  this->WriteEntry(DigestName(identity), hex.data(), hex.size(), nullptr, 0);
+}
+
+bool RenderCache::Lookup(const std::string &key, MappedFile &entry)
+{
+  std::string name = key + ".bin";
+  std::string path;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (this->directory_.empty())
+    {
+      return false;
+    }
+    path = this->PathOf(name);
+  }
+  bool hit = entry.Open(path, true) == 0 && entry.Size() > 0;
+  std::vector<std::string> evicted;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (hit)
+    {
+      this->hits_++;
+      this->Account(name, entry.Size(), evicted);
+    }
+    else
+    {
+      this->misses_++;
+    }
+  }
+  if (hit)
+  {
+    // marks the entry as recently used for later runs
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+  }
+  this->Unlink(evicted);
+  return hit;
+}
+
+void RenderCache::Store(const std::string &key, const void *header, std::size_t headerSize, const void *data, std::size_t size)
+{
+  this->WriteEntry(key + ".bin", header, headerSize, data, size);
+}
+
+/*
+ * Writes to a temporary file first and renames it into place, so the entry
+ * appears complete or not at all.
+ */
+void RenderCache::WriteEntry(const std::string &name, const void *header, std::size_t headerSize, const void *data,
+                             std::size_t size)
+{
+  std::string path;
+  std::string temp;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (this->directory_.empty())
+    {
+      return;
+    }
+    path = this->PathOf(name);
+    temp = this->PathOf(".tmp-" + std::to_string(getpid()) + "-" + std::to_string(this->writes_++));
+  }
+
+  int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+  {
+    return;
+  }
+  bool written = WriteAll(fd, header, headerSize) && (!size || WriteAll(fd, data, size));
+  if (::close(fd) != 0 || !written || ::rename(temp.c_str(), path.c_str()) != 0)
+  {
+    ::unlink(temp.c_str());
+    return;
+  }
+
+  std::vector<std::string> evicted;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (this->directory_.empty())
+    {
+      return;
+    }
+    this->Account(name, headerSize + size, evicted);
+  }
+  this->Unlink(evicted);
+}
+
+void RenderCache::Remove(const std::string &key)
+{
+  std::vector<std::string> removed;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (this->directory_.empty())
+    {
+      return;
+    }
+    std::string name = key + ".bin";
+    auto found = this->entries_.find(name);
+    if (found != this->entries_.end())
+    {
+      this->bytes_ -= found->second.size;
+      this->entries_.erase(found);
+    }
+    removed.push_back(this->PathOf(name));
+  }
+  this->Unlink(removed);
+}
+
+RenderCacheStats RenderCache::Stats()
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return RenderCacheStats{this->entries_.size(), this->bytes_, this->maxBytes_, this->hits_, this->misses_};
+}
+
+std::string RenderCache::Key(uint64_t digest, const std::string &options)
+{
+  return Xxh64::ToHex(digest) + "-" + Xxh64::ToHex(Xxh64::Hash(options.data(), options.size()));
+}
+
+/*
+ * Records the use of `name` (none if empty) and, once the cache is over
+ * its budget, moves the paths of the least recently used entries to
+ * `evicted`. Called with the mutex held.
+ */
+void RenderCache::Account(const std::string &name, std::size_t size, std::vector<std::string> &evicted)
+{
+  if (!name.empty())
+  {
+    auto found = this->entries_.find(name);
+    if (found != this->entries_.end())
+    {
+      this->bytes_ -= found->second.size;
+    }
+    this->entries_[name] = Entry{size, Now()};
+    this->bytes_ += size;
+  }
+  if (this->bytes_ <= this->maxBytes_)
+  {
+    return;
+  }
+
+  std::vector<std::pair<int64_t, std::string>> byAge;
+  byAge.reserve(this->entries_.size());
+  for (const auto &entry : this->entries_)
+  {
+    byAge.emplace_back(entry.second.lastUse, entry.first);
+  }
+  std::sort(byAge.begin(), byAge.end());
+  std::size_t target = this->maxBytes_ / 10 * 9;
+  for (const auto &oldest : byAge)
+  {
+    if (this->bytes_ <= target)
+    {
+      break;
+    }
+    this->bytes_ -= this->entries_[oldest.second].size;
+    this->entries_.erase(oldest.second);
+    evicted.push_back(this->PathOf(oldest.second));
+  }
+}
+
+void RenderCache::Unlink(const std::vector<std::string> &paths)
+{
+  for (const std::string &path : paths)
+  {
+    ::unlink(path.c_str());
+  }
+}
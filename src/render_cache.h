@@ -0,0 +1,118 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_RENDER_CACHE_H
+#define LIBRAWJS_RENDER_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "hot_file_cache.h"
+#include "mapped_file.h"
+
+struct RenderCacheStats
+{
+  // files in the cache directory, renders and recorded digests
+  std::size_t entries;
+  std::size_t bytes;
+  std::size_t maxBytes;
+  uint64_t hits;
+  uint64_t misses;
+};
+
+/*
+ * Optional on-disk cache of rendered outputs, so previews survive a
+ * restart.
+ *
+ * Renders are content addressed: the key combines the XXH64 digest of the
+ * source file with a hash of the canonicalized render options, so a moved
+ * or copied file still hits and an edited one misses. Hashing a file reads
+ * all of it, so the digest of every file is also recorded under its
+ * identity (path, device, inode, size and mtime); an unchanged file is then
+ * looked up without reading it at all.
+ *
+ * Entries are written to a temporary file and renamed into place, so
+ * readers, including other processes sharing the directory, never see a
+ * partial entry, and are read by mapping them. When the directory grows
+ * beyond `maxBytes`, the least recently used entries are removed down to
+ * 90% of it. Use is tracked through the files' mtime, which survives
+ * restarts; entries written by other processes are only accounted once
+ * they are read.
+ */
+class RenderCache
+{
+public:
+  static RenderCache &Instance();
+
+  /*
+   * Uses `directory`, creating it if needed, and indexes the entries it
+   * already holds. An empty directory or a maxBytes of 0 disables the
+   * cache. Returns 0 on success, otherwise an errno value.
+   */
+  int Configure(const std::string &directory, std::size_t maxBytes);
+  bool Enabled();
+
+  // the digest recorded for an unchanged file
+  bool FindDigest(const FileIdentity &identity, uint64_t &digest);
+  void StoreDigest(const FileIdentity &identity, uint64_t digest);
+
+  // maps the entry stored under `key` copy-on-write, returns false on a miss
+  bool Lookup(const std::string &key, MappedFile &entry);
+  // stores `header` followed by `data` under `key`, failures are ignored
+  void Store(const std::string &key, const void *header, std::size_t headerSize, const void *data, std::size_t size);
+  // drops an entry that turned out to be unusable
+  void Remove(const std::string &key);
+
+  RenderCacheStats Stats();
+
+  // `<digest>-<options hash>`, both as hex
+  static std::string Key(uint64_t digest, const std::string &options);
+
+private:
+  struct Entry
+  {
+    std::size_t size;
+    // mtime in nanoseconds
+    int64_t lastUse;
+  };
+
+  RenderCache() = default;
+
+  void WriteEntry(const std::string &name, const void *header, std::size_t headerSize, const void *data, std::size_t size);
+  void Account(const std::string &name, std::size_t size, std::vector<std::string> &evicted);
+  void Unlink(const std::vector<std::string> &names);
+  std::string PathOf(const std::string &name) const { return this->directory_ + "/" + name; }
+
+  std::mutex mutex_;
+  std::string directory_;
+  std::size_t maxBytes_ = 0;
+  std::size_t bytes_ = 0;
+  std::unordered_map<std::string, Entry> entries_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t writes_ = 0;
+};
+
+#endif
@@ -0,0 +1,345 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "async_job.h"
+#include "developer.h"
+#include "hash.h"
+#include "libraw_wrapper.h"
+#include "preview.h"
+#include "render_cache.h"
+#include "trace.h"
+
+namespace
+{
+  // precedes the pixels of a cached preview
+  struct PreviewHeader
+  {
+    char magic[4];
+    uint32_t width;
+    uint32_t height;
+    uint32_t size;
+  };
+
+  const char kPreviewMagic[4] = {'L', 'R', 'P', '1'};
+}
+
+/*
+ * Produces an 8 bit RGB preview of a file, from its embedded thumbnail or
+ * developed from the raw data, on the worker pool.
+ *
+ * With the render cache enabled the file is identified by its content
+ * digest, and a cached preview is returned as a Buffer over the mapped
+ * entry without opening the file. Otherwise the file is opened on the
+ * wrapper, like `extract`, and the preview is stored for next time.
+ */
+class PreviewJob : public AsyncJob
+{
+public:
+  PreviewJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper, std::string filename, bool raw, int size)
+      : AsyncJob(info.Env(), "preview"), wrapper_(wrapper), filename_(std::move(filename)), raw_(raw), size_(size)
+  {
+    this->Retain(info.This().As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    TraceSpan::SetFile(this->filename_);
+    RenderCache &cache = RenderCache::Instance();
+
+    std::string key;
+    MappedFile contents;
+    if (cache.Enabled())
+    {
+      FileIdentity identity;
+      int err = StatFile(this->filename_, identity);
+      uint64_t digest = 0;
+      if (!err && !cache.FindDigest(identity, digest))
+      {
+        // read once, the mapping is reused to open the file on a miss
+        err = contents.Open(this->filename_);
+        if (!err)
+        {
+          digest = Xxh64::Hash(contents.Data(), contents.Size());
+          cache.StoreDigest(identity, digest);
+        }
+      }
+      if (err)
+      {
+        this->SetError(std::string("preview could not read file: ") + std::strerror(err));
+        return;
+      }
+      key = RenderCache::Key(digest, this->Options());
+      this->entry_.reset(new MappedFile());
+      if (cache.Lookup(key, *this->entry_))
+      {
+        if (this->ReadEntry())
+        {
+          return;
+        }
+        cache.Remove(key);
+      }
+      this->entry_.reset();
+    }
+
+    if (!this->Open(contents) || !this->Render())
+    {
+      return;
+    }
+    if (!key.empty())
+    {
+      PreviewHeader header;
+      std::memcpy(header.magic, kPreviewMagic, sizeof(header.magic));
+      header.width = this->image_.width;
+      header.height = this->image_.height;
+      header.size = static_cast<uint32_t>(this->image_.data.size());
+      cache.Store(key, &header, sizeof(header), this->image_.data.data(), this->image_.data.size());
+    }
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", this->image_.width);
+    result.Set("height", this->image_.height);
+    result.Set("colors", 3);
+    result.Set("bits", 8);
+    if (this->entry_)
+    {
+      // the mapping is copy-on-write, so the Buffer may be modified
+      MappedFile *entry = this->entry_.release();
+      result.Set("data", Napi::Buffer<char>::New(
+                             env,
+                             const_cast<char *>(entry->Data()) + sizeof(PreviewHeader),
+                             entry->Size() - sizeof(PreviewHeader),
+                             [](Napi::Env, char *, MappedFile *hint)
+                             { delete hint; },
+                             entry));
+    }
+    else
+    {
+      result.Set("data", MoveToBuffer(env, std::move(this->image_.data)));
+    }
+    return result;
+  }
+
+private:
+  // the canonical form of the options, part of the cache key
+  std::string Options() const
+  {
+    return std::string("preview/1 source=") + (this->raw_ ? "raw" : "embedded") + " size=" + std::to_string(this->size_);
+  }
+
+  bool ReadEntry()
+  {
+    PreviewHeader header;
+    if (this->entry_->Size() < sizeof(header))
+    {
+      return false;
+    }
+    std::memcpy(&header, this->entry_->Data(), sizeof(header));
+    if (std::memcmp(header.magic, kPreviewMagic, sizeof(header.magic)) != 0 || !header.width || !header.height ||
+        header.size != static_cast<uint64_t>(header.width) * header.height * 3 ||
+        this->entry_->Size() - sizeof(header) != header.size)
+    {
+      return false;
+    }
+    this->image_.width = header.width;
+    this->image_.height = header.height;
+    return true;
+  }
+
+  // opens the file on the wrapper, from `contents` if it was mapped to be hashed
+  bool Open(MappedFile &contents)
+  {
+    LibRawWrapper *wrapper = this->wrapper_;
+    wrapper->CloseInput();
+    if (wrapper->OpenCached(this->filename_))
+    {
+      return true;
+    }
+    int ret;
+    if (contents.Data())
+    {
+      wrapper->mapped_ = std::move(contents);
+      TraceSpan span("parse");
+      ret = wrapper->processor_->open_buffer(wrapper->mapped_.Data(), wrapper->mapped_.Size());
+      wrapper->inputData_ = wrapper->mapped_.Data();
+      wrapper->inputSize_ = wrapper->mapped_.Size();
+    }
+    else
+    {
+      TraceSpan span("parse");
+      ret = wrapper->processor_->open_file(this->filename_.c_str());
+      wrapper->inputPath_ = this->filename_;
+    }
+    if (ret != LIBRAW_SUCCESS)
+    {
+      wrapper->ReleaseInput();
+      this->SetError(std::string("preview could not open file: ") + libraw_strerror(ret));
+      return false;
+    }
+    wrapper->cacheable_ = !wrapper->fileId_.path.empty();
+    return true;
+  }
+
+  bool Render()
+  {
+    LibRaw *processor = this->wrapper_->processor_;
+    if (!this->raw_)
+    {
+      int ret = this->wrapper_->LoadThumbnail();
+      if (ret != LIBRAW_SUCCESS)
+      {
+        this->SetError(std::string("preview could not unpack the thumbnail: ") + libraw_strerror(ret));
+        return false;
+      }
+      if (!FitThumbnail(processor->imgdata.thumbnail, this->size_, this->image_))
+      {
+        this->SetError("preview cannot decode the thumbnail.");
+        return false;
+      }
+      return true;
+    }
+
+    if (!processor->imgdata.rawdata.raw_alloc)
+    {
+      TraceSpan span("unpack");
+      int ret = this->wrapper_->InputTruncated() ? LIBRAW_IO_ERROR : processor->unpack();
+      if (ret != LIBRAW_SUCCESS)
+      {
+        this->SetError(std::string("preview could not unpack the image: ") + libraw_strerror(ret));
+        return false;
+      }
+    }
+    RawDeveloper developer(processor);
+    int ret = developer.Init(false);
+    if (ret != LIBRAW_SUCCESS)
+    {
+      this->SetError(std::string("preview cannot develop this image: ") + libraw_strerror(ret));
+      return false;
+    }
+    developer.RenderPreview(this->size_, this->image_.width, this->image_.height, this->image_.data);
+    return true;
+  }
+
+  LibRawWrapper *wrapper_;
+  std::string filename_;
+  bool raw_;
+  int size_;
+  PreviewImage image_;
+  // the cached preview on a hit
+  std::unique_ptr<MappedFile> entry_;
+};
+
+/*
+ * preview(filename, { source?: 'embedded' | 'raw', size?: number })
+ */
+Napi::Value LibRawWrapper::Preview(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsString())
+  {
+    Napi::TypeError::New(env, "preview received an invalid argument, filename must be a string.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object options = info[1].IsObject() ? info[1].As<Napi::Object>() : Napi::Object::New(env);
+
+  Napi::Value source = options.Get("source");
+  std::string sourceName = source.IsUndefined() ? "embedded" : source.ToString().Utf8Value();
+  if (sourceName != "embedded" && sourceName != "raw")
+  {
+    Napi::TypeError::New(env, "preview received an invalid argument, source must be 'embedded' or 'raw'.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  int size = 1024;
+  Napi::Value sizeValue = options.Get("size");
+  if (!sizeValue.IsUndefined())
+  {
+    size = sizeValue.ToNumber().Int32Value();
+    if (size < 1)
+    {
+      Napi::TypeError::New(env, "preview received an invalid argument, size must be a positive number.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  // the job closes any datastream over a previous `open_buffer` input first
+  this->buffer_.Reset();
+  return (new PreviewJob(info, this, info[0].As<Napi::String>().Utf8Value(), sourceName == "raw", size))
+      ->Queue(this->priority_);
+}
+
+/*
+ * configureRenderCache({ directory: string, maxBytes: number })
+ *
+ * An empty directory or a maxBytes of 0 disables the cache; the files are
+ * left in place.
+ */
+Napi::Value LibRawWrapper::ConfigureRenderCache(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsObject())
+  {
+    Napi::TypeError::New(env, "configureRenderCache received an invalid argument, options must be an object.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object options = info[0].As<Napi::Object>();
+  Napi::Value directory = options.Get("directory");
+  if (!directory.IsString())
+  {
+    Napi::TypeError::New(env, "configureRenderCache received an invalid argument, directory must be a string.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Value maxBytes = options.Get("maxBytes");
+  if (!maxBytes.IsNumber() || !(maxBytes.As<Napi::Number>().DoubleValue() >= 0))
+  {
+    Napi::TypeError::New(env, "configureRenderCache received an invalid argument, maxBytes must be a non-negative number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  int err = RenderCache::Instance().Configure(
+      directory.As<Napi::String>().Utf8Value(),
+      static_cast<std::size_t>(maxBytes.As<Napi::Number>().DoubleValue()));
+  if (err)
+  {
+    Napi::Error::New(env, std::string("configureRenderCache could not use the directory: ") + std::strerror(err)).ThrowAsJavaScriptException();
+  }
+  return env.Undefined();
+}
+
+Napi::Value LibRawWrapper::RenderCacheStats(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  ::RenderCacheStats stats = RenderCache::Instance().Stats();
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("entries", Napi::Number::New(env, stats.entries));
+  result.Set("bytes", Napi::Number::New(env, stats.bytes));
+  result.Set("maxBytes", Napi::Number::New(env, stats.maxBytes));
+  result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+  result.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+  return result;
+}
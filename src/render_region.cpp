@@ -0,0 +1,506 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include <algorithm>
+#include <vector>
+#include "async_job.h"
+#include "developer.h"
+#include "encoder.h"
+#include "libraw_wrapper.h"
+#include "trace.h"
+
+namespace
+{
+  // how a render job's region is resolved against the image
+  enum class RegionMode
+  {
+    // the region as given
+    Exact,
+    // the whole image
+    Whole,
+    // full width rows from the region's `y`, clamped to the image
+    Band,
+  };
+}
+
+/*
+ * Unpacks the image if that has not happened yet, prepares a developer of
+ * `processor` and resolves `region` according to `mode`. `truncated` fails
+ * the unpack of an input file that shrank under its mapping. Returns the
+ * error of `method`, or an empty string once the region can be rendered.
+ */
+static std::string PrepareRender(const std::string &method, LibRaw *processor, bool truncated, RawDeveloper &developer, bool inset, RegionMode mode, Region &region)
+{
+  if (!processor->imgdata.rawdata.raw_alloc)
+  {
+    TraceSpan span("unpack");
+    int ret = truncated ? LIBRAW_IO_ERROR : processor->unpack();
+    if (ret != LIBRAW_SUCCESS)
+    {
+      return method + " could not unpack the image: " + libraw_strerror(ret);
+    }
+  }
+
+  int ret = developer.Init(inset);
+  if (ret != LIBRAW_SUCCESS)
+  {
+    return method + " cannot develop this image: " + libraw_strerror(ret);
+  }
+  if (mode == RegionMode::Whole)
+  {
+    region = Region{0, 0, developer.Width(), developer.Height()};
+  }
+  else if (mode == RegionMode::Band)
+  {
+    region.x = 0;
+    region.width = developer.Width();
+    region.height = std::min(region.height, developer.Height() - region.y);
+  }
+  if (!developer.Contains(region))
+  {
+    return method + " received a region outside of the " +
+           std::to_string(developer.Width()) + "x" + std::to_string(developer.Height()) + " image.";
+  }
+  return std::string();
+}
+
+/*
+ * Develops a rectangle of the open image on the worker pool, unpacking the
+ * raw data first if that has not happened yet.
+ *
+ * In band mode the region's `x` and `width` are ignored and the job renders
+ * full width rows starting at `y`, clamping the row count to the image, so
+ * callers can walk an image band by band without knowing its size up front.
+ */
+class RenderRegionJob : public AsyncJob
+{
+public:
+  RenderRegionJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper, Region region, unsigned bits, bool inset, bool band)
+      : AsyncJob(info.Env(), "renderRegion"), wrapper_(wrapper), region_(region), bits_(bits), inset_(inset), band_(band)
+  {
+    this->Retain(info.This().As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    LibRaw *processor = this->wrapper_->processor_;
+    RawDeveloper developer(processor);
+    RegionMode mode = this->band_ ? RegionMode::Band : RegionMode::Exact;
+    std::string error = PrepareRender("renderRegion", processor, this->wrapper_->InputTruncated(), developer, this->inset_, mode, this->region_);
+    if (!error.empty())
+    {
+      this->SetError(error);
+      return;
+    }
+    this->imageHeight_ = developer.Height();
+
+    this->data_.resize(static_cast<std::size_t>(this->region_.width) * this->region_.height * 3 * (this->bits_ / 8));
+    developer.Render(this->region_, this->bits_, this->data_.data());
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", this->region_.width);
+    result.Set("height", this->region_.height);
+    result.Set("colors", 3);
+    result.Set("bits", this->bits_);
+    result.Set("data", MoveToBuffer(env, std::move(this->data_)));
+    if (this->band_)
+    {
+      result.Set("y", this->region_.y);
+      result.Set("imageHeight", this->imageHeight_);
+    }
+    return result;
+  }
+
+private:
+  LibRawWrapper *wrapper_;
+  Region region_;
+  unsigned bits_;
+  bool inset_;
+  bool band_;
+  int imageHeight_ = 0;
+  std::vector<char> data_;
+};
+
+/*
+ * Develops the image, or a region of it, into a caller provided
+ * Float32Array on the worker pool.
+ */
+class RenderTensorJob : public AsyncJob
+{
+public:
+  RenderTensorJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper, float *out, TensorOptions options, bool inset, bool whole, Region region)
+      : AsyncJob(info.Env(), "renderTensor"), wrapper_(wrapper), out_(out), options_(options), inset_(inset), whole_(whole), region_(region)
+  {
+    this->Retain(info.This().As<Napi::Object>());
+    // the tensor's memory is written from the pool
+    this->Retain(info[0].As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    LibRaw *processor = this->wrapper_->processor_;
+    RawDeveloper developer(processor);
+    RegionMode mode = this->whole_ ? RegionMode::Whole : RegionMode::Exact;
+    std::string error = PrepareRender("renderTensor", processor, this->wrapper_->InputTruncated(), developer, this->inset_, mode, this->region_);
+    if (!error.empty())
+    {
+      this->SetError(error);
+      return;
+    }
+    developer.RenderTensor(this->region_, this->options_, this->out_);
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    return env.Undefined();
+  }
+
+private:
+  LibRawWrapper *wrapper_;
+  float *out_;
+  TensorOptions options_;
+  bool inset_;
+  bool whole_;
+  Region region_;
+};
+
+/*
+ * Develops the image, or a region of it, band by band straight into an
+ * encoder on the worker pool, so only the encoded file reaches JS.
+ */
+class RenderEncodedJob : public AsyncJob
+{
+public:
+  RenderEncodedJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper, EncodeSettings settings, bool inset, bool whole, Region region)
+      : AsyncJob(info.Env(), "renderEncoded"), wrapper_(wrapper), settings_(std::move(settings)), inset_(inset), whole_(whole), region_(region)
+  {
+    this->Retain(info.This().As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    LibRaw *processor = this->wrapper_->processor_;
+    RawDeveloper developer(processor);
+    RegionMode mode = this->whole_ ? RegionMode::Whole : RegionMode::Exact;
+    std::string error = PrepareRender("renderEncoded", processor, this->wrapper_->InputTruncated(), developer, this->inset_, mode, this->region_);
+    if (!error.empty())
+    {
+      this->SetError(error);
+      return;
+    }
+
+    std::unique_ptr<ImageEncoder> encoder = CreateEncoder(this->settings_, this->region_.width, this->region_.height, error);
+    if (!encoder)
+    {
+      this->SetError("renderEncoded cannot encode this image: " + error + ".");
+      return;
+    }
+    for (int y = 0; y < this->region_.height; y += encoder->BandRows())
+    {
+      Region band{this->region_.x, this->region_.y + y, this->region_.width, std::min(encoder->BandRows(), this->region_.height - y)};
+      developer.Render(band, this->settings_.bits, encoder->Band(band.height));
+      TraceSpan span("encode");
+      if (!encoder->Write(band.height))
+      {
+        this->SetError("renderEncoded could not encode the image: " + encoder->Error() + ".");
+        return;
+      }
+    }
+    TraceSpan span("encode");
+    if (!encoder->Finish(this->data_))
+    {
+      this->SetError("renderEncoded could not encode the image: " + encoder->Error() + ".");
+    }
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    return MoveToBuffer(env, std::move(this->data_));
+  }
+
+private:
+  LibRawWrapper *wrapper_;
+  EncodeSettings settings_;
+  bool inset_;
+  bool whole_;
+  Region region_;
+  std::vector<char> data_;
+};
+
+static bool ParseRegion(Napi::Env env, const std::string &method, Napi::Object object, Region *region)
+{
+  int *coords[4] = {&region->x, &region->y, &region->width, &region->height};
+  const char *names[4] = {"x", "y", "w", "h"};
+  for (int i = 0; i < 4; i++)
+  {
+    Napi::Value value = object.Get(names[i]);
+    if (!value.IsNumber())
+    {
+      Napi::TypeError::New(env, method + " received an invalid argument, region must have numeric x, y, w and h.").ThrowAsJavaScriptException();
+      return false;
+    }
+    *coords[i] = value.As<Napi::Number>().Int32Value();
+  }
+  return true;
+}
+
+static bool ParseRenderOptions(Napi::Env env, const std::string &method, Napi::Value value, unsigned *bits, bool *inset)
+{
+  *bits = 8;
+  *inset = false;
+  if (value.IsObject())
+  {
+    Napi::Object options = value.As<Napi::Object>();
+    if (!options.Get("bits").IsUndefined())
+    {
+      *bits = options.Get("bits").ToNumber().Uint32Value();
+    }
+    *inset = options.Get("inset").ToBoolean().Value();
+  }
+  if (*bits != 8 && *bits != 16)
+  {
+    Napi::TypeError::New(env, method + " received an invalid argument, bits must be 8 or 16.").ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
+}
+
+Napi::Value LibRawWrapper::RenderRegion(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsObject())
+  {
+    Napi::TypeError::New(env, "renderRegion received an invalid argument, region must be an object.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Region region;
+  if (!ParseRegion(env, "renderRegion", info[0].As<Napi::Object>(), &region))
+  {
+    return env.Undefined();
+  }
+
+  unsigned bits;
+  bool inset;
+  if (!ParseRenderOptions(env, "renderRegion", info[1], &bits, &inset))
+  {
+    return env.Undefined();
+  }
+
+  return (new RenderRegionJob(info, this, region, bits, inset, false))->Queue(this->priority_);
+}
+
+Napi::Value LibRawWrapper::RenderRows(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsNumber() || !info[1].IsNumber() ||
+      info[0].As<Napi::Number>().Int32Value() < 0 || info[1].As<Napi::Number>().Int32Value() < 1)
+  {
+    Napi::TypeError::New(env, "renderRows received an invalid argument, y and rows must be a non-negative offset and a positive count.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  unsigned bits;
+  bool inset;
+  if (!ParseRenderOptions(env, "renderRows", info[2], &bits, &inset))
+  {
+    return env.Undefined();
+  }
+
+  Region region{0, info[0].As<Napi::Number>().Int32Value(), 0, info[1].As<Napi::Number>().Int32Value()};
+  return (new RenderRegionJob(info, this, region, bits, inset, true))->Queue(this->priority_);
+}
+
+static bool ParseTriple(Napi::Object options, const char *name, float fallback, float *out)
+{
+  Napi::Value value = options.Get(name);
+  if (value.IsUndefined())
+  {
+    std::fill(out, out + 3, fallback);
+    return true;
+  }
+  if (!value.IsArray() || value.As<Napi::Array>().Length() != 3)
+  {
+    return false;
+  }
+  Napi::Array array = value.As<Napi::Array>();
+  for (uint32_t i = 0; i < 3; i++)
+  {
+    Napi::Value item = array.Get(i);
+    if (!item.IsNumber())
+    {
+      return false;
+    }
+    out[i] = item.As<Napi::Number>().FloatValue();
+  }
+  return true;
+}
+
+/*
+ * render_tensor(out: Float32Array, options) where options holds the output
+ * `width` and `height`, `layout` ('chw' or 'hwc'), `linear`, `inset`, an
+ * optional source `region` and per channel `mean` and `std`.
+ */
+Napi::Value LibRawWrapper::RenderTensor(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsTypedArray() || info[0].As<Napi::TypedArray>().TypedArrayType() != napi_float32_array)
+  {
+    Napi::TypeError::New(env, "renderTensor received an invalid argument, out must be a Float32Array.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (!info[1].IsObject())
+  {
+    Napi::TypeError::New(env, "renderTensor received an invalid argument, options must be an object.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Float32Array out = info[0].As<Napi::Float32Array>();
+  Napi::Object options = info[1].As<Napi::Object>();
+
+  TensorOptions tensor;
+  Napi::Value width = options.Get("width");
+  Napi::Value height = options.Get("height");
+  if (!width.IsNumber() || !height.IsNumber() ||
+      width.As<Napi::Number>().Int32Value() < 1 || height.As<Napi::Number>().Int32Value() < 1)
+  {
+    Napi::TypeError::New(env, "renderTensor received an invalid argument, width and height must be positive numbers.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  tensor.width = width.As<Napi::Number>().Int32Value();
+  tensor.height = height.As<Napi::Number>().Int32Value();
+
+  Napi::Value layout = options.Get("layout");
+  std::string layoutName = layout.IsUndefined() ? "chw" : layout.ToString().Utf8Value();
+  if (layoutName != "chw" && layoutName != "hwc")
+  {
+    Napi::TypeError::New(env, "renderTensor received an invalid argument, layout must be 'chw' or 'hwc'.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  tensor.planar = layoutName == "chw";
+  tensor.linear = options.Get("linear").ToBoolean().Value();
+
+  if (!ParseTriple(options, "mean", 0.0f, tensor.mean) || !ParseTriple(options, "std", 1.0f, tensor.std) ||
+      std::find(tensor.std, tensor.std + 3, 0.0f) != tensor.std + 3)
+  {
+    Napi::TypeError::New(env, "renderTensor received an invalid argument, mean and std must be arrays of three numbers and std must not be 0.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  if (out.ElementLength() != static_cast<std::size_t>(tensor.width) * tensor.height * 3)
+  {
+    Napi::RangeError::New(env, "renderTensor received an invalid argument, out must hold width * height * 3 elements.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Region region{0, 0, 0, 0};
+  bool whole = !options.Get("region").IsObject();
+  if (!whole && !ParseRegion(env, "renderTensor", options.Get("region").As<Napi::Object>(), &region))
+  {
+    return env.Undefined();
+  }
+
+  bool inset = options.Get("inset").ToBoolean().Value();
+  return (new RenderTensorJob(info, this, out.Data(), tensor, inset, whole, region))->Queue(this->priority_);
+}
+
+/*
+ * render_encoded(options) where options holds the `encode` settings
+ * (`format` 'jpeg' or 'tiff', `quality` and `icc`), an optional `region`
+ * and the usual `bits` and `inset`. Bits default to 16 for TIFF.
+ */
+Napi::Value LibRawWrapper::RenderEncoded(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsObject() || !info[0].As<Napi::Object>().Get("encode").IsObject())
+  {
+    Napi::TypeError::New(env, "renderEncoded received an invalid argument, options must be an object with encode settings.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object options = info[0].As<Napi::Object>();
+  Napi::Object encode = options.Get("encode").As<Napi::Object>();
+
+  EncodeSettings settings;
+  Napi::Value format = encode.Get("format");
+  std::string formatName = format.IsString() ? format.As<Napi::String>().Utf8Value() : "";
+  if (formatName != "jpeg" && formatName != "tiff")
+  {
+    Napi::TypeError::New(env, "renderEncoded received an invalid argument, format must be 'jpeg' or 'tiff'.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  settings.format = formatName == "jpeg" ? ImageFormat::Jpeg : ImageFormat::Tiff;
+
+  bool inset;
+  if (!ParseRenderOptions(env, "renderEncoded", options, &settings.bits, &inset))
+  {
+    return env.Undefined();
+  }
+  if (options.Get("bits").IsUndefined() && settings.format == ImageFormat::Tiff)
+  {
+    settings.bits = 16;
+  }
+  if (settings.format == ImageFormat::Jpeg && settings.bits != 8)
+  {
+    Napi::TypeError::New(env, "renderEncoded received an invalid argument, JPEG output must use 8 bits.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Napi::Value quality = encode.Get("quality");
+  settings.quality = quality.IsUndefined() ? 90 : quality.ToNumber().Int32Value();
+  if (settings.quality < 1 || settings.quality > 100)
+  {
+    Napi::TypeError::New(env, "renderEncoded received an invalid argument, quality must be between 1 and 100.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Napi::Value icc = encode.Get("icc");
+  if (icc.IsBuffer())
+  {
+    Napi::Buffer<char> profile = icc.As<Napi::Buffer<char>>();
+    settings.icc.assign(profile.Data(), profile.Data() + profile.Length());
+  }
+  else if (icc.IsUndefined() || (icc.IsBoolean() && icc.As<Napi::Boolean>().Value()))
+  {
+    settings.icc = RenderedIccProfile();
+  }
+  else if (!icc.IsBoolean())
+  {
+    Napi::TypeError::New(env, "renderEncoded received an invalid argument, icc must be a boolean or a Buffer.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Region region{0, 0, 0, 0};
+  bool whole = !options.Get("region").IsObject();
+  if (!whole && !ParseRegion(env, "renderEncoded", options.Get("region").As<Napi::Object>(), &region))
+  {
+    return env.Undefined();
+  }
+
+  return (new RenderEncodedJob(info, this, std::move(settings), inset, whole, region))->Queue(this->priority_);
+}
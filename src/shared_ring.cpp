@@ -0,0 +1,357 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "shared_ring.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <string>
+#include <thread>
+#else
+#include <linux/futex.h>
+#include <linux/memfd.h>
+#include <sys/syscall.h>
+#endif
+
+struct SharedRing::Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t capacity;
+  // next free position, moved by the writer
+  alignas(64) std::atomic<uint64_t> head;
+  // oldest position still in use, moved by the reader
+  alignas(64) std::atomic<uint64_t> tail;
+  // bumped whenever the tail moves, the writer waits on it
+  std::atomic<uint32_t> released;
+};
+
+struct SharedRing::RecordHeader
+{
+  // whole record including this header, a multiple of kAlign
+  uint64_t size;
+  uint32_t kind;
+  uint32_t reserved;
+};
+
+namespace
+{
+  const uint32_t kMagic = 0x4c525247; // "LRRG"
+  const uint32_t kVersion = 1;
+  const std::size_t kAlign = 64;
+  const std::size_t kMinCapacity = 4096;
+
+  enum RecordKind : uint32_t
+  {
+    kData = 1,
+    // fills the end of the ring when a record does not fit there
+    kPadding = 2,
+  };
+
+  std::size_t AlignUp(std::size_t value, std::size_t alignment)
+  {
+    return (value + alignment - 1) / alignment * alignment;
+  }
+
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "the ring needs address-free atomics");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free, "the ring needs address-free atomics");
+
+  void WaitReleased(std::atomic<uint32_t> &word, uint32_t seen, std::chrono::milliseconds timeout)
+  {
+#ifdef __APPLE__
+    // no futex for shared memory, poll instead
+    (void)word;
+    (void)seen;
+    std::this_thread::sleep_for(std::min(timeout, std::chrono::milliseconds(1)));
+#else
+    struct timespec ts;
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, seen, &ts, nullptr, 0);
+#endif
+  }
+
+  void WakeReleased(std::atomic<uint32_t> &word)
+  {
+#ifndef __APPLE__
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+  }
+
+  int CreateSharedFd()
+  {
+#ifdef __APPLE__
+    static std::atomic<unsigned> counter(0);
+    std::string name = "/librawjs-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0)
+    {
+      shm_unlink(name.c_str());
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#else
+    return static_cast<int>(syscall(SYS_memfd_create, "libraw-ring", MFD_CLOEXEC));
+#endif
+  }
+}
+
+SharedRing::~SharedRing()
+{
+  if (this->base_)
+  {
+    munmap(this->base_, this->mapped_);
+  }
+  this->CloseFd();
+}
+
+SharedRing *SharedRing::Create(std::size_t capacity, int &err)
+{
+  capacity = AlignUp(std::max(capacity, kMinCapacity), kAlign);
+  SharedRing *ring = new SharedRing();
+  ring->fd_ = CreateSharedFd();
+  std::size_t size = AlignUp(sizeof(Header), kAlign) + capacity;
+  if (ring->fd_ < 0 || ftruncate(ring->fd_, size) != 0 || !ring->Map(size))
+  {
+    err = errno;
+    delete ring;
+    return nullptr;
+  }
+  new (ring->header_) Header();
+  ring->header_->magic = kMagic;
+  ring->header_->version = kVersion;
+  ring->header_->capacity = capacity;
+  ring->capacity_ = capacity;
+  return ring;
+}
+
+SharedRing *SharedRing::Attach(int fd, int &err)
+{
+  SharedRing *ring = new SharedRing();
+  ring->fd_ = fd;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !ring->Map(st.st_size))
+  {
+    err = errno;
+    delete ring;
+    return nullptr;
+  }
+  std::size_t capacity = ring->header_->capacity;
+  if (ring->header_->magic != kMagic || ring->header_->version != kVersion ||
+      capacity % kAlign != 0 || capacity > ring->mapped_ - AlignUp(sizeof(Header), kAlign))
+  {
+    err = EINVAL;
+    delete ring;
+    return nullptr;
+  }
+  ring->capacity_ = capacity;
+  ring->CloseFd();
+  return ring;
+}
+
+bool SharedRing::Map(std::size_t size)
+{
+  if (size < AlignUp(sizeof(Header), kAlign) + kMinCapacity)
+  {
+    errno = EINVAL;
+    return false;
+  }
+  void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd_, 0);
+  if (base == MAP_FAILED)
+  {
+    return false;
+  }
+  this->base_ = static_cast<char *>(base);
+  this->mapped_ = size;
+  this->header_ = reinterpret_cast<Header *>(this->base_);
+  this->data_ = this->base_ + AlignUp(sizeof(Header), kAlign);
+  return true;
+}
+
+void SharedRing::CloseFd()
+{
+  if (this->fd_ >= 0)
+  {
+    ::close(this->fd_);
+    this->fd_ = -1;
+  }
+}
+
+std::size_t SharedRing::Used() const
+{
+  return this->header_->head.load(std::memory_order_acquire) - this->header_->tail.load(std::memory_order_acquire);
+}
+
+bool SharedRing::Write(const std::vector<std::pair<const char *, std::size_t>> &parts, unsigned waitMs,
+                       uint64_t &record, std::vector<std::size_t> &offsets)
+{
+  std::size_t payload = 0;
+  offsets.clear();
+  for (const auto &part : parts)
+  {
+    offsets.push_back(payload);
+    payload += AlignUp(part.second, 8);
+  }
+  std::size_t size = AlignUp(sizeof(RecordHeader) + payload, kAlign);
+  if (size > this->capacity_)
+  {
+    return false;
+  }
+
+  Header *header = this->header_;
+  uint64_t head = header->head.load(std::memory_order_relaxed);
+  std::size_t padding = 0;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(waitMs);
+  for (;;)
+  {
+    uint32_t seen = header->released.load(std::memory_order_acquire);
+    uint64_t tail = header->tail.load(std::memory_order_acquire);
+    std::size_t offset = head % this->capacity_;
+    padding = offset + size > this->capacity_ ? this->capacity_ - offset : 0;
+    if (head + padding + size - tail <= this->capacity_)
+    {
+      break;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now >= deadline)
+    {
+      return false;
+    }
+    WaitReleased(header->released, seen,
+                 std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now) + std::chrono::milliseconds(1));
+  }
+
+  if (padding)
+  {
+    RecordHeader *pad = reinterpret_cast<RecordHeader *>(this->data_ + head % this->capacity_);
+    *pad = RecordHeader{padding, kPadding, 0};
+    head += padding;
+  }
+  char *out = this->data_ + head % this->capacity_;
+  *reinterpret_cast<RecordHeader *>(out) = RecordHeader{size, kData, 0};
+  for (std::size_t i = 0; i < parts.size(); i++)
+  {
+    if (parts[i].second)
+    {
+      std::memcpy(out + sizeof(RecordHeader) + offsets[i], parts[i].first, parts[i].second);
+    }
+  }
+  record = head;
+  header->head.store(head + size, std::memory_order_release);
+  return true;
+}
+
+bool SharedRing::ReadRecord(uint64_t position, uint64_t head, RecordHeader &record) const
+{
+  uint64_t tail = this->header_->tail.load(std::memory_order_relaxed);
+  if (head - tail > this->capacity_ || position < tail || position >= head || position % kAlign != 0)
+  {
+    return false;
+  }
+  std::size_t offset = position % this->capacity_;
+  // copied once, the writer may change it under us
+  std::memcpy(&record, this->data_ + offset, sizeof(RecordHeader));
+  return record.size >= kAlign && record.size % kAlign == 0 && record.size <= this->capacity_ - offset &&
+         record.size <= head - position && (record.kind == kData || record.kind == kPadding);
+}
+
+const char *SharedRing::View(uint64_t record, const std::vector<std::pair<std::size_t, std::size_t>> &spans)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  RecordHeader header;
+  uint64_t head = this->header_->head.load(std::memory_order_acquire);
+  if (this->records_.count(record) || !this->ReadRecord(record, head, header) || header.kind != kData)
+  {
+    return nullptr;
+  }
+  std::size_t payload = header.size - sizeof(RecordHeader);
+  for (const auto &span : spans)
+  {
+    if (span.first > payload || span.second > payload - span.first)
+    {
+      return nullptr;
+    }
+  }
+  this->records_[record] = false;
+  return this->data_ + record % this->capacity_ + sizeof(RecordHeader);
+}
+
+void SharedRing::Release(uint64_t record)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  auto it = this->records_.find(record);
+  if (it == this->records_.end())
+  {
+    return;
+  }
+  it->second = true;
+  this->Advance();
+}
+
+void SharedRing::Advance()
+{
+  if (this->corrupt_)
+  {
+    return;
+  }
+  Header *header = this->header_;
+  uint64_t start = header->tail.load(std::memory_order_relaxed);
+  uint64_t tail = start;
+  uint64_t head = header->head.load(std::memory_order_acquire);
+  while (tail != head)
+  {
+    RecordHeader record;
+    if (!this->ReadRecord(tail, head, record))
+    {
+      // the writer broke the ring, its space is not reused
+      this->corrupt_ = true;
+      break;
+    }
+    if (record.kind == kData)
+    {
+      auto it = this->records_.find(tail);
+      if (it == this->records_.end() || !it->second)
+      {
+        break;
+      }
+      this->records_.erase(it);
+    }
+    tail += record.size;
+    // ReadRecord checks positions against the stored tail
+    header->tail.store(tail, std::memory_order_release);
+  }
+  if (tail != start)
+  {
+    header->released.fetch_add(1, std::memory_order_release);
+    WakeReleased(header->released);
+  }
+}
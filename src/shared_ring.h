@@ -0,0 +1,115 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_SHARED_RING_H
+#define LIBRAWJS_SHARED_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*
+ * Shared-memory ring carrying results from a decode worker process to its
+ * parent.
+ *
+ * The parent creates the ring over an anonymous shared memory file
+ * (memfd, or an unlinked POSIX shm object on macOS) and passes the
+ * descriptor to the child. The child appends one record per result with
+ * `Write`, and tells the parent the record's position over its IPC
+ * channel; the parent exposes the record's spans as Buffers over the
+ * mapping with `View` and hands the space back with `Release` once they are
+ * collected. Records are released in any order; the tail only advances
+ * over a contiguous run of released records.
+ *
+ * A full ring makes the writer wait on a futex (polling on macOS) for the
+ * parent to release space, up to a deadline, after which the caller falls
+ * back to another transport. The child may be running on a malicious
+ * file, so the parent checks everything it reads from the ring: a bad
+ * record is rejected, and a bad header stops the tail for good.
+ */
+class SharedRing
+{
+public:
+  ~SharedRing();
+  SharedRing(const SharedRing &) = delete;
+  SharedRing &operator=(const SharedRing &) = delete;
+
+  /*
+   * Creates a ring with `capacity` bytes of records. Returns nullptr and
+   * sets `err` to an errno value on failure. `Fd` stays open until
+   * `CloseFd`, so it can be passed on to the child.
+   */
+  static SharedRing *Create(std::size_t capacity, int &err);
+  // maps the ring created by the parent, taking ownership of `fd`
+  static SharedRing *Attach(int fd, int &err);
+
+  int Fd() const { return this->fd_; }
+  void CloseFd();
+  std::size_t Capacity() const { return this->capacity_; }
+  // bytes held by records not released yet, padding included
+  std::size_t Used() const;
+
+  /*
+   * Writer side. Appends the concatenation of `parts`, each aligned to 8
+   * bytes, as one record. On success sets `record` to its position and
+   * `offsets` to where each part starts within it. Returns false if the
+   * record does not fit within `waitMs` milliseconds.
+   */
+  bool Write(const std::vector<std::pair<const char *, std::size_t>> &parts, unsigned waitMs,
+             uint64_t &record, std::vector<std::size_t> &offsets);
+
+  /*
+   * Reader side. Checks that `record` is a committed record not viewed yet
+   * and that every `[offset, offset + length)` span lies within it, then
+   * returns its payload. Each viewed record must be released exactly once.
+   */
+  const char *View(uint64_t record, const std::vector<std::pair<std::size_t, std::size_t>> &spans);
+  void Release(uint64_t record);
+
+private:
+  struct Header;
+  struct RecordHeader;
+
+  SharedRing() = default;
+  bool Map(std::size_t size);
+  // copies out the header of the record at `position`, false if it is bad
+  bool ReadRecord(uint64_t position, uint64_t head, RecordHeader &record) const;
+  void Advance();
+
+  int fd_ = -1;
+  char *base_ = nullptr;
+  std::size_t mapped_ = 0;
+  std::size_t capacity_ = 0;
+  Header *header_ = nullptr;
+  char *data_ = nullptr;
+
+  // reader state: records viewed, and whether they were released
+  std::mutex mutex_;
+  std::unordered_map<uint64_t, bool> records_;
+  bool corrupt_ = false;
+};
+
+#endif
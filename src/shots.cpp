@@ -0,0 +1,294 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "async_job.h"
+#include "developer.h"
+#include "libraw_wrapper.h"
+#include "parallel.h"
+#include "processor_pool.h"
+#include "trace.h"
+
+/*
+ * Unpacks several shots of a multi-frame file (pixel shift, dual exposure,
+ * ...) at once.
+ *
+ * LibRaw selects a frame with `rawparams.shot_select` while opening, so a
+ * processor can only hold one frame. Every shot gets its own pooled
+ * processor and the shots are decoded in parallel. The input is read only
+ * once: files are memory mapped and shared by all processors, buffers and
+ * descriptors are read in place.
+ */
+class UnpackShotsJob : public AsyncJob
+{
+public:
+  UnpackShotsJob(const Napi::CallbackInfo &info, LibRawWrapper *wrapper, std::vector<int> shots, bool preview, int previewSize)
+      : AsyncJob(info.Env(), "unpackAll"), wrapper_(wrapper), shots_(std::move(shots)), preview_(preview), previewSize_(previewSize)
+  {
+    this->Retain(info.This().As<Napi::Object>());
+  }
+
+protected:
+  void Execute() override
+  {
+    std::lock_guard<std::mutex> lock(this->wrapper_->mutex_);
+    LibRawWrapper *wrapper = this->wrapper_;
+
+    const void *data = wrapper->inputData_;
+    std::size_t size = wrapper->inputSize_;
+    MappedFile mapped;
+    if (!wrapper->inputPath_.empty())
+    {
+      int err = mapped.Open(wrapper->inputPath_);
+      if (err)
+      {
+        this->SetError(std::string("unpackAll could not read file: ") + std::strerror(err));
+        return;
+      }
+      data = mapped.Data();
+      size = mapped.Size();
+    }
+    else if (!data && !wrapper->stream_)
+    {
+      this->SetError("unpackAll requires an open image.");
+      return;
+    }
+    if (mapped.Truncated() || wrapper->InputTruncated())
+    {
+      this->SetError(std::string("unpackAll could not read file: ") + libraw_strerror(LIBRAW_IO_ERROR));
+      return;
+    }
+
+    int count = std::max<int>(wrapper->processor_->imgdata.idata.raw_count, 1);
+    if (this->shots_.empty())
+    {
+      for (int shot = 0; shot < count; shot++)
+      {
+        this->shots_.push_back(shot);
+      }
+    }
+    for (int shot : this->shots_)
+    {
+      if (shot < 0 || shot >= count)
+      {
+        this->SetError("unpackAll received an invalid shot " + std::to_string(shot) + ", the image has " + std::to_string(count) + ".");
+        return;
+      }
+    }
+
+    int fd = wrapper->stream_ ? wrapper->stream_->fd() : -1;
+    this->frames_.resize(this->shots_.size());
+    ParallelFor(this->shots_.size(), 1, [&](std::size_t first, std::size_t last)
+                {
+      for (std::size_t i = first; i < last; i++)
+      {
+        this->Decode(data, size, fd, this->shots_[i], this->frames_[i]);
+      } });
+
+    for (const Frame &frame : this->frames_)
+    {
+      if (!frame.error.empty())
+      {
+        this->SetError(frame.error);
+        return;
+      }
+    }
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    Napi::Array result = Napi::Array::New(env, this->frames_.size());
+    for (std::size_t i = 0; i < this->frames_.size(); i++)
+    {
+      Frame &frame = this->frames_[i];
+      Napi::Object object = Napi::Object::New(env);
+      object.Set("shot", frame.shot);
+      object.Set("width", frame.width);
+      object.Set("height", frame.height);
+      object.Set("colors", frame.colors);
+      object.Set("bits", frame.bits);
+      object.Set("data", MoveToBuffer(env, std::move(frame.data)));
+      result[i] = object;
+    }
+    return result;
+  }
+
+private:
+  struct Frame
+  {
+    int shot = 0;
+    int width = 0;
+    int height = 0;
+    int colors = 0;
+    int bits = 0;
+    std::vector<char> data;
+    std::string error;
+  };
+
+  void Decode(const void *data, std::size_t size, int fd, int shot, Frame &frame)
+  {
+    frame.shot = shot;
+    LibRaw *processor = ProcessorPool::Instance().Acquire();
+    processor->imgdata.rawparams.shot_select = shot;
+
+    std::unique_ptr<FdDatastream> stream;
+    int ret;
+    if (data)
+    {
+      ret = processor->open_buffer(data, size);
+    }
+    else
+    {
+      stream.reset(new FdDatastream(fd));
+      ret = stream->valid() ? processor->open_datastream(stream.get()) : stream->error();
+    }
+    if (ret == LIBRAW_SUCCESS)
+    {
+      TraceSpan span("unpack");
+      ret = processor->unpack();
+    }
+
+    if (ret != LIBRAW_SUCCESS)
+    {
+      frame.error = "unpackAll could not unpack shot " + std::to_string(shot) + ": " + libraw_strerror(ret);
+    }
+    else if (this->preview_)
+    {
+      this->Preview(processor, frame);
+    }
+    else
+    {
+      this->Plane(processor, frame);
+    }
+
+    // releases the datastream before `stream` goes away
+    ProcessorPool::Instance().Release(processor);
+  }
+
+  /* the visible area of the CFA plane, one 16 bit sample per pixel */
+  void Plane(LibRaw *processor, Frame &frame)
+  {
+    const libraw_image_sizes_t &sizes = processor->imgdata.sizes;
+    const uint16_t *raw = processor->imgdata.rawdata.raw_image;
+    if (!raw)
+    {
+      frame.error = "unpackAll cannot return a raw plane for shot " + std::to_string(frame.shot) + ", the image is not a single channel sensor.";
+      return;
+    }
+    frame.width = sizes.width;
+    frame.height = sizes.height;
+    frame.colors = 1;
+    frame.bits = 16;
+    std::size_t rowBytes = static_cast<std::size_t>(sizes.width) * sizeof(uint16_t);
+    frame.data.resize(rowBytes * sizes.height);
+    for (int row = 0; row < sizes.height; row++)
+    {
+      const uint16_t *src = raw + static_cast<std::size_t>(row + sizes.top_margin) * (sizes.raw_pitch / 2) + sizes.left_margin;
+      std::memcpy(frame.data.data() + row * rowBytes, src, rowBytes);
+    }
+  }
+
+  /* an 8 bit RGB rendering whose longer side is at most `previewSize_` */
+  void Preview(LibRaw *processor, Frame &frame)
+  {
+    RawDeveloper developer(processor);
+    int ret = developer.Init(false);
+    if (ret != LIBRAW_SUCCESS)
+    {
+      frame.error = "unpackAll cannot preview shot " + std::to_string(frame.shot) + ": " + libraw_strerror(ret);
+      return;
+    }
+    frame.colors = 3;
+    frame.bits = 8;
+    developer.RenderPreview(this->previewSize_, frame.width, frame.height, frame.data);
+  }
+
+  LibRawWrapper *wrapper_;
+  std::vector<int> shots_;
+  bool preview_;
+  int previewSize_;
+  std::vector<Frame> frames_;
+};
+
+Napi::Value LibRawWrapper::ShotCount(const Napi::CallbackInfo &info)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return Napi::Number::New(info.Env(), std::max<unsigned>(this->processor_->imgdata.idata.raw_count, 1));
+}
+
+/*
+ * unpack_shots(options) where options may hold `shots` (indices, all shots
+ * by default), `output` ('raw' or 'preview') and `previewSize`.
+ */
+Napi::Value LibRawWrapper::UnpackShots(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  Napi::Object options = info[0].IsObject() ? info[0].As<Napi::Object>() : Napi::Object::New(env);
+
+  std::vector<int> shots;
+  Napi::Value list = options.Get("shots");
+  if (!list.IsUndefined())
+  {
+    if (!list.IsArray())
+    {
+      Napi::TypeError::New(env, "unpackAll received an invalid argument, shots must be an array of numbers.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    Napi::Array array = list.As<Napi::Array>();
+    for (uint32_t i = 0; i < array.Length(); i++)
+    {
+      Napi::Value shot = array.Get(i);
+      if (!shot.IsNumber())
+      {
+        Napi::TypeError::New(env, "unpackAll received an invalid argument, shots must be an array of numbers.").ThrowAsJavaScriptException();
+        return env.Undefined();
+      }
+      shots.push_back(shot.As<Napi::Number>().Int32Value());
+    }
+  }
+
+  Napi::Value output = options.Get("output");
+  std::string outputName = output.IsUndefined() ? "raw" : output.ToString().Utf8Value();
+  if (outputName != "raw" && outputName != "preview")
+  {
+    Napi::TypeError::New(env, "unpackAll received an invalid argument, output must be 'raw' or 'preview'.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  int previewSize = 1024;
+  Napi::Value size = options.Get("previewSize");
+  if (!size.IsUndefined())
+  {
+    previewSize = size.ToNumber().Int32Value();
+    if (previewSize < 1)
+    {
+      Napi::TypeError::New(env, "unpackAll received an invalid argument, previewSize must be a positive number.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+  }
+
+  return (new UnpackShotsJob(info, this, std::move(shots), outputName == "preview", previewSize))->Queue(this->priority_);
+}
@@ -0,0 +1,285 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "async_job.h"
+#include "libraw_wrapper.h"
+#include "parallel.h"
+#include "processor_pool.h"
+#include "stacker.h"
+#include "trace.h"
+
+/*
+ * Stacks light frames, optionally calibrated with master dark and flat
+ * frames, on the worker pool. Frames are decoded in parallel with pooled
+ * processors, each released as soon as its plane has been added.
+ */
+class StackJob : public AsyncJob
+{
+public:
+  StackJob(Napi::Env env, StackSettings settings, std::vector<std::string> paths,
+           std::string dark, std::string flat, bool dng)
+      : AsyncJob(env, "stack"), settings_(std::move(settings)), paths_(std::move(paths)),
+        dark_(std::move(dark)), flat_(std::move(flat)), dng_(dng)
+  {
+  }
+
+protected:
+  void Execute() override
+  {
+    FrameStacker stacker(this->settings_, this->paths_.size());
+    struct Source
+    {
+      FrameStacker::Role role;
+      std::size_t index;
+      const std::string *path;
+    };
+    std::vector<Source> sources;
+    for (std::size_t i = 0; i < this->paths_.size(); i++)
+    {
+      sources.push_back({FrameStacker::Role::Light, i, &this->paths_[i]});
+    }
+    if (!this->dark_.empty())
+    {
+      sources.push_back({FrameStacker::Role::Dark, 0, &this->dark_});
+    }
+    if (!this->flat_.empty())
+    {
+      sources.push_back({FrameStacker::Role::Flat, 0, &this->flat_});
+    }
+
+    std::vector<std::string> errors(sources.size());
+    ParallelFor(sources.size(), 1, [&](std::size_t first, std::size_t last)
+                {
+      for (std::size_t i = first; i < last; i++)
+      {
+        this->Load(stacker, sources[i].role, sources[i].index, *sources[i].path, errors[i]);
+      } });
+    for (const std::string &error : errors)
+    {
+      if (!error.empty())
+      {
+        this->SetError(error);
+        return;
+      }
+    }
+
+    const RawFormat &format = stacker.Format();
+    std::size_t samples = static_cast<std::size_t>(format.width) * format.height;
+    std::size_t dataAt = 0;
+    std::string error;
+    if (this->dng_)
+    {
+      if (!LayoutDng(format, this->data_, dataAt, error))
+      {
+        this->SetError("stack cannot write a DNG: " + error + ".");
+        return;
+      }
+    }
+    else
+    {
+      this->data_.resize(samples * sizeof(uint16_t));
+    }
+    // combined straight into the output, DNG or plane
+    if (!stacker.Combine(reinterpret_cast<uint16_t *>(this->data_.data() + dataAt), error))
+    {
+      this->SetError("stack could not combine the frames: " + error + ".");
+      return;
+    }
+    this->width_ = format.width;
+    this->height_ = format.height;
+  }
+
+  Napi::Value OnOK(Napi::Env env) override
+  {
+    if (this->dng_)
+    {
+      return MoveToBuffer(env, std::move(this->data_));
+    }
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("width", this->width_);
+    result.Set("height", this->height_);
+    result.Set("colors", 1);
+    result.Set("bits", 16);
+    result.Set("frames", static_cast<double>(this->paths_.size()));
+    result.Set("data", MoveToBuffer(env, std::move(this->data_)));
+    return result;
+  }
+
+private:
+  void Load(FrameStacker &stacker, FrameStacker::Role role, std::size_t index, const std::string &path, std::string &error)
+  {
+    LibRaw *processor = ProcessorPool::Instance().Acquire();
+    int ret;
+    {
+      TraceSpan span("open");
+      ret = processor->open_file(path.c_str());
+    }
+    if (ret == LIBRAW_SUCCESS)
+    {
+      TraceSpan span("unpack");
+      ret = processor->unpack();
+    }
+    if (ret != LIBRAW_SUCCESS)
+    {
+      error = "stack could not unpack " + path + ": " + libraw_strerror(ret);
+    }
+    else
+    {
+      std::string reason;
+      if (!stacker.Add(role, index, *processor, reason))
+      {
+        error = "stack cannot use " + path + ": " + reason + ".";
+      }
+    }
+    ProcessorPool::Instance().Release(processor);
+  }
+
+  StackSettings settings_;
+  std::vector<std::string> paths_;
+  std::string dark_;
+  std::string flat_;
+  bool dng_;
+  int width_ = 0;
+  int height_ = 0;
+  std::vector<char> data_;
+};
+
+static bool ParseOptionalPath(Napi::Object options, const char *name, std::string &path)
+{
+  Napi::Value value = options.Get(name);
+  if (value.IsUndefined())
+  {
+    return true;
+  }
+  if (!value.IsString())
+  {
+    return false;
+  }
+  path = value.As<Napi::String>().Utf8Value();
+  return true;
+}
+
+/*
+ * stack(paths, options) where options may hold `method` ('mean',
+ * 'sigmaClip' or 'median'), `sigma`, `iterations`, `dark` and `flat`
+ * paths, `output` ('raw' or 'dng'), `tileRows`, `tempDir` and `priority`.
+ *
+ * Static: the frames are decoded with pooled processors, so no instance is
+ * needed.
+ */
+Napi::Value LibRawWrapper::Stack(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsArray() || info[0].As<Napi::Array>().Length() == 0)
+  {
+    Napi::TypeError::New(env, "stack received an invalid argument, paths must be a non-empty array of strings.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array list = info[0].As<Napi::Array>();
+  std::vector<std::string> paths;
+  for (uint32_t i = 0; i < list.Length(); i++)
+  {
+    Napi::Value path = list.Get(i);
+    if (!path.IsString())
+    {
+      Napi::TypeError::New(env, "stack received an invalid argument, paths must be a non-empty array of strings.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    paths.push_back(path.As<Napi::String>().Utf8Value());
+  }
+  // the running sums of a mean are 32 bit
+  if (paths.size() > 65536)
+  {
+    Napi::RangeError::New(env, "stack received an invalid argument, at most 65536 frames can be stacked.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object options = info[1].IsObject() ? info[1].As<Napi::Object>() : Napi::Object::New(env);
+
+  StackSettings settings;
+  Napi::Value method = options.Get("method");
+  std::string methodName = method.IsUndefined() ? "mean" : method.ToString().Utf8Value();
+  if (methodName == "mean")
+  {
+    settings.method = StackMethod::Mean;
+  }
+  else if (methodName == "sigmaClip")
+  {
+    settings.method = StackMethod::SigmaClip;
+  }
+  else if (methodName == "median")
+  {
+    settings.method = StackMethod::Median;
+  }
+  else
+  {
+    Napi::TypeError::New(env, "stack received an invalid argument, method must be 'mean', 'sigmaClip' or 'median'.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Napi::Value sigma = options.Get("sigma");
+  Napi::Value iterations = options.Get("iterations");
+  Napi::Value tileRows = options.Get("tileRows");
+  settings.sigma = sigma.IsUndefined() ? 2.5f : sigma.ToNumber().FloatValue();
+  settings.iterations = iterations.IsUndefined() ? 3 : iterations.ToNumber().Int32Value();
+  settings.tileRows = tileRows.IsUndefined() ? 64 : tileRows.ToNumber().Int32Value();
+  if (!(settings.sigma > 0) || settings.iterations < 1 || settings.tileRows < 1)
+  {
+    Napi::TypeError::New(env, "stack received an invalid argument, sigma, iterations and tileRows must be positive numbers.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  std::string dark;
+  std::string flat;
+  if (!ParseOptionalPath(options, "dark", dark) || !ParseOptionalPath(options, "flat", flat) ||
+      !ParseOptionalPath(options, "tempDir", settings.tempDir))
+  {
+    Napi::TypeError::New(env, "stack received an invalid argument, dark, flat and tempDir must be paths.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  if (settings.tempDir.empty())
+  {
+    settings.tempDir = "/tmp";
+  }
+
+  Napi::Value output = options.Get("output");
+  std::string outputName = output.IsUndefined() ? "raw" : output.ToString().Utf8Value();
+  if (outputName != "raw" && outputName != "dng")
+  {
+    Napi::TypeError::New(env, "stack received an invalid argument, output must be 'raw' or 'dng'.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Priority priority = Priority::Normal;
+  Napi::Value priorityName = options.Get("priority");
+  if (!priorityName.IsUndefined() && !ParsePriority(priorityName, priority))
+  {
+    Napi::TypeError::New(env, "stack received an invalid argument, priority must be interactive, normal or background.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  return (new StackJob(env, std::move(settings), std::move(paths), std::move(dark), std::move(flat), outputName == "dng"))
+      ->Queue(priority);
+}
@@ -0,0 +1,667 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "stacker.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <unistd.h>
+#include "encoder.h"
+#include "parallel.h"
+
+namespace
+{
+  // pixels combined at once; a column of every frame stays in L1 cache
+  const std::size_t Chunk = 256;
+  // up to this many frames the median sorts with a min/max network,
+  // which costs frames squared but vectorizes, above it selects per pixel
+  const std::size_t MaxNetworkFrames = 32;
+
+  void CopyRows(const LibRaw &processor, int firstRow, int rows, uint16_t *out)
+  {
+    const libraw_image_sizes_t &sizes = processor.imgdata.sizes;
+    const uint16_t *raw = processor.imgdata.rawdata.raw_image;
+    for (int row = firstRow; row < firstRow + rows; row++)
+    {
+      const uint16_t *src = raw + static_cast<std::size_t>(row + sizes.top_margin) * (sizes.raw_pitch / 2) + sizes.left_margin;
+      std::copy(src, src + sizes.width, out + static_cast<std::size_t>(row - firstRow) * sizes.width);
+    }
+  }
+
+  bool WriteAll(int fd, const void *data, std::size_t size, off_t offset)
+  {
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+      ssize_t written = pwrite(fd, bytes, size, offset);
+      if (written < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (written <= 0)
+      {
+        return false;
+      }
+      bytes += written;
+      size -= written;
+      offset += written;
+    }
+    return true;
+  }
+
+  bool ReadAll(int fd, void *data, std::size_t size, off_t offset)
+  {
+    char *bytes = static_cast<char *>(data);
+    while (size > 0)
+    {
+      ssize_t read = pread(fd, bytes, size, offset);
+      if (read < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (read <= 0)
+      {
+        if (read == 0)
+        {
+          errno = EIO;
+        }
+        return false;
+      }
+      bytes += read;
+      size -= read;
+      offset += read;
+    }
+    return true;
+  }
+
+  void MedianNetwork(const uint16_t *slabs, std::size_t stride, std::size_t frames, std::size_t samples, float *values)
+  {
+    std::vector<uint16_t> column(frames * Chunk);
+    for (std::size_t begin = 0; begin < samples; begin += Chunk)
+    {
+      std::size_t n = std::min(Chunk, samples - begin);
+      for (std::size_t f = 0; f < frames; f++)
+      {
+        std::copy(slabs + f * stride + begin, slabs + f * stride + begin + n, column.data() + f * Chunk);
+      }
+      // odd-even transposition sort of every pixel's column at once
+      for (std::size_t round = 0; round < frames; round++)
+      {
+        for (std::size_t f = round & 1; f + 1 < frames; f += 2)
+        {
+          uint16_t *a = column.data() + f * Chunk;
+          uint16_t *b = a + Chunk;
+          for (std::size_t i = 0; i < n; i++)
+          {
+            uint16_t lo = std::min(a[i], b[i]);
+            uint16_t hi = std::max(a[i], b[i]);
+            a[i] = lo;
+            b[i] = hi;
+          }
+        }
+      }
+      const uint16_t *upper = column.data() + frames / 2 * Chunk;
+      const uint16_t *lower = frames % 2 ? upper : upper - Chunk;
+      for (std::size_t i = 0; i < n; i++)
+      {
+        values[begin + i] = (static_cast<float>(lower[i]) + upper[i]) * 0.5f;
+      }
+    }
+  }
+
+  void MedianSelect(const uint16_t *slabs, std::size_t stride, std::size_t frames, std::size_t samples, float *values)
+  {
+    std::vector<uint16_t> column(frames);
+    for (std::size_t i = 0; i < samples; i++)
+    {
+      for (std::size_t f = 0; f < frames; f++)
+      {
+        column[f] = slabs[f * stride + i];
+      }
+      auto middle = column.begin() + frames / 2;
+      std::nth_element(column.begin(), middle, column.end());
+      float median = *middle;
+      if (frames % 2 == 0)
+      {
+        median = (median + *std::max_element(column.begin(), middle)) * 0.5f;
+      }
+      values[i] = median;
+    }
+  }
+
+  /*
+   * Deviations are taken from the first frame's value, which keeps the
+   * single precision sums of squares small.
+   */
+  void SigmaClip(const uint16_t *slabs, std::size_t stride, std::size_t frames, std::size_t samples, float sigma, int iterations, float *values)
+  {
+    float ref[Chunk], lo[Chunk], hi[Chunk], mean[Chunk], sum[Chunk], squares[Chunk], count[Chunk];
+    for (std::size_t begin = 0; begin < samples; begin += Chunk)
+    {
+      std::size_t n = std::min(Chunk, samples - begin);
+      for (std::size_t i = 0; i < n; i++)
+      {
+        ref[i] = slabs[begin + i];
+        lo[i] = -std::numeric_limits<float>::infinity();
+        hi[i] = std::numeric_limits<float>::infinity();
+        mean[i] = 0;
+      }
+      for (int pass = 0; pass <= iterations; pass++)
+      {
+        std::fill(sum, sum + n, 0.0f);
+        std::fill(squares, squares + n, 0.0f);
+        std::fill(count, count + n, 0.0f);
+        for (std::size_t f = 0; f < frames; f++)
+        {
+          const uint16_t *x = slabs + f * stride + begin;
+          for (std::size_t i = 0; i < n; i++)
+          {
+            float d = x[i] - ref[i];
+            float keep = d >= lo[i] && d <= hi[i] ? 1.0f : 0.0f;
+            sum[i] += keep * d;
+            squares[i] += keep * d * d;
+            count[i] += keep;
+          }
+        }
+        for (std::size_t i = 0; i < n; i++)
+        {
+          // a pixel whose samples were all rejected keeps its last mean
+          if (count[i] > 0)
+          {
+            mean[i] = sum[i] / count[i];
+            float deviation = std::sqrt(std::max(squares[i] / count[i] - mean[i] * mean[i], 0.0f));
+            lo[i] = mean[i] - sigma * deviation;
+            hi[i] = mean[i] + sigma * deviation;
+          }
+        }
+      }
+      for (std::size_t i = 0; i < n; i++)
+      {
+        values[begin + i] = ref[i] + mean[i];
+      }
+    }
+  }
+
+  int32_t Fixed(float value, int32_t scale)
+  {
+    return static_cast<int32_t>(std::lround(static_cast<double>(value) * scale));
+  }
+}
+
+bool RawFormat::Read(const LibRaw &processor, std::string &error)
+{
+  const libraw_data_t &imgdata = processor.imgdata;
+  const libraw_colordata_t &color = imgdata.rawdata.color;
+  if (!imgdata.rawdata.raw_image || !(imgdata.idata.filters >= 1000 || imgdata.idata.filters == 9))
+  {
+    error = "it is not a Bayer or X-Trans raw image";
+    return false;
+  }
+  this->width = imgdata.sizes.width;
+  this->height = imgdata.sizes.height;
+  this->colors = imgdata.idata.colors;
+  this->filters = imgdata.idata.filters;
+  std::memcpy(this->xtrans, imgdata.idata.xtrans, sizeof(this->xtrans));
+  this->black = color.black;
+  this->cblack.assign(std::begin(color.cblack), std::end(color.cblack));
+  this->maximum = color.maximum;
+  std::memcpy(this->camMul, color.cam_mul, sizeof(this->camMul));
+  std::memcpy(this->camXyz, color.cam_xyz, sizeof(this->camXyz));
+  std::memcpy(this->rgbCam, color.rgb_cam, sizeof(this->rgbCam));
+  this->flip = imgdata.sizes.flip;
+  this->make = imgdata.idata.make;
+  this->model = imgdata.idata.model;
+  return true;
+}
+
+bool RawFormat::Matches(const RawFormat &other) const
+{
+  return this->width == other.width && this->height == other.height && this->colors == other.colors &&
+         this->filters == other.filters &&
+         (this->filters != 9 || std::memcmp(this->xtrans, other.xtrans, sizeof(this->xtrans)) == 0);
+}
+
+int RawFormat::Color(int row, int col) const
+{
+  if (this->filters == 9)
+  {
+    return this->xtrans[(row + 6) % 6][(col + 6) % 6];
+  }
+  return this->filters >> ((((row << 1) & 14) | (col & 1)) << 1) & 3;
+}
+
+float RawFormat::Black(int row, int col) const
+{
+  float value = static_cast<float>(this->black + this->cblack[this->Color(row, col)]);
+  unsigned rows = this->cblack[4];
+  unsigned cols = this->cblack[5];
+  if (rows && cols)
+  {
+    value += this->cblack[6 + (row % rows) * cols + col % cols];
+  }
+  return value;
+}
+
+FrameStacker::FrameStacker(const StackSettings &settings, std::size_t frames)
+    : settings_(settings), frames_(frames)
+{
+}
+
+FrameStacker::~FrameStacker()
+{
+  if (this->fd_ >= 0)
+  {
+    close(this->fd_);
+  }
+}
+
+bool FrameStacker::Adopt(const LibRaw &processor, std::string &error)
+{
+  if (!this->format_.Read(processor, error))
+  {
+    return false;
+  }
+  int tileRows = std::max(1, std::min(this->settings_.tileRows, this->format_.height));
+  this->tiles_ = (this->format_.height + tileRows - 1) / tileRows;
+  this->tileSamples_ = static_cast<std::size_t>(tileRows) * this->format_.width;
+  this->settings_.tileRows = tileRows;
+  if (this->settings_.method == StackMethod::Mean)
+  {
+    this->sums_.assign(static_cast<std::size_t>(this->format_.width) * this->format_.height, 0);
+    return true;
+  }
+
+  std::string path = this->settings_.tempDir + "/librawjs-stack-XXXXXX";
+  this->fd_ = mkstemp(&path[0]);
+  if (this->fd_ < 0)
+  {
+    error = std::string("could not create a temporary file: ") + std::strerror(errno);
+    return false;
+  }
+  // the file is only reachable through the descriptor and goes away with it
+  unlink(path.c_str());
+  return true;
+}
+
+bool FrameStacker::Add(Role role, std::size_t index, const LibRaw &processor, std::string &error)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    if (!this->adopted_)
+    {
+      if (!this->Adopt(processor, error))
+      {
+        return false;
+      }
+      this->adopted_ = true;
+    }
+  }
+
+  RawFormat format;
+  if (!format.Read(processor, error))
+  {
+    return false;
+  }
+  if (!format.Matches(this->format_))
+  {
+    error = "its size or CFA pattern differs from the other frames";
+    return false;
+  }
+
+  if (role == Role::Light)
+  {
+    if (this->settings_.method == StackMethod::Mean)
+    {
+      this->Accumulate(processor);
+      return true;
+    }
+    return this->Spill(index, processor, error);
+  }
+  std::vector<uint16_t> &plane = role == Role::Dark ? this->dark_ : this->flat_;
+  plane.resize(static_cast<std::size_t>(this->format_.width) * this->format_.height);
+  CopyRows(processor, 0, this->format_.height, plane.data());
+  return true;
+}
+
+void FrameStacker::Accumulate(const LibRaw &processor)
+{
+  const libraw_image_sizes_t &sizes = processor.imgdata.sizes;
+  const uint16_t *raw = processor.imgdata.rawdata.raw_image;
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  for (int row = 0; row < this->format_.height; row++)
+  {
+    const uint16_t *src = raw + static_cast<std::size_t>(row + sizes.top_margin) * (sizes.raw_pitch / 2) + sizes.left_margin;
+    uint32_t *sums = this->sums_.data() + static_cast<std::size_t>(row) * this->format_.width;
+    for (int col = 0; col < this->format_.width; col++)
+    {
+      sums[col] += src[col];
+    }
+  }
+}
+
+bool FrameStacker::Spill(std::size_t index, const LibRaw &processor, std::string &error)
+{
+  std::vector<uint16_t> tile(this->tileSamples_);
+  for (int t = 0; t < this->tiles_; t++)
+  {
+    int firstRow = t * this->settings_.tileRows;
+    int rows = std::min(this->settings_.tileRows, this->format_.height - firstRow);
+    CopyRows(processor, firstRow, rows, tile.data());
+    // the tile of every frame is contiguous, in frame order
+    off_t offset = static_cast<off_t>((t * this->frames_ + index) * this->tileSamples_ * sizeof(uint16_t));
+    if (!WriteAll(this->fd_, tile.data(), static_cast<std::size_t>(rows) * this->format_.width * sizeof(uint16_t), offset))
+    {
+      error = std::string("could not write the temporary file: ") + std::strerror(errno);
+      return false;
+    }
+  }
+  return true;
+}
+
+bool FrameStacker::Combine(uint16_t *out, std::string &error)
+{
+  if (!this->adopted_)
+  {
+    error = "no frames were added";
+    return false;
+  }
+  if (!this->flat_.empty())
+  {
+    double sums[4] = {};
+    double counts[4] = {};
+    for (int row = 0; row < this->format_.height; row++)
+    {
+      for (int col = 0; col < this->format_.width; col++)
+      {
+        int c = this->format_.Color(row, col);
+        sums[c] += this->flat_[static_cast<std::size_t>(row) * this->format_.width + col] - this->format_.Black(row, col);
+        counts[c]++;
+      }
+    }
+    for (int c = 0; c < 4; c++)
+    {
+      this->flatMean_[c] = counts[c] > 0 ? static_cast<float>(sums[c] / counts[c]) : 0.0f;
+    }
+  }
+
+  std::mutex errorMutex;
+  ParallelFor(this->tiles_, 1, [&](std::size_t first, std::size_t last)
+              {
+    std::vector<uint16_t> slabs(this->settings_.method == StackMethod::Mean ? 0 : this->frames_ * this->tileSamples_);
+    std::vector<float> values(this->tileSamples_);
+    for (std::size_t t = first; t < last; t++)
+    {
+      int firstRow = static_cast<int>(t) * this->settings_.tileRows;
+      int rows = std::min(this->settings_.tileRows, this->format_.height - firstRow);
+      std::size_t samples = static_cast<std::size_t>(rows) * this->format_.width;
+      if (this->settings_.method == StackMethod::Mean)
+      {
+        const uint32_t *sums = this->sums_.data() + static_cast<std::size_t>(firstRow) * this->format_.width;
+        float scale = 1.0f / this->frames_;
+        for (std::size_t i = 0; i < samples; i++)
+        {
+          values[i] = sums[i] * scale;
+        }
+      }
+      else
+      {
+        // the last tile of each frame is short, its tail is never read
+        std::size_t bytes = ((this->frames_ - 1) * this->tileSamples_ + samples) * sizeof(uint16_t);
+        off_t offset = static_cast<off_t>(t * this->frames_ * this->tileSamples_ * sizeof(uint16_t));
+        if (!ReadAll(this->fd_, slabs.data(), bytes, offset))
+        {
+          std::lock_guard<std::mutex> lock(errorMutex);
+          error = std::string("could not read the temporary file: ") + std::strerror(errno);
+          return;
+        }
+        this->CombineTile(slabs.data(), samples, values.data());
+      }
+      this->Calibrate(firstRow, rows, values.data(), out + static_cast<std::size_t>(firstRow) * this->format_.width);
+    } });
+  return error.empty();
+}
+
+void FrameStacker::CombineTile(const uint16_t *slabs, std::size_t samples, float *values) const
+{
+  if (this->settings_.method == StackMethod::SigmaClip)
+  {
+    SigmaClip(slabs, this->tileSamples_, this->frames_, samples, this->settings_.sigma, this->settings_.iterations, values);
+  }
+  else if (this->frames_ <= MaxNetworkFrames)
+  {
+    MedianNetwork(slabs, this->tileSamples_, this->frames_, samples, values);
+  }
+  else
+  {
+    MedianSelect(slabs, this->tileSamples_, this->frames_, samples, values);
+  }
+}
+
+void FrameStacker::Calibrate(int firstRow, int rows, const float *values, uint16_t *out) const
+{
+  // only a flat can push values past the white level
+  float maximum = this->flat_.empty() || !this->format_.maximum ? 65535.0f : static_cast<float>(this->format_.maximum);
+  for (int r = 0; r < rows; r++)
+  {
+    int row = firstRow + r;
+    std::size_t at = static_cast<std::size_t>(r) * this->format_.width;
+    std::size_t plane = static_cast<std::size_t>(row) * this->format_.width;
+    for (int col = 0; col < this->format_.width; col++)
+    {
+      float v = values[at + col];
+      if (!this->dark_.empty() || !this->flat_.empty())
+      {
+        float black = this->format_.Black(row, col);
+        // the dark frame holds the black level too, which is kept
+        if (!this->dark_.empty())
+        {
+          v -= this->dark_[plane + col] - black;
+        }
+        float flat = this->flat_.empty() ? 0.0f : this->flat_[plane + col] - black;
+        if (flat > 0)
+        {
+          v = (v - black) * this->flatMean_[this->format_.Color(row, col)] / flat + black;
+        }
+      }
+      out[at + col] = static_cast<uint16_t>(std::min(std::max(v, 0.0f), maximum) + 0.5f);
+    }
+  }
+}
+
+bool LayoutDng(const RawFormat &format, std::vector<char> &file, std::size_t &dataAt, std::string &error)
+{
+  if (format.colors != 3)
+  {
+    error = "DNG output supports three color sensors only";
+    return false;
+  }
+
+  // the smallest repeat of the CFA, Bayer patterns may span up to 8 rows
+  uint16_t cfaRows = 6;
+  uint16_t cfaCols = 6;
+  if (format.filters != 9)
+  {
+    cfaCols = 2;
+    for (cfaRows = 2; cfaRows < 8; cfaRows *= 2)
+    {
+      bool repeats = true;
+      for (int row = cfaRows; row < 8; row++)
+      {
+        for (int col = 0; col < 2; col++)
+        {
+          repeats = repeats && format.Color(row, col) == format.Color(row % cfaRows, col);
+        }
+      }
+      if (repeats)
+      {
+        break;
+      }
+    }
+  }
+  std::vector<uint8_t> pattern;
+  for (int row = 0; row < cfaRows; row++)
+  {
+    for (int col = 0; col < cfaCols; col++)
+    {
+      // the second green of a Bayer pattern is plain green in DNG
+      int color = format.Color(row, col);
+      pattern.push_back(static_cast<uint8_t>(color == 3 ? 1 : color));
+    }
+  }
+
+  // black levels repeat with both the CFA and the black pattern
+  unsigned blackRows = cfaRows;
+  unsigned blackCols = cfaCols;
+  if (format.cblack[4] && format.cblack[5] &&
+      std::lcm(blackRows, format.cblack[4]) * std::lcm(blackCols, format.cblack[5]) <= 256)
+  {
+    blackRows = std::lcm(blackRows, format.cblack[4]);
+    blackCols = std::lcm(blackCols, format.cblack[5]);
+  }
+  std::vector<uint32_t> blacks;
+  for (unsigned row = 0; row < blackRows; row++)
+  {
+    for (unsigned col = 0; col < blackCols; col++)
+    {
+      blacks.push_back(static_cast<uint32_t>(format.Black(row, col)));
+    }
+  }
+
+  // XYZ to camera; files without one get the inverse of the camera to
+  // sRGB matrix combined with XYZ to sRGB
+  float matrix[3][3];
+  bool hasMatrix = false;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      matrix[i][j] = format.camXyz[i][j];
+      hasMatrix = hasMatrix || matrix[i][j] != 0;
+    }
+  }
+  if (!hasMatrix)
+  {
+    const double xyzToSrgb[3][3] = {
+        {3.2404542, -1.5371385, -0.4985314},
+        {-0.9692660, 1.8760108, 0.0415560},
+        {0.0556434, -0.2040259, 1.0572252},
+    };
+    const float(*m)[4] = format.rgbCam;
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                 m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                 m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (std::fabs(det) < 1e-9)
+    {
+      error = "the image has no color matrix";
+      return false;
+    }
+    double inverse[3][3];
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        int r0 = (j + 1) % 3, r1 = (j + 2) % 3, c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+        inverse[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+      }
+    }
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        double v = 0;
+        for (int k = 0; k < 3; k++)
+        {
+          v += inverse[i][k] * xyzToSrgb[k][j];
+        }
+        matrix[i][j] = static_cast<float>(v);
+      }
+    }
+  }
+  std::vector<int32_t> colorMatrix;
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      colorMatrix.push_back(Fixed(matrix[i][j], 10000));
+      colorMatrix.push_back(10000);
+    }
+  }
+
+  std::vector<uint32_t> neutral;
+  for (int c = 0; c < 3; c++)
+  {
+    bool valid = format.camMul[0] > 0 && format.camMul[1] > 0 && format.camMul[2] > 0;
+    neutral.push_back(static_cast<uint32_t>(Fixed(valid ? format.camMul[1] / format.camMul[c] : 1.0f, 1000000)));
+    neutral.push_back(1000000);
+  }
+
+  // LibRaw's flip codes to TIFF orientations
+  uint16_t orientation = format.flip == 3 ? 3 : format.flip == 5 ? 8
+                                            : format.flip == 6   ? 6
+                                                                 : 1;
+
+  const uint8_t dngVersion[4] = {1, 4, 0, 0};
+  const uint8_t backwardVersion[4] = {1, 1, 0, 0};
+  const uint8_t planeColors[3] = {0, 1, 2};
+  TiffWriter writer;
+  writer.Long(254, {0});
+  writer.Long(256, {static_cast<uint32_t>(format.width)});
+  writer.Long(257, {static_cast<uint32_t>(format.height)});
+  writer.Short(258, {16});
+  writer.Short(259, {1});
+  // color filter array
+  writer.Short(262, {32803});
+  writer.Ascii(271, format.make);
+  writer.Ascii(272, format.model);
+  writer.Short(274, {orientation});
+  writer.Short(277, {1});
+  writer.Long(278, {static_cast<uint32_t>(format.height)});
+  writer.Short(284, {1});
+  writer.Ascii(305, "libraw.js");
+  writer.Short(33421, {cfaRows, cfaCols});
+  writer.Add(33422, TiffByte, static_cast<uint32_t>(pattern.size()), pattern.data(), pattern.size());
+  writer.Add(50706, TiffByte, 4, dngVersion, sizeof(dngVersion));
+  writer.Add(50707, TiffByte, 4, backwardVersion, sizeof(backwardVersion));
+  writer.Ascii(50708, format.make + " " + format.model);
+  writer.Add(50710, TiffByte, 3, planeColors, sizeof(planeColors));
+  writer.Short(50711, {1});
+  writer.Short(50713, {static_cast<uint16_t>(blackRows), static_cast<uint16_t>(blackCols)});
+  writer.Long(50714, blacks);
+  writer.Long(50717, {format.maximum});
+  writer.SRational(50721, colorMatrix);
+  writer.Rational(50728, neutral);
+  // D65, the illuminant of LibRaw's matrices
+  writer.Short(50778, {21});
+
+  std::size_t imageBytes = static_cast<std::size_t>(format.width) * format.height * sizeof(uint16_t);
+  if (!writer.Fits(imageBytes))
+  {
+    error = "the image is too large for DNG";
+    return false;
+  }
+  dataAt = writer.Layout(file, imageBytes);
+  return true;
+}
@@ -0,0 +1,153 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_STACKER_H
+#define LIBRAWJS_STACKER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "libraw/libraw.h"
+
+enum class StackMethod
+{
+  Mean,
+  SigmaClip,
+  Median,
+};
+
+struct StackSettings
+{
+  StackMethod method;
+  // samples further than `sigma` deviations from the mean are rejected
+  float sigma;
+  int iterations;
+  // rows combined at once by median and sigma clipping
+  int tileRows;
+  // where their per tile copies of the frames are kept
+  std::string tempDir;
+};
+
+/*
+ * Geometry, CFA and levels of a raw frame's visible area, kept so frames
+ * can be compared and the result described after the processors that
+ * decoded them have been released.
+ */
+struct RawFormat
+{
+  int width = 0;
+  int height = 0;
+  int colors = 0;
+  unsigned filters = 0;
+  char xtrans[6][6] = {};
+  unsigned black = 0;
+  std::vector<unsigned> cblack;
+  unsigned maximum = 0;
+  float camMul[4] = {};
+  float camXyz[4][3] = {};
+  float rgbCam[3][4] = {};
+  int flip = 0;
+  std::string make;
+  std::string model;
+
+  bool Read(const LibRaw &processor, std::string &error);
+  bool Matches(const RawFormat &other) const;
+  // CFA color of a visible pixel, 0 to 3
+  int Color(int row, int col) const;
+  float Black(int row, int col) const;
+};
+
+/*
+ * Combines the visible CFA planes of several exposures of the same scene,
+ * pixel by pixel, and calibrates the result with master dark and flat
+ * frames.
+ *
+ * Frames are added from any thread as they are decoded. A mean only needs
+ * a running sum. Median and sigma clipping need every frame's value of a
+ * pixel at once, so frames are copied tile by tile into an unlinked
+ * temporary file, laid out so that one tile of every frame is a single
+ * contiguous read; combining then holds one tile of each frame per thread
+ * instead of every frame in memory.
+ *
+ * The kernels process rows of pixels with the frames in the outer loop so
+ * the compiler vectorizes them: sigma clipping keeps per pixel bounds and
+ * sums, and the median sorts short columns with a branch free odd-even
+ * transposition network of min/max operations.
+ *
+ * The dark frame is subtracted keeping the black level, and the flat is
+ * normalized per CFA color so it only corrects relative illumination.
+ * Both can be applied after combining because every method commutes with
+ * a per pixel offset and scale.
+ */
+class FrameStacker
+{
+public:
+  enum class Role
+  {
+    Light,
+    Dark,
+    Flat,
+  };
+
+  FrameStacker(const StackSettings &settings, std::size_t frames);
+  ~FrameStacker();
+  FrameStacker(const FrameStacker &) = delete;
+  FrameStacker &operator=(const FrameStacker &) = delete;
+
+  // adds light frame `index` or a master frame; safe to call concurrently
+  bool Add(Role role, std::size_t index, const LibRaw &processor, std::string &error);
+  // writes `Format().width * Format().height` calibrated samples
+  bool Combine(uint16_t *out, std::string &error);
+
+  const RawFormat &Format() const { return this->format_; }
+
+private:
+  bool Adopt(const LibRaw &processor, std::string &error);
+  bool Spill(std::size_t index, const LibRaw &processor, std::string &error);
+  void Accumulate(const LibRaw &processor);
+  void CombineTile(const uint16_t *slabs, std::size_t samples, float *values) const;
+  void Calibrate(int firstRow, int rows, const float *values, uint16_t *out) const;
+
+  StackSettings settings_;
+  std::size_t frames_;
+  std::mutex mutex_;
+  bool adopted_ = false;
+  RawFormat format_;
+  std::size_t tileSamples_ = 0;
+  int tiles_ = 0;
+  int fd_ = -1;
+  std::vector<uint32_t> sums_;
+  std::vector<uint16_t> dark_;
+  std::vector<uint16_t> flat_;
+  float flatMean_[4] = {};
+};
+
+/*
+ * Sizes `file` as an uncompressed DNG of a visible CFA plane described by
+ * `format` and sets `dataAt` to where its 16 bit samples go, so the plane
+ * can be combined straight into the file.
+ */
+bool LayoutDng(const RawFormat &format, std::vector<char> &file, std::size_t &dataAt, std::string &error);
+
+#endif
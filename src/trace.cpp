@@ -0,0 +1,320 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+#ifdef LIBRAWJS_USDT
+#include <sys/sdt.h>
+#endif
+
+std::atomic<bool> Tracer::enabled_{false};
+
+namespace
+{
+  thread_local const char *threadName = "thread";
+  thread_local TraceSpan *currentSpan = nullptr;
+
+  void AppendJsonString(std::string &out, const std::string &value)
+  {
+    out += '"';
+    for (unsigned char c : value)
+    {
+      if (c == '"' || c == '\\')
+      {
+        out += '\\';
+        out += c;
+      }
+      else if (c < 0x20)
+      {
+        char escaped[8];
+        std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+        out += escaped;
+      }
+      else
+      {
+        out += c;
+      }
+    }
+    out += '"';
+  }
+
+  void AppendMicros(std::string &out, uint64_t ns)
+  {
+    char number[32];
+    std::snprintf(number, sizeof(number), "%.3f", ns / 1000.0);
+    out += number;
+  }
+}
+
+// unregisters the thread's buffer when the thread exits
+struct ThreadBufferHolder
+{
+  Tracer::Buffer *buffer = nullptr;
+
+  ~ThreadBufferHolder()
+  {
+    if (this->buffer)
+    {
+      Tracer::Instance().Unregister(this->buffer);
+    }
+  }
+};
+
+namespace
+{
+  thread_local ThreadBufferHolder threadBuffer;
+}
+
+Tracer &Tracer::Instance()
+{
+  static Tracer *tracer = new Tracer();
+  return *tracer;
+}
+
+uint64_t Tracer::Now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::NameThread(const char *name)
+{
+  threadName = name;
+  if (threadBuffer.buffer)
+  {
+    std::lock_guard<std::mutex> lock(threadBuffer.buffer->mutex);
+    threadBuffer.buffer->name = name;
+  }
+}
+
+void Tracer::Start(std::size_t eventsPerThread)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->capacity_.store(std::max<std::size_t>(eventsPerThread, 1));
+  this->startNs_ = Now();
+  // buffers drop their events lazily when they see the new generation
+  this->generation_.fetch_add(1, std::memory_order_release);
+  enabled_.store(true);
+}
+
+std::string Tracer::Stop()
+{
+  enabled_.store(false);
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  uint64_t generation = this->generation_.load(std::memory_order_acquire);
+  std::string pid = std::to_string(getpid());
+  std::string out = "{\"traceEvents\":[";
+  bool first = true;
+  auto begin = [&](const char *name, const char *category, const char *phase, uint32_t tid)
+  {
+    out += first ? "\n" : ",\n";
+    first = false;
+    out += "{\"name\":";
+    AppendJsonString(out, name);
+    out += ",\"cat\":\"";
+    out += category;
+    out += "\",\"ph\":\"";
+    out += phase;
+    out += "\",\"pid\":" + pid + ",\"tid\":" + std::to_string(tid);
+  };
+
+  for (Buffer *buffer : this->buffers_)
+  {
+    std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+    begin("thread_name", "__metadata", "M", buffer->tid);
+    out += ",\"args\":{\"name\":";
+    AppendJsonString(out, buffer->name);
+    out += "}}";
+    if (buffer->generation != generation)
+    {
+      continue;
+    }
+    for (const TraceEvent &event : buffer->events)
+    {
+      if (event.startNs < this->startNs_)
+      {
+        continue;
+      }
+      std::string args;
+      if (event.call)
+      {
+        args += ",\"call\":";
+        AppendJsonString(args, event.call);
+      }
+      if (!event.file.empty())
+      {
+        args += ",\"file\":";
+        AppendJsonString(args, event.file);
+      }
+      if (!event.model.empty())
+      {
+        args += ",\"model\":";
+        AppendJsonString(args, event.model);
+      }
+      if (!args.empty())
+      {
+        args[0] = '{';
+        args += '}';
+      }
+
+      if (event.kind == TraceEvent::Kind::Span)
+      {
+        begin(event.name, "libraw", "X", buffer->tid);
+        out += ",\"ts\":";
+        AppendMicros(out, event.startNs - this->startNs_);
+        out += ",\"dur\":";
+        AppendMicros(out, event.durationNs);
+        if (!args.empty())
+        {
+          out += ",\"args\":" + args;
+        }
+        out += '}';
+        continue;
+      }
+      // queue waits overlap on no particular thread, so they are async events
+      std::string id = ",\"id\":\"" + std::to_string(event.id) + "\"";
+      begin(event.name, "queue", "b", buffer->tid);
+      out += id + ",\"ts\":";
+      AppendMicros(out, event.startNs - this->startNs_);
+      if (!args.empty())
+      {
+        out += ",\"args\":" + args;
+      }
+      out += '}';
+      begin(event.name, "queue", "e", buffer->tid);
+      out += id + ",\"ts\":";
+      AppendMicros(out, event.startNs + event.durationNs - this->startNs_);
+      out += '}';
+    }
+  }
+  out += "\n],\"displayTimeUnit\":\"ms\"}\n";
+  return out;
+}
+
+void Tracer::Record(TraceEvent &&event)
+{
+  Buffer *buffer = this->CurrentBuffer();
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  uint64_t generation = this->generation_.load(std::memory_order_acquire);
+  std::size_t capacity = this->capacity_.load();
+  if (buffer->generation != generation)
+  {
+    buffer->generation = generation;
+    buffer->events.clear();
+    buffer->events.reserve(capacity);
+    buffer->next = 0;
+  }
+  if (buffer->events.size() < capacity)
+  {
+    buffer->events.push_back(std::move(event));
+  }
+  else
+  {
+    // full, the oldest event is overwritten
+    buffer->events[buffer->next % buffer->events.size()] = std::move(event);
+  }
+  buffer->next++;
+}
+
+Tracer::Buffer *Tracer::CurrentBuffer()
+{
+  if (!threadBuffer.buffer)
+  {
+    Buffer *buffer = new Buffer();
+    buffer->name = threadName;
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    buffer->tid = this->nextTid_++;
+    this->buffers_.push_back(buffer);
+    threadBuffer.buffer = buffer;
+  }
+  return threadBuffer.buffer;
+}
+
+void Tracer::Unregister(Buffer *buffer)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->buffers_.erase(std::remove(this->buffers_.begin(), this->buffers_.end(), buffer), this->buffers_.end());
+  delete buffer;
+}
+
+TraceSpan::TraceSpan(const char *name, const char *call) : name_(name), call_(call)
+{
+#ifdef LIBRAWJS_USDT
+  this->active_ = true;
+  DTRACE_PROBE2(librawjs, span_start, name, call);
+#else
+  this->active_ = Tracer::Enabled();
+#endif
+  if (!this->active_)
+  {
+    return;
+  }
+  this->start_ = Tracer::Now();
+  this->parent_ = currentSpan;
+  currentSpan = this;
+}
+
+TraceSpan::~TraceSpan()
+{
+  if (!this->active_)
+  {
+    return;
+  }
+  currentSpan = this->parent_;
+  uint64_t duration = Tracer::Now() - this->start_;
+#ifdef LIBRAWJS_USDT
+  DTRACE_PROBE4(librawjs, span_end, this->name_, this->file_.c_str(), this->model_.c_str(), duration);
+#endif
+  if (Tracer::Enabled())
+  {
+    Tracer::Instance().Record(TraceEvent{TraceEvent::Kind::Span, this->name_, this->call_, this->start_, duration, 0,
+                                         std::move(this->file_), std::move(this->model_)});
+  }
+}
+
+TraceSpan *TraceSpan::Root()
+{
+  TraceSpan *span = currentSpan;
+  while (span && span->parent_)
+  {
+    span = span->parent_;
+  }
+  return span;
+}
+
+void TraceSpan::SetFile(const std::string &file)
+{
+  if (TraceSpan *root = Root())
+  {
+    root->file_ = file;
+  }
+}
+
+void TraceSpan::SetModel(const char *make, const char *model)
+{
+  if (TraceSpan *root = Root())
+  {
+    root->model_ = make && *make ? std::string(make) + " " + model : model;
+  }
+}
@@ -0,0 +1,142 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_TRACE_H
+#define LIBRAWJS_TRACE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Opt-in span tracing of the native phases (queue waits, open, parse,
+ * unpack, thumbnail, wrap), exported as Chrome Trace Event JSON.
+ *
+ * Every thread records into its own fixed-size ring, which overwrites the
+ * oldest events when full, so recording takes an uncontended lock and no
+ * allocation beyond the span's arguments. Nothing is recorded while
+ * tracing is off; a disabled span costs one relaxed atomic load.
+ *
+ * Building with LIBRAWJS_USDT defined (e.g. `CXXFLAGS=-DLIBRAWJS_USDT`)
+ * also fires the `librawjs:span_start` and `librawjs:span_end` USDT probes
+ * from <sys/sdt.h> for every span, whether tracing is on or not, for use
+ * with perf or bpftrace.
+ */
+
+struct TraceEvent
+{
+  enum class Kind
+  {
+    // a span on the recording thread
+    Span,
+    // a queue wait, from submission until a pool thread picked the job up
+    Queue,
+  };
+
+  Kind kind;
+  // static strings, never freed
+  const char *name;
+  const char *call;
+  uint64_t startNs;
+  uint64_t durationNs;
+  uint64_t id;
+  std::string file;
+  std::string model;
+};
+
+class Tracer
+{
+public:
+  static Tracer &Instance();
+
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+  // monotonic clock shared by all events
+  static uint64_t Now();
+  // names the calling thread in exported traces
+  static void NameThread(const char *name);
+
+  // clears previous events and starts recording up to `eventsPerThread`
+  void Start(std::size_t eventsPerThread);
+  // stops recording and returns the events as Chrome Trace Event JSON
+  std::string Stop();
+
+  void Record(TraceEvent &&event);
+
+private:
+  struct Buffer
+  {
+    std::mutex mutex;
+    uint32_t tid;
+    const char *name;
+    uint64_t generation = 0;
+    std::vector<TraceEvent> events;
+    std::size_t next = 0;
+  };
+  friend struct ThreadBufferHolder;
+
+  Tracer() = default;
+  Buffer *CurrentBuffer();
+  void Unregister(Buffer *buffer);
+
+  static std::atomic<bool> enabled_;
+
+  std::mutex mutex_;
+  std::vector<Buffer *> buffers_;
+  uint32_t nextTid_ = 1;
+  std::atomic<uint64_t> generation_{0};
+  std::atomic<std::size_t> capacity_{0};
+  uint64_t startNs_ = 0;
+};
+
+/*
+ * Records the time from construction to destruction as a span of the
+ * calling thread. Spans nest; the file name and camera model are attached
+ * to the outermost span, which stands for the whole call.
+ */
+class TraceSpan
+{
+public:
+  explicit TraceSpan(const char *name, const char *call = nullptr);
+  ~TraceSpan();
+  TraceSpan(const TraceSpan &) = delete;
+  TraceSpan &operator=(const TraceSpan &) = delete;
+
+  static void SetFile(const std::string &file);
+  static void SetModel(const char *make, const char *model);
+
+private:
+  static TraceSpan *Root();
+
+  const char *name_;
+  const char *call_;
+  bool active_;
+  uint64_t start_ = 0;
+  std::string file_;
+  std::string model_;
+  TraceSpan *parent_ = nullptr;
+};
+
+#endif
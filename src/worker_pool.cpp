@@ -0,0 +1,215 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "worker_pool.h"
+#include <algorithm>
+#include "trace.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+  thread_local Priority currentPriority = Priority::Normal;
+}
+
+WorkerPool &WorkerPool::Instance()
+{
+  static WorkerPool *pool = new WorkerPool(std::thread::hardware_concurrency());
+  return *pool;
+}
+
+WorkerPool::WorkerPool(std::size_t size)
+{
+  if (size == 0)
+  {
+    size = 1;
+  }
+  for (std::size_t i = 0; i < size; i++)
+  {
+    this->threads_.emplace_back(&WorkerPool::Run, this);
+  }
+}
+
+void WorkerPool::Submit(Task task, Priority priority)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->queues_[static_cast<std::size_t>(priority)].tasks.push_back({std::move(task), Clock::now(), false});
+  }
+  // a capped class may leave some waiters unable to take the task
+  this->cv_.notify_all();
+}
+
+std::size_t WorkerPool::SubmitHelpers(const Task &task, std::size_t wanted)
+{
+  std::size_t count;
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    std::size_t busy = 0;
+    for (const Queue &queue : this->queues_)
+    {
+      busy += queue.running + queue.tasks.size();
+    }
+    // helpers never queue behind other work, they only fill idle threads
+    count = busy < this->threads_.size() ? this->threads_.size() - busy : 0;
+    if (this->threadsPerCall_ > 0)
+    {
+      count = std::min(count, this->threadsPerCall_ - 1);
+    }
+    Queue &queue = this->queues_[static_cast<std::size_t>(currentPriority)];
+    if (queue.limit > 0)
+    {
+      count = std::min(count, queue.limit > queue.running ? queue.limit - queue.running : 0);
+    }
+    count = std::min(count, wanted);
+    for (std::size_t i = 0; i < count; i++)
+    {
+      queue.tasks.push_back({task, Clock::now(), true});
+    }
+  }
+  if (count > 0)
+  {
+    this->cv_.notify_all();
+  }
+  return count;
+}
+
+void WorkerPool::SetThreadsPerCall(std::size_t threads)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->threadsPerCall_ = threads;
+}
+
+Priority WorkerPool::CurrentPriority()
+{
+  return currentPriority;
+}
+
+void WorkerPool::SetLimit(Priority priority, std::size_t limit)
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->queues_[static_cast<std::size_t>(priority)].limit = limit;
+  }
+  this->cv_.notify_all();
+}
+
+bool WorkerPool::SetAffinity(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+  cpu_set_t all;
+  CPU_ZERO(&all);
+  if (cpus.empty() && sched_getaffinity(0, sizeof(all), &all) != 0)
+  {
+    return false;
+  }
+  for (int cpu : cpus)
+  {
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+    {
+      return false;
+    }
+  }
+  bool ok = true;
+  for (std::size_t i = 0; i < this->threads_.size(); i++)
+  {
+    cpu_set_t set = all;
+    if (!cpus.empty())
+    {
+      CPU_ZERO(&set);
+      CPU_SET(cpus[i % cpus.size()], &set);
+    }
+    ok = pthread_setaffinity_np(this->threads_[i].native_handle(), sizeof(set), &set) == 0 && ok;
+  }
+  return ok;
+#else
+  return cpus.empty();
+#endif
+}
+
+PriorityStats WorkerPool::Stats(Priority priority, bool reset)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  Queue &queue = this->queues_[static_cast<std::size_t>(priority)];
+  PriorityStats stats = {queue.tasks.size(), queue.running, queue.limit, queue.started,
+                         queue.helpers, queue.totalWaitMs, queue.maxWaitMs};
+  if (reset)
+  {
+    queue.started = 0;
+    queue.helpers = 0;
+    queue.totalWaitMs = 0;
+    queue.maxWaitMs = 0;
+  }
+  return stats;
+}
+
+WorkerPool::Queue *WorkerPool::Runnable()
+{
+  for (Queue &queue : this->queues_)
+  {
+    if (!queue.tasks.empty() && (queue.limit == 0 || queue.running < queue.limit))
+    {
+      return &queue;
+    }
+  }
+  return nullptr;
+}
+
+void WorkerPool::Run()
+{
+  Tracer::NameThread("pool");
+  for (;;)
+  {
+    Task task;
+    Queue *queue;
+    {
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      this->cv_.wait(lock, [this, &queue]
+                     { return (queue = this->Runnable()) != nullptr; });
+      Pending pending = std::move(queue->tasks.front());
+      queue->tasks.pop_front();
+      queue->running++;
+      if (pending.helper)
+      {
+        queue->helpers++;
+      }
+      else
+      {
+        queue->started++;
+        double waitMs = std::chrono::duration<double, std::milli>(Clock::now() - pending.queued).count();
+        queue->totalWaitMs += waitMs;
+        queue->maxWaitMs = std::max(queue->maxWaitMs, waitMs);
+      }
+      task = std::move(pending.task);
+      currentPriority = static_cast<Priority>(queue - this->queues_);
+    }
+    task();
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      queue->running--;
+    }
+    // the slot this task held may unblock a capped class
+    this->cv_.notify_one();
+  }
+}
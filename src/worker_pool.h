@@ -0,0 +1,143 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_WORKER_POOL_H
+#define LIBRAWJS_WORKER_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Scheduling classes, highest first. A pool thread always takes the oldest
+ * task of the highest class that is below its concurrency limit.
+ */
+enum class Priority
+{
+  Interactive,
+  Normal,
+  Background,
+};
+
+const std::size_t PriorityCount = 3;
+
+struct PriorityStats
+{
+  std::size_t queued;
+  std::size_t running;
+  // 0 when the class is not capped
+  std::size_t limit;
+  uint64_t started;
+  // tasks that joined a running call to share its parallel work
+  uint64_t helpers;
+  // time between submission and start
+  double totalWaitMs;
+  double maxWaitMs;
+};
+
+/*
+ * A process-wide pool of native threads that runs decode work.
+ *
+ * Every Node environment (the main thread and each `worker_thread`) that
+ * loads the addon submits into the same pool, so spinning up more JS workers
+ * does not multiply native threads. The pool is created on first use and
+ * intentionally never torn down; idle threads simply block until the
+ * process exits.
+ *
+ * Tasks are queued per `Priority`. Strict priority means a steady stream of
+ * interactive work can delay background work indefinitely, while capping a
+ * lower class (e.g. background at one less than `Size()`) keeps threads
+ * free for higher classes when they arrive.
+ *
+ * The pool is also the thread budget for parallelism within a call (see
+ * `ParallelFor`): a running task may recruit helpers, but only threads
+ * that would otherwise sit idle, so a batch of files keeps one file per
+ * thread while a lone interactive file gets the whole machine.
+ */
+class WorkerPool
+{
+public:
+  using Task = std::function<void()>;
+
+  static WorkerPool &Instance();
+
+  void Submit(Task task, Priority priority = Priority::Normal);
+  std::size_t Size() const { return this->threads_.size(); }
+
+  /*
+   * Queues up to `wanted` copies of `task` in the class of the calling
+   * task, limited to the threads that are idle, the class's cap and the
+   * per-call budget. Returns how many were queued.
+   */
+  std::size_t SubmitHelpers(const Task &task, std::size_t wanted);
+  // most threads a call may use including its own, 0 for no limit
+  void SetThreadsPerCall(std::size_t threads);
+  // the class of the task running on this thread, Normal off the pool
+  static Priority CurrentPriority();
+
+  // caps how many tasks of a class run at once, 0 removes the cap
+  void SetLimit(Priority priority, std::size_t limit);
+  // pins thread i to cpus[i % cpus.size()], or unpins all threads if empty;
+  // returns false where thread affinity is not supported
+  bool SetAffinity(const std::vector<int> &cpus);
+  PriorityStats Stats(Priority priority, bool reset = false);
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Pending
+  {
+    Task task;
+    Clock::time_point queued;
+    bool helper;
+  };
+
+  struct Queue
+  {
+    std::deque<Pending> tasks;
+    std::size_t running = 0;
+    std::size_t limit = 0;
+    uint64_t started = 0;
+    uint64_t helpers = 0;
+    double totalWaitMs = 0;
+    double maxWaitMs = 0;
+  };
+
+  explicit WorkerPool(std::size_t size);
+  void Run();
+  // the queue to take from next, or nullptr if none is runnable
+  Queue *Runnable();
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  Queue queues_[PriorityCount];
+  std::vector<std::thread> threads_;
+  std::size_t threadsPerCall_ = 0;
+};
+
+#endif
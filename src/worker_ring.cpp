@@ -0,0 +1,229 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include <napi.h>
+#include "libraw_wrapper.h"
+#include "shared_ring.h"
+#include <cstring>
+#include <memory>
+
+/*
+ * Bindings of the shared-memory ring used by the decode worker processes,
+ * see `SharedRing` and decode_workers.ts. Rings are passed around as
+ * externals; every Buffer viewing a record keeps its ring mapped.
+ */
+
+namespace
+{
+  using RingHandle = Napi::External<std::shared_ptr<SharedRing>>;
+
+  Napi::Value WrapRing(Napi::Env env, SharedRing *ring)
+  {
+    return RingHandle::New(env, new std::shared_ptr<SharedRing>(ring), [](Napi::Env, std::shared_ptr<SharedRing> *ring)
+                           { delete ring; });
+  }
+
+  std::shared_ptr<SharedRing> UnwrapRing(const Napi::Value &value)
+  {
+    if (!value.IsExternal())
+    {
+      return nullptr;
+    }
+    return *value.As<RingHandle>().Data();
+  }
+
+  // a viewed record, released once all of its Buffers are collected
+  struct RecordRef
+  {
+    std::shared_ptr<SharedRing> ring;
+    uint64_t record;
+    std::size_t buffers;
+  };
+
+  void ReleaseRecord(RecordRef *ref)
+  {
+    if (--ref->buffers == 0)
+    {
+      ref->ring->Release(ref->record);
+      delete ref;
+    }
+  }
+}
+
+/*
+ * ringCreate(capacity: number): { fd: number, ring: object }
+ *
+ * `fd` is passed on to the child process; it stays open, close-on-exec,
+ * for as long as the ring is alive.
+ */
+Napi::Value LibRawWrapper::RingCreate(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsNumber() || !(info[0].As<Napi::Number>().DoubleValue() > 0))
+  {
+    Napi::TypeError::New(env, "ringCreate received an invalid argument, capacity must be a positive number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  int err = 0;
+  SharedRing *ring = SharedRing::Create(static_cast<std::size_t>(info[0].As<Napi::Number>().DoubleValue()), err);
+  if (!ring)
+  {
+    Napi::Error::New(env, std::string("ringCreate could not create shared memory: ") + std::strerror(err)).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("fd", Napi::Number::New(env, ring->Fd()));
+  result.Set("ring", WrapRing(env, ring));
+  return result;
+}
+
+// ringAttach(fd: number): object, maps a ring handed down by the parent
+Napi::Value LibRawWrapper::RingAttach(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  if (!info[0].IsNumber())
+  {
+    Napi::TypeError::New(env, "ringAttach received an invalid argument, fd must be a number.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  int err = 0;
+  SharedRing *ring = SharedRing::Attach(info[0].As<Napi::Number>().Int32Value(), err);
+  if (!ring)
+  {
+    Napi::Error::New(env, std::string("ringAttach could not map shared memory: ") + std::strerror(err)).ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  return WrapRing(env, ring);
+}
+
+/*
+ * ringWrite(ring: object, buffers: ArrayBufferView[], waitMs: number):
+ *   { record: number, offsets: number[] } | null
+ *
+ * Copies the buffers into one record, blocking for up to `waitMs` while the
+ * ring is full. Returns null if they do not fit in time.
+ */
+Napi::Value LibRawWrapper::RingWrite(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  std::shared_ptr<SharedRing> ring = UnwrapRing(info[0]);
+  if (!ring || !info[1].IsArray() || !info[2].IsNumber())
+  {
+    Napi::TypeError::New(env, "ringWrite received an invalid argument, expected a ring, an array of buffers and a timeout.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  Napi::Array buffers = info[1].As<Napi::Array>();
+  std::vector<std::pair<const char *, std::size_t>> parts;
+  for (uint32_t i = 0; i < buffers.Length(); i++)
+  {
+    Napi::Value buffer = buffers.Get(i);
+    if (!buffer.IsTypedArray())
+    {
+      Napi::TypeError::New(env, "ringWrite received an invalid argument, buffers must be typed arrays.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    napi_typedarray_type type;
+    std::size_t count;
+    void *data = nullptr;
+    napi_status status = napi_get_typedarray_info(env, buffer, &type, &count, &data, nullptr, nullptr);
+    NAPI_THROW_IF_FAILED(env, status, env.Undefined());
+    parts.emplace_back(static_cast<const char *>(data), buffer.As<Napi::TypedArray>().ByteLength());
+  }
+
+  uint64_t record;
+  std::vector<std::size_t> offsets;
+  if (!ring->Write(parts, info[2].As<Napi::Number>().Uint32Value(), record, offsets))
+  {
+    return env.Null();
+  }
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("record", Napi::Number::New(env, static_cast<double>(record)));
+  Napi::Array list = Napi::Array::New(env, offsets.size());
+  for (uint32_t i = 0; i < offsets.size(); i++)
+  {
+    list.Set(i, Napi::Number::New(env, offsets[i]));
+  }
+  result.Set("offsets", list);
+  return result;
+}
+
+/*
+ * ringView(ring: object, record: number, spans: [offset, length][]): Buffer[]
+ *
+ * Returns Buffers over the spans of a record written by the child, without
+ * copying. Throws if the record or a span is not valid, which means the
+ * child misbehaved.
+ */
+Napi::Value LibRawWrapper::RingView(const Napi::CallbackInfo &info)
+{
+  Napi::Env env = info.Env();
+  std::shared_ptr<SharedRing> ring = UnwrapRing(info[0]);
+  if (!ring || !info[1].IsNumber() || !info[2].IsArray())
+  {
+    Napi::TypeError::New(env, "ringView received an invalid argument, expected a ring, a record and an array of spans.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+  double position = info[1].As<Napi::Number>().DoubleValue();
+  Napi::Array list = info[2].As<Napi::Array>();
+  std::vector<std::pair<std::size_t, std::size_t>> spans;
+  for (uint32_t i = 0; i < list.Length(); i++)
+  {
+    Napi::Value span = list.Get(i);
+    Napi::Value offset = span.IsArray() ? span.As<Napi::Array>().Get(0u) : env.Undefined();
+    Napi::Value length = span.IsArray() ? span.As<Napi::Array>().Get(1u) : env.Undefined();
+    if (!offset.IsNumber() || !length.IsNumber() || !(offset.As<Napi::Number>().DoubleValue() >= 0) ||
+        !(length.As<Napi::Number>().DoubleValue() >= 0))
+    {
+      Napi::TypeError::New(env, "ringView received an invalid argument, spans must be [offset, length] pairs.").ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+    spans.emplace_back(static_cast<std::size_t>(offset.As<Napi::Number>().DoubleValue()),
+                       static_cast<std::size_t>(length.As<Napi::Number>().DoubleValue()));
+  }
+
+  uint64_t record = position >= 0 ? static_cast<uint64_t>(position) : UINT64_MAX;
+  const char *payload = position >= 0 && position < 9007199254740992.0 ? ring->View(record, spans) : nullptr;
+  if (!payload)
+  {
+    Napi::Error::New(env, "ringView received an invalid record.").ThrowAsJavaScriptException();
+    return env.Undefined();
+  }
+
+  Napi::Array result = Napi::Array::New(env, spans.size());
+  if (spans.empty())
+  {
+    ring->Release(record);
+    return result;
+  }
+  RecordRef *ref = new RecordRef{ring, record, spans.size()};
+  for (uint32_t i = 0; i < spans.size(); i++)
+  {
+    result.Set(i, Napi::Buffer<char>::New(
+                      env,
+                      const_cast<char *>(payload) + spans[i].first,
+                      spans[i].second,
+                      [](Napi::Env, char *, RecordRef *ref)
+                      { ReleaseRecord(ref); },
+                      ref));
+  }
+  return result;
+}
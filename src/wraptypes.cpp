@@ -22,6 +22,10 @@
 
 #include <napi.h>
 #include "wraptypes.h"
+#include "libraw_fields.h"
+#include <cstring>
+#include <string>
+#include <utility>
 
 /* passing raw floats to v8 will cause a loss of precision.
  * simply casting to double does not seem to work either.
@@ -40,1010 +44,363 @@ double convertFloat(float f)
   return std::stod(s, &offset);
 }
 
-template <class T>
-Napi::Array WrapArray(Napi::Env *env, T ar[], size_t size)
-{
-  Napi::Array a = Napi::Array::New(*env, size);
-  for (size_t i = 0; i < size; i++)
-  {
-    a[i] = ar[i];
-  }
-  return a;
-}
+template <typename T>
+Napi::Object WrapStruct(Napi::Env env, const T &t);
 
-Napi::Array MapFloatArrayToDouble(Napi::Env *env, float ar[], size_t size)
+template <typename T, FieldRepr R>
+Napi::Value WrapValue(Napi::Env env, const T &v)
 {
-  Napi::Array a = Napi::Array::New(*env, size);
-  for (size_t i = 0; i < size; i++)
+  if constexpr (std::is_array<T>::value)
   {
-    a[i] = convertFloat(ar[i]);
+    using Element = typename std::remove_extent<T>::type;
+    constexpr std::size_t size = std::extent<T>::value;
+    if constexpr (std::is_same<Element, char>::value && R == FieldRepr::Text)
+    {
+      return Napi::String::New(env, v, strnlen(v, size));
+    }
+    else
+    {
+      Napi::Array a = Napi::Array::New(env, size);
+      for (std::size_t i = 0; i < size; i++)
+      {
+        a[i] = WrapValue<Element, R>(env, v[i]);
+      }
+      return a;
+    }
   }
-  return a;
-}
-
-Napi::Object Wrapidata(Napi::Env *env, libraw_iparams_t iparams)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("guard", iparams.guard);
-  o.Set("make", iparams.make);
-  o.Set("model", iparams.model);
-  o.Set("software", iparams.software);
-  o.Set("normalized_make", iparams.normalized_make);
-  o.Set("normalized_model", iparams.normalized_model);
-  o.Set("maker_index", iparams.maker_index);
-  o.Set("raw_count", iparams.raw_count);
-  o.Set("dng_version", iparams.dng_version);
-  o.Set("is_foveon", iparams.is_foveon);
-  o.Set("colors", iparams.colors);
-  o.Set("filters", iparams.filters);
-  Napi::Array xtrans = Napi::Array::New(*env, 6);
-  Napi::Array xtrans_abs = Napi::Array::New(*env, 6);
-
-  for (int i = 0; i < 6; i++)
+  else if constexpr (std::is_same<T, float>::value)
   {
-    xtrans[i] = WrapArray(env, iparams.xtrans[i], 6);
-    xtrans_abs[i] = WrapArray(env, iparams.xtrans_abs[i], 6);
+    return Napi::Number::New(env, convertFloat(v));
   }
-
-  o.Set("xtrans", xtrans);
-  o.Set("xtrans_abs", xtrans_abs);
-  o.Set("cdesc", iparams.cdesc);
-  o.Set("xmplen", iparams.xmplen);
-  /*
-   * There were some cross-platform inconsistencies with this code.
-   * The Ubuntu container that creates the release versions works fine,
-   * as does macOS, but the ubuntu-latest container provided by GitHub Actions
-   * for the CI builds does not allow for this buffer creation at runtime.
-   *
-   * Given that the API the package exposes has a dedicated XMP function, this
-   * buffer is excluded from the default metadata wrapper code.
-   */
-  // if (iparams.xmplen)
-  // {
-  //   o.Set("xmpdata", Napi::Buffer<char>::New(*env, iparams.xmpdata, (std::size_t)iparams.xmplen));
-  // }
-
-  return o;
-}
-
-Napi::Object WrapRawInsetCrop(Napi::Env *env, libraw_raw_inset_crop_t t[], std::size_t size)
-{
-  Napi::Array a = Napi::Array::New(*env, size);
-  for (std::size_t i = 0; i < size; i++)
+  else if constexpr (std::is_arithmetic<T>::value)
   {
-    Napi::Object o = Napi::Object::New(*env);
-
-    o.Set("cleft", t->cleft);
-    o.Set("ctop", t->ctop);
-    o.Set("cwidth", t->cwidth);
-    o.Set("cheight", t->cheight);
-
-    a[i] = o;
+    return Napi::Number::New(env, static_cast<double>(v));
   }
-
-  return a;
-}
-
-Napi::Object WrapImageSizes(Napi::Env *env, libraw_image_sizes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("raw_height", t.raw_height);
-  o.Set("raw_width", t.raw_width);
-  o.Set("height", t.height);
-  o.Set("width", t.width);
-  o.Set("top_margin", t.top_margin);
-  o.Set("left_margin", t.left_margin);
-  o.Set("iheight", t.iheight);
-  o.Set("iwidth", t.iwidth);
-  o.Set("raw_pitch", t.raw_pitch);
-  o.Set("pixel_aspect", t.pixel_aspect);
-  o.Set("flip", t.flip);
-  Napi::Array mask = Napi::Array::New(*env, 8);
-  for (int j = 0; j < 8; j++)
+  else
   {
-    mask[j] = WrapArray(env, t.mask[j], 4);
+    static_assert(HasFieldTable<T>::value, "no FieldTable for wrapped struct");
+    return WrapStruct(env, v);
   }
-  o.Set("mask", mask);
-  o.Set("raw_inset_crops", WrapRawInsetCrop(env, t.raw_inset_crops, 2));
-
-  return o;
-}
-
-Napi::Object WrapDngLens(Napi::Env *env, libraw_dnglens_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("MinFocal", convertFloat(t.MinFocal));
-  o.Set("MaxFocal", convertFloat(t.MaxFocal));
-  o.Set("MaxAp4MinFocal", convertFloat(t.MaxAp4MinFocal));
-  o.Set("MaxAp4MaxFocal", convertFloat(t.MaxAp4MaxFocal));
-
-  return o;
-}
-
-Napi::Object WrapMakernotesLens(Napi::Env *env, libraw_makernotes_lens_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("LensID", t.Lens);
-  o.Set("Lens", t.Lens);
-  o.Set("LensFormat", t.LensFormat);
-  o.Set("LensMount", t.LensMount);
-  o.Set("CamID", t.CamID);
-  o.Set("CameraFormat", t.CameraFormat);
-  o.Set("CameraMount", t.CameraMount);
-  o.Set("body", t.body);
-  o.Set("FocalType", t.FocalType);
-  o.Set("LensFeatures_pre", t.LensFeatures_pre);
-  o.Set("LensFeatures_suf", t.LensFeatures_suf);
-  o.Set("MinFocal", convertFloat(t.MinFocal));
-  o.Set("MaxFocal", convertFloat(t.MaxFocal));
-  o.Set("MaxAp4MinFocal", convertFloat(t.MaxAp4MinFocal));
-  o.Set("MaxAp4MaxFocal", convertFloat(t.MaxAp4MaxFocal));
-  o.Set("MinAp4MinFocal", convertFloat(t.MinAp4MinFocal));
-  o.Set("MinAp4MaxFocal", convertFloat(t.MinAp4MaxFocal));
-  o.Set("MaxAp", convertFloat(t.MaxAp));
-  o.Set("MinAp", convertFloat(t.MinAp));
-  o.Set("CurFocal", convertFloat(t.CurFocal));
-  o.Set("CurAp", convertFloat(t.CurAp));
-  o.Set("MaxAp4CurFocal", convertFloat(t.MaxAp4CurFocal));
-  o.Set("MinAp4CurFocal", convertFloat(t.MinAp4CurFocal));
-  o.Set("MinFocusDistance", convertFloat(t.MinFocusDistance));
-  o.Set("FocusRangeIndex", convertFloat(t.FocusRangeIndex));
-  o.Set("LensFStops", convertFloat(t.LensFStops));
-  o.Set("TeleconverterID", t.TeleconverterID);
-  o.Set("Teleconverter", t.Teleconverter);
-  o.Set("AdapterID", t.AdapterID);
-  o.Set("Adapter", t.Adapter);
-  o.Set("AttachmentID", t.AttachmentID);
-  o.Set("Attachment", t.Attachment);
-  o.Set("FocalUnits", t.FocalUnits);
-  o.Set("FocalLengthIn35mmFormat", convertFloat(t.FocalLengthIn35mmFormat));
-
-  return o;
-}
-
-Napi::Object WrapNikonLens(Napi::Env *env, libraw_nikonlens_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("EffectiveMaxAp", convertFloat(t.EffectiveMaxAp));
-  o.Set("LensIDNumber", t.LensIDNumber);
-  o.Set("LensFStops", t.LensFStops);
-  o.Set("MCUVersion", t.MCUVersion);
-  o.Set("LensType", t.LensType);
-
-  return o;
-}
-
-Napi::Object WrapLensInfo(Napi::Env *env, libraw_lensinfo_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("MinFocal", convertFloat(t.MinFocal));
-  o.Set("MaxFocal", convertFloat(t.MaxFocal));
-  o.Set("MaxAp4MinFocal", convertFloat(t.MaxAp4MinFocal));
-  o.Set("MaxAp4MaxFocal", convertFloat(t.MaxAp4MaxFocal));
-  o.Set("EXIF_MaxAp", convertFloat(t.EXIF_MaxAp));
-  o.Set("LensMake", t.LensMake);
-  o.Set("Lens", t.Lens);
-  o.Set("LensSerial", t.LensSerial);
-  o.Set("InternalLensSerial", t.InternalLensSerial);
-  o.Set("FocalLengthIn35mmFormat", t.FocalLengthIn35mmFormat);
-  o.Set("nikon", WrapNikonLens(env, t.nikon));
-  o.Set("dng", WrapDngLens(env, t.dng));
-  o.Set("makernotes", WrapMakernotesLens(env, t.makernotes));
-
-  return o;
-}
-
-Napi::Object WrapLibrawArea(Napi::Env *env, libraw_area_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("t", t.t);
-  o.Set("l", t.l);
-  o.Set("b", t.b);
-  o.Set("r", t.r);
-
-  return o;
-}
-
-Napi::Object WrapCanonMakernotes(Napi::Env *env, libraw_canon_makernotes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("ColorDataVer", t.ColorDataVer);
-  o.Set("ColorDataSubVer", t.ColorDataSubVer);
-  o.Set("SpecularWhiteLevel", t.SpecularWhiteLevel);
-  o.Set("NormalWhiteLevel", t.NormalWhiteLevel);
-  o.Set("ChannelBlackLevel", WrapArray(env, t.ChannelBlackLevel, 4));
-  o.Set("AverageBlackLevel", t.AverageBlackLevel);
-  o.Set("multishot", WrapArray(env, t.multishot, 4));
-  o.Set("MeteringMode", t.MeteringMode);
-  o.Set("SpotMeteringMode", t.SpotMeteringMode);
-  o.Set("FlashMeteringMode", t.FlashMeteringMode);
-  o.Set("FlashExposureLock", t.FlashExposureLock);
-  o.Set("ExposureMode", t.ExposureMode);
-  o.Set("AESetting", t.AESetting);
-  o.Set("ImageStabilization", t.ImageStabilization);
-  o.Set("FlashMode", t.FlashMode);
-  o.Set("FlashActivity", t.FlashActivity);
-  o.Set("FlashBits", t.FlashBits);
-  o.Set("ManualFlashOutput", t.ManualFlashOutput);
-  o.Set("FlashOutput", t.FlashOutput);
-  o.Set("FlashGuideNumber", t.FlashGuideNumber);
-  o.Set("ContinuousDrive", t.ContinuousDrive);
-  o.Set("SensorWidth", t.SensorWidth);
-  o.Set("SensorHeight", t.SensorHeight);
-  o.Set("AFMicroAdjMode", t.AFMicroAdjMode);
-  o.Set("AFMicroAdjValue", convertFloat(t.AFMicroAdjValue));
-  o.Set("MakernotesFlip", t.MakernotesFlip);
-  o.Set("RecordMode", t.RecordMode);
-  o.Set("SRAWQuality", t.SRAWQuality);
-  o.Set("wbi", t.wbi);
-  o.Set("RF_lensID", t.RF_lensID);
-  o.Set("AutoLightingOptimizer", t.AutoLightingOptimizer);
-  o.Set("HighlightTonePriority", t.HighlightTonePriority);
-  o.Set("Quality", t.Quality);
-  o.Set("CanonLog", t.CanonLog);
-  o.Set("DefaultCropAbsolute", WrapLibrawArea(env, t.DefaultCropAbsolute));
-  o.Set("RecommendedImageArea", WrapLibrawArea(env, t.RecommendedImageArea));
-  o.Set("LeftOpticalBlack", WrapLibrawArea(env, t.LeftOpticalBlack));
-  o.Set("UpperOpticalBlack", WrapLibrawArea(env, t.UpperOpticalBlack));
-  o.Set("ActiveArea", WrapLibrawArea(env, t.ActiveArea));
-  o.Set("ISOgain", WrapArray(env, t.ISOgain, 2));
-
-  return o;
-}
-
-Napi::Object WrapSensorHighspeedCrop(Napi::Env *env, libraw_sensor_highspeed_crop_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("cleft", t.cleft);
-  o.Set("ctop", t.ctop);
-  o.Set("cwidth", t.cwidth);
-  o.Set("cheight", t.cheight);
-
-  return o;
 }
 
-Napi::Object WrapNikonMakernotes(Napi::Env *env, libraw_nikon_makernotes_t t)
+/*
+ * Hook for members that cannot be described by the field tables.
+ */
+template <typename T>
+void WrapExtras(Napi::Env env, Napi::Object &o, const T &t)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("ExposureBracketValue", t.ExposureBracketValue);
-  o.Set("ActiveDLighting", t.ActiveDLighting);
-  o.Set("ShootingMode", t.ShootingMode);
-  o.Set("ImageStabilization", WrapArray(env, t.ImageStabilization, 7));
-  o.Set("VibrationReduction", t.VibrationReduction);
-  o.Set("VRMode", t.VRMode);
-  o.Set("FlashSetting", WrapArray(env, t.FlashSetting, 13));
-  o.Set("FlashType", WrapArray(env, t.FlashType, 20));
-  o.Set("FlashExposureCompensation", WrapArray(env, t.FlashExposureCompensation, 4));
-  o.Set("ExternalFlashExposureComp", WrapArray(env, t.ExternalFlashExposureComp, 4));
-  o.Set("FlashExposureBracketValue", WrapArray(env, t.FlashExposureBracketValue, 4));
-  o.Set("FlashMode", t.FlashMode);
-  o.Set("FlashExposureCompensation2", t.FlashExposureCompensation2);
-  o.Set("FlashExposureCompensation3", t.FlashExposureCompensation3);
-  o.Set("FlashExposureCompensation4", t.FlashExposureCompensation4);
-  o.Set("FlashSource", t.FlashSource);
-  o.Set("FlashFirmware", WrapArray(env, t.FlashFirmware, 2));
-  o.Set("ExternalFlashFlags", t.ExternalFlashFlags);
-  o.Set("FlashControlCommanderMode", t.FlashControlCommanderMode);
-  o.Set("FlashOutputAndCompensation", t.FlashOutputAndCompensation);
-  o.Set("FlashFocalLength", t.FlashFocalLength);
-  o.Set("FlashGNDistance", t.FlashGNDistance);
-  o.Set("FlashGroupControlMode", WrapArray(env, t.FlashGroupControlMode, 4));
-  o.Set("FlashGroupOutputAndCompensation", WrapArray(env, t.FlashGroupOutputAndCompensation, 4));
-  o.Set("FlashColorFilter", t.FlashColorFilter);
-  o.Set("NEFCompression", t.NEFCompression);
-  o.Set("ExposureMode", t.ExposureMode);
-  o.Set("ExposureProgram", t.ExposureProgram);
-  o.Set("nMEshots", t.nMEshots);
-  o.Set("MEgainOn", t.MEgainOn);
-  o.Set("ME_WB", WrapArray(env, t.ME_WB, 4));
-  o.Set("AFFineTune", t.AFFineTune);
-  o.Set("AFFineTuneIndex", t.AFFineTuneIndex);
-  o.Set("AFFineTuneAdj", t.AFFineTuneAdj);
-  o.Set("LensDataVersion", t.LensDataVersion);
-  o.Set("FlashInfoVersion", t.FlashInfoVersion);
-  o.Set("ColorBalanceVersion", t.ColorBalanceVersion);
-  o.Set("key", t.key);
-  o.Set("NEFBitDepth", WrapArray(env, t.NEFBitDepth, 4));
-  o.Set("HighSpeedCropFormat", t.HighSpeedCropFormat);
-  o.Set("SensorHighSpeedCrop", WrapSensorHighspeedCrop(env, t.SensorHighSpeedCrop));
-  o.Set("SensorWidth", t.SensorWidth);
-  o.Set("SensorHeight", t.SensorHeight);
-
-  return o;
 }
 
-Napi::Object WrapHasselbladMakernotes(Napi::Env *env, libraw_hasselblad_makernotes_t t)
+template <>
+void WrapExtras<libraw_colordata_t>(Napi::Env env, Napi::Object &o, const libraw_colordata_t &t)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("BaseISO", t.BaseISO);
-  o.Set("Gain", t.Gain);
-  o.Set("Sensor", t.Sensor);
-  o.Set("SensorUnit", t.SensorUnit);
-  o.Set("HostBody", t.HostBody);
-  o.Set("SensorCode", t.SensorCode);
-  o.Set("SensorSubCode", t.SensorSubCode);
-  o.Set("CoatingCode", t.CoatingCode);
-  o.Set("uncropped", t.uncropped);
-  o.Set("CaptureSequenceInitiator", t.CaptureSequenceInitiator);
-  o.Set("SensorUnitConnector", t.SensorUnitConnector);
-  o.Set("format", t.format);
-  o.Set("nIFD_CM", WrapArray(env, t.nIFD_CM, 2));
-  o.Set("RecommendedCrop", WrapArray(env, t.RecommendedCrop, 2));
-  Napi::Array mnColorMatrix = Napi::Array::New(*env, 4);
-  for (std::size_t i = 0; i < 4; i++)
+  if (t.profile_length)
   {
-    mnColorMatrix[i] = WrapArray(env, t.mnColorMatrix[i], 3);
+    // the processor owning the profile may be recycled or reopened
+    o.Set("profile", Napi::Buffer<char>::Copy(env, static_cast<const char *>(t.profile), (std::size_t)t.profile_length));
   }
-  o.Set("mnColorMatrix", mnColorMatrix);
-
-  return o;
 }
 
-Napi::Object WrapFujiInfo(Napi::Env *env, libraw_fuji_info_t t)
+template <typename T>
+Napi::Object WrapStruct(Napi::Env env, const T &t)
 {
-  Napi::Object o = Napi::Object::New(*env);
+  Napi::Object o = Napi::Object::New(env);
 
-  o.Set("ExpoMidPointShift", convertFloat(t.ExpoMidPointShift));
-  o.Set("DynamicRange", t.DynamicRange);
-  o.Set("FilmMode", t.FilmMode);
-  o.Set("DynamicRangeSetting", t.DynamicRangeSetting);
-  o.Set("DevelopmentDynamicRange", t.DevelopmentDynamicRange);
-  o.Set("AutoDynamicRange", t.AutoDynamicRange);
-  o.Set("DRangePriority", t.DRangePriority);
-  o.Set("DRangePriorityAuto", t.DRangePriorityAuto);
-  o.Set("DRangePriorityFixed", t.DRangePriorityFixed);
-  o.Set("BrightnessCompensation", t.BrightnessCompensation);
-  o.Set("FocusMode", t.FocusMode);
-  o.Set("AFMode", t.AFMode);
-  o.Set("FocusPixel", WrapArray(env, t.FocusPixel, 2));
-  o.Set("PrioritySettings", t.PrioritySettings);
-  o.Set("FocusSettings", t.FocusSettings);
-  o.Set("AF_C_Settings", t.AF_C_Settings);
-  o.Set("FocusWarning", t.FocusWarning);
-  o.Set("ImageStabilization", WrapArray(env, t.ImageStabilization, 3));
-  o.Set("FlashMode", t.FlashMode);
-  o.Set("WB_Preset", t.WB_Preset);
-  o.Set("ShutterType", t.ShutterType);
-  o.Set("ExrMode", t.ExrMode);
-  o.Set("Macro", t.Macro);
-  o.Set("Rating", t.Rating);
-  o.Set("CropMode", t.CropMode);
-  o.Set("SerialSignature", t.SerialSignature);
-  o.Set("SensorID", t.SensorID);
-  o.Set("RAFVersion", t.RAFVersion);
-  o.Set("RAFDataGeneration", t.RAFDataGeneration);
-  o.Set("RAFDataVersion", t.RAFDataVersion);
-  o.Set("isTSNERDTS", t.isTSNERDTS);
-  o.Set("DriveMode", t.DriveMode);
-  o.Set("BlackLevel", WrapArray(env, t.BlackLevel, 9));
-  o.Set("RAFData_ImageSizeTable", WrapArray(env, t.RAFData_ImageSizeTable, 32));
-  o.Set("AutoBracketing", t.AutoBracketing);
-  o.Set("SequenceNumber", t.SequenceNumber);
-  o.Set("SeriesLength", t.SeriesLength);
-  o.Set("PixelShiftOffset", WrapArray(env, t.PixelShiftOffset, 2));
-  o.Set("ImageCount", t.ImageCount);
+  ForEachField<T>([&](const auto &field)
+  {
+    using F = typename std::decay<decltype(field)>::type;
+    o.Set(field.name, WrapValue<typename F::member_type, F::repr>(env, field.get(t)));
+  });
+  WrapExtras(env, o, t);
 
   return o;
 }
 
-Napi::Object WrapOlympusMakernotes(Napi::Env *env, libraw_olympus_makernotes_t t)
+Napi::Value WrapLibRawData(Napi::Env *env, libraw_data_t *data)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("CameraType2", t.CameraType2);
-  o.Set("ValidBits", t.ValidBits);
-  o.Set("SensorCalibration", WrapArray(env, t.SensorCalibration, 2));
-  o.Set("DriveMode", WrapArray(env, t.DriveMode, 5));
-  o.Set("ColorSpace", t.ColorSpace);
-  o.Set("FocusMode", WrapArray(env, t.FocusMode, 2));
-  o.Set("AutoFocus", t.AutoFocus);
-  o.Set("AFPoint", t.AFPoint);
-  o.Set("AFAreas", WrapArray(env, t.AFAreas, 64));
-  o.Set("AFPointSelected", WrapArray(env, t.AFPointSelected, 5));
-  o.Set("AFResult", t.AFResult);
-  o.Set("AFFineTune", t.AFFineTune);
-  o.Set("AFFineTuneAdj", WrapArray(env, t.AFFineTuneAdj, 3));
-  o.Set("SpecialMode", WrapArray(env, t.SpecialMode, 3));
-  o.Set("ZoomStepCount", t.ZoomStepCount);
-  o.Set("FocusStepCount", t.FocusStepCount);
-  o.Set("FocusStepInfinity", t.FocusStepInfinity);
-  o.Set("FocusStepNear", t.FocusStepNear);
-  o.Set("FocusDistance", t.FocusDistance);
-  o.Set("AspectFrame", WrapArray(env, t.AspectFrame, 4));
-  o.Set("StackedImage", WrapArray(env, t.StackedImage, 2));
-  o.Set("isLiveND", t.isLiveND);
-  o.Set("Panorama_mode", t.Panorama_mode);
-  o.Set("Panorama_frameNum", t.Panorama_frameNum);
-
-  return o;
+  return WrapStruct(*env, *data);
 }
 
-Napi::Object WrapSonyInfo(Napi::Env *env, libraw_sony_info_t t)
+template <typename T>
+static double ReadScalar(const char *p)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("CameraType", t.CameraType);
-  o.Set("Sony0x9400_version", t.Sony0x9400_version);
-  o.Set("Sony0x9400_ReleaseMode2", t.Sony0x9400_ReleaseMode2);
-  o.Set("Sony0x9400_SequenceImageNumber", t.Sony0x9400_SequenceImageNumber);
-  o.Set("Sony0x9400_SequenceLength1", t.Sony0x9400_SequenceLength1);
-  o.Set("Sony0x9400_SequenceFileNumber", t.Sony0x9400_SequenceFileNumber);
-  o.Set("Sony0x9400_SequenceLength2", t.Sony0x9400_SequenceLength2);
-  o.Set("AFAreaModeSetting", t.AFAreaModeSetting);
-  o.Set("AFAreaMode", t.AFAreaMode);
-  o.Set("FlexibleSpotPosition", WrapArray(env, t.FlexibleSpotPosition, 2));
-  o.Set("AFPointSelected", t.AFPointSelected);
-  o.Set("AFPointSelected_0x201e", t.AFPointSelected_0x201e);
-  o.Set("nAFPointsUsed", t.nAFPointsUsed);
-  o.Set("AFPointsUsed", WrapArray(env, t.AFPointsUsed, 10));
-  o.Set("AFTracking", t.AFTracking);
-  o.Set("AFType", t.AFType);
-  o.Set("FocusLocation", WrapArray(env, t.FocusLocation, 4));
-  o.Set("FocusPosition", t.FocusPosition);
-  o.Set("AFMicroAdjValue", t.AFMicroAdjValue);
-  o.Set("AFMicroAdjOn", t.AFMicroAdjOn);
-  o.Set("AFMicroAdjRegisteredLenses", t.AFMicroAdjRegisteredLenses);
-  o.Set("VariableLowPassFilter", t.VariableLowPassFilter);
-  o.Set("LongExposureNoiseReduction", t.LongExposureNoiseReduction);
-  o.Set("HighISONoiseReduction", t.HighISONoiseReduction);
-  o.Set("HDR", WrapArray(env, t.HDR, 2));
-  o.Set("group2010", t.group2010);
-  o.Set("group9050", t.group9050);
-  o.Set("real_iso_offset", t.real_iso_offset);
-  o.Set("MeteringMode_offset", t.MeteringMode_offset);
-  o.Set("ExposureProgram_offset", t.ExposureProgram_offset);
-  o.Set("ReleaseMode2_offset", t.ReleaseMode2_offset);
-  o.Set("MinoltaCamID", t.MinoltaCamID);
-  o.Set("firmware", convertFloat(t.firmware));
-  o.Set("ImageCount3_offset", t.ImageCount3_offset);
-  o.Set("ImageCount3", t.ImageCount3);
-  o.Set("ElectronicFrontCurtainShutter", t.ElectronicFrontCurtainShutter);
-  o.Set("MeteringMode2", t.MeteringMode2);
-  o.Set("SonyDateTime", WrapArray(env, t.SonyDateTime, 20));
-  o.Set("ShotNumberSincePowerUp", t.ShotNumberSincePowerUp);
-  o.Set("PixelShiftGroupPrefix", t.PixelShiftGroupPrefix);
-  o.Set("PixelShiftGroupID", t.PixelShiftGroupID);
-  o.Set("nShotsInPixelShiftGroup", t.nShotsInPixelShiftGroup);
-  o.Set("numInPixelShiftGroup", t.numInPixelShiftGroup);
-  o.Set("prd_ImageHeight", t.prd_ImageHeight);
-  o.Set("prd_ImageWidth", t.prd_ImageWidth);
-  o.Set("prd_Total_bps", t.prd_Total_bps);
-  o.Set("prd_Active_bps", t.prd_Active_bps);
-  o.Set("prd_StorageMethod", t.prd_StorageMethod);
-  o.Set("prd_BayerPattern", t.prd_BayerPattern);
-  o.Set("SonyRawFileType", t.SonyRawFileType);
-  o.Set("RAWFileType", t.RAWFileType);
-  o.Set("RawSizeType", t.RawSizeType);
-  o.Set("Quality", t.Quality);
-  o.Set("FileFormat", t.FileFormat);
-  o.Set("MetaVersion", WrapArray(env, t.MetaVersion, 16));
-
-  return o;
+  T v;
+  std::memcpy(&v, p, sizeof(v));
+  return static_cast<double>(v);
 }
 
-Napi::Object WrapKodakMakernotes(Napi::Env *env, libraw_kodak_makernotes_t t)
+/* the same conversions as `WrapValue`, driven by the descriptor instead of the type */
+static Napi::Value ReadField(Napi::Env env, const FieldRef &ref, const char *p, std::size_t dim)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("BlackLevelTop", t.BlackLevelTop);
-  o.Set("BlackLevelBottom", t.BlackLevelBottom);
-  o.Set("offset_left", t.offset_left);
-  o.Set("offset_top", t.offset_top);
-  o.Set("clipBlack", t.clipBlack);
-  o.Set("clipWhite", t.clipWhite);
-
-  std::size_t arraySize = 3;
-  Napi::Array romm_camDaylight = Napi::Array::New(*env, arraySize);
-  Napi::Array romm_camTungsten = Napi::Array::New(*env, arraySize);
-  Napi::Array romm_camFluorescent = Napi::Array::New(*env, arraySize);
-  Napi::Array romm_camFlash = Napi::Array::New(*env, arraySize);
-  Napi::Array romm_camCustom = Napi::Array::New(*env, arraySize);
-  Napi::Array romm_camAuto = Napi::Array::New(*env, arraySize);
-
-  for (std::size_t i = 0; i < arraySize; i++)
+  if (dim < ref.rank)
   {
-    romm_camDaylight[i] = MapFloatArrayToDouble(env, t.romm_camDaylight[i], arraySize);
-    romm_camTungsten[i] = MapFloatArrayToDouble(env, t.romm_camTungsten[i], arraySize);
-    romm_camFluorescent[i] = MapFloatArrayToDouble(env, t.romm_camFluorescent[i], arraySize);
-    romm_camFlash[i] = MapFloatArrayToDouble(env, t.romm_camFlash[i], arraySize);
-    romm_camCustom[i] = MapFloatArrayToDouble(env, t.romm_camCustom[i], arraySize);
-    romm_camAuto[i] = MapFloatArrayToDouble(env, t.romm_camAuto[i], arraySize);
+    std::size_t stride = ref.size;
+    for (std::size_t d = dim + 1; d < ref.rank; d++)
+    {
+      stride *= ref.extents[d];
+    }
+    if (dim + 1 == ref.rank && ref.kind == FieldKind::Char && ref.repr == FieldRepr::Text)
+    {
+      return Napi::String::New(env, p, strnlen(p, ref.extents[dim]));
+    }
+    Napi::Array a = Napi::Array::New(env, ref.extents[dim]);
+    for (std::size_t i = 0; i < ref.extents[dim]; i++)
+    {
+      a[i] = ReadField(env, ref, p + i * stride, dim + 1);
+    }
+    return a;
   }
 
-  o.Set("romm_camDaylight", romm_camDaylight);
-  o.Set("romm_camTungsten", romm_camTungsten);
-  o.Set("romm_camFluorescent", romm_camFluorescent);
-  o.Set("romm_camFlash", romm_camFlash);
-  o.Set("romm_camCustom", romm_camCustom);
-  o.Set("romm_camAuto", romm_camAuto);
-  o.Set("val018percent", t.val018percent);
-  o.Set("val100percent", t.val100percent);
-  o.Set("val170percent", t.val170percent);
-  o.Set("MakerNoteKodak8a", t.MakerNoteKodak8a);
-  o.Set("ISOCalibrationGain", convertFloat(t.ISOCalibrationGain));
-  o.Set("AnalogISO", convertFloat(t.AnalogISO));
-
-  return o;
-}
-
-Napi::Object WrapPanasonicMakernotes(Napi::Env *env, libraw_panasonic_makernotes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("Compression", t.Compression);
-  o.Set("BlackLevelDim", t.BlackLevelDim);
-  o.Set("BlackLevel", MapFloatArrayToDouble(env, t.BlackLevel, 8));
-  o.Set("Multishot", t.Multishot);
-  o.Set("gamma", convertFloat(t.gamma));
-  o.Set("HighISOMultiplier", WrapArray(env, t.HighISOMultiplier, 3));
-  o.Set("FocusStepNear", t.FocusStepNear);
-  o.Set("FocusStepCount", t.FocusStepCount);
-  o.Set("ZoomPosition", t.ZoomPosition);
-  o.Set("LensManufacturer", t.LensManufacturer);
-
-  return o;
-}
-
-Napi::Object WrapPentaxMakernotes(Napi::Env *env, libraw_pentax_makernotes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("FocusMode", WrapArray(env, t.FocusMode, 2));
-  o.Set("AFPointSelected", WrapArray(env, t.AFPointSelected, 2));
-  o.Set("AFPointsInFocus", t.AFPointsInFocus);
-  o.Set("FocusPosition", t.FocusPosition);
-  o.Set("DriveMode", WrapArray(env, t.DriveMode, 4));
-  o.Set("AFAdjustment", t.AFAdjustment);
-  o.Set("MultiExposure", t.MultiExposure);
-  o.Set("Quality", t.Quality);
-
-  return o;
-}
-
-Napi::Object WrapPhaseoneMakernotes(Napi::Env *env, libraw_p1_makernotes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("Software", t.Software);
-  o.Set("SystemType", t.SystemType);
-  o.Set("FirmwareString", t.FirmwareString);
-  o.Set("SystemModel", t.SystemModel);
-
-  return o;
-}
-
-Napi::Object WrapSamsungMakernotes(Napi::Env *env, libraw_samsung_makernotes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("ImageSizeFull", WrapArray(env, t.ImageSizeFull, 4));
-  o.Set("ImageSizeCrop", WrapArray(env, t.ImageSizeCrop, 4));
-  o.Set("ColorSpace", WrapArray(env, t.ColorSpace, 2));
-  o.Set("key", WrapArray(env, t.key, 11));
-  o.Set("DigitalGain", t.DigitalGain);
-  o.Set("DeviceType", t.DeviceType);
-  o.Set("LensFirmware", t.LensFirmware);
-
-  return o;
-}
-
-Napi::Object WrapCommonMakernotes(Napi::Env *env, libraw_metadata_common_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("FlashEC", convertFloat(t.FlashEC));
-  o.Set("FlashGN", convertFloat(t.FlashGN));
-  o.Set("CameraTemperature", convertFloat(t.CameraTemperature));
-  o.Set("SensorTemperature", convertFloat(t.SensorTemperature));
-  o.Set("SensorTemperature2", convertFloat(t.SensorTemperature2));
-  o.Set("LensTemperature", convertFloat(t.LensTemperature));
-  o.Set("AmbientTemperature", convertFloat(t.AmbientTemperature));
-  o.Set("BatteryTemperature", convertFloat(t.BatteryTemperature));
-  o.Set("exifAmbientTemperature", convertFloat(t.exifAmbientTemperature));
-  o.Set("exifHumidity", convertFloat(t.exifHumidity));
-  o.Set("exifPressure", convertFloat(t.exifPressure));
-  o.Set("exifWaterDepth", convertFloat(t.exifWaterDepth));
-  o.Set("exifAcceleration", convertFloat(t.exifAcceleration));
-  o.Set("exifCameraElevationAngle", convertFloat(t.exifCameraElevationAngle));
-  o.Set("real_ISO", convertFloat(t.real_ISO));
-  o.Set("exifExposureIndex", convertFloat(t.exifExposureIndex));
-  o.Set("ColorSpace", t.ColorSpace);
-  o.Set("firmware", t.firmware);
-  o.Set("ExposureCalibrationShift", convertFloat(t.ExposureCalibrationShift));
-  o.Set("afcount", t.afcount);
-
-  return o;
-}
-
-Napi::Object WrapRicohMakernotes(Napi::Env *env, libraw_ricoh_makernotes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("AFStatus", t.AFStatus);
-  o.Set("AFAreaXPosition", WrapArray(env, t.AFAreaXPosition, 2));
-  o.Set("AFAreaYPosition", WrapArray(env, t.AFAreaYPosition, 2));
-  o.Set("AFAreaMode", t.AFAreaMode);
-  o.Set("SensorWidth", t.SensorWidth);
-  o.Set("SensorHeight", t.SensorHeight);
-  o.Set("CroppedImageWidth", t.CroppedImageWidth);
-  o.Set("CroppedImageHeight", t.CroppedImageHeight);
-  o.Set("WideAdapter", t.WideAdapter);
-  o.Set("CropMode", t.CropMode);
-  o.Set("NDFilter", t.NDFilter);
-  o.Set("AutoBracketing", t.AutoBracketing);
-  o.Set("MacroMode", t.MacroMode);
-  o.Set("FlashMode", t.FlashMode);
-  o.Set("FlashExposureComp", t.FlashExposureComp);
-  o.Set("ManualFlashOutput", t.ManualFlashOutput);
-
-  return o;
-}
-
-Napi::Object WrapMakernotes(Napi::Env *env, libraw_makernotes_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("canon", WrapCanonMakernotes(env, t.canon));
-  o.Set("nikon", WrapNikonMakernotes(env, t.nikon));
-  o.Set("hasselblad", WrapHasselbladMakernotes(env, t.hasselblad));
-  o.Set("fuji", WrapFujiInfo(env, t.fuji));
-  o.Set("olympus", WrapOlympusMakernotes(env, t.olympus));
-  o.Set("sony", WrapSonyInfo(env, t.sony));
-  o.Set("kodak", WrapKodakMakernotes(env, t.kodak));
-  o.Set("panasonic", WrapPanasonicMakernotes(env, t.panasonic));
-  o.Set("pentax", WrapPentaxMakernotes(env, t.pentax));
-  o.Set("ricoh", WrapRicohMakernotes(env, t.ricoh));
-  o.Set("phaseone", WrapPhaseoneMakernotes(env, t.phaseone));
-  o.Set("samsung", WrapSamsungMakernotes(env, t.samsung));
-  o.Set("common", WrapCommonMakernotes(env, t.common));
-
-  return o;
-}
-
-Napi::Object WrapShootinginfo(Napi::Env *env, libraw_shootinginfo_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("DriveMode", t.DriveMode);
-  o.Set("FocusMode", t.FocusMode);
-  o.Set("MeteringMode", t.MeteringMode);
-  o.Set("AFPoint", t.AFPoint);
-  o.Set("ExposureMode", t.ExposureMode);
-  o.Set("ExposureProgram", t.ExposureProgram);
-  o.Set("ImageStabilization", t.ImageStabilization);
-  o.Set("BodySerial", t.BodySerial);
-  o.Set("InternalBodySerial", t.InternalBodySerial);
-
-  return o;
-}
-
-Napi::Object WrapOutputParams(Napi::Env *env, libraw_output_params_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("greybox", WrapArray(env, t.greybox, 4));
-  o.Set("cropbox", WrapArray(env, t.cropbox, 4));
-  o.Set("aber", WrapArray(env, t.aber, 4));
-  o.Set("gamm", WrapArray(env, t.gamm, 6));
-  o.Set("user_mul", MapFloatArrayToDouble(env, t.user_mul, 4));
-  o.Set("bright", convertFloat(t.bright));
-  o.Set("threshold", convertFloat(t.threshold));
-  o.Set("half_size", t.half_size);
-  o.Set("four_color_rgb", t.four_color_rgb);
-  o.Set("highlight", t.highlight);
-  o.Set("use_auto_wb", t.use_auto_wb);
-  o.Set("use_camera_wb", t.use_camera_wb);
-  o.Set("use_camera_matrix", t.use_camera_matrix);
-  o.Set("output_color", t.output_color);
-  o.Set("output_bps", t.output_bps);
-  o.Set("output_tiff", t.output_tiff);
-  o.Set("output_flags", t.output_flags);
-  o.Set("user_flip", t.user_flip);
-  o.Set("user_qual", t.user_qual);
-  o.Set("user_black", t.user_black);
-  o.Set("user_cblack", WrapArray(env, t.user_cblack, 4));
-  o.Set("user_sat", t.user_sat);
-  o.Set("med_passes", t.med_passes);
-  o.Set("auto_bright_thr", convertFloat(t.auto_bright_thr));
-  o.Set("adjust_maximum_thr", convertFloat(t.adjust_maximum_thr));
-  o.Set("no_auto_bright", t.no_auto_bright);
-  o.Set("use_fuji_rotate", t.use_fuji_rotate);
-  o.Set("green_matching", t.green_matching);
-  o.Set("dcb_iterations", t.dcb_iterations);
-  o.Set("dcb_enhance_fl", t.dcb_enhance_fl);
-  o.Set("fbdd_noiserd", t.fbdd_noiserd);
-  o.Set("exp_correc", t.exp_correc);
-  o.Set("exp_shift", convertFloat(t.exp_shift));
-  o.Set("exp_preser", convertFloat(t.exp_preser));
-  o.Set("no_auto_scale", t.no_auto_scale);
-  o.Set("no_interpolation", t.no_interpolation);
-
-  return o;
-}
-
-Napi::Object WrapInternalOutputParams(Napi::Env *env, libraw_internal_output_params_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("mix_green", t.mix_green);
-  o.Set("raw_color", t.raw_color);
-  o.Set("zero_is_bad", t.zero_is_bad);
-  o.Set("shrink", t.shrink);
-  o.Set("fuji_width", t.fuji_width);
-
-  return o;
-}
-
-Napi::Object WrapP1Color(Napi::Env *env, libraw_P1_color_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("romm_cam", MapFloatArrayToDouble(env, t.romm_cam, 9));
-
-  return o;
-}
-
-Napi::Object WrapDngLevels(Napi::Env *env, libraw_dng_levels_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("parsedfields", t.parsedfields);
-  o.Set("dng_cblack", WrapArray(env, t.dng_cblack, LIBRAW_CBLACK_SIZE));
-  o.Set("dng_black", t.dng_black);
-  o.Set("dng_fcblack", WrapArray(env, t.dng_fcblack, LIBRAW_CBLACK_SIZE));
-  o.Set("dng_fblack", t.dng_fblack);
-  o.Set("dng_whitelevel", WrapArray(env, t.dng_whitelevel, 4));
-  o.Set("default_crop", WrapArray(env, t.default_crop, 4));
-  o.Set("preview_colorspace", t.preview_colorspace);
-  o.Set("analogbalance", MapFloatArrayToDouble(env, t.analogbalance, 4));
-  o.Set("asshotneutral", WrapArray(env, t.asshotneutral, 4));
-  o.Set("baseline_exposure", convertFloat(t.baseline_exposure));
-  o.Set("LinearResponseLimit", t.LinearResponseLimit);
-
-  return o;
+  switch (ref.kind)
+  {
+  case FieldKind::Char:
+    return Napi::Number::New(env, ReadScalar<char>(p));
+  case FieldKind::Integer:
+    return Napi::Number::New(env, ref.size == 1   ? ReadScalar<int8_t>(p)
+                                  : ref.size == 2 ? ReadScalar<int16_t>(p)
+                                  : ref.size == 4 ? ReadScalar<int32_t>(p)
+                                                  : ReadScalar<int64_t>(p));
+  case FieldKind::Unsigned:
+    return Napi::Number::New(env, ref.size == 1   ? ReadScalar<uint8_t>(p)
+                                  : ref.size == 2 ? ReadScalar<uint16_t>(p)
+                                  : ref.size == 4 ? ReadScalar<uint32_t>(p)
+                                                  : ReadScalar<uint64_t>(p));
+  case FieldKind::Float:
+  {
+    float f;
+    std::memcpy(&f, p, sizeof(f));
+    return Napi::Number::New(env, convertFloat(f));
+  }
+  case FieldKind::Double:
+    return Napi::Number::New(env, ref.size == sizeof(double) ? ReadScalar<double>(p) : ReadScalar<long double>(p));
+  default:
+    return env.Undefined();
+  }
 }
 
-Napi::Object WrapDngColor(Napi::Env *env, libraw_dng_color_t t)
+bool ResolveMetadataFields(Napi::Env env, Napi::Value spec, const char *method, std::vector<std::pair<std::string, FieldRef>> &fields)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("parsedfields", t.parsedfields);
-  o.Set("illuminant", t.illuminant);
-  Napi::Array calibration = Napi::Array::New(*env, 4);
-  for (int i = 0; i < 4; i++)
+  if (!spec.IsArray())
   {
-    calibration[i] = MapFloatArrayToDouble(env, t.calibration[i], 4);
+    Napi::TypeError::New(env, std::string(method) + " received an invalid argument, fields must be an array of strings.").ThrowAsJavaScriptException();
+    return false;
   }
-  o.Set("calibration", calibration);
-  Napi::Array colormatrix = Napi::Array::New(*env, 4);
-  for (int i = 0; i < 4; i++)
+  Napi::Array array = spec.As<Napi::Array>();
+  fields.clear();
+  for (uint32_t i = 0; i < array.Length(); i++)
   {
-    colormatrix[i] = MapFloatArrayToDouble(env, t.colormatrix[i], 3);
+    Napi::Value name = array.Get(i);
+    if (!name.IsString())
+    {
+      Napi::TypeError::New(env, std::string(method) + " received an invalid argument, fields must be an array of strings.").ThrowAsJavaScriptException();
+      return false;
+    }
+    std::string path = name.As<Napi::String>().Utf8Value();
+    FieldRef ref;
+    if (!ResolveField<libraw_data_t>(path, ref))
+    {
+      Napi::TypeError::New(env, std::string(method) + " received an invalid argument, " + path + " is not a number, string or array of the metadata.").ThrowAsJavaScriptException();
+      return false;
+    }
+    fields.emplace_back(std::move(path), ref);
   }
-  o.Set("colormatrix", colormatrix);
-  Napi::Array forwardmatrix = Napi::Array::New(*env, 3);
-  for (int i = 0; i < 3; i++)
-  {
-    forwardmatrix[i] = MapFloatArrayToDouble(env, t.forwardmatrix[i], 4);
-  }
-  o.Set("forwardmatrix", forwardmatrix);
-
-  return o;
+  return true;
 }
 
-Napi::Object WrapPh1(Napi::Env *env, ph1_t t)
+Napi::Object WrapMetadataFields(Napi::Env env, const libraw_data_t &data, const std::vector<std::pair<std::string, FieldRef>> &fields)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("format", t.format);
-  o.Set("key_off", t.key_off);
-  o.Set("tag_21a", t.tag_21a);
-  o.Set("t_black", t.t_black);
-  o.Set("split_col", t.split_col);
-  o.Set("black_col", t.black_col);
-  o.Set("split_row", t.split_row);
-  o.Set("black_row", t.black_row);
-  o.Set("tag_210", convertFloat(t.tag_210));
-
+  Napi::Object o = Napi::Object::New(env);
+  const char *base = reinterpret_cast<const char *>(&data);
+  for (const auto &field : fields)
+  {
+    o.Set(field.first, ReadField(env, field.second, base + field.second.offset, 0));
+  }
   return o;
 }
 
-Napi::Object WrapColordata(Napi::Env *env, libraw_colordata_t t)
+bool ReadXmpSpec(Napi::Env env, Napi::Value spec, const char *method, std::vector<XmpField> &fields)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("curve", WrapArray(env, t.curve, 0x10000));
-  o.Set("cblack", WrapArray(env, t.cblack, LIBRAW_CBLACK_SIZE));
-  o.Set("black", t.black);
-  o.Set("data_maximum", t.data_maximum);
-  o.Set("maximum", t.maximum);
-  o.Set("linear_max", WrapArray(env, t.linear_max, 4));
-  o.Set("fmaximum", convertFloat(t.fmaximum));
-  o.Set("fnorm", convertFloat(t.fnorm));
-  Napi::Array white = Napi::Array::New(*env, 8);
-  for (int i = 0; i < 8; i++)
-  {
-    white[i] = WrapArray(env, t.white[i], 8);
-  }
-  o.Set("white", white);
-  o.Set("cam_mul", MapFloatArrayToDouble(env, t.cam_mul, 4));
-  o.Set("pre_mul", MapFloatArrayToDouble(env, t.pre_mul, 4));
-  Napi::Array cmatrix = Napi::Array::New(*env, 3);
-  for (int i = 0; i < 3; i++)
-  {
-    cmatrix[i] = MapFloatArrayToDouble(env, t.cmatrix[i], 4);
-  }
-  o.Set("cmatrix", cmatrix);
-  Napi::Array ccm = Napi::Array::New(*env, 3);
-  for (int i = 0; i < 3; i++)
-  {
-    ccm[i] = MapFloatArrayToDouble(env, t.ccm[i], 4);
-  }
-  o.Set("ccm", ccm);
-  Napi::Array rgb_cam = Napi::Array::New(*env, 3);
-  for (int i = 0; i < 3; i++)
-  {
-    rgb_cam[i] = MapFloatArrayToDouble(env, t.rgb_cam[i], 4);
-  }
-  o.Set("rgb_cam", rgb_cam);
-  Napi::Array cam_xyz = Napi::Array::New(*env, 4);
-  for (int i = 0; i < 4; i++)
+  std::vector<std::pair<std::string, XmpType>> names;
+  if (spec.IsArray())
   {
-    cam_xyz[i] = MapFloatArrayToDouble(env, t.cam_xyz[i], 3);
+    Napi::Array array = spec.As<Napi::Array>();
+    for (uint32_t i = 0; i < array.Length(); i++)
+    {
+      Napi::Value name = array.Get(i);
+      if (!name.IsString())
+      {
+        Napi::TypeError::New(env, std::string(method) + " received an invalid argument, XMP field names must be strings.").ThrowAsJavaScriptException();
+        return false;
+      }
+      names.emplace_back(name.As<Napi::String>().Utf8Value(), XmpType::Auto);
+    }
   }
-  o.Set("cam_xyz", cam_xyz);
-  o.Set("phase_one_data", WrapPh1(env, t.phase_one_data));
-  o.Set("flash_used", convertFloat(t.flash_used));
-  o.Set("canon_ev", convertFloat(t.canon_ev));
-  o.Set("model2", t.model2);
-  o.Set("UniqueCameraModel", t.UniqueCameraModel);
-  o.Set("LocalizedCameraModel", t.LocalizedCameraModel);
-  o.Set("ImageUniqueID", t.ImageUniqueID);
-  o.Set("RawDataUniqueID", t.RawDataUniqueID);
-  o.Set("OriginalRawFileName", t.OriginalRawFileName);
-  if (t.profile_length)
-  {
-    o.Set("profile", Napi::Buffer<char>::New(*env, (char *)t.profile, (std::size_t)t.profile_length));
-  }
-  o.Set("profile_length", t.profile_length);
-  o.Set("black_stat", WrapArray(env, t.black_stat, 8));
-  Napi::Array dng_color = Napi::Array::New(*env, 2);
-  for (int i = 0; i < 2; i++)
+  else if (spec.IsObject())
   {
-    dng_color[i] = WrapDngColor(env, t.dng_color[i]);
+    Napi::Object object = spec.As<Napi::Object>();
+    Napi::Array keys = object.GetPropertyNames();
+    for (uint32_t i = 0; i < keys.Length(); i++)
+    {
+      std::string name = keys.Get(i).ToString().Utf8Value();
+      Napi::Value type = object.Get(name);
+      std::string typeName = type.IsString() ? type.As<Napi::String>().Utf8Value() : "";
+      XmpType xmpType;
+      if (typeName == "string")
+        xmpType = XmpType::String;
+      else if (typeName == "number")
+        xmpType = XmpType::Number;
+      else if (typeName == "boolean")
+        xmpType = XmpType::Boolean;
+      else if (typeName == "array")
+        xmpType = XmpType::Array;
+      else
+      {
+        Napi::TypeError::New(env, std::string(method) + " received an invalid argument, XMP field " + name + " must be of type string, number, boolean or array.").ThrowAsJavaScriptException();
+        return false;
+      }
+      names.emplace_back(name, xmpType);
+    }
   }
-  o.Set("dng_color", dng_color);
-  o.Set("dng_levels", WrapDngLevels(env, t.dng_levels));
-  Napi::Array WB_Coeffs = Napi::Array::New(*env, 256);
-  for (int i = 0; i < 256; i++)
+  else
   {
-    WB_Coeffs[i] = WrapArray(env, t.WB_Coeffs[i], 4);
+    Napi::TypeError::New(env, std::string(method) + " received an invalid argument, XMP fields must be an array or an object.").ThrowAsJavaScriptException();
+    return false;
   }
-  o.Set("WB_Coeffs", WB_Coeffs);
-  Napi::Array WBCT_Coeffs = Napi::Array::New(*env, 64);
-  for (int i = 0; i < 64; i++)
-  {
-    WBCT_Coeffs[i] = MapFloatArrayToDouble(env, t.WBCT_Coeffs[i], 5);
-  }
-  o.Set("WBCT_Coeffs", WBCT_Coeffs);
-  o.Set("as_shot_wb_applied", t.as_shot_wb_applied);
-  Napi::Array P1_color = Napi::Array::New(*env, 2);
-  for (int i = 0; i < 2; i++)
+
+  fields.clear();
+  for (const auto &name : names)
   {
-    P1_color[i] = WrapP1Color(env, t.P1_color[i]);
+    XmpField field;
+    if (!MakeXmpField(name.first, name.second, field))
+    {
+      Napi::TypeError::New(env, std::string(method) + " received an invalid argument, XMP field " + name.first + " must be a qualified name like xmp:Rating.").ThrowAsJavaScriptException();
+      return false;
+    }
+    fields.push_back(std::move(field));
   }
-  o.Set("P1_color", P1_color);
-  o.Set("raw_bps", t.raw_bps);
-  o.Set("ExifColorSpace", t.ExifColorSpace);
-
-  return o;
-}
-
-Napi::Object WrapGpsInfo(Napi::Env *env, libraw_gps_info_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("latitude", MapFloatArrayToDouble(env, t.latitude, 3));
-  o.Set("longitude", MapFloatArrayToDouble(env, t.longitude, 3));
-  o.Set("gpstimestamp", MapFloatArrayToDouble(env, t.gpstimestamp, 3));
-  o.Set("altitude", convertFloat(t.altitude));
-  o.Set("altref", t.altref);
-  o.Set("latref", t.latref);
-  o.Set("longref", t.longref);
-  o.Set("gpsstatus", t.gpsstatus);
-  o.Set("gpsparsed", t.gpsparsed);
-
-  return o;
+  return true;
 }
 
-Napi::Object WrapImgother(Napi::Env *env, libraw_imgother_t t)
+Napi::Object WrapXmpFields(Napi::Env env, const std::vector<XmpField> &fields, const std::vector<XmpValue> &values)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("iso_speed", convertFloat(t.iso_speed));
-  o.Set("shutter", convertFloat(t.shutter));
-  o.Set("aperture", convertFloat(t.aperture));
-  o.Set("focal_len", convertFloat(t.focal_len));
-  o.Set("timestamp", t.timestamp);
-  o.Set("shot_order", t.shot_order);
-  o.Set("gpsdata", WrapArray(env, t.gpsdata, 32));
-  o.Set("parsed_gps", WrapGpsInfo(env, t.parsed_gps));
-  o.Set("desc", t.desc);
-  o.Set("artist", t.artist);
-  o.Set("analogbalance", MapFloatArrayToDouble(env, t.analogbalance, 4));
-
-  return o;
-}
-
-Napi::Value WrapThumbnail(Napi::Env *env, libraw_thumbnail_t t)
-{
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("twidth", t.twidth);
-  o.Set("theight", t.theight);
-  o.Set("tlength", t.tlength);
-  o.Set("tcolors", t.tcolors);
-
+  Napi::Object o = Napi::Object::New(env);
+  for (std::size_t i = 0; i < fields.size(); i++)
+  {
+    const XmpValue &value = values[i];
+    if (!value.found)
+    {
+      continue;
+    }
+    XmpType type = fields[i].type;
+    if (type == XmpType::Array || (type == XmpType::Auto && value.array))
+    {
+      Napi::Array items = Napi::Array::New(env, value.items.size());
+      for (std::size_t j = 0; j < value.items.size(); j++)
+      {
+        items.Set(j, Napi::String::New(env, value.items[j]));
+      }
+      o.Set(fields[i].name, items);
+      continue;
+    }
+    if (value.items.empty())
+    {
+      continue;
+    }
+    // scalar types use the first item of a list
+    const std::string &text = value.items[0];
+    double number;
+    bool boolean;
+    if (type == XmpType::Number)
+    {
+      if (XmpNumber(text, number))
+      {
+        o.Set(fields[i].name, Napi::Number::New(env, number));
+      }
+    }
+    else if (type == XmpType::Boolean)
+    {
+      if (XmpBoolean(text, boolean))
+      {
+        o.Set(fields[i].name, Napi::Boolean::New(env, boolean));
+      }
+    }
+    else
+    {
+      o.Set(fields[i].name, Napi::String::New(env, text));
+    }
+  }
   return o;
 }
 
-Napi::Value WrapRawData(Napi::Env *env, libraw_rawdata_t t)
+bool ReadExifTagSpec(Napi::Env env, Napi::Value spec, const char *method, std::vector<ExifTagRequest> &requests)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("iparams", Wrapidata(env, t.iparams));
-  o.Set("sizes", WrapImageSizes(env, t.sizes));
-  o.Set("ioparams", WrapInternalOutputParams(env, t.ioparams));
-  o.Set("color", WrapColordata(env, t.color));
-
-  return o;
+  if (!spec.IsArray())
+  {
+    Napi::TypeError::New(env, std::string(method) + " received an invalid argument, EXIF tags must be an array.").ThrowAsJavaScriptException();
+    return false;
+  }
+  Napi::Array array = spec.As<Napi::Array>();
+  requests.clear();
+  for (uint32_t i = 0; i < array.Length(); i++)
+  {
+    Napi::Value item = array.Get(i);
+    ExifTagRequest request;
+    if (item.IsNumber())
+    {
+      double tag = item.As<Napi::Number>().DoubleValue();
+      if (tag >= 0 && tag <= 0xffff && tag == static_cast<uint16_t>(tag))
+      {
+        request.key = std::to_string(static_cast<unsigned>(tag));
+        request.group = ExifGroup::Any;
+        request.tag = static_cast<uint16_t>(tag);
+        requests.push_back(std::move(request));
+        continue;
+      }
+    }
+    else if (item.IsString() && ExifTagCollector::ParseRequest(item.As<Napi::String>().Utf8Value(), request))
+    {
+      requests.push_back(std::move(request));
+      continue;
+    }
+    Napi::TypeError::New(env, std::string(method) + " received an invalid argument, EXIF tags must be tag numbers or strings like makernote:0x0016.").ThrowAsJavaScriptException();
+    return false;
+  }
+  return true;
 }
 
-Napi::Value WrapRawUnpackParams(Napi::Env *env, libraw_raw_unpack_params_t t)
+Napi::Object WrapExifTags(Napi::Env env, const ExifTagCollector &collector)
 {
-  Napi::Object o = Napi::Object::New(*env);
-
-  o.Set("use_rawspeed", t.use_rawspeed);
-  o.Set("use_dngsdk", t.use_dngsdk);
-  o.Set("options", t.options);
-  o.Set("shot_select", t.shot_select);
-  o.Set("specials", t.specials);
-  o.Set("max_raw_memory_mb", t.max_raw_memory_mb);
-  o.Set("sony_arw2_posterization_thr", t.sony_arw2_posterization_thr);
-  o.Set("coolscan_nef_gamma", t.coolscan_nef_gamma);
-  o.Set("p4shot_order", WrapArray(env, t.p4shot_order, 5));
-
+  Napi::Object o = Napi::Object::New(env);
+  const std::vector<ExifTagRequest> &requests = collector.Requests();
+  const std::vector<ExifTagValue> &values = collector.Values();
+  for (std::size_t i = 0; i < requests.size(); i++)
+  {
+    const ExifTagValue &value = values[i];
+    if (!value.found)
+    {
+      continue;
+    }
+    if (value.type == 2)
+    {
+      o.Set(requests[i].key, Napi::String::New(env, value.text));
+    }
+    else if (value.type == 7)
+    {
+      o.Set(requests[i].key, Napi::Buffer<unsigned char>::Copy(env, value.bytes.data(), value.bytes.size()));
+    }
+    else if (value.numbers.size() == 1)
+    {
+      o.Set(requests[i].key, Napi::Number::New(env, value.numbers[0]));
+    }
+    else
+    {
+      Napi::Array numbers = Napi::Array::New(env, value.numbers.size());
+      for (std::size_t j = 0; j < value.numbers.size(); j++)
+      {
+        numbers.Set(j, Napi::Number::New(env, value.numbers[j]));
+      }
+      o.Set(requests[i].key, numbers);
+    }
+  }
   return o;
 }
-
-Napi::Value WrapLibRawData(Napi::Env *env, libraw_data_t *data)
-{
-  Napi::Object wrapper = Napi::Object::New(*env);
-
-  wrapper.Set("sizes", WrapImageSizes(env, data->sizes));
-  wrapper.Set("idata", Wrapidata(env, data->idata));
-  wrapper.Set("lens", WrapLensInfo(env, data->lens));
-  wrapper.Set("makernotes", WrapMakernotes(env, data->makernotes));
-  wrapper.Set("shootinginfo", WrapShootinginfo(env, data->shootinginfo));
-  wrapper.Set("params", WrapOutputParams(env, data->params));
-  wrapper.Set("rawparams", WrapRawUnpackParams(env, data->rawparams));
-  wrapper.Set("progress_flags", data->progress_flags);
-  wrapper.Set("process_warnings", data->process_warnings);
-  wrapper.Set("color", WrapColordata(env, data->color));
-  wrapper.Set("other", WrapImgother(env, data->other));
-  wrapper.Set("thumbnail", WrapThumbnail(env, data->thumbnail));
-  wrapper.Set("rawdata", WrapRawData(env, data->rawdata));
-
-  return wrapper;
-}
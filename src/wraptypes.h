@@ -20,6 +20,50 @@
  * Direct further questions to justinkambic.github@gmail.com.
  */
 
+#include <vector>
 #include "libraw/libraw.h"
+#include "exif_tags.h"
+#include "fields.h"
+#include "xmp.h"
 
 Napi::Value WrapLibRawData(Napi::Env* env, libraw_data_t* data);
+
+/*
+ * Reads a list of metadata paths like `color.cam_mul` and resolves them
+ * through the field tables. Throws a TypeError naming `method` and returns
+ * false if a path does not name a number, string or array.
+ */
+bool ResolveMetadataFields(Napi::Env env, Napi::Value spec, const char* method, std::vector<std::pair<std::string, FieldRef>>& fields);
+
+/*
+ * Reads the resolved fields of `data` into an object keyed by path, with
+ * the values `getMetadata` has at those paths.
+ */
+Napi::Object WrapMetadataFields(Napi::Env env, const libraw_data_t& data, const std::vector<std::pair<std::string, FieldRef>>& fields);
+
+/*
+ * Reads an XMP field selection, either an array of names or an object of
+ * names to `'string' | 'number' | 'boolean' | 'array'`. Throws a TypeError
+ * naming `method` and returns false if it is invalid.
+ */
+bool ReadXmpSpec(Napi::Env env, Napi::Value spec, const char* method, std::vector<XmpField>& fields);
+
+/*
+ * Converts the values read by `ReadXmp` to an object keyed by field name.
+ * Fields that are missing or do not convert to their type are omitted.
+ */
+Napi::Object WrapXmpFields(Napi::Env env, const std::vector<XmpField>& fields, const std::vector<XmpValue>& values);
+
+/*
+ * Reads a list of EXIF tags, numbers for tags of the TIFF and EXIF IFDs or
+ * `group:tag` strings. Throws a TypeError naming `method` and returns false
+ * if it is invalid.
+ */
+bool ReadExifTagSpec(Napi::Env env, Napi::Value spec, const char* method, std::vector<ExifTagRequest>& requests);
+
+/*
+ * Converts the collected tags to an object keyed by request. ASCII values
+ * become strings, UNDEFINED values Buffers and everything else numbers, or
+ * arrays of numbers for multi-valued tags.
+ */
+Napi::Object WrapExifTags(Napi::Env env, const ExifTagCollector& collector);
\ No newline at end of file
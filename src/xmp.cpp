@@ -0,0 +1,659 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#include "xmp.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <strings.h>
+
+namespace
+{
+const char *const RDF_NS = "http://www.w3.org/1999/02/22-rdf-syntax-ns#";
+const char *const XML_NS = "http://www.w3.org/XML/1998/namespace";
+
+struct Schema
+{
+  const char *prefix;
+  const char *uri;
+};
+
+// the usual prefixes of the schemas found in camera and editor XMP
+const Schema SCHEMAS[] = {
+    {"aux", "http://ns.adobe.com/exif/1.0/aux/"},
+    {"crd", "http://ns.adobe.com/camera-raw-defaults/1.0/"},
+    {"crs", "http://ns.adobe.com/camera-raw-settings/1.0/"},
+    {"dc", "http://purl.org/dc/elements/1.1/"},
+    {"exif", "http://ns.adobe.com/exif/1.0/"},
+    {"exifEX", "http://cipa.jp/exif/1.0/"},
+    {"Iptc4xmpCore", "http://iptc.org/std/Iptc4xmpCore/1.0/xmlns/"},
+    {"lr", "http://ns.adobe.com/lightroom/1.0/"},
+    {"photoshop", "http://ns.adobe.com/photoshop/1.0/"},
+    {"rdf", RDF_NS},
+    {"tiff", "http://ns.adobe.com/tiff/1.0/"},
+    {"xml", XML_NS},
+    {"xmp", "http://ns.adobe.com/xap/1.0/"},
+    {"xmpDM", "http://ns.adobe.com/xmp/1.0/DynamicMedia/"},
+    {"xmpMM", "http://ns.adobe.com/xap/1.0/mm/"},
+    {"xmpRights", "http://ns.adobe.com/xap/1.0/rights/"},
+};
+
+const char *SchemaUri(const std::string &prefix)
+{
+  for (const Schema &schema : SCHEMAS)
+  {
+    if (prefix == schema.prefix)
+    {
+      return schema.uri;
+    }
+  }
+  return "";
+}
+
+void AppendUtf8(std::string &out, unsigned long code)
+{
+  if (code < 0x80)
+  {
+    out += static_cast<char>(code);
+  }
+  else if (code < 0x800)
+  {
+    out += static_cast<char>(0xc0 | (code >> 6));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+  else if (code < 0x10000)
+  {
+    out += static_cast<char>(0xe0 | (code >> 12));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+  else if (code < 0x110000)
+  {
+    out += static_cast<char>(0xf0 | (code >> 18));
+    out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+}
+
+// appends character data, replacing the predefined and numeric entities
+void AppendDecoded(std::string &out, const char *begin, const char *end)
+{
+  while (begin < end)
+  {
+    const char *amp = static_cast<const char *>(std::memchr(begin, '&', end - begin));
+    if (!amp)
+    {
+      out.append(begin, end);
+      return;
+    }
+    out.append(begin, amp);
+    const char *semi = static_cast<const char *>(std::memchr(amp, ';', end - amp));
+    if (!semi)
+    {
+      out.append(amp, end);
+      return;
+    }
+    std::string entity(amp + 1, semi);
+    if (entity == "lt")
+      out += '<';
+    else if (entity == "gt")
+      out += '>';
+    else if (entity == "amp")
+      out += '&';
+    else if (entity == "quot")
+      out += '"';
+    else if (entity == "apos")
+      out += '\'';
+    else if (entity.size() > 1 && entity[0] == '#')
+    {
+      bool hex = entity[1] == 'x' || entity[1] == 'X';
+      AppendUtf8(out, std::strtoul(entity.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10));
+    }
+    else
+      out.append(amp, semi + 1);
+    begin = semi + 1;
+  }
+}
+
+bool IsSpace(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+struct Binding
+{
+  std::string prefix;
+  std::string uri;
+};
+
+struct Name
+{
+  std::string prefix;
+  std::string local;
+  std::string uri;
+};
+
+struct Attribute
+{
+  std::string name;
+  std::string value;
+};
+
+class XmpScanner
+{
+public:
+  XmpScanner(const char *data, std::size_t size, const std::vector<XmpField> &fields, std::vector<XmpValue> &values)
+      : p_(data), end_(data + size), fields_(fields), values_(values), remaining_(fields.size())
+  {
+  }
+
+  void Run()
+  {
+    while (this->p_ < this->end_ && this->remaining_ > 0)
+    {
+      if (*this->p_ != '<')
+      {
+        const char *lt = static_cast<const char *>(std::memchr(this->p_, '<', this->end_ - this->p_));
+        const char *stop = lt ? lt : this->end_;
+        this->Text(this->p_, stop, true);
+        this->p_ = stop;
+      }
+      else if (this->StartsWith("<!--"))
+      {
+        this->SkipPast("-->");
+      }
+      else if (this->StartsWith("<![CDATA["))
+      {
+        const char *begin = this->p_ + 9;
+        this->SkipPast("]]>");
+        this->Text(begin, this->p_ < this->end_ ? this->p_ - 3 : this->end_, false);
+      }
+      else if (this->StartsWith("<?"))
+      {
+        this->SkipPast("?>");
+      }
+      else if (this->StartsWith("</"))
+      {
+        this->SkipPast(">");
+        this->EndElement();
+      }
+      else if (this->StartsWith("<!"))
+      {
+        this->SkipPast(">");
+      }
+      else
+      {
+        this->StartElement();
+      }
+    }
+  }
+
+private:
+  enum class Container
+  {
+    None,
+    List,
+    Alt,
+  };
+
+  bool StartsWith(const char *token) const
+  {
+    std::size_t length = std::strlen(token);
+    return static_cast<std::size_t>(this->end_ - this->p_) >= length && std::memcmp(this->p_, token, length) == 0;
+  }
+
+  void SkipPast(const char *token)
+  {
+    std::size_t length = std::strlen(token);
+    for (const char *q = this->p_; q + length <= this->end_; q++)
+    {
+      if (std::memcmp(q, token, length) == 0)
+      {
+        this->p_ = q + length;
+        return;
+      }
+    }
+    this->p_ = this->end_;
+  }
+
+  void SkipSpace()
+  {
+    while (this->p_ < this->end_ && IsSpace(*this->p_))
+    {
+      this->p_++;
+    }
+  }
+
+  std::string ReadName()
+  {
+    const char *begin = this->p_;
+    while (this->p_ < this->end_ && !IsSpace(*this->p_) && *this->p_ != '/' && *this->p_ != '>' && *this->p_ != '=')
+    {
+      this->p_++;
+    }
+    return std::string(begin, this->p_);
+  }
+
+  Name Resolve(const std::string &qualified, bool attribute) const
+  {
+    Name name;
+    std::size_t colon = qualified.find(':');
+    if (colon == std::string::npos)
+    {
+      name.local = qualified;
+      // unprefixed attributes are in no namespace
+      if (attribute)
+      {
+        return name;
+      }
+    }
+    else
+    {
+      name.prefix = qualified.substr(0, colon);
+      name.local = qualified.substr(colon + 1);
+    }
+    if (name.prefix == "xml")
+    {
+      name.uri = XML_NS;
+      return name;
+    }
+    for (auto it = this->bindings_.rbegin(); it != this->bindings_.rend(); ++it)
+    {
+      if (it->prefix == name.prefix)
+      {
+        name.uri = it->uri;
+        break;
+      }
+    }
+    return name;
+  }
+
+  static bool Is(const Name &name, const char *uri, const char *local)
+  {
+    return name.uri == uri && name.local == local;
+  }
+
+  // index of the first unfound field called `name`, or -1
+  int Match(const Name &name) const
+  {
+    for (std::size_t i = 0; i < this->fields_.size(); i++)
+    {
+      const XmpField &field = this->fields_[i];
+      if (this->values_[i].found || field.local != name.local)
+      {
+        continue;
+      }
+      if (field.uri.empty() ? field.prefix == name.prefix : field.uri == name.uri)
+      {
+        return static_cast<int>(i);
+      }
+    }
+    return -1;
+  }
+
+  void Found(int index, std::vector<std::string> items, bool array)
+  {
+    XmpValue &value = this->values_[index];
+    value.found = true;
+    value.array = array;
+    value.items = std::move(items);
+    this->remaining_--;
+  }
+
+  void StartElement()
+  {
+    this->p_++;
+    std::string qualified = this->ReadName();
+    std::vector<Attribute> attributes;
+    bool empty = false;
+    std::size_t mark = this->bindings_.size();
+
+    while (this->p_ < this->end_)
+    {
+      this->SkipSpace();
+      if (this->p_ >= this->end_)
+      {
+        return;
+      }
+      if (*this->p_ == '>')
+      {
+        this->p_++;
+        break;
+      }
+      if (*this->p_ == '/')
+      {
+        empty = true;
+        this->p_++;
+        continue;
+      }
+      std::string name = this->ReadName();
+      this->SkipSpace();
+      if (this->p_ >= this->end_ || *this->p_ != '=')
+      {
+        // malformed, give up on the rest of the packet
+        this->p_ = this->end_;
+        return;
+      }
+      this->p_++;
+      this->SkipSpace();
+      if (this->p_ >= this->end_ || (*this->p_ != '"' && *this->p_ != '\''))
+      {
+        this->p_ = this->end_;
+        return;
+      }
+      char quote = *this->p_++;
+      const char *close = static_cast<const char *>(std::memchr(this->p_, quote, this->end_ - this->p_));
+      if (!close)
+      {
+        this->p_ = this->end_;
+        return;
+      }
+      Attribute attribute{std::move(name), std::string()};
+      AppendDecoded(attribute.value, this->p_, close);
+      this->p_ = close + 1;
+
+      if (attribute.name == "xmlns")
+      {
+        this->bindings_.push_back({std::string(), attribute.value});
+      }
+      else if (attribute.name.compare(0, 6, "xmlns:") == 0)
+      {
+        this->bindings_.push_back({attribute.name.substr(6), attribute.value});
+      }
+      else
+      {
+        attributes.push_back(std::move(attribute));
+      }
+    }
+
+    this->open_.push_back(mark);
+    std::size_t index = this->open_.size() - 1;
+    Name name = this->Resolve(qualified, false);
+
+    if (this->active_ < 0)
+    {
+      this->StartOutside(name, attributes, index);
+    }
+    else
+    {
+      this->StartInside(name, attributes, index - this->property_);
+    }
+    if (empty)
+    {
+      this->EndElement();
+    }
+  }
+
+  void StartOutside(const Name &name, const std::vector<Attribute> &attributes, std::size_t index)
+  {
+    int field = this->Match(name);
+    if (field >= 0)
+    {
+      this->active_ = field;
+      this->property_ = index;
+      this->container_ = Container::None;
+      this->structured_ = false;
+      this->inItem_ = false;
+      this->text_.clear();
+      this->items_.clear();
+      this->defaultItem_ = -1;
+      for (const Attribute &attribute : attributes)
+      {
+        Name qualifier = this->Resolve(attribute.name, true);
+        if (Is(qualifier, RDF_NS, "resource"))
+        {
+          this->text_ = attribute.value;
+        }
+        else if (qualifier.uri != XML_NS)
+        {
+          // rdf:parseType="Resource" or the struct shorthand
+          this->structured_ = true;
+        }
+      }
+      return;
+    }
+
+    // simple properties written as attributes, usually of rdf:Description
+    for (const Attribute &attribute : attributes)
+    {
+      int match = this->Match(this->Resolve(attribute.name, true));
+      if (match >= 0)
+      {
+        this->Found(match, {attribute.value}, false);
+      }
+    }
+  }
+
+  void StartInside(const Name &name, const std::vector<Attribute> &attributes, std::size_t level)
+  {
+    if (level == 1 && this->container_ == Container::None && !this->structured_)
+    {
+      if (Is(name, RDF_NS, "Bag") || Is(name, RDF_NS, "Seq"))
+      {
+        this->container_ = Container::List;
+      }
+      else if (Is(name, RDF_NS, "Alt"))
+      {
+        this->container_ = Container::Alt;
+      }
+      else
+      {
+        this->structured_ = true;
+      }
+    }
+    else if (level == 2 && this->container_ != Container::None && Is(name, RDF_NS, "li"))
+    {
+      this->inItem_ = true;
+      this->itemStructured_ = false;
+      this->text_.clear();
+      this->itemLang_.clear();
+      for (const Attribute &attribute : attributes)
+      {
+        Name qualifier = this->Resolve(attribute.name, true);
+        if (Is(qualifier, XML_NS, "lang"))
+        {
+          this->itemLang_ = attribute.value;
+        }
+        else if (Is(qualifier, RDF_NS, "resource"))
+        {
+          this->text_ = attribute.value;
+        }
+        else
+        {
+          this->itemStructured_ = true;
+        }
+      }
+    }
+    else if (level >= 3 && this->inItem_)
+    {
+      this->itemStructured_ = true;
+    }
+  }
+
+  void EndElement()
+  {
+    if (this->open_.empty())
+    {
+      return;
+    }
+    this->bindings_.resize(this->open_.back());
+    this->open_.pop_back();
+    if (this->active_ < 0)
+    {
+      return;
+    }
+
+    std::size_t index = this->open_.size();
+    if (index == this->property_ + 2 && this->inItem_)
+    {
+      if (this->itemStructured_)
+      {
+        // a list of structs
+        this->structured_ = true;
+      }
+      else
+      {
+        if (this->itemLang_ == "x-default" && this->defaultItem_ < 0)
+        {
+          this->defaultItem_ = static_cast<int>(this->items_.size());
+        }
+        this->items_.push_back(std::move(this->text_));
+      }
+      this->inItem_ = false;
+      this->text_.clear();
+    }
+    else if (index == this->property_)
+    {
+      int field = this->active_;
+      this->active_ = -1;
+      if (this->structured_)
+      {
+        return;
+      }
+      switch (this->container_)
+      {
+      case Container::None:
+        this->Found(field, {std::move(this->text_)}, false);
+        break;
+      case Container::List:
+        this->Found(field, std::move(this->items_), true);
+        break;
+      case Container::Alt:
+        if (!this->items_.empty())
+        {
+          std::size_t pick = this->defaultItem_ < 0 ? 0 : this->defaultItem_;
+          this->Found(field, {std::move(this->items_[pick])}, false);
+        }
+        break;
+      }
+    }
+  }
+
+  void Text(const char *begin, const char *end, bool decode)
+  {
+    if (this->active_ < 0)
+    {
+      return;
+    }
+    std::size_t level = this->open_.size() - 1 - this->property_;
+    if ((level == 0 && this->container_ == Container::None) || (level == 2 && this->inItem_))
+    {
+      if (decode)
+      {
+        AppendDecoded(this->text_, begin, end);
+      }
+      else
+      {
+        this->text_.append(begin, end);
+      }
+    }
+  }
+
+  const char *p_;
+  const char *end_;
+  const std::vector<XmpField> &fields_;
+  std::vector<XmpValue> &values_;
+  std::size_t remaining_;
+
+  std::vector<Binding> bindings_;
+  // per open element, the size of `bindings_` before it
+  std::vector<std::size_t> open_;
+
+  // the field whose element is open, and that element's depth
+  int active_ = -1;
+  std::size_t property_ = 0;
+  Container container_ = Container::None;
+  bool structured_ = false;
+  bool inItem_ = false;
+  bool itemStructured_ = false;
+  std::string itemLang_;
+  int defaultItem_ = -1;
+  std::string text_;
+  std::vector<std::string> items_;
+};
+} // namespace
+
+bool MakeXmpField(const std::string &name, XmpType type, XmpField &field)
+{
+  std::size_t colon = name.find(':');
+  if (colon == std::string::npos || colon == 0 || colon + 1 == name.size())
+  {
+    return false;
+  }
+  field.name = name;
+  field.prefix = name.substr(0, colon);
+  field.local = name.substr(colon + 1);
+  field.uri = SchemaUri(field.prefix);
+  field.type = type;
+  return true;
+}
+
+void ReadXmp(const char *data, std::size_t size, const std::vector<XmpField> &fields, std::vector<XmpValue> &values)
+{
+  values.assign(fields.size(), XmpValue());
+  if (data && size && !fields.empty())
+  {
+    XmpScanner(data, size, fields, values).Run();
+  }
+}
+
+bool XmpNumber(const std::string &text, double &number)
+{
+  const char *begin = text.c_str();
+  char *end;
+  number = std::strtod(begin, &end);
+  if (end == begin)
+  {
+    return false;
+  }
+  if (*end == '/')
+  {
+    const char *denominatorBegin = end + 1;
+    double denominator = std::strtod(denominatorBegin, &end);
+    if (end == denominatorBegin || denominator == 0)
+    {
+      return false;
+    }
+    number /= denominator;
+  }
+  while (IsSpace(*end))
+  {
+    end++;
+  }
+  return *end == '\0';
+}
+
+bool XmpBoolean(const std::string &text, bool &boolean)
+{
+  if (strcasecmp(text.c_str(), "true") == 0)
+  {
+    boolean = true;
+    return true;
+  }
+  if (strcasecmp(text.c_str(), "false") == 0)
+  {
+    boolean = false;
+    return true;
+  }
+  return false;
+}
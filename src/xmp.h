@@ -0,0 +1,92 @@
+/*
+ * libraw.js - node wrapper for LibRaw
+ * Copyright (C) 2020-2021  Justin Kambic
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301
+ * USA
+ *
+ * Direct further questions to justinkambic.github@gmail.com.
+ */
+
+#ifndef LIBRAWJS_XMP_H
+#define LIBRAWJS_XMP_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+ * Selected-field reader for XMP packets.
+ *
+ * Fields are named by qualified name, e.g. `xmp:Rating` or `dc:subject`.
+ * Prefixes of the common XMP schemas are matched by namespace URI, so a
+ * packet that binds the schema to another prefix still matches; other
+ * prefixes are matched literally. The packet is scanned once, without
+ * building a tree, and scanning stops as soon as every field was found.
+ *
+ * A property is read from an attribute of `rdf:Description`, from the text
+ * of its element, from an `rdf:Bag`/`rdf:Seq` (one item per `rdf:li`) or
+ * from an `rdf:Alt` (the `x-default` item, else the first). Structured
+ * values are not reported.
+ */
+
+enum class XmpType
+{
+  Auto,
+  String,
+  Number,
+  Boolean,
+  Array,
+};
+
+struct XmpField
+{
+  std::string name;
+  std::string prefix;
+  std::string local;
+  // empty unless the prefix is a known schema
+  std::string uri;
+  XmpType type;
+};
+
+struct XmpValue
+{
+  bool found = false;
+  bool array = false;
+  std::vector<std::string> items;
+};
+
+/*
+ * Splits `name` into prefix and local name. Returns false unless it has
+ * the form `prefix:Local`.
+ */
+bool MakeXmpField(const std::string &name, XmpType type, XmpField &field);
+
+/*
+ * Reads `fields` from the packet; `values` is resized to match `fields`.
+ */
+void ReadXmp(const char *data, std::size_t size, const std::vector<XmpField> &fields, std::vector<XmpValue> &values);
+
+/*
+ * Interprets a value as a number, accepting XMP rationals such as `28/10`.
+ */
+bool XmpNumber(const std::string &text, double &number);
+
+/*
+ * Interprets a value as an XMP boolean, `True` or `False`.
+ */
+bool XmpBoolean(const std::string &text, bool &boolean);
+
+#endif
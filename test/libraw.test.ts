@@ -20,9 +20,12 @@
  * Direct further questions to justinkambic.github@gmail.com.
  */
 
-import { LibRaw } from '../src/libraw';
+import { DecodeWorkers, ExifTag, LibRaw } from '../src/libraw';
+import { execFileSync } from 'child_process';
 import path from 'path';
 import fs from 'fs';
+import os from 'os';
+import { Worker } from 'worker_threads';
 import * as t from 'io-ts';
 import { PathReporter } from 'io-ts/lib/PathReporter';
 import { isRight } from 'fp-ts/Either';
@@ -41,6 +44,46 @@ const TEST_THUMBNAIL_JPG = path.join(
   'test_thumb.jpg'
 );
 
+const BENCH_DIR = path.join(__dirname, '../bench');
+
+let generatedDir: string | undefined;
+
+/*
+ * Writes a DNG with the synthetic corpus generator, built on first use, so
+ * tests can run on files that are not checked in. The same options always
+ * give the same bytes.
+ */
+function generateDng(name: string, options: string[] = []): string {
+  if (!generatedDir) {
+    execFileSync('make', ['-C', BENCH_DIR, 'bin/make_dng'], {
+      stdio: 'ignore',
+    });
+    generatedDir = fs.mkdtempSync(path.join(os.tmpdir(), 'libraw-dng-'));
+  }
+  const file = path.join(generatedDir, name);
+  execFileSync(path.join(BENCH_DIR, 'bin/make_dng'), [
+    '--width',
+    '256',
+    '--height',
+    '128',
+    '--bits',
+    '12',
+    '--compression',
+    'none',
+    '--previews',
+    '',
+    ...options,
+    file,
+  ]);
+  return file;
+}
+
+afterAll(() => {
+  if (generatedDir) {
+    fs.rmSync(generatedDir, { recursive: true, force: true });
+  }
+});
+
 const __2dNumArray = t.array(t.array(t.number));
 const __dngColor = t.array(
   t.type({
@@ -231,6 +274,46 @@ describe('LibRaw', () => {
       normalizeTimestampAndTest(metadata, { day: 28, month: 9, year: 2014 });
       expect(metadata.other).toMatchSnapshot();
     });
+
+    test('projects fields with the values of the full metadata', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const metadata = (await lr.getMetadata()) as Record<
+        string,
+        Record<string, unknown>
+      >;
+      const paths = [
+        'idata.make',
+        'idata.cdesc',
+        'idata.xtrans',
+        'sizes.width',
+        'color.cam_mul',
+        'color.cam_xyz',
+        'other.iso_speed',
+        'other.timestamp',
+        'makernotes.common.CameraTemperature',
+      ];
+      const fields = await lr.getMetadataFields(paths);
+      expect(Object.keys(fields)).toEqual(paths);
+      for (const p of paths) {
+        const value = p
+          .split('.')
+          .reduce<unknown>(
+            (o, name) => (o as Record<string, unknown>)[name],
+            metadata
+          );
+        expect(fields[p]).toEqual(value);
+      }
+      expect(fields['idata.make']).toBe('Nikon');
+    });
+
+    test('rejects paths that do not name a value', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      for (const p of ['idata', 'idata.nope', 'sizes.width.x', '']) {
+        await expect(lr.getMetadataFields([p])).rejects.toThrow(
+          'is not a number, string or array of the metadata'
+        );
+      }
+    });
   });
 
   describe('getXmp', () => {
@@ -242,6 +325,241 @@ describe('LibRaw', () => {
     });
   });
 
+  describe('getXmpFields', () => {
+    test('reads selected properties', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      expect(
+        await lr.getXmpFields(['xmp:Rating', 'xmp:CreatorTool', 'dc:subject'])
+      ).toEqual({
+        'xmp:Rating': '0',
+        'xmp:CreatorTool': 'NIKON Z 6 Ver.02.00     ',
+      });
+    });
+
+    test('converts to the requested types', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const fields = await lr.getXmpFields({
+        'xmp:Rating': 'number',
+        'crd:SharpenRadius': 'number',
+        'xmp:CreateDate': 'array',
+        'xmp:CreatorTool': 'boolean',
+      });
+      expect(fields).toEqual({
+        'xmp:Rating': 0,
+        'crd:SharpenRadius': 2,
+        'xmp:CreateDate': ['2019-07-26T20:36:57.90'],
+      });
+    });
+
+    test('is available from extract', async () => {
+      const result = await lr.extract(RAW_NIKON_FILE_PATH, {
+        metadata: false,
+        xmpFields: { 'xmp:Rating': 'number' },
+      });
+      expect(result.xmpFields).toEqual({ 'xmp:Rating': 0 });
+    });
+
+    test('rejects unqualified names', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      await expect(lr.getXmpFields(['Rating'])).rejects.toThrow(
+        'must be a qualified name like xmp:Rating'
+      );
+    });
+  });
+
+  describe('exifTags', () => {
+    test('collects tags while opening', async () => {
+      await lr.setExifTags([0x010f, 'exif:0x829a', 'gps:0x0002']);
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const { other } = await lr.getMetadata();
+      const tags = await lr.getExifTags();
+      expect(tags[0x010f]).toMatch(/^NIKON/);
+      expect(tags['exif:0x829a']).toBeCloseTo(
+        (other as { shutter: number }).shutter
+      );
+      expect(tags['gps:0x0002']).toBeUndefined();
+    });
+
+    test('is available from extract', async () => {
+      const result = await lr.extract(RAW_SONY_FILE_PATH, {
+        metadata: false,
+        exifTags: [0x0110],
+      });
+      expect(result.exifTags).toEqual({ [0x0110]: expect.any(String) });
+    });
+
+    test('keeps the registered tags across extract', async () => {
+      await lr.setExifTags([0x010f]);
+      const result = await lr.extract(RAW_SONY_FILE_PATH, {
+        metadata: false,
+        exifTags: [0x0110],
+      });
+      expect(Object.keys(result.exifTags!)).toEqual([String(0x0110)]);
+      expect(Object.keys(await lr.getExifTags())).toEqual([String(0x010f)]);
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      expect((await lr.getExifTags())[0x010f]).toMatch(/^NIKON/);
+    });
+
+    test('rejects malformed tags', async () => {
+      await expect(lr.setExifTags(['lens:1' as ExifTag])).rejects.toThrow(
+        'EXIF tags must be tag numbers'
+      );
+    });
+  });
+
+  describe('extract', () => {
+    test('returns metadata, thumbnail, xmp and hash in one call', async () => {
+      const result = await lr.extract(RAW_SONY_FILE_PATH, {
+        metadata: true,
+        thumbnail: true,
+        xmp: true,
+        hash: true,
+      });
+      const metadata = decodeLibRawMetadata(result.metadata);
+      expect(metadata.idata.model).toBe('ILCA-77M2');
+      expect(result.thumbnail?.equals(fs.readFileSync(TEST_THUMBNAIL_JPG))).toBe(
+        true
+      );
+      expect(result.hash).toMatch(/^[0-9a-f]{16}$/);
+    });
+
+    test('hash is stable across calls', async () => {
+      const first = await lr.extract(RAW_NIKON_FILE_PATH, { hash: true });
+      const second = await lr.extract(RAW_NIKON_FILE_PATH, { hash: true });
+      expect(first.hash).toEqual(second.hash);
+    });
+
+    test('returns xmp packet', async () => {
+      const result = await lr.extract(RAW_NIKON_FILE_PATH, {
+        metadata: false,
+        xmp: true,
+      });
+      expect(result.metadata).toBeUndefined();
+      expect(result.xmp?.toString('utf8')).toEqual(
+        (await lr.getXmp()).toString('utf8')
+      );
+    });
+
+    test('rejects for nonexistent file', async () => {
+      await expect(lr.extract('some nonexistent path')).rejects.toThrow();
+    });
+  });
+
+  describe('ingest', () => {
+    test('yields one result per path and isolates failures', async () => {
+      const paths = [
+        RAW_SONY_FILE_PATH,
+        'some nonexistent path',
+        RAW_NIKON_FILE_PATH,
+      ];
+      const results = [];
+      for await (const item of LibRaw.ingest(paths, {
+        concurrency: 2,
+        ordered: true,
+      })) {
+        results.push(item);
+      }
+      expect(results.map((item) => item.input)).toEqual(paths);
+      expect(results[1].error).toBeInstanceOf(Error);
+      expect(decodeLibRawMetadata(results[0].result?.metadata).idata.model).toBe(
+        'ILCA-77M2'
+      );
+      expect(decodeLibRawMetadata(results[2].result?.metadata).idata.model).toBe(
+        'Z 6'
+      );
+    });
+
+    test('pulls paths lazily', async () => {
+      let pulled = 0;
+      function* paths() {
+        for (;;) {
+          pulled++;
+          yield RAW_NIKON_FILE_PATH;
+        }
+      }
+      for await (const item of LibRaw.ingest(paths(), { concurrency: 2 })) {
+        expect(item.error).toBeUndefined();
+        break;
+      }
+      expect(pulled).toBeLessThanOrEqual(3);
+    });
+
+    test('rejects invalid concurrency', async () => {
+      await expect(
+        LibRaw.ingest([], { concurrency: 0 }).next()
+      ).rejects.toThrow('concurrency must be a positive integer');
+    });
+
+    test('ingestStream transforms paths into results', async () => {
+      const stream = LibRaw.ingestStream({ extract: { hash: true } });
+      stream.end(RAW_NIKON_FILE_PATH);
+      const results = [];
+      for await (const item of stream) {
+        results.push(item);
+      }
+      expect(results).toHaveLength(1);
+      expect(results[0].result.hash).toMatch(/^[0-9a-f]{16}$/);
+    });
+
+    test('reads files ahead with prefetchBytes', async () => {
+      const paths = [
+        RAW_SONY_FILE_PATH,
+        RAW_NIKON_FILE_PATH,
+        RAW_SONY_FILE_PATH,
+        RAW_NIKON_FILE_PATH,
+      ];
+      const options = { concurrency: 1, ordered: true, extract: { hash: true } };
+      const hashes = async (prefetchBytes: number) => {
+        const results = [];
+        for await (const item of LibRaw.ingest(paths, {
+          ...options,
+          prefetchBytes,
+        })) {
+          results.push(item.result?.hash);
+        }
+        return results;
+      };
+      const before = LibRaw.prefetchStats();
+      const prefetched = await hashes(256 * 1024 * 1024);
+      expect(prefetched).toEqual(await hashes(0));
+      const stats = LibRaw.prefetchStats();
+      expect(stats.hits + stats.misses - before.hits - before.misses).toBe(
+        paths.length
+      );
+      expect(stats.hits).toBeGreaterThan(before.hits);
+      expect(stats.queued).toBe(0);
+      expect(stats.bytes).toBe(0);
+      expect(stats.held + stats.pooled).toBeLessThanOrEqual(stats.maxBytes);
+    });
+
+    test('cancels read-ahead of paths never extracted', async () => {
+      function* paths() {
+        for (;;) {
+          yield RAW_NIKON_FILE_PATH;
+        }
+      }
+      for await (const item of LibRaw.ingest(paths(), {
+        concurrency: 1,
+        prefetchBytes: 64 * 1024 * 1024,
+      })) {
+        expect(item.error).toBeUndefined();
+        break;
+      }
+      // a read in progress is dropped once it completes
+      await new Promise((resolve) => setTimeout(resolve, 200));
+      const stats = LibRaw.prefetchStats();
+      expect(stats.queued).toBe(0);
+      expect(stats.ready).toBe(0);
+      expect(stats.bytes).toBe(0);
+    });
+
+    test('rejects invalid prefetchBytes', async () => {
+      await expect(
+        LibRaw.ingest([], { prefetchBytes: -1 }).next()
+      ).rejects.toThrow('prefetchBytes must be a non-negative number');
+    });
+  });
+
   describe('errorCount', () => {
     test('returns 0 with no errors', async () => {
       await lr.openFile(RAW_SONY_FILE_PATH);
@@ -292,6 +610,64 @@ describe('LibRaw', () => {
       const buffer = fs.readFileSync(RAW_SONY_FILE_PATH);
       expect(await lr.openBuffer(buffer)).toEqual(0);
     });
+
+    test('openBuffer reads from a SharedArrayBuffer at an offset', async () => {
+      const file = fs.readFileSync(RAW_SONY_FILE_PATH);
+      const shared = new SharedArrayBuffer(file.length + 16);
+      new Uint8Array(shared, 16).set(file);
+      expect(await lr.openBuffer(shared, 16, file.length)).toEqual(0);
+      const metadata = decodeLibRawMetadata(await lr.getMetadata());
+      expect(metadata.idata.model).toBe('ILCA-77M2');
+    });
+
+    test('openBuffer accepts a typed array view', async () => {
+      const file = fs.readFileSync(RAW_SONY_FILE_PATH);
+      const view = new Uint8Array(file.buffer, file.byteOffset, file.length);
+      expect(await lr.openBuffer(view)).toEqual(0);
+    });
+  });
+
+  describe('openFd', () => {
+    test('opens from a file descriptor', async () => {
+      const handle = await fs.promises.open(RAW_NIKON_FILE_PATH, 'r');
+      try {
+        expect(await lr.openFd(handle.fd)).toEqual(0);
+      } finally {
+        await handle.close();
+      }
+      expect(await lr.unpack()).toBe(0);
+      const metadata = decodeLibRawMetadata(await lr.getMetadata());
+      expect(metadata.idata.model).toBe('Z 6');
+    });
+
+    test('returns error code for invalid descriptor', async () => {
+      expect(await lr.openFd(-1)).not.toEqual(0);
+    });
+  });
+
+  describe('generated DNG', () => {
+    test('opens and unpacks a file of the synthetic corpus', async () => {
+      const file = generateDng('open.dng', ['--seed', '7']);
+      expect(await lr.openFile(file)).toEqual(0);
+      const [plane] = await lr.unpackAll();
+      expect(plane).toMatchObject({ width: 256, height: 128, colors: 1 });
+      const fields = await lr.getMetadataFields([
+        'idata.dng_version',
+        'idata.filters',
+        'rawdata.color.maximum',
+      ]);
+      expect(fields['idata.dng_version']).toBeGreaterThan(0);
+      expect(fields['idata.filters']).not.toBe(0);
+      expect(fields['rawdata.color.maximum']).toBe(4095);
+    });
+
+    test('the same options give the same file', async () => {
+      const hash = async (file: string) =>
+        (await lr.extract(file, { metadata: false, hash: true })).hash;
+      const first = await hash(generateDng('a.dng', ['--seed', '7']));
+      expect(await hash(generateDng('b.dng', ['--seed', '7']))).toBe(first);
+      expect(await hash(generateDng('c.dng', ['--seed', '8']))).not.toBe(first);
+    });
   });
 
   describe('unpack', () => {
@@ -305,6 +681,553 @@ describe('LibRaw', () => {
     });
   });
 
+  describe('renderRegion', () => {
+    test('renders a crop as RGB', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const image = await lr.renderRegion({ x: 100, y: 50, w: 64, h: 32 });
+      expect(image).toMatchObject({ width: 64, height: 32, colors: 3, bits: 8 });
+      expect(image.data.length).toBe(64 * 32 * 3);
+    });
+
+    test('renders 16 bit samples', async () => {
+      await lr.openFile(RAW_SONY_FILE_PATH);
+      await lr.unpack();
+      const image = await lr.renderRegion(
+        { x: 0, y: 0, w: 16, h: 16 },
+        { bits: 16 }
+      );
+      expect(image.data.length).toBe(16 * 16 * 3 * 2);
+    });
+
+    test('crops match the same pixels of a larger render', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const large = await lr.renderRegion({ x: 0, y: 0, w: 64, h: 64 });
+      const small = await lr.renderRegion({ x: 16, y: 16, w: 8, h: 8 });
+      for (let row = 0; row < 8; row++) {
+        const start = ((16 + row) * 64 + 16) * 3;
+        expect(
+          small.data
+            .subarray(row * 24, row * 24 + 24)
+            .equals(large.data.subarray(start, start + 24))
+        ).toBe(true);
+      }
+    });
+
+    test('rejects regions outside the image', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      await expect(
+        lr.renderRegion({ x: -1, y: 0, w: 10, h: 10 })
+      ).rejects.toThrow('renderRegion received a region outside of the');
+    });
+  });
+
+  describe('renderEncoded', () => {
+    const region = { x: 100, y: 50, w: 64, h: 32 };
+
+    test('encodes a region as JPEG with an ICC profile', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const jpeg = await lr.renderEncoded({
+        region,
+        encode: { format: 'jpeg', quality: 80 },
+      });
+      expect(jpeg.subarray(0, 2)).toEqual(Buffer.from([0xff, 0xd8]));
+      expect(jpeg.includes('ICC_PROFILE\0')).toBe(true);
+      const bare = await lr.renderEncoded({
+        region,
+        encode: { format: 'jpeg', icc: false },
+      });
+      expect(bare.includes('ICC_PROFILE\0')).toBe(false);
+    });
+
+    test('writes the rendered samples into a 16 bit TIFF', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const tiff = await lr.renderEncoded({
+        region,
+        encode: { format: 'tiff', icc: false },
+      });
+      const pixels = await lr.renderRegion(region, { bits: 16 });
+      expect(['II', 'MM']).toContain(tiff.toString('latin1', 0, 2));
+      expect(
+        tiff.subarray(tiff.length - pixels.data.length).equals(pixels.data)
+      ).toBe(true);
+    });
+
+    test('validates its options', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      await expect(
+        lr.renderEncoded({ encode: { format: 'png' as never } })
+      ).rejects.toThrow("format must be 'jpeg' or 'tiff'");
+      await expect(
+        lr.renderEncoded({ bits: 16, encode: { format: 'jpeg' } })
+      ).rejects.toThrow('JPEG output must use 8 bits');
+    });
+  });
+
+  describe('renderTensor', () => {
+    test('fills a normalized CHW tensor', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const out = new Float32Array(3 * 224 * 224);
+      expect(await lr.renderTensor(out, { width: 224, height: 224 })).toBe(out);
+      expect(out.every((v) => v >= 0 && v <= 1)).toBe(true);
+      expect(out.some((v) => v > 0)).toBe(true);
+    });
+
+    test('HWC is the transposed CHW layout', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const options = { width: 32, height: 24, linear: true };
+      const chw = await lr.renderTensor(new Float32Array(3 * 32 * 24), options);
+      const hwc = await lr.renderTensor(new Float32Array(3 * 32 * 24), {
+        ...options,
+        layout: 'hwc',
+      });
+      const pixels = 32 * 24;
+      for (const i of [0, 100, pixels - 1]) {
+        for (let c = 0; c < 3; c++) {
+          expect(hwc[i * 3 + c]).toBeCloseTo(chw[c * pixels + i]);
+        }
+      }
+    });
+
+    test('applies mean and std', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const options = { width: 8, height: 8 };
+      const plain = await lr.renderTensor(new Float32Array(192), options);
+      const normalized = await lr.renderTensor(new Float32Array(192), {
+        ...options,
+        mean: [0.5, 0.5, 0.5],
+        std: [0.25, 0.25, 0.25],
+      });
+      expect(normalized[0]).toBeCloseTo((plain[0] - 0.5) / 0.25);
+    });
+
+    test('rejects a tensor of the wrong size', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      await expect(
+        lr.renderTensor(new Float32Array(10), { width: 8, height: 8 })
+      ).rejects.toThrow('out must hold width * height * 3 elements');
+    });
+  });
+
+  describe('renderBands', () => {
+    test('covers the image in bands matching renderRegion', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const { sizes } = await lr.getMetadata();
+      const { width, height } = sizes as { width: number; height: number };
+      let rows = 0;
+      for await (const band of lr.renderBands({ bandHeight: 512 })) {
+        expect(band.y).toBe(rows);
+        expect(band.width).toBe(width);
+        expect(band.imageHeight).toBe(height);
+        expect(band.data.length).toBe(band.width * band.height * 3);
+        if (rows === 512) {
+          const region = await lr.renderRegion({ x: 0, y: 512, w: width, h: 4 });
+          expect(band.data.subarray(0, region.data.length).equals(region.data)).toBe(
+            true
+          );
+        }
+        rows += band.height;
+      }
+      expect(rows).toBe(height);
+    });
+
+    test('renderStream produces the whole image', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const { sizes } = await lr.getMetadata();
+      const { width, height } = sizes as { width: number; height: number };
+      let bytes = 0;
+      for await (const chunk of lr.renderStream({ bandHeight: 1024 })) {
+        bytes += chunk.length;
+      }
+      expect(bytes).toBe(width * height * 3);
+    });
+  });
+
+  describe('unpackAll', () => {
+    test('returns the raw plane of every shot', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const count = await lr.shotCount();
+      const { sizes } = await lr.getMetadata();
+      const { width, height } = sizes as { width: number; height: number };
+      const frames = await lr.unpackAll();
+      expect(frames.map((frame) => frame.shot)).toEqual(
+        [...Array(count).keys()]
+      );
+      expect(frames[0]).toMatchObject({ width, height, colors: 1, bits: 16 });
+      expect(frames[0].data.length).toBe(width * height * 2);
+    });
+
+    test('returns previews', async () => {
+      const buffer = fs.readFileSync(RAW_SONY_FILE_PATH);
+      await lr.openBuffer(buffer);
+      const [frame] = await lr.unpackAll({
+        output: 'preview',
+        previewSize: 256,
+      });
+      expect(Math.max(frame.width, frame.height)).toBeLessThanOrEqual(256);
+      expect(frame.data.length).toBe(frame.width * frame.height * 3);
+    });
+
+    test('forEachShot visits every shot', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const shots: number[] = [];
+      await lr.forEachShot((frame) => {
+        shots.push(frame.shot);
+      });
+      expect(shots).toHaveLength(await lr.shotCount());
+    });
+
+    test('rejects without an open image', async () => {
+      await expect(lr.unpackAll()).rejects.toThrow(
+        'unpackAll requires an open image.'
+      );
+    });
+  });
+
+  describe('stack', () => {
+    const frames = new Array<string>(3).fill(RAW_NIKON_FILE_PATH);
+
+    test('every method reproduces identical frames', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const [plane] = await lr.unpackAll();
+      for (const method of ['mean', 'sigmaClip', 'median'] as const) {
+        const stacked = await LibRaw.stack(frames, { method, tileRows: 50 });
+        expect(stacked).toMatchObject({
+          width: plane.width,
+          height: plane.height,
+          colors: 1,
+          bits: 16,
+          frames: 3,
+        });
+        expect(stacked.data.equals(plane.data)).toBe(true);
+      }
+    });
+
+    // generated frames differ in noise, `hot` ones have a white pixel at 40,20
+    const HOT = 20 * 256 + 40;
+    const generateLights = (count: number, hot: number[] = []) =>
+      Array.from({ length: count }, (_, i) =>
+        hot.includes(i)
+          ? generateDng(`light-${i + 1}-hot.dng`, [
+              '--seed',
+              String(i + 1),
+              '--hot',
+              '40,20',
+            ])
+          : generateDng(`light-${i + 1}.dng`, ['--seed', String(i + 1)])
+      );
+    const toSamples = (data: Buffer) =>
+      Array.from({ length: data.length / 2 }, (_, i) =>
+        data.readUInt16LE(i * 2)
+      );
+
+    async function readPlanes(files: string[]) {
+      const planes: number[][] = [];
+      for (const file of files) {
+        await lr.openFile(file);
+        const [plane] = await lr.unpackAll();
+        planes.push(toSamples(plane.data));
+      }
+      return planes;
+    }
+
+    // the CFA color and black level of every pixel, as the stacker sees them
+    async function readLevels(file: string) {
+      await lr.openFile(file);
+      const [plane] = await lr.unpackAll();
+      const fields = await lr.getMetadataFields([
+        'idata.filters',
+        'rawdata.color.black',
+        'rawdata.color.cblack',
+        'rawdata.color.maximum',
+      ]);
+      const filters = fields['idata.filters'] as number;
+      const black = fields['rawdata.color.black'] as number;
+      const cblack = fields['rawdata.color.cblack'] as number[];
+      const colors: number[] = [];
+      const blacks: number[] = [];
+      for (let row = 0; row < plane.height; row++) {
+        for (let col = 0; col < plane.width; col++) {
+          const shift = (((row << 1) & 14) | (col & 1)) << 1;
+          const color = (filters >>> shift) & 3;
+          const pattern =
+            cblack[4] && cblack[5]
+              ? cblack[6 + (row % cblack[4]) * cblack[5] + (col % cblack[5])]
+              : 0;
+          colors.push(color);
+          blacks.push(black + cblack[color] + pattern);
+        }
+      }
+      return {
+        colors,
+        blacks,
+        maximum: fields['rawdata.color.maximum'] as number,
+      };
+    }
+
+    test('combines differing frames by each method', async () => {
+      const lights = generateLights(5, [2]);
+      const planes = await readPlanes(lights);
+      const stacked: Record<string, number[]> = {};
+      for (const method of ['mean', 'sigmaClip', 'median'] as const) {
+        const result = await LibRaw.stack(lights, {
+          method,
+          sigma: 1.5,
+          tileRows: 50,
+        });
+        expect(result.frames).toBe(5);
+        stacked[method] = toSamples(result.data);
+      }
+      const columns = planes[0].map((_, i) =>
+        planes.map((plane) => plane[i]).sort((a, b) => a - b)
+      );
+      expect(stacked.mean).toEqual(
+        columns.map((column) => Math.round(column.reduce((a, b) => a + b) / 5))
+      );
+      expect(stacked.median).toEqual(columns.map((column) => column[2]));
+      expect(
+        columns.filter(
+          (column, i) =>
+            stacked.sigmaClip[i] < column[0] || stacked.sigmaClip[i] > column[4]
+        )
+      ).toEqual([]);
+
+      // the hot pixel pulls up the mean, sigma clipping rejects it
+      const others = planes
+        .filter((_, f) => f !== 2)
+        .map((plane) => plane[HOT]);
+      expect(planes[2][HOT]).toBe(4095);
+      expect(stacked.mean[HOT]).toBeGreaterThan(Math.max(...others) + 500);
+      expect(stacked.sigmaClip[HOT]).toBeGreaterThanOrEqual(
+        Math.min(...others)
+      );
+      expect(stacked.sigmaClip[HOT]).toBeLessThanOrEqual(Math.max(...others));
+    });
+
+    test('subtracts the dark and divides by the normalized flat', async () => {
+      // the hot pixel is a sensor defect, in the lights and the dark
+      const lights = generateLights(3, [0, 1, 2]);
+      const dark = generateDng('dark.dng', [
+        '--scene',
+        'dark',
+        '--hot',
+        '40,20',
+      ]);
+      const flat = generateDng('flat.dng', ['--scene', 'flat', '--seed', '9']);
+      const { colors, blacks, maximum } = await readLevels(dark);
+      const [darkPlane, flatPlane] = await readPlanes([dark, flat]);
+      const stack = async (options: { dark?: string; flat?: string }) =>
+        toSamples(
+          (await LibRaw.stack(lights, { method: 'median', ...options })).data
+        );
+      const combined = await stack({});
+      const darkened = await stack({ dark });
+      const calibrated = await stack({ dark, flat });
+
+      const subtracted = combined.map((v, i) => v - (darkPlane[i] - blacks[i]));
+      expect(darkened).toEqual(subtracted.map((v) => Math.max(v, 0)));
+      expect(darkened[HOT]).toBe(blacks[HOT]);
+
+      const sums = [0, 0, 0, 0];
+      const counts = [0, 0, 0, 0];
+      flatPlane.forEach((v, i) => {
+        sums[colors[i]] += v - blacks[i];
+        counts[colors[i]]++;
+      });
+      const flatMean = sums.map((sum, c) => (counts[c] ? sum / counts[c] : 0));
+      // the stacker works in single precision, so allow one level
+      const deviation = subtracted.reduce((worst, v, i) => {
+        const level = flatPlane[i] - blacks[i];
+        const corrected =
+          level > 0
+            ? ((v - blacks[i]) * flatMean[colors[i]]) / level + blacks[i]
+            : v;
+        const expected = Math.round(Math.min(Math.max(corrected, 0), maximum));
+        return Math.max(worst, Math.abs(calibrated[i] - expected));
+      }, 0);
+      expect(deviation).toBeLessThanOrEqual(1);
+    });
+
+    test('takes the median of more frames than the network sorts', async () => {
+      const lights = generateLights(34, [5]);
+      const planes = await readPlanes(lights);
+      for (const count of [33, 34]) {
+        const result = await LibRaw.stack(lights.slice(0, count), {
+          method: 'median',
+        });
+        expect(result.frames).toBe(count);
+        const middle = count >> 1;
+        const expected = planes[0].map((_, i) => {
+          const column = planes
+            .slice(0, count)
+            .map((plane) => plane[i])
+            .sort((a, b) => a - b);
+          return count % 2
+            ? column[middle]
+            : Math.floor((column[middle - 1] + column[middle]) / 2 + 0.5);
+        });
+        expect(toSamples(result.data)).toEqual(expected);
+      }
+    }, 30000);
+
+    test('writes a DNG that opens as a raw image', async () => {
+      const stacked = await LibRaw.stack(frames);
+      const dng = await LibRaw.stack(frames, { output: 'dng' });
+      await lr.openBuffer(dng);
+      const [plane] = await lr.unpackAll();
+      expect(plane.width).toBe(stacked.width);
+      expect(plane.data.equals(stacked.data)).toBe(true);
+    });
+
+    test('rejects frames of different cameras', async () => {
+      await expect(
+        LibRaw.stack([RAW_NIKON_FILE_PATH, RAW_SONY_FILE_PATH])
+      ).rejects.toThrow('its size or CFA pattern differs');
+      await expect(
+        LibRaw.stack(frames, { method: 'mode' as never })
+      ).rejects.toThrow("method must be 'mean', 'sigmaClip' or 'median'");
+      await expect(
+        LibRaw.stack(frames, { priority: 'urgent' as never })
+      ).rejects.toThrow('priority must be interactive, normal or background');
+    });
+  });
+
+  describe('exportRaw', () => {
+    test('round trips the raw frame', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const [plane] = await lr.unpackAll();
+      for (const compression of ['lossless', 'none'] as const) {
+        const frame = await LibRaw.decodeRaw(
+          await lr.exportRaw({ compression, tileRows: 100 })
+        );
+        expect(frame).toMatchObject({
+          visibleWidth: plane.width,
+          visibleHeight: plane.height,
+        });
+        const visible = new Uint16Array(plane.width * plane.height);
+        for (let y = 0; y < plane.height; y++) {
+          const start = (y + frame.topMargin) * frame.width + frame.leftMargin;
+          visible.set(
+            frame.data.subarray(start, start + plane.width),
+            y * plane.width
+          );
+        }
+        expect(Buffer.from(visible.buffer).equals(plane.data)).toBe(true);
+      }
+    });
+
+    test('packs and compresses the samples', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const packed = await lr.exportRaw({ compression: 'none' });
+      const compressed = await lr.exportRaw();
+      const { width, height, bits } = await LibRaw.decodeRaw(packed);
+      expect(bits).toBeLessThan(16);
+      expect(packed.length).toBeLessThan(width * height * 2);
+      expect(compressed.length).toBeLessThan(packed.length);
+    });
+
+    test('rejects corrupt archives', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const archive = await lr.exportRaw();
+      await expect(
+        LibRaw.decodeRaw(archive.subarray(0, archive.length - 1))
+      ).rejects.toThrow('the archive is truncated');
+      archive[archive.length - 100] ^= 0xff;
+      await expect(LibRaw.decodeRaw(archive)).rejects.toThrow('is corrupt');
+      // a header claiming a larger frame than its tiles hold
+      const forged = await lr.exportRaw({ tileRows: 65535 });
+      forged.writeUInt32LE(65535, 8);
+      forged.writeUInt32LE(65535, 12);
+      await expect(LibRaw.decodeRaw(forged)).rejects.toThrow(
+        'tile 0 is corrupt'
+      );
+      await expect(
+        lr.exportRaw({ compression: 'zip' as never })
+      ).rejects.toThrow("compression must be 'lossless' or 'none'");
+    });
+  });
+
+  describe('perceptualHash', () => {
+    test('matches the hashes returned by extract', async () => {
+      const extracted = await lr.extract(RAW_NIKON_FILE_PATH, {
+        metadata: false,
+        perceptualHash: true,
+      });
+      expect(typeof extracted.dhash).toBe('bigint');
+      expect(typeof extracted.phash).toBe('bigint');
+      expect(await lr.perceptualHash()).toEqual({
+        dhash: extracted.dhash,
+        phash: extracted.phash,
+      });
+    });
+
+    test('omits the hashes unless requested', async () => {
+      const result = await lr.extract(RAW_NIKON_FILE_PATH);
+      expect(result.dhash).toBeUndefined();
+      expect(result.phash).toBeUndefined();
+    });
+  });
+
+  describe('preview', () => {
+    let directory: string;
+
+    beforeEach(() => {
+      directory = fs.mkdtempSync(path.join(os.tmpdir(), 'libraw-'));
+    });
+
+    afterEach(() => {
+      LibRaw.configureRenderCache({ directory: '', maxBytes: 0 });
+      fs.rmSync(directory, { recursive: true, force: true });
+    });
+
+    test('resizes the embedded thumbnail', async () => {
+      const image = await lr.preview(RAW_NIKON_FILE_PATH, { size: 256 });
+      expect(Math.max(image.width, image.height)).toBe(256);
+      expect(image.colors).toBe(3);
+      expect(image.bits).toBe(8);
+      expect(image.data).toHaveLength(image.width * image.height * 3);
+    });
+
+    test('develops the raw data', async () => {
+      const image = await lr.preview(RAW_SONY_FILE_PATH, {
+        source: 'raw',
+        size: 128,
+      });
+      expect(Math.max(image.width, image.height)).toBe(128);
+      expect(image.data).toHaveLength(image.width * image.height * 3);
+    });
+
+    test('serves repeated previews from the render cache', async () => {
+      LibRaw.configureRenderCache({ directory, maxBytes: 64 * 1024 * 1024 });
+      const rendered = await lr.preview(RAW_NIKON_FILE_PATH, { size: 200 });
+      expect(LibRaw.renderCacheStats()).toMatchObject({ hits: 0, misses: 1 });
+
+      // as after a restart
+      LibRaw.configureRenderCache({ directory, maxBytes: 64 * 1024 * 1024 });
+      expect(LibRaw.renderCacheStats().entries).toBeGreaterThan(0);
+      const cached = await new LibRaw().preview(RAW_NIKON_FILE_PATH, {
+        size: 200,
+      });
+      expect(LibRaw.renderCacheStats().hits).toBe(1);
+      expect(cached.width).toBe(rendered.width);
+      expect(cached.height).toBe(rendered.height);
+      expect(cached.data).toEqual(rendered.data);
+    });
+
+    test('keeps the cache within its budget', async () => {
+      LibRaw.configureRenderCache({ directory, maxBytes: 100 * 1024 });
+      for (const size of [100, 120, 140, 160, 180]) {
+        await lr.preview(RAW_NIKON_FILE_PATH, { size });
+      }
+      expect(LibRaw.renderCacheStats().bytes).toBeLessThanOrEqual(100 * 1024);
+    });
+
+    test('rejects an unknown source', async () => {
+      await expect(
+        lr.preview(RAW_NIKON_FILE_PATH, { source: 'jpeg' as never })
+      ).rejects.toThrow("source must be 'embedded' or 'raw'");
+    });
+  });
+
   describe('unpackThumb', () => {
     test('unpacks thumbnail without error', async () => {
       expect(await lr.openFile(RAW_NIKON_FILE_PATH)).toBe(0);
@@ -342,6 +1265,335 @@ describe('LibRaw', () => {
     test('gives a list of supported cameras', async () => {
       expect(JSON.stringify(await lr.cameraList(), null, 2)).toMatchSnapshot();
     });
+
+    test('returns an array the caller may modify', async () => {
+      const list = await lr.cameraList();
+      const count = list.length;
+      list.push('Example Camera');
+      const again = await new LibRaw().cameraList();
+      expect(again).not.toBe(list);
+      expect(again).toHaveLength(count);
+    });
+  });
+
+  describe('isSupported', () => {
+    test('matches normalized make and model', () => {
+      expect(LibRaw.isSupported('Nikon', 'Z 6')).toBe(true);
+      expect(LibRaw.isSupported('Sony', 'ILCA-77M2')).toBe(true);
+    });
+
+    test('ignores case, whitespace and a repeated make', () => {
+      expect(LibRaw.isSupported('NIKON', '  nikon  z 6 ')).toBe(true);
+    });
+
+    test('matches EXIF maker strings and alternative names', () => {
+      expect(LibRaw.isSupported('NIKON CORPORATION', 'NIKON Z 6')).toBe(true);
+      expect(LibRaw.isSupported('Sony', 'A77-II')).toBe(true);
+      expect(LibRaw.isSupported('Canon', 'IXUS 40')).toBe(true);
+    });
+
+    test('rejects unknown cameras', () => {
+      expect(LibRaw.isSupported('Nikon', 'Z 600')).toBe(false);
+      expect(LibRaw.isSupported('', '')).toBe(false);
+    });
+  });
+
+  describe('hammingSearch', () => {
+    test('finds hashes within the distance', () => {
+      const query = BigInt('0x0123456789abcdef');
+      const hashes = new BigUint64Array(1000).fill(
+        BigInt.asUintN(64, ~query)
+      );
+      hashes[10] = query;
+      hashes[500] = query ^ BigInt(0b101);
+      hashes[999] = query ^ BigInt(0b111);
+      expect(Array.from(LibRaw.hammingSearch(hashes, query, 2))).toEqual([
+        10, 500,
+      ]);
+      expect(LibRaw.hammingSearch(hashes, query, 64)).toHaveLength(1000);
+    });
+
+    test('validates its arguments', () => {
+      expect(() =>
+        LibRaw.hammingSearch(new Uint32Array(4) as never, BigInt(0), 1)
+      ).toThrow('hashes must be a BigUint64Array');
+    });
+  });
+
+  describe('scheduler', () => {
+    afterEach(() => {
+      LibRaw.configureScheduler({
+        limits: { interactive: 0, normal: 0, background: 0 },
+        threadsPerCall: 0,
+      });
+    });
+
+    test('reports stats per priority class', () => {
+      const stats = LibRaw.schedulerStats(true);
+      expect(Object.keys(stats).sort()).toEqual([
+        'background',
+        'interactive',
+        'normal',
+      ]);
+      expect(stats.normal).toEqual({
+        queued: expect.any(Number),
+        running: expect.any(Number),
+        limit: 0,
+        started: expect.any(Number),
+        helpers: expect.any(Number),
+        meanWaitMs: expect.any(Number),
+        maxWaitMs: expect.any(Number),
+      });
+    });
+
+    test('validates its options', () => {
+      expect(() =>
+        LibRaw.configureScheduler({ limits: { urgent: 1 } as never })
+      ).toThrow('limits must map interactive, normal or background');
+      expect(() =>
+        LibRaw.configureScheduler({ affinity: [-1] })
+      ).toThrow('affinity must be an array of CPU numbers');
+      expect(() => LibRaw.configureScheduler({ threadsPerCall: -1 })).toThrow(
+        'threadsPerCall must be a non-negative number'
+      );
+      expect(() => LibRaw.configureScheduler({ threadsPerCall: NaN })).toThrow(
+        'threadsPerCall must be a non-negative number'
+      );
+      expect(() =>
+        LibRaw.configureScheduler({ limits: { background: NaN } })
+      ).toThrow('limits must map interactive, normal or background');
+    });
+
+    test('applies nothing when an option is invalid', () => {
+      expect(() =>
+        LibRaw.configureScheduler({
+          limits: { background: 3 },
+          affinity: [-1],
+        })
+      ).toThrow('affinity must be an array of CPU numbers');
+      expect(LibRaw.schedulerStats().background.limit).toBe(0);
+    });
+
+    test('renders the same pixels with any thread budget', async () => {
+      await lr.openFile(RAW_NIKON_FILE_PATH);
+      const region = { x: 0, y: 0, w: 256, h: 256 };
+      LibRaw.configureScheduler({ threadsPerCall: 1 });
+      LibRaw.schedulerStats(true);
+      const serial = await lr.renderRegion(region);
+      expect(LibRaw.schedulerStats().normal.helpers).toBe(0);
+      LibRaw.configureScheduler({ threadsPerCall: 0 });
+      const parallel = await lr.renderRegion(region);
+      expect(parallel.data.equals(serial.data)).toBe(true);
+    });
+
+    test('starts interactive calls ahead of queued background work', async () => {
+      LibRaw.configureScheduler({ limits: { background: 1 } });
+      LibRaw.schedulerStats(true);
+      const order: string[] = [];
+      const background = Array.from({ length: 4 }, (_, i) =>
+        new LibRaw()
+          .extract(RAW_NIKON_FILE_PATH, {
+            thumbnail: true,
+            priority: 'background',
+          })
+          .then(() => order.push(`background${i}`))
+      );
+      const interactive = new LibRaw()
+        .extract(RAW_SONY_FILE_PATH, { priority: 'interactive' })
+        .then(() => order.push('interactive'));
+      await Promise.all([...background, interactive]);
+      expect(order.indexOf('interactive')).toBeLessThan(
+        order.indexOf('background3')
+      );
+      const stats = LibRaw.schedulerStats();
+      expect(stats.background.started).toBe(4);
+      expect(stats.interactive.started).toBe(1);
+    });
+
+    test('rejects an unknown priority', async () => {
+      await expect(
+        lr.openFile(RAW_SONY_FILE_PATH, undefined, {
+          priority: 'urgent' as never,
+        })
+      ).rejects.toThrow('priority must be interactive, normal or background');
+    });
+  });
+
+  describe('tracing', () => {
+    test('exports the phases of a call as Chrome trace events', async () => {
+      const libraw = new LibRaw();
+      LibRaw.startTrace();
+      await libraw.extract(RAW_NIKON_FILE_PATH, { thumbnail: true });
+      const trace = JSON.parse(LibRaw.stopTrace());
+      await libraw.recycle();
+
+      const names = trace.traceEvents.map(
+        (event: { name: string }) => event.name
+      );
+      expect(names).toEqual(
+        expect.arrayContaining(['queue', 'extract', 'open', 'parse', 'wrap'])
+      );
+      const call = trace.traceEvents.find(
+        (event: { name: string }) => event.name === 'extract'
+      );
+      expect(call.ph).toBe('X');
+      expect(call.args).toEqual({
+        file: RAW_NIKON_FILE_PATH,
+        model: 'Nikon Z 6',
+      });
+    });
+
+    test('records nothing while stopped', async () => {
+      LibRaw.startTrace();
+      LibRaw.stopTrace();
+      const libraw = new LibRaw();
+      await libraw.extract(RAW_NIKON_FILE_PATH);
+      await libraw.recycle();
+      LibRaw.startTrace({ eventsPerThread: 16 });
+      const trace = JSON.parse(LibRaw.stopTrace());
+      expect(
+        trace.traceEvents.filter((event: { ph: string }) => event.ph !== 'M')
+      ).toEqual([]);
+    });
+  });
+
+  describe('decode workers', () => {
+    let workers: DecodeWorkers;
+
+    beforeEach(() => {
+      workers = new DecodeWorkers({ workers: 2 });
+    });
+
+    afterEach(async () => {
+      await workers.close();
+    });
+
+    test('extracts like the in-process call', async () => {
+      const options = { metadata: true, thumbnail: true, hash: true };
+      const libraw = new LibRaw();
+      const local = await libraw.extract(RAW_NIKON_FILE_PATH, options);
+      const remote = await workers.extract(RAW_NIKON_FILE_PATH, options);
+      expect(remote.hash).toBe(local.hash);
+      expect(decodeLibRawMetadata(remote.metadata).idata.model).toBe('Z 6');
+      expect(Buffer.isBuffer(remote.thumbnail)).toBe(true);
+      expect(remote.thumbnail?.equals(local.thumbnail as Buffer)).toBe(true);
+      expect(workers.stats()).toMatchObject({ shared: 1, copied: 0 });
+      await libraw.recycle();
+    });
+
+    test('rejects a file that cannot be opened and keeps going', async () => {
+      await expect(
+        workers.extract('some nonexistent path', { metadata: true })
+      ).rejects.toThrow();
+      const result = await workers.extract(RAW_SONY_FILE_PATH, { hash: true });
+      expect(result.hash).toMatch(/^[0-9a-f]{16}$/);
+      expect(workers.stats().crashes).toBe(0);
+    });
+
+    test('replaces a worker that times out', async () => {
+      // opening a FIFO without a writer never returns, like a hung decode
+      const dir = fs.mkdtempSync(path.join(os.tmpdir(), 'libraw-hang-'));
+      const fifo = path.join(dir, 'hang.nef');
+      execFileSync('mkfifo', [fifo]);
+      const impatient = new DecodeWorkers({ workers: 1, timeout: 2000 });
+      try {
+        await expect(
+          impatient.extract(fifo, { metadata: true })
+        ).rejects.toThrow('timed out');
+        expect(impatient.stats().timeouts).toBe(1);
+        const result = await impatient.extract(RAW_SONY_FILE_PATH, {
+          hash: true,
+        });
+        expect(result.hash).toMatch(/^[0-9a-f]{16}$/);
+        expect(impatient.stats()).toMatchObject({ workers: 1, timeouts: 1 });
+      } finally {
+        await impatient.close();
+        fs.rmSync(dir, { recursive: true, force: true });
+      }
+    });
+
+    test('serves ingest', async () => {
+      const paths = [RAW_SONY_FILE_PATH, RAW_NIKON_FILE_PATH];
+      const results = [];
+      for await (const item of LibRaw.ingest(paths, {
+        ordered: true,
+        workers,
+        extract: { thumbnail: true },
+      })) {
+        results.push(item);
+      }
+      expect(results.map((item) => item.error)).toEqual([undefined, undefined]);
+      expect(workers.stats().shared).toBe(2);
+    });
+
+    test('rejects calls after close', async () => {
+      await workers.close();
+      await expect(workers.extract(RAW_NIKON_FILE_PATH)).rejects.toThrow(
+        'decode workers are closed'
+      );
+    });
+  });
+
+  describe('hot-file cache', () => {
+    beforeEach(() => {
+      LibRaw.configureCache({ maxBytes: 512 * 1024 * 1024 });
+    });
+
+    afterEach(() => {
+      LibRaw.configureCache({ maxBytes: 0 });
+    });
+
+    test('hands unpacked files to the next instance', async () => {
+      const first = new LibRaw();
+      expect(await first.openFile(RAW_NIKON_FILE_PATH)).toBe(0);
+      expect(await first.unpack()).toBe(0);
+      const crop = await first.renderRegion({ x: 100, y: 50, w: 16, h: 16 });
+      await first.recycle();
+      expect(LibRaw.cacheStats().entries).toBe(1);
+
+      const { hits } = LibRaw.cacheStats();
+      const second = new LibRaw();
+      expect(await second.openFile(RAW_NIKON_FILE_PATH)).toBe(0);
+      expect(LibRaw.cacheStats().hits).toBe(hits + 1);
+      expect(LibRaw.cacheStats().entries).toBe(0);
+      expect(await second.unpack()).toBe(0);
+      expect(
+        (await second.renderRegion({ x: 100, y: 50, w: 16, h: 16 })).data
+      ).toEqual(crop.data);
+      await second.recycle();
+    });
+
+    test('serves extract from the cache', async () => {
+      const first = new LibRaw();
+      const expected = await first.extract(RAW_SONY_FILE_PATH, {
+        thumbnail: true,
+        hash: true,
+      });
+      await first.recycle();
+      const second = new LibRaw();
+      const actual = await second.extract(RAW_SONY_FILE_PATH, {
+        thumbnail: true,
+        hash: true,
+      });
+      expect(actual.hash).toBe(expected.hash);
+      expect(actual.thumbnail).toEqual(expected.thumbnail);
+      expect(actual.metadata).toEqual(expected.metadata);
+      await second.recycle();
+    });
+
+    test('drops entries when disabled', async () => {
+      await lr.openFile(RAW_SONY_FILE_PATH);
+      await lr.recycle();
+      expect(LibRaw.cacheStats().entries).toBe(1);
+      LibRaw.configureCache({ maxBytes: 0 });
+      expect(LibRaw.cacheStats()).toMatchObject({ entries: 0, bytes: 0 });
+    });
+
+    test('validates its options', () => {
+      expect(() => LibRaw.configureCache({ maxBytes: -1 })).toThrow(
+        'maxBytes must be a non-negative number'
+      );
+    });
   });
 
   describe('recycle', () => {
@@ -370,4 +1622,36 @@ describe('LibRaw', () => {
       expect(await lr.versionNumber()).toBeGreaterThanOrEqual(4869);
     });
   });
+
+  describe('worker_threads', () => {
+    test('opens files concurrently from several workers', async () => {
+      const source = `
+        const { parentPort, workerData } = require('worker_threads');
+        const addon = require('node-gyp-build')(workerData.root);
+        const lr = new addon.LibRawWrapper();
+        lr.open_file(workerData.file)
+          .then(() => parentPort.postMessage(lr.getMetadata().idata.model));
+      `;
+      const models = await Promise.all(
+        [1, 2, 3].map(
+          () =>
+            new Promise((resolve, reject) => {
+              const worker = new Worker(source, {
+                eval: true,
+                workerData: {
+                  root: path.join(__dirname, '..'),
+                  file: RAW_NIKON_FILE_PATH,
+                },
+              });
+              worker.once('message', (model) => {
+                resolve(model);
+                worker.terminate();
+              });
+              worker.once('error', reject);
+            })
+        )
+      );
+      expect(models).toEqual(['Z 6', 'Z 6', 'Z 6']);
+    });
+  });
 });